@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <unistd.h>
+
+namespace api {
+
+// Wakes the event loop that polls eventfd fd. Safe from any thread; wakes
+// that arrive before the loop reads the counter coalesce into one.
+inline void wake_eventfd(int fd) {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0) {
+        // The eventfd counter cannot overflow here; nothing else can fail
+    }
+}
+
+} // namespace api
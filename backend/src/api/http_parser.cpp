@@ -0,0 +1,273 @@
+/**
+ * HTTP Request Parser Implementation
+ *
+ * Accepts the request line "METHOD target HTTP/1.x" and "name: value" header
+ * lines terminated by CRLF. Bodies are delimited by Content-Length only:
+ * Transfer-Encoding is rejected rather than guessed at, so a request can
+ * never be framed differently here than by a proxy in front of us.
+ */
+
+#include "http_parser.h"
+#include <cstdint>
+#include <cstring>
+
+namespace api {
+
+namespace {
+    // Character classes, one table lookup per byte
+    enum : uint8_t { TOKEN = 1, FIELD_VALUE = 2 };
+
+    struct CharClasses {
+        uint8_t classes[256] = {};
+
+        CharClasses() {
+            // RFC 9110 token characters (method and header names)
+            for (int c = 'a'; c <= 'z'; ++c) classes[c] |= TOKEN;
+            for (int c = 'A'; c <= 'Z'; ++c) classes[c] |= TOKEN;
+            for (int c = '0'; c <= '9'; ++c) classes[c] |= TOKEN;
+            for (const char* c = "!#$%&'*+-.^_`|~"; *c != '\0'; ++c) classes[static_cast<uint8_t>(*c)] |= TOKEN;
+            // Anything but control characters (tab is allowed)
+            for (int c = 0x20; c < 256; ++c) classes[c] |= FIELD_VALUE;
+            classes[0x7f] &= static_cast<uint8_t>(~FIELD_VALUE);
+            classes['\t'] |= FIELD_VALUE;
+        }
+    };
+
+    const CharClasses CHAR_CLASSES;
+
+    bool all_of_class(std::string_view value, uint8_t char_class) {
+        for (char c : value) {
+            if ((CHAR_CLASSES.classes[static_cast<uint8_t>(c)] & char_class) == 0) return false;
+        }
+        return true;
+    }
+
+    bool is_token(std::string_view value) {
+        return !value.empty() && all_of_class(value, TOKEN);
+    }
+
+    char lower(char c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+
+    bool iequals(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (lower(a[i]) != lower(b[i])) return false;
+        }
+        return true;
+    }
+
+    bool icontains(std::string_view haystack, std::string_view needle) {
+        for (size_t i = 0; i + needle.size() <= haystack.size(); ++i) {
+            if (iequals(haystack.substr(i, needle.size()), needle)) return true;
+        }
+        return false;
+    }
+
+    std::string_view trim(std::string_view value) {
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+        return value;
+    }
+}
+
+std::string_view HttpRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < header_count; ++i) {
+        if (iequals(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return {};
+}
+
+std::string_view HttpRequest::path_param(std::string_view name) const {
+    for (size_t i = 0; i < path_param_count; ++i) {
+        if (path_params[i].name == name) {
+            return path_params[i].value;
+        }
+    }
+    return {};
+}
+
+std::string_view HttpRequest::query_param(std::string_view name, std::string& scratch) const {
+    size_t start = 0;
+    while (start < query.size()) {
+        size_t end = query.find('&', start);
+        if (end == std::string_view::npos) end = query.size();
+        std::string_view pair = query.substr(start, end - start);
+        start = end + 1;
+
+        size_t equals = pair.find('=');
+        if (pair.substr(0, equals) != name) {
+            continue;
+        }
+        std::string_view value = equals == std::string_view::npos ? std::string_view() : pair.substr(equals + 1);
+        if (value.find_first_of("%+") == std::string_view::npos) {
+            return value;
+        }
+        scratch = url_decode(value);
+        return scratch;
+    }
+    return {};
+}
+
+std::string url_decode(std::string_view value) {
+    auto hex = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    std::string result;
+    result.reserve(value.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '+') {
+            result += ' ';
+        } else if (value[i] == '%' && i + 2 < value.size() && hex(value[i + 1]) >= 0 && hex(value[i + 2]) >= 0) {
+            result += static_cast<char>(hex(value[i + 1]) * 16 + hex(value[i + 2]));
+            i += 2;
+        } else {
+            result += value[i];
+        }
+    }
+    return result;
+}
+
+void HttpParser::reset() {
+    scanned_ = 0;
+    head_size_ = 0;
+    content_length_ = 0;
+}
+
+HttpParser::Result HttpParser::parse(std::string_view data, HttpRequest& request) {
+    bool head_parsed = false;
+    if (head_size_ == 0) {
+        // Resume a little before where the last call stopped, in case the
+        // terminator straddles two reads
+        size_t from = scanned_ > 3 ? scanned_ - 3 : 0;
+        const void* end = from < data.size() ? memmem(data.data() + from, data.size() - from, "\r\n\r\n", 4) : nullptr;
+        if (end == nullptr) {
+            scanned_ = data.size();
+            if (data.size() >= max_request_size_) {
+                fail(431, "Request header fields too large");
+                return Result::ERROR;
+            }
+            return Result::INCOMPLETE;
+        }
+        head_size_ = static_cast<size_t>(static_cast<const char*>(end) - data.data()) + 4;
+        if (!parse_head(data.substr(0, head_size_), request)) {
+            reset();
+            return Result::ERROR;
+        }
+        if (head_size_ + content_length_ > max_request_size_) {
+            fail(413, "Request too large");
+            reset();
+            return Result::ERROR;
+        }
+        head_parsed = true;
+    }
+
+    if (data.size() < head_size_ + content_length_) {
+        return Result::INCOMPLETE;
+    }
+    // The headers were found in an earlier call, whose views may point at
+    // where the buffer used to be; the same bytes parse the same way
+    if (!head_parsed) {
+        parse_head(data.substr(0, head_size_), request);
+    }
+    request.body = data.substr(head_size_, content_length_);
+    request_size_ = head_size_ + content_length_;
+    reset();
+    return Result::COMPLETE;
+}
+
+bool HttpParser::parse_head(std::string_view head, HttpRequest& request) {
+    request.header_count = 0;
+    request.path_param_count = 0;
+    request.body = {};
+    content_length_ = 0;
+
+    size_t line_end = head.find("\r\n");
+    std::string_view line = head.substr(0, line_end);
+    size_t method_end = line.find(' ');
+    size_t target_end = method_end == std::string_view::npos ? method_end : line.find(' ', method_end + 1);
+    if (target_end == std::string_view::npos || target_end == method_end + 1) {
+        return fail(400, "Malformed request line");
+    }
+    request.method = line.substr(0, method_end);
+    std::string_view target = line.substr(method_end + 1, target_end - method_end - 1);
+    request.version = line.substr(target_end + 1);
+    if (!is_token(request.method) || target.front() != '/') {
+        return fail(400, "Malformed request line");
+    }
+    if (request.version != "HTTP/1.1" && request.version != "HTTP/1.0") {
+        return fail(505, "HTTP version not supported");
+    }
+    size_t query_start = target.find('?');
+    request.path = target.substr(0, query_start);
+    request.query = query_start == std::string_view::npos ? std::string_view() : target.substr(query_start + 1);
+
+    bool have_length = false;
+    std::string_view connection;
+    size_t position = line_end + 2;
+    while (true) {
+        line_end = head.find("\r\n", position);
+        line = head.substr(position, line_end - position);
+        position = line_end + 2;
+        if (line.empty()) {
+            break;
+        }
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            return fail(400, "Malformed header line");
+        }
+        // Also rejects obsolete line folding and whitespace before the colon
+        std::string_view name = line.substr(0, colon);
+        if (!is_token(name)) {
+            return fail(400, "Malformed header name");
+        }
+        std::string_view value = trim(line.substr(colon + 1));
+        if (!all_of_class(value, FIELD_VALUE)) {
+            return fail(400, "Invalid character in header value");
+        }
+        if (request.header_count == HttpRequest::MAX_HEADERS) {
+            return fail(431, "Too many headers");
+        }
+        request.headers[request.header_count++] = {name, value};
+
+        if (iequals(name, "content-length")) {
+            if (value.empty() || value.size() > 18 || value.find_first_not_of("0123456789") != std::string_view::npos) {
+                return fail(400, "Invalid Content-Length");
+            }
+            size_t length = 0;
+            for (char c : value) {
+                length = length * 10 + static_cast<size_t>(c - '0');
+            }
+            if (have_length && length != content_length_) {
+                return fail(400, "Conflicting Content-Length headers");
+            }
+            content_length_ = length;
+            have_length = true;
+        } else if (iequals(name, "transfer-encoding")) {
+            return fail(501, "Transfer-Encoding is not supported");
+        } else if (iequals(name, "connection")) {
+            connection = value;
+        }
+    }
+
+    // HTTP/1.1 connections persist unless the client says close; HTTP/1.0
+    // ones only if the client asks for keep-alive
+    request.keep_alive = request.version == "HTTP/1.0" ? icontains(connection, "keep-alive")
+                                                       : !icontains(connection, "close");
+    return true;
+}
+
+bool HttpParser::fail(int status, const char* message) {
+    error_status_ = status;
+    error_ = message;
+    return false;
+}
+
+} // namespace api
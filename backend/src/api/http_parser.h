@@ -0,0 +1,95 @@
+/**
+ * HTTP Request Parser
+ *
+ * Incremental HTTP/1.x request parser that works directly on a connection's
+ * read buffer. Method, path, query, headers and body come back as
+ * std::string_view slices of that buffer, so parsing copies nothing and
+ * allocates nothing. A request that arrives over several reads is scanned
+ * once: the parser remembers how far it searched for the end of the headers
+ * and resumes from there.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace api {
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// {name} segment of a route and the path segment it matched
+struct PathParam {
+    std::string_view name;
+    std::string_view value;
+};
+
+// The views point into the connection's read buffer and stay valid until
+// the request has been answered, i.e. for the whole handler call; copy
+// anything that must outlive it.
+struct HttpRequest {
+    static constexpr size_t MAX_HEADERS = 32;
+    static constexpr size_t MAX_PATH_PARAMS = 8;
+
+    std::string_view method;
+    std::string_view path;                              // without the query string
+    std::string_view query;                             // raw query string, without the '?'
+    std::string_view version;                           // "HTTP/1.0" or "HTTP/1.1"
+    std::array<HttpHeader, MAX_HEADERS> headers;
+    size_t header_count = 0;
+    std::string_view body;
+    bool keep_alive = true;                             // from the version and Connection header
+    std::array<PathParam, MAX_PATH_PARAMS> path_params; // filled by the router
+    size_t path_param_count = 0;
+
+    // Case-insensitive lookup; empty if the header is absent
+    std::string_view header(std::string_view name) const;
+    // Value of a {name} route segment; empty if the route has none
+    std::string_view path_param(std::string_view name) const;
+    // Value of the first ?name=value pair, found by scanning the query
+    // string on each call. Values without escapes are returned as views of
+    // the request; percent-encoded or '+' values are decoded into scratch
+    // and the view points there. Empty if absent. Names are compared as sent.
+    std::string_view query_param(std::string_view name, std::string& scratch) const;
+};
+
+// Decodes %XX escapes and '+' (as space) in a query string component
+std::string url_decode(std::string_view value);
+
+class HttpParser {
+public:
+    enum class Result { COMPLETE, INCOMPLETE, ERROR };
+
+    explicit HttpParser(size_t max_request_size = 1 << 20) : max_request_size_(max_request_size) {}
+
+    // Parses the request at the start of data. Between INCOMPLETE calls data
+    // must begin with the same bytes (the buffer itself may move). COMPLETE
+    // fills request and request_size() and readies the parser for the next
+    // request; ERROR sets error_status() and error().
+    Result parse(std::string_view data, HttpRequest& request);
+
+    // Size of the last complete request, headers plus body
+    size_t request_size() const { return request_size_; }
+    int error_status() const { return error_status_; }
+    const char* error() const { return error_; }
+    void reset();
+
+private:
+    size_t max_request_size_;
+    size_t scanned_ = 0;        // bytes already searched for the end of the headers
+    size_t head_size_ = 0;      // non-zero once the headers are complete
+    size_t content_length_ = 0;
+    size_t request_size_ = 0;
+    int error_status_ = 0;
+    const char* error_ = "";
+
+    bool parse_head(std::string_view head, HttpRequest& request);
+    bool fail(int status, const char* message);
+};
+
+} // namespace api
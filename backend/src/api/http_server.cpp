@@ -1,229 +1,559 @@
 #include "http_server.h"
+#include "event_fd.h"
+#include "../utils/json_utils.h"
 #include <algorithm>
-#include <regex>
+#include <charconv>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 
 namespace api {
 
-HttpServer::HttpServer(int port) : port_(port), running_(false) {
-    server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd_ < 0) {
-        throw std::runtime_error("Failed to create socket");
+namespace {
+    constexpr int MAX_EVENTS = 256;
+    // Free space guaranteed before each recv; the buffer grows past it as needed
+    constexpr size_t MIN_READ_SPACE = 4096;
+    // Queued response bytes above which a connection stops parsing pipelined requests
+    constexpr size_t OUTPUT_HIGH_WATER = 1 << 20;
+    // Bodies up to this size are copied behind their head (and small
+    // pieces appended to the previous one) rather than queued as their own
+    // iovec; larger bodies are moved into the queue without a copy
+    constexpr size_t COALESCE_LIMIT = 4096;
+    // iovecs per sendmsg; well under IOV_MAX
+    constexpr size_t MAX_IOVECS = 64;
+
+    const char* status_text(int status_code) {
+        switch (status_code) {
+            case 200: return "OK";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 413: return "Payload Too Large";
+            case 431: return "Request Header Fields Too Large";
+            case 500: return "Internal Server Error";
+            case 501: return "Not Implemented";
+            case 505: return "HTTP Version Not Supported";
+            default: return "Unknown";
+        }
     }
-    
-    int opt = 1;
-    if (setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        throw std::runtime_error("Failed to set socket options");
+
+    std::string format_prefix(int status_code) {
+        return "HTTP/1.1 " + std::to_string(status_code) + " " + status_text(status_code) + "\r\n"
+               "Access-Control-Allow-Headers: Content-Type, Authorization\r\n"
+               "Access-Control-Allow-Methods: GET, POST, PUT, PATCH, DELETE, OPTIONS\r\n"
+               "Access-Control-Allow-Origin: *\r\n"
+               "Content-Type: application/json\r\n";
+    }
+
+    // Status line plus the headers every response carries, for the status
+    // codes the server produces
+    const std::string* response_prefix(int status_code) {
+        static const std::unordered_map<int, std::string> prefixes = [] {
+            std::unordered_map<int, std::string> table;
+            for (int status : {200, 400, 404, 405, 413, 431, 500, 501, 505}) {
+                table.emplace(status, format_prefix(status));
+            }
+            return table;
+        }();
+        auto it = prefixes.find(status_code);
+        return it == prefixes.end() ? nullptr : &it->second;
+    }
+
+    uint64_t now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+}
+
+HttpServer::HttpServer(int port, HttpServerConfig config) : port_(port), config_(config), running_(false) {
+    if (config_.workers == 0) {
+        config_.workers = std::max(1u, std::thread::hardware_concurrency());
     }
 }
 
 HttpServer::~HttpServer() {
     stop();
-    if (server_fd_ >= 0) {
-        close(server_fd_);
-    }
 }
 
 void HttpServer::start() {
     if (running_) return;
-    
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port_);
-    
-    if (bind(server_fd_, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        throw std::runtime_error("Failed to bind socket");
-    }
-    
-    if (listen(server_fd_, 10) < 0) {
-        throw std::runtime_error("Failed to listen on socket");
+
+    // Bind every listener before starting any thread so a failure leaves nothing running
+    for (size_t i = 0; i < config_.workers; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+        try {
+            open_worker(*workers_.back());
+        } catch (...) {
+            for (auto& worker : workers_) {
+                close_worker(*worker);
+            }
+            workers_.clear();
+            throw;
+        }
     }
-    
+
     running_ = true;
-    server_thread_ = std::thread(&HttpServer::server_loop, this);
-    
-    std::cout << "HTTP Server started on port " << port_ << std::endl;
+    for (auto& worker : workers_) {
+        worker->thread = std::thread(&HttpServer::worker_loop, this, std::ref(*worker));
+    }
+
+    std::cout << "HTTP Server started on port " << port_ << " (" << workers_.size() << " workers)" << std::endl;
 }
 
 void HttpServer::stop() {
     if (!running_) return;
-    
+
     running_ = false;
-    if (server_thread_.joinable()) {
-        server_thread_.join();
+    for (auto& worker : workers_) {
+        wake_eventfd(worker->wake_fd);
+    }
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+        close_worker(*worker);
     }
-    
+    workers_.clear();
+
     std::cout << "HTTP Server stopped" << std::endl;
 }
 
 void HttpServer::add_route(const std::string& method, const std::string& path,
                           std::function<HttpResponse(const HttpRequest&)> handler) {
-    std::string key = method + " " + path;
-    routes_[key] = handler;
+    router_.add(method, path, static_cast<uint32_t>(routes_.size()));
+    routes_.push_back(Route{std::move(handler), nullptr});
+}
+
+void HttpServer::add_async_route(const std::string& method, const std::string& path,
+                                 std::function<void(const HttpRequest&, HttpResponder)> handler) {
+    router_.add(method, path, static_cast<uint32_t>(routes_.size()));
+    routes_.push_back(Route{nullptr, std::move(handler)});
 }
 
-void HttpServer::server_loop() {
+void HttpServer::open_worker(Worker& worker) {
+    worker.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (worker.listen_fd < 0) {
+        throw std::runtime_error("Failed to create socket");
+    }
+
+    int opt = 1;
+    if (setsockopt(worker.listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        setsockopt(worker.listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        throw std::runtime_error("Failed to set socket options");
+    }
+
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port_);
+
+    if (bind(worker.listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        throw std::runtime_error("Failed to bind socket");
+    }
+
+    if (listen(worker.listen_fd, config_.backlog) < 0) {
+        throw std::runtime_error("Failed to listen on socket");
+    }
+
+    worker.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    worker.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    worker.spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (worker.epoll_fd < 0 || worker.wake_fd < 0) {
+        throw std::runtime_error("Failed to create event loop");
+    }
+    worker.mailbox = std::make_shared<Mailbox>();
+    worker.mailbox->wake_fd = worker.wake_fd;
+
+    // The listener and wake fd are told apart from connections by their data pointers
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = &worker.listen_fd;
+    if (epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, worker.listen_fd, &event) < 0) {
+        throw std::runtime_error("Failed to register listening socket");
+    }
+    event.events = EPOLLIN;
+    event.data.ptr = &worker.wake_fd;
+    if (epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, worker.wake_fd, &event) < 0) {
+        throw std::runtime_error("Failed to register wake-up descriptor");
+    }
+}
+
+void HttpServer::close_worker(Worker& worker) {
+    if (worker.mailbox) {
+        // Responders that complete later find it closed and drop the response
+        std::lock_guard<std::mutex> lock(worker.mailbox->mutex);
+        worker.mailbox->open = false;
+        worker.mailbox->completed.clear();
+    }
+    for (auto& entry : worker.connections) {
+        close(entry.first);
+    }
+    worker.connections.clear();
+    for (int* fd : {&worker.listen_fd, &worker.epoll_fd, &worker.wake_fd, &worker.spare_fd}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void HttpServer::worker_loop(Worker& worker) {
+    epoll_event events[MAX_EVENTS];
+    // Wake up a few times per idle timeout to sweep idle connections
+    int wait_ms = config_.idle_timeout_ms > 0 ? static_cast<int>(std::clamp<uint32_t>(config_.idle_timeout_ms / 4, 1, 1000)) : -1;
+    uint64_t last_sweep = now_ms();
     while (running_) {
-        struct sockaddr_in client_address;
-        socklen_t client_len = sizeof(client_address);
-        
-        int client_fd = accept(server_fd_, (struct sockaddr*)&client_address, &client_len);
-        if (client_fd < 0) {
-            if (running_) {
-                std::cerr << "Failed to accept client connection" << std::endl;
+        int count = epoll_wait(worker.epoll_fd, events, MAX_EVENTS, wait_ms);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        uint64_t now = now_ms();
+        bool woken = false;
+        for (int i = 0; i < count && running_; ++i) {
+            void* tag = events[i].data.ptr;
+            if (tag == &worker.wake_fd) {
+                woken = true;
+                continue;
+            }
+            if (tag == &worker.listen_fd) {
+                accept_connections(worker);
+                continue;
             }
+
+            Connection& connection = *static_cast<Connection*>(tag);
+            connection.last_active_ms = now;
+            // Read even on EPOLLHUP/EPOLLERR: recv drains what is left and
+            // reports the error, which closes the connection
+            service(worker, connection, events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP));
+        }
+
+        // After the pass: delivering may close a connection with an event
+        // still to come in this one
+        if (woken && running_) {
+            deliver_responses(worker);
+        }
+
+        if (wait_ms > 0 && now - last_sweep >= static_cast<uint64_t>(wait_ms)) {
+            close_idle_connections(worker, now);
+            last_sweep = now;
+        }
+    }
+}
+
+void HttpServer::close_idle_connections(Worker& worker, uint64_t now) {
+    for (auto it = worker.connections.begin(); it != worker.connections.end();) {
+        // Connections accepted after now was taken are newer than now; one
+        // waiting on the engine is not idle
+        if (it->second->awaiting == 0 && it->second->last_active_ms + config_.idle_timeout_ms <= now) {
+            close(it->first);
+            it = worker.connections.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void HttpServer::accept_connections(Worker& worker) {
+    // Edge-triggered: keep accepting until the queue is empty
+    while (true) {
+        int fd = accept4(worker.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if ((errno == EMFILE || errno == ENFILE) && worker.spare_fd >= 0) {
+                // Out of descriptors: free the spare to accept and drop one
+                // pending connection, so the queue keeps draining instead of
+                // stalling the edge-triggered listener
+                close(worker.spare_fd);
+                int shed = accept(worker.listen_fd, nullptr, nullptr);
+                if (shed >= 0) close(shed);
+                worker.spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Failed to accept client connection: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        auto connection = std::make_unique<Connection>(config_.max_request_size);
+        connection->fd = fd;
+        connection->last_active_ms = now_ms();
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = connection.get();
+        if (epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
             continue;
         }
-        
-        // Handle client in a separate thread
-        std::thread client_thread(&HttpServer::handle_client, this, client_fd);
-        client_thread.detach();
+        worker.connections.emplace(fd, std::move(connection));
     }
 }
 
-void HttpServer::handle_client(int client_fd) {
-    std::string raw_request;
-    std::string line;
-    
-    // Read request line
-    line = read_line(client_fd);
-    if (line.empty()) {
-        close(client_fd);
-        return;
+void HttpServer::close_connection(Worker& worker, Connection& connection) {
+    // Closing the descriptor also removes it from the epoll set
+    int fd = connection.fd;
+    close(fd);
+    worker.connections.erase(fd);
+}
+
+bool HttpServer::service(Worker& worker, Connection& connection, bool readable) {
+    bool read = readable;
+    while (true) {
+        if (read && !connection.peer_closed && !read_input(connection)) {
+            close_connection(worker, connection);
+            return false;
+        }
+        process_input(worker, connection);
+        if (!flush(worker, connection)) {
+            return false;
+        }
+        if (connection.out_bytes > 0) {
+            return true;  // EPOLLOUT resumes once the socket drains
+        }
+        if (connection.awaiting != 0) {
+            return true;  // deliver_responses() resumes once the response arrives
+        }
+        // Output is drained: pick up where reading or parsing stopped for it
+        if (connection.read_paused || connection.input_pending) {
+            read = connection.read_paused;
+            continue;
+        }
+        if (connection.peer_closed) {
+            close_connection(worker, connection);
+            return false;
+        }
+        return true;
     }
-    raw_request += line + "\r\n";
-    
-    // Read headers
+}
+
+bool HttpServer::read_input(Connection& connection) {
+    connection.read_paused = false;
     while (true) {
-        line = read_line(client_fd);
-        if (line.empty()) break;
-        raw_request += line + "\r\n";
-    }
-    raw_request += "\r\n";
-    
-    HttpRequest request = parse_request(raw_request);
-    
-    // Read body if present
-    auto content_length_it = request.headers.find("content-length");
-    if (content_length_it != request.headers.end()) {
-        size_t content_length = std::stoul(content_length_it->second);
-        if (content_length > 0) {
-            request.body = read_body(client_fd, content_length);
-        }
-    }
-    
-    // Handle request
+        // Leave the rest in the socket until buffered requests are answered
+        if (connection.in.size() >= config_.max_request_size) {
+            connection.read_paused = true;
+            return true;
+        }
+        size_t available;
+        char* space = connection.in.prepare(MIN_READ_SPACE, available);
+        ssize_t n = recv(connection.fd, space, available, 0);
+        if (n > 0) {
+            connection.in.commit(static_cast<size_t>(n));
+            continue;
+        }
+        if (n == 0) {
+            connection.peer_closed = true;
+            return true;
+        }
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+void HttpServer::process_input(Worker& worker, Connection& connection) {
+    // Answer every complete request in the buffer, in order. Parsing pauses
+    // while too much output is queued, so a client that pipelines without
+    // reading cannot grow the write buffer without bound.
+    std::string_view input = connection.in.view();
+    size_t offset = 0;
+    HttpRequest& request = worker.request;
+    connection.input_pending = false;
+    while (!connection.close_after_write && connection.awaiting == 0 && offset < input.size()) {
+        if (connection.out_bytes >= OUTPUT_HIGH_WATER) {
+            connection.input_pending = true;
+            break;
+        }
+
+        HttpParser::Result result = connection.parser.parse(input.substr(offset), request);
+        if (result == HttpParser::Result::INCOMPLETE) {
+            break;
+        }
+        if (result == HttpParser::Result::ERROR) {
+            respond(connection, error_response(connection.parser.error_status(), connection.parser.error()), false);
+            break;
+        }
+
+        offset += connection.parser.request_size();
+        ++connection.requests;
+        bool under_cap = config_.max_requests_per_connection == 0 ||
+                         connection.requests < config_.max_requests_per_connection;
+        dispatch(worker, connection, request, request.keep_alive && under_cap);
+    }
+    connection.in.consume(offset);
+}
+
+void HttpServer::deliver_responses(Worker& worker) {
+    uint64_t count;
+    if (read(worker.wake_fd, &count, sizeof(count)) < 0) {
+        // EAGAIN: another pass already reset the counter
+    }
+    {
+        std::lock_guard<std::mutex> lock(worker.mailbox->mutex);
+        worker.delivering.swap(worker.mailbox->completed);
+    }
+
+    uint64_t now = now_ms();
+    for (Completed& completed : worker.delivering) {
+        // The connection may have been closed, and its descriptor reused,
+        // while the engine worked; tickets are never reused
+        auto it = worker.connections.find(completed.fd);
+        if (it == worker.connections.end() || it->second->awaiting != completed.ticket) {
+            continue;
+        }
+        Connection& connection = *it->second;
+        connection.awaiting = 0;
+        connection.last_active_ms = now;
+        respond(connection, std::move(completed.response), connection.awaiting_keep_alive);
+        // Send it, then carry on with any requests pipelined behind it
+        service(worker, connection, false);
+    }
+    worker.delivering.clear();
+}
+
+HttpResponse HttpServer::error_response(int status_code, const std::string& message) {
     HttpResponse response;
-    std::string route_key = request.method + " " + request.path;
-    
-    if (request.method == "OPTIONS") {
-        // Handle CORS preflight
-        response.status_code = 200;
-    } else if (routes_.find(route_key) != routes_.end()) {
-        response = routes_[route_key](request);
+    response.status_code = status_code;
+    // The message may quote request input, so it goes through the escaping writer
+    response.body = utils::JsonBuilder().start_object().add_string("error", message).end_object().build();
+    return response;
+}
+
+void HttpServer::respond(Connection& connection, HttpResponse&& response, bool keep_alive) {
+    std::string head = format_head(response, keep_alive);
+    size_t bytes = head.size() + response.body.size();
+    bool small_body = response.body.size() <= COALESCE_LIMIT;
+    if (small_body) {
+        head += response.body;
+    }
+    // Pipelined small responses share one buffer instead of an iovec each
+    if (!connection.out.empty() && connection.out.back().size() + head.size() <= COALESCE_LIMIT) {
+        connection.out.back() += head;
     } else {
-        response.status_code = 404;
-        response.body = "{\"error\": \"Not Found\"}";
-    }
-    
-    // Send response
-    std::string response_str = serialize_response(response);
-    send(client_fd, response_str.c_str(), response_str.length(), 0);
-    
-    close(client_fd);
-}
-
-HttpRequest HttpServer::parse_request(const std::string& raw_request) {
-    HttpRequest request;
-    std::istringstream stream(raw_request);
-    std::string line;
-    
-    // Parse request line
-    if (std::getline(stream, line)) {
-        std::istringstream line_stream(line);
-        line_stream >> request.method >> request.path;
-    }
-    
-    // Parse headers
-    while (std::getline(stream, line) && line != "\r" && !line.empty()) {
-        size_t colon_pos = line.find(':');
-        if (colon_pos != std::string::npos) {
-            std::string key = line.substr(0, colon_pos);
-            std::string value = line.substr(colon_pos + 1);
-            
-            // Trim whitespace
-            key.erase(0, key.find_first_not_of(" \t"));
-            key.erase(key.find_last_not_of(" \t\r") + 1);
-            value.erase(0, value.find_first_not_of(" \t"));
-            value.erase(value.find_last_not_of(" \t\r") + 1);
-            
-            // Convert to lowercase
-            std::transform(key.begin(), key.end(), key.begin(), ::tolower);
-            request.headers[key] = value;
-        }
-    }
-    
-    return request;
-}
-
-std::string HttpServer::serialize_response(const HttpResponse& response) {
-    std::ostringstream oss;
-    
-    // Status line
-    oss << "HTTP/1.1 " << response.status_code << " ";
-    switch (response.status_code) {
-        case 200: oss << "OK"; break;
-        case 404: oss << "Not Found"; break;
-        case 500: oss << "Internal Server Error"; break;
-        default: oss << "Unknown"; break;
-    }
-    oss << "\r\n";
-    
-    // Headers
-    for (const auto& header : response.headers) {
-        oss << header.first << ": " << header.second << "\r\n";
-    }
-    
-    // Content-Length
-    oss << "Content-Length: " << response.body.length() << "\r\n";
-    
-    // End of headers
-    oss << "\r\n";
-    
-    // Body
-    oss << response.body;
-    
-    return oss.str();
-}
-
-std::string HttpServer::read_line(int fd) {
-    std::string line;
-    char c;
-    
-    while (recv(fd, &c, 1, 0) > 0) {
-        if (c == '\n') {
-            break;
+        connection.out.push_back(std::move(head));
+    }
+    if (!small_body) {
+        connection.out.push_back(std::move(response.body));
+    }
+    connection.out_bytes += bytes;
+    if (!keep_alive) {
+        connection.close_after_write = true;
+    }
+}
+
+bool HttpServer::flush(Worker& worker, Connection& connection) {
+    // sendmsg rather than writev so MSG_NOSIGNAL still applies
+    iovec iov[MAX_IOVECS];
+    while (connection.out_bytes > 0) {
+        size_t count = 0;
+        for (auto it = connection.out.begin(); it != connection.out.end() && count < MAX_IOVECS; ++it, ++count) {
+            size_t skip = count == 0 ? connection.out_offset : 0;
+            iov[count].iov_base = const_cast<char*>(it->data() + skip);
+            iov[count].iov_len = it->size() - skip;
+        }
+        msghdr message{};
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t n = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (n <= 0) {
+            close_connection(worker, connection);
+            return false;
+        }
+
+        // Drop what was sent; a short write leaves out_offset inside a piece
+        size_t sent = static_cast<size_t>(n);
+        connection.out_bytes -= sent;
+        while (sent > 0) {
+            size_t remaining = connection.out.front().size() - connection.out_offset;
+            if (sent < remaining) {
+                connection.out_offset += sent;
+                break;
+            }
+            sent -= remaining;
+            connection.out.pop_front();
+            connection.out_offset = 0;
         }
-        if (c != '\r') {
-            line += c;
+    }
+
+    if (connection.close_after_write) {
+        close_connection(worker, connection);
+        return false;
+    }
+    return true;
+}
+
+void HttpServer::dispatch(Worker& worker, Connection& connection, HttpRequest& request, bool keep_alive) {
+    if (request.method == "OPTIONS") {
+        // Handle CORS preflight
+        respond(connection, HttpResponse(), keep_alive);
+        return;
+    }
+
+    uint32_t route = router_.match(request);
+    if (route == Router::NOT_FOUND) {
+        respond(connection, error_response(404, "Not Found"), keep_alive);
+        return;
+    }
+    if (route == Router::METHOD_NOT_ALLOWED) {
+        respond(connection, error_response(405, "Method Not Allowed"), keep_alive);
+        return;
+    }
+
+    // A handler that throws must not take the worker's event loop down with it
+    const Route& target = routes_[route];
+    try {
+        if (target.handler) {
+            respond(connection, target.handler(request), keep_alive);
+            return;
         }
+        uint64_t ticket = worker.next_ticket++;
+        connection.awaiting = ticket;
+        connection.awaiting_keep_alive = keep_alive;
+        target.async_handler(request, [mailbox = worker.mailbox, fd = connection.fd, ticket](HttpResponse&& response) {
+            std::lock_guard<std::mutex> lock(mailbox->mutex);
+            if (!mailbox->open) return;
+            mailbox->completed.push_back(Completed{fd, ticket, std::move(response)});
+            if (mailbox->completed.size() == 1) {
+                wake_eventfd(mailbox->wake_fd);
+            }
+        });
+    } catch (const std::exception& e) {
+        std::cerr << "Handler for " << request.method << " " << request.path << " failed: " << e.what() << std::endl;
+        connection.awaiting = 0;
+        respond(connection, error_response(500, "Internal Server Error"), keep_alive);
     }
-    
-    return line;
 }
 
-std::string HttpServer::read_body(int fd, size_t content_length) {
-    std::string body;
-    body.resize(content_length);
-    
-    size_t total_read = 0;
-    while (total_read < content_length) {
-        ssize_t bytes_read = recv(fd, &body[total_read], content_length - total_read, 0);
-        if (bytes_read <= 0) break;
-        total_read += bytes_read;
+std::string HttpServer::format_head(const HttpResponse& response, bool keep_alive) {
+    const std::string* prefix = response_prefix(response.status_code);
+    std::string head;
+    head.reserve((prefix != nullptr ? prefix->size() : 256) + 64);
+    head += prefix != nullptr ? *prefix : format_prefix(response.status_code);
+    for (const auto& header : response.headers) {
+        head.append(header.first).append(": ").append(header.second).append("\r\n");
     }
-    
-    return body;
+
+    char length[24];
+    char* length_end = std::to_chars(length, length + sizeof(length), response.body.size()).ptr;
+    head.append("Content-Length: ").append(length, length_end);
+    head.append(keep_alive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+    return head;
 }
 
 } // namespace api
@@ -1,10 +1,17 @@
 #pragma once
 
+#include "http_parser.h"
+#include "read_buffer.h"
+#include "router.h"
 #include <string>
 #include <map>
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <sstream>
 #include <iostream>
@@ -15,51 +22,160 @@
 
 namespace api {
 
-struct HttpRequest {
-    std::string method;
-    std::string path;
-    std::map<std::string, std::string> headers;
-    std::string body;
-};
-
+// Every response also carries Content-Type: application/json and the CORS
+// headers; those are formatted once per status code, not per response
 struct HttpResponse {
     int status_code = 200;
-    std::map<std::string, std::string> headers;
+    std::map<std::string, std::string> headers;     // additional headers only
     std::string body;
-    
-    HttpResponse() {
-        headers["Content-Type"] = "application/json";
-        headers["Access-Control-Allow-Origin"] = "*";
-        headers["Access-Control-Allow-Methods"] = "GET, POST, PUT, DELETE, OPTIONS";
-        headers["Access-Control-Allow-Headers"] = "Content-Type, Authorization";
-    }
 };
 
+// Delivers an asynchronous route's response. It may be called from any
+// thread, and must be called exactly once.
+using HttpResponder = std::function<void(HttpResponse&&)>;
+
+struct HttpServerConfig {
+    // Event loops, each with its own SO_REUSEPORT listener so the kernel
+    // spreads new connections across them; 0 means one per hardware thread
+    size_t workers = 0;
+    // listen() backlog per worker (the kernel caps it at net.core.somaxconn)
+    int backlog = 4096;
+    // Largest request (headers plus body) a connection may buffer; larger
+    // requests are answered with 413 and the connection is closed
+    size_t max_request_size = 1 << 20;
+    // Connections with no traffic for this long are closed; 0 disables
+    uint32_t idle_timeout_ms = 30000;
+    // Requests answered on one connection before the server closes it, so
+    // long-lived clients reconnect and rebalance across workers; 0 disables
+    uint32_t max_requests_per_connection = 10000;
+};
+
+// Edge-triggered epoll server. Each worker thread owns a listening socket,
+// an epoll instance and every connection it accepts, so connections never
+// move between threads and need no locking. Sockets are non-blocking and
+// each connection keeps its own read and write buffers; route handlers run
+// on the worker thread. Connections are persistent (HTTP/1.1 keep-alive)
+// and pipelined requests are answered in order from the read buffer.
+//
+// Handlers that wait on something, such as the matching engine and its
+// journal sync, are registered with add_async_route() and answer through an
+// HttpResponder instead of returning. The responder puts the response in
+// the worker's mailbox and wakes the worker through its eventfd, so the
+// loop never blocks and keeps serving its other connections meanwhile. The
+// connection stops parsing until the response arrives, so pipelined
+// responses stay in order.
 class HttpServer {
 private:
-    int server_fd_;
+    struct Connection {
+        explicit Connection(size_t max_request_size) : parser(max_request_size) {}
+
+        int fd = -1;
+        ReadBuffer in;              // received bytes not yet consumed by a request
+        HttpParser parser;          // state of the request at the front of in
+        // Response bytes not yet sent, in order: response heads (with small
+        // bodies appended) and large bodies moved in whole, written with
+        // one scatter-gather send per batch
+        std::deque<std::string> out;
+        size_t out_offset = 0;      // bytes of out.front() already sent
+        size_t out_bytes = 0;       // unsent bytes across out
+        uint32_t requests = 0;
+        uint64_t last_active_ms = 0;
+        bool peer_closed = false;
+        bool read_paused = false;   // stopped reading at max_request_size buffered bytes
+        bool input_pending = false; // stopped parsing until queued output drains
+        bool close_after_write = false;
+        // Set while an asynchronous route's response is outstanding; names
+        // it in the worker's mailbox
+        uint64_t awaiting = 0;
+        bool awaiting_keep_alive = false;
+    };
+
+    // An asynchronous route's response, for the connection on fd if it is
+    // still awaiting ticket
+    struct Completed {
+        int fd = -1;
+        uint64_t ticket = 0;
+        HttpResponse response;
+    };
+
+    // Shared with the responders, which may outlive the worker
+    struct Mailbox {
+        std::mutex mutex;
+        std::vector<Completed> completed;
+        int wake_fd = -1;
+        bool open = true;
+    };
+
+    struct Worker {
+        int listen_fd = -1;
+        int epoll_fd = -1;
+        int wake_fd = -1;           // eventfd written by stop() and by responders
+        int spare_fd = -1;          // released to shed a connection when out of descriptors
+        std::thread thread;
+        std::unordered_map<int, std::unique_ptr<Connection>> connections;
+        HttpRequest request;        // reused for every request the worker parses
+        std::shared_ptr<Mailbox> mailbox;
+        std::vector<Completed> delivering;  // swapped with the mailbox
+        uint64_t next_ticket = 1;
+    };
+
+    // One of handler and async_handler is set
+    struct Route {
+        std::function<HttpResponse(const HttpRequest&)> handler;
+        std::function<void(const HttpRequest&, HttpResponder)> async_handler;
+    };
+
     int port_;
+    HttpServerConfig config_;
     std::atomic<bool> running_;
-    std::thread server_thread_;
-    std::map<std::string, std::function<HttpResponse(const HttpRequest&)>> routes_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    Router router_;
+    std::vector<Route> routes_;     // indexed by route id
 
 public:
-    HttpServer(int port = 8080);
+    HttpServer(int port = 8080, HttpServerConfig config = HttpServerConfig());
     ~HttpServer();
-    
+
+    // Throws std::runtime_error if a worker cannot bind or listen
     void start();
     void stop();
-    
-    void add_route(const std::string& method, const std::string& path, 
+
+    // Routes must be registered before start(). A path segment written as
+    // {name} matches any one segment; handlers read it with
+    // request.path_param("name"). Throws std::invalid_argument for a
+    // malformed or duplicate route.
+    void add_route(const std::string& method, const std::string& path,
                    std::function<HttpResponse(const HttpRequest&)> handler);
-    
+    // As add_route(), for a handler that answers through respond, possibly
+    // later and from another thread. The request is only valid during the
+    // call. If the handler throws, it must not have called respond.
+    void add_async_route(const std::string& method, const std::string& path,
+                         std::function<void(const HttpRequest&, HttpResponder)> handler);
+
 private:
-    void server_loop();
-    HttpRequest parse_request(const std::string& raw_request);
-    std::string serialize_response(const HttpResponse& response);
-    void handle_client(int client_fd);
-    std::string read_line(int fd);
-    std::string read_body(int fd, size_t content_length);
+    void open_worker(Worker& worker);
+    void close_worker(Worker& worker);
+    void worker_loop(Worker& worker);
+    void accept_connections(Worker& worker);
+    void close_connection(Worker& worker, Connection& connection);
+    void close_idle_connections(Worker& worker, uint64_t now);
+    // Answers the connections whose asynchronous responses have arrived
+    void deliver_responses(Worker& worker);
+    // Reads (if readable), answers every complete buffered request and
+    // writes as much as the socket takes; returns false once the
+    // connection has been closed
+    bool service(Worker& worker, Connection& connection, bool readable);
+    // Returns false on a socket error
+    bool read_input(Connection& connection);
+    void process_input(Worker& worker, Connection& connection);
+    bool flush(Worker& worker, Connection& connection);
+    void respond(Connection& connection, HttpResponse&& response, bool keep_alive);
+
+    // Responds, or starts an asynchronous route and marks the connection awaiting
+    void dispatch(Worker& worker, Connection& connection, HttpRequest& request, bool keep_alive);
+    static HttpResponse error_response(int status_code, const std::string& message);
+    // Status line and headers, ending with the blank line
+    static std::string format_head(const HttpResponse& response, bool keep_alive);
 };
 
 } // namespace api
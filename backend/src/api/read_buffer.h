@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+namespace api {
+
+// Byte buffer for socket reads: bytes are appended at the back and consumed
+// from the front. Space is reused across reads, and growing it neither
+// zero-fills nor re-reads anything, unlike resizing a std::string.
+class ReadBuffer {
+public:
+    static constexpr size_t INITIAL_CAPACITY = 4096;
+
+    std::string_view view() const { return std::string_view(data_.get() + begin_, end_ - begin_); }
+    size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+
+    // Returns the free space at the back, making sure there are at least
+    // min_free bytes (compacting first, then growing); pass the number of
+    // bytes written to commit()
+    char* prepare(size_t min_free, size_t& available) {
+        if (capacity_ - end_ < min_free) {
+            size_t used = size();
+            if (capacity_ - used >= min_free) {
+                std::memmove(data_.get(), data_.get() + begin_, used);
+            } else {
+                size_t capacity = capacity_ == 0 ? INITIAL_CAPACITY : capacity_ * 2;
+                while (capacity - used < min_free) capacity *= 2;
+                std::unique_ptr<char[]> data(new char[capacity]);
+                if (used > 0) std::memcpy(data.get(), data_.get() + begin_, used);
+                data_ = std::move(data);
+                capacity_ = capacity;
+            }
+            begin_ = 0;
+            end_ = used;
+        }
+        available = capacity_ - end_;
+        return data_.get() + end_;
+    }
+
+    void commit(size_t count) { end_ += count; }
+
+    void consume(size_t count) {
+        begin_ += count;
+        if (begin_ == end_) {
+            begin_ = end_ = 0;
+        }
+    }
+
+private:
+    std::unique_ptr<char[]> data_;
+    size_t capacity_ = 0;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+};
+
+} // namespace api
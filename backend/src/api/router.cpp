@@ -0,0 +1,135 @@
+/**
+ * HTTP Route Table Implementation
+ */
+
+#include "router.h"
+#include <stdexcept>
+
+namespace api {
+
+namespace {
+    // Takes the first segment off a path that starts with '/'; the rest
+    // keeps its leading '/', so "/a/" leaves "/" (an empty last segment)
+    // while "/a" leaves nothing
+    std::string_view next_segment(std::string_view& rest) {
+        size_t end = rest.find('/', 1);
+        std::string_view segment = rest.substr(1, end == std::string_view::npos ? end : end - 1);
+        rest = end == std::string_view::npos ? std::string_view() : rest.substr(end);
+        return segment;
+    }
+}
+
+Router::Router() : nodes_(1) {}
+
+void Router::add(std::string_view method, std::string_view path, uint32_t route_id) {
+    if (method.empty() || path.empty() || path.front() != '/') {
+        throw std::invalid_argument("Invalid route: " + std::string(method) + " " + std::string(path));
+    }
+
+    uint32_t node = 0;
+    size_t params = 0;
+    std::string_view rest = path == "/" ? std::string_view() : path;
+    while (!rest.empty()) {
+        std::string_view segment = next_segment(rest);
+        if (segment.empty()) {
+            throw std::invalid_argument("Empty segment in route " + std::string(path));
+        }
+
+        if (segment.front() == '{') {
+            if (segment.size() < 3 || segment.back() != '}') {
+                throw std::invalid_argument("Malformed parameter in route " + std::string(path));
+            }
+            if (++params > HttpRequest::MAX_PATH_PARAMS) {
+                throw std::invalid_argument("Too many parameters in route " + std::string(path));
+            }
+            std::string_view name = segment.substr(1, segment.size() - 2);
+            uint32_t child = nodes_[node].param_child;
+            if (child == NO_NODE) {
+                child = static_cast<uint32_t>(nodes_.size());
+                nodes_.emplace_back();
+                nodes_.back().param_name = std::string(name);
+                nodes_[node].param_child = child;
+            } else if (nodes_[child].param_name != name) {
+                throw std::invalid_argument("Parameter {" + std::string(name) + "} in route " + std::string(path) +
+                                            " conflicts with {" + nodes_[child].param_name + "}");
+            }
+            node = child;
+            continue;
+        }
+
+        uint32_t child = NO_NODE;
+        for (const auto& entry : nodes_[node].children) {
+            if (entry.first == segment) {
+                child = entry.second;
+                break;
+            }
+        }
+        if (child == NO_NODE) {
+            child = static_cast<uint32_t>(nodes_.size());
+            nodes_[node].children.emplace_back(std::string(segment), child);
+            nodes_.emplace_back();
+        }
+        node = child;
+    }
+
+    for (const auto& entry : nodes_[node].methods) {
+        if (entry.first == method) {
+            throw std::invalid_argument("Duplicate route: " + std::string(method) + " " + std::string(path));
+        }
+    }
+    nodes_[node].methods.emplace_back(std::string(method), route_id);
+}
+
+uint32_t Router::match(HttpRequest& request) const {
+    request.path_param_count = 0;
+    if (request.path.empty() || request.path.front() != '/') {
+        return NOT_FOUND;
+    }
+    bool path_found = false;
+    std::string_view rest = request.path == "/" ? std::string_view() : request.path;
+    uint32_t route = match_from(0, rest, request, path_found);
+    return route == NOT_FOUND && path_found ? METHOD_NOT_ALLOWED : route;
+}
+
+uint32_t Router::match_from(uint32_t node_index, std::string_view rest, HttpRequest& request, bool& path_found) const {
+    const Node& node = nodes_[node_index];
+    if (rest.empty()) {
+        path_found = path_found || !node.methods.empty();
+        for (const auto& entry : node.methods) {
+            if (entry.first == request.method) {
+                return entry.second;
+            }
+        }
+        return NOT_FOUND;
+    }
+
+    std::string_view segment = next_segment(rest);
+    if (segment.empty()) {
+        return NOT_FOUND;
+    }
+
+    for (const auto& entry : node.children) {
+        if (entry.first == segment) {
+            uint32_t route = match_from(entry.second, rest, request, path_found);
+            if (route != NOT_FOUND) {
+                return route;
+            }
+            break;
+        }
+    }
+
+    // Fall back to a parameter when the literal branch has no such route
+    if (node.param_child != NO_NODE) {
+        size_t count = request.path_param_count;
+        request.path_params[count] = {nodes_[node.param_child].param_name, segment};
+        request.path_param_count = count + 1;
+        uint32_t route = match_from(node.param_child, rest, request, path_found);
+        if (route != NOT_FOUND) {
+            return route;
+        }
+        request.path_param_count = count;
+    }
+    return NOT_FOUND;
+}
+
+} // namespace api
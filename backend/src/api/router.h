@@ -0,0 +1,57 @@
+/**
+ * HTTP Route Table
+ *
+ * Maps a request's method and path to the id of a registered route. Routes
+ * are stored as a trie of path segments in one flat node array, built once
+ * while routes are registered; matching walks the request path segment by
+ * segment over string_views and neither copies nor allocates. A segment
+ * written as {name} matches any single non-empty segment, and the matched
+ * value is handed to the handler through HttpRequest::path_param(name).
+ * Literal segments take precedence over parameters.
+ */
+
+#pragma once
+
+#include "http_parser.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace api {
+
+class Router {
+public:
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;           // no route has this path
+    static constexpr uint32_t METHOD_NOT_ALLOWED = UINT32_MAX - 1; // path exists, method does not
+
+    Router();
+
+    // Registers method + path (e.g. "GET", "/api/orderbook/{symbol}") as
+    // route_id. Throws std::invalid_argument for a malformed pattern, a
+    // duplicate route, or a parameter named differently from one already
+    // registered at the same position.
+    void add(std::string_view method, std::string_view path, uint32_t route_id);
+
+    // Returns the route id, NOT_FOUND or METHOD_NOT_ALLOWED, and on a match
+    // fills the request's path parameters. The parameter names point into
+    // the router, so it must outlive the request.
+    uint32_t match(HttpRequest& request) const;
+
+private:
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+    struct Node {
+        std::vector<std::pair<std::string, uint32_t>> children;  // literal segment -> node
+        uint32_t param_child = NO_NODE;                          // {name} segment
+        std::string param_name;                                  // set on parameter nodes
+        std::vector<std::pair<std::string, uint32_t>> methods;  // method -> route id
+    };
+
+    std::vector<Node> nodes_;   // nodes_[0] is the root "/"
+
+    uint32_t match_from(uint32_t node, std::string_view rest, HttpRequest& request, bool& path_found) const;
+};
+
+} // namespace api
@@ -1,243 +1,586 @@
 /**
  * Trading API Implementation
  * 
- * Implements REST API endpoints for the trading engine, providing thread-safe
- * access to order book operations and JSON serialization for client communication.
+ * Implements REST API endpoints for the trading engine. Each request is routed
+ * by symbol to the matching engine: order entry is queued to the instrument's
+ * shard, order book and summary reads are served from the snapshot the shard
+ * last published, and trade history is read on the matching thread. Handlers
+ * that go through a shard never wait for it: they answer from the command's
+ * completion on the matching thread, which hands the response back to the
+ * HTTP worker.
  */
 
 #include "trading_api.h"
 #include <chrono>
 #include <algorithm>
+#include <charconv>
+#include <limits>
+#include <stdexcept>
 
 namespace api {
 
-TradingApi::TradingApi() : order_book_(std::make_unique<order_book::OrderBook>()) {
-    // Initialize order book with sample data for demonstration
-    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()
-    ).count();
-    
-    std::lock_guard<std::mutex> lock(order_book_mutex_);
+TradingApi::TradingApi(const std::vector<std::string>& symbols, size_t num_shards,
+                       const persistence::JournalConfig& journal)
+    : engine_(std::make_unique<engine::MatchingEngine>(num_shards)),
+      default_symbol_(symbols.empty() ? DEFAULT_SYMBOL : symbols.front()) {
+    if (symbols.empty()) {
+        engine_->add_symbol(default_symbol_);
+    }
+    for (const auto& symbol : symbols) {
+        engine_->add_symbol(symbol);
+    }
+    if (!journal.directory.empty()) {
+        recovery_ = engine_->open_journal(journal);
+    }
+    engine_->start();
+    if (recovery_.orders > 0 || recovery_.snapshots_loaded > 0) {
+        return;
+    }
     
-    // Add some sample orders
-    order::Order order1 = {1, order::OrderType::BUY, 100, 99.50, "client1", static_cast<uint64_t>(now)};
-    order::Order order2 = {2, order::OrderType::BUY, 200, 99.00, "client2", static_cast<uint64_t>(now)};
-    order::Order order3 = {3, order::OrderType::SELL, 150, 100.50, "client3", static_cast<uint64_t>(now)};
-    order::Order order4 = {4, order::OrderType::SELL, 300, 101.00, "client4", static_cast<uint64_t>(now)};
+    // Initialize a fresh default book with sample data for demonstration
+    auto now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count());
     
-    order_book_->add_order(order1);
-    order_book_->add_order(order2);
-    order_book_->add_order(order3);
-    order_book_->add_order(order4);
+    // Add some sample orders (ids are assigned by the engine)
+    order::Order order1 = {0, order::OrderType::BUY, 100, 99.50, "client1", now, default_symbol_};
+    order::Order order2 = {0, order::OrderType::BUY, 200, 99.00, "client2", now, default_symbol_};
+    order::Order order3 = {0, order::OrderType::SELL, 150, 100.50, "client3", now, default_symbol_};
+    order::Order order4 = {0, order::OrderType::SELL, 300, 101.00, "client4", now, default_symbol_};
     
-    order_book_->match_orders();
+    engine_->submit(order1);
+    engine_->submit(order2);
+    engine_->submit(order3);
+    engine_->submit(order4).wait();
 }
 
-// GET /api/orderbook - Retrieve current order book state
+TradingApi::~TradingApi() {
+    engine_->stop();
+}
+
+// GET /api/orderbook - Retrieve the latest published order book snapshot
 api::HttpResponse TradingApi::get_order_book(const api::HttpRequest& request) {
-    std::lock_guard<std::mutex> lock(order_book_mutex_);
-    
-    api::HttpResponse response;
-    response.body = serialize_order_book();
-    return response;
+    try {
+        api::HttpResponse response;
+        response.body = serialize_order_book(*engine_->snapshot(request_symbol(request)));
+        return response;
+    } catch (const std::exception& e) {
+        return error_response(400, e.what());
+    }
 }
 
-// GET /api/trades - Retrieve trade history
-api::HttpResponse TradingApi::get_trades(const api::HttpRequest& request) {
-    std::lock_guard<std::mutex> lock(order_book_mutex_);
-    
-    api::HttpResponse response;
-    response.body = serialize_trades();
-    return response;
+// GET /api/trades - Retrieve recent trades. ?since_trade_id=N returns only
+// trades after N, oldest first, so pollers pull just what is new; without it
+// (or with -1) the latest trades are returned. Trades the book still holds
+// are read on the matching thread; older ones come from the shard journal,
+// read on this worker. X-Oldest-Trade-Id names the oldest trade the response
+// could start from, so a poller whose next id is below it knows trades are
+// missing rather than that there are none.
+void TradingApi::get_trades(const api::HttpRequest& request, api::HttpResponder respond) {
+    try {
+        int64_t since_trade_id = query_int(request, "since_trade_id", -1);
+        int64_t limit = query_int(request, "limit", DEFAULT_TRADE_LIMIT);
+        if (since_trade_id < -1 || limit < 1) {
+            throw std::invalid_argument("since_trade_id must be >= -1 and limit >= 1");
+        }
+        limit = std::min<int64_t>(limit, order_book::TradeRing::DEFAULT_CAPACITY);
+        std::string symbol = request_symbol(request);
+        
+        auto snapshot = engine_->snapshot(symbol);
+        if (snapshot && engine_->has_journal()) {
+            int64_t first = since_trade_id >= 0 ? since_trade_id + 1
+                                                : std::max<int64_t>(0, snapshot->trade_count - limit);
+            if (first < snapshot->first_trade_id) {
+                auto trades = engine_->journal_trades(symbol, first - 1, static_cast<size_t>(limit));
+                api::HttpResponse response;
+                response.headers["X-Oldest-Trade-Id"] = "0";
+                response.body = serialize_trades(trades);
+                respond(std::move(response));
+                return;
+            }
+        }
+        
+        // Serialized by the query on the matching thread, sent by the completion
+        auto body = std::make_shared<std::string>();
+        auto oldest = std::make_shared<int64_t>(0);
+        engine_->query(symbol, [body, oldest, since_trade_id, limit](const order_book::OrderBook& book) {
+            const auto& trades = book.get_trades();
+            *oldest = trades.empty() ? book.get_next_trade_id() : trades.first_id();
+            *body = serialize_trades(book, since_trade_id, static_cast<size_t>(limit));
+        }, [this, body, oldest, respond](engine::CommandResult&& result) {
+            if (!result.accepted) {
+                respond(error_response(500, result.error));
+                return;
+            }
+            api::HttpResponse response;
+            response.headers["X-Oldest-Trade-Id"] = std::to_string(*oldest);
+            response.body = std::move(*body);
+            respond(std::move(response));
+        });
+    } catch (const std::exception& e) {
+        respond(error_response(400, e.what()));
+    }
 }
 
-// POST /api/orders - Submit new order and attempt matching
-api::HttpResponse TradingApi::submit_order(const api::HttpRequest& request) {
+// POST /api/orders - Submit new order, matching it against the book on entry.
+// Answered once the shard has applied the order and committed its journal.
+void TradingApi::submit_order(const api::HttpRequest& request, api::HttpResponder respond) {
     try {
         // Parse and validate order from JSON request body
-        order::Order new_order = parse_order_from_json(request.body);
+        OrderRequest order_request;
+        parse_order_request(request.body, order_request);
         
-        // Thread-safe order book operations
-        std::lock_guard<std::mutex> lock(order_book_mutex_);
-        order_book_->add_order(new_order);
-        order_book_->match_orders();
+        order::Order new_order;
+        // The matching engine assigns the order ID when the order reaches its shard
+        new_order.order_id = 0;
+        new_order.type = order_request.type;
+        new_order.quantity = order_request.quantity;
+        new_order.price = order_request.price;
+        new_order.client_id = std::string(order_request.client_id);
+        new_order.symbol = order_request.symbol.empty() ? request_symbol(request) : std::string(order_request.symbol);
+        new_order.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count());
         
-        // Return success response with order ID
-        api::HttpResponse response;
-        response.body = "{\"status\": \"success\", \"order_id\": " + std::to_string(new_order.order_id) + "}";
-        return response;
+        // Hand the order to its instrument's shard: match on entry, rest the remainder
+        engine_->submit(std::move(new_order), [this, respond](engine::CommandResult&& result) {
+            if (!result.accepted) {
+                respond(error_response(400, result.error));
+                return;
+            }
+            
+            // Return success response with order ID and the fills it generated
+            utils::JsonBuilder json;
+            json.start_object()
+                .add_string("status", "success")
+                .add_number("order_id", static_cast<int64_t>(result.order_id));
+            serialize_fills(json, result.fills);
+            json.end_object();
+            
+            api::HttpResponse response;
+            response.body = json.build();
+            respond(std::move(response));
+        });
     } catch (const std::exception& e) {
         // Return error response for invalid orders
+        respond(error_response(400, e.what()));
+    }
+}
+
+// POST /api/orders/batch - Submit orders and cancels in one request, with one
+// handoff to each matching shard involved instead of one per order
+void TradingApi::submit_batch(const api::HttpRequest& request, api::HttpResponder respond) {
+    try {
+        std::vector<engine::Command> commands;
+        parse_batch_request(request.body, request_symbol(request), commands);
+        std::vector<engine::CommandType> types(commands.size());
+        for (size_t i = 0; i < commands.size(); ++i) {
+            types[i] = commands[i].type;
+        }
+        engine_->submit_batch(std::move(commands), [respond, types = std::move(types)](
+                                  std::vector<engine::CommandResult>&& results) {
+            utils::JsonBuilder json;
+            json.reserve(64 + results.size() * 64);
+            json.start_object()
+                .add_string("status", "success")
+                .start_array("results");
+            // One entry per item, in order, shaped like the POST /api/orders response
+            for (size_t i = 0; i < results.size(); ++i) {
+                const engine::CommandResult& result = results[i];
+                json.start_object()
+                    .add_string("status", result.accepted ? "success" : "error");
+                // A rejected new order's id was never live, so it is left out
+                bool new_order = types[i] == engine::CommandType::NEW_ORDER;
+                if (result.order_id != 0 && (result.accepted || !new_order)) {
+                    json.add_number("order_id", static_cast<int64_t>(result.order_id));
+                }
+                if (!result.accepted) {
+                    json.add_string("error", result.error);
+                } else if (types[i] != engine::CommandType::CANCEL_ORDER) {
+                    serialize_fills(json, result.fills);
+                }
+                json.end_object();
+            }
+            json.end_array().end_object();
+            
+            api::HttpResponse response;
+            response.body = json.build();
+            respond(std::move(response));
+        });
+    } catch (const std::exception& e) {
+        respond(error_response(400, e.what()));
+    }
+}
+
+// DELETE /api/orders/{order_id} - Cancel a resting order
+void TradingApi::cancel_order(const api::HttpRequest& request, api::HttpResponder respond) {
+    uint64_t order_id = 0;
+    try {
+        order_id = path_order_id(request);
+    } catch (const std::exception& e) {
+        respond(error_response(400, e.what()));
+        return;
+    }
+    try {
+        engine_->cancel(order_id, [this, respond, order_id](engine::CommandResult&& result) {
+            if (!result.accepted) {
+                respond(error_response(result.error == "Order not found" ? 404 : 400, result.error));
+                return;
+            }
+            
+            api::HttpResponse response;
+            response.body = utils::JsonBuilder().start_object()
+                .add_string("status", "success")
+                .add_number("order_id", static_cast<int64_t>(order_id))
+                .end_object().build();
+            respond(std::move(response));
+        });
+    } catch (const std::invalid_argument& e) {
+        // An id no instrument could have issued
+        respond(error_response(404, e.what()));
+    }
+}
+
+// PATCH /api/orders/{order_id} - Amend a resting order's price and quantity.
+// A quantity reduction at the same price keeps the order's place in the
+// queue; any other change moves it to the back of the new price level,
+// matching first if it now crosses.
+void TradingApi::amend_order(const api::HttpRequest& request, api::HttpResponder respond) {
+    uint64_t order_id = 0;
+    OrderRequest amend_request;
+    try {
+        order_id = path_order_id(request);
+        parse_amend_request(request.body, amend_request);
+    } catch (const std::exception& e) {
+        respond(error_response(400, e.what()));
+        return;
+    }
+    try {
+        engine_->amend(order_id, amend_request.quantity, amend_request.price,
+                       [this, respond, order_id](engine::CommandResult&& result) {
+            if (!result.accepted) {
+                respond(error_response(result.error == "Order not found" ? 404 : 400, result.error));
+                return;
+            }
+            
+            utils::JsonBuilder json;
+            json.start_object()
+                .add_string("status", "success")
+                .add_number("order_id", static_cast<int64_t>(order_id));
+            serialize_fills(json, result.fills);
+            json.end_object();
+            
+            api::HttpResponse response;
+            response.body = json.build();
+            respond(std::move(response));
+        });
+    } catch (const std::invalid_argument& e) {
+        respond(error_response(404, e.what()));
+    }
+}
+
+// GET /api/market-summary - Retrieve market statistics from the latest snapshot
+api::HttpResponse TradingApi::get_market_summary(const api::HttpRequest& request) {
+    try {
         api::HttpResponse response;
-        response.status_code = 400;
-        response.body = "{\"error\": \"" + std::string(e.what()) + "\"}";
+        response.body = serialize_market_summary(*engine_->snapshot(request_symbol(request)));
         return response;
+    } catch (const std::exception& e) {
+        return error_response(400, e.what());
     }
 }
 
-// GET /api/market-summary - Retrieve market statistics and summary
-api::HttpResponse TradingApi::get_market_summary(const api::HttpRequest& request) {
-    std::lock_guard<std::mutex> lock(order_book_mutex_);
-    
-    api::HttpResponse response;
-    response.body = serialize_market_summary();
-    return response;
+int64_t TradingApi::query_int(const api::HttpRequest& request, std::string_view name, int64_t fallback) const {
+    std::string scratch;
+    std::string_view text = request.query_param(name, scratch);
+    if (text.empty()) {
+        return fallback;
+    }
+    int64_t value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        throw std::invalid_argument("Invalid " + std::string(name) + ": " + std::string(text));
+    }
+    return value;
 }
 
-// WebSocket broadcasting methods (to be implemented with WebSocket server)
-void TradingApi::broadcast_order_book_update() {
-    // TODO: Implement WebSocket broadcasting for real-time order book updates
+uint64_t TradingApi::path_order_id(const api::HttpRequest& request) {
+    std::string_view text = request.path_param("order_id");
+    uint64_t order_id = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), order_id);
+    if (error != std::errc() || end != text.data() + text.size() || order_id == 0) {
+        throw std::invalid_argument("Invalid order id: " + std::string(text));
+    }
+    return order_id;
+}
+
+std::string TradingApi::request_symbol(const api::HttpRequest& request) const {
+    // /api/orderbook/AAPL and /api/orderbook?symbol=AAPL are equivalent
+    std::string_view symbol = request.path_param("symbol");
+    std::string scratch;
+    if (symbol.empty()) {
+        symbol = request.query_param("symbol", scratch);
+    }
+    return symbol.empty() ? default_symbol_ : std::string(symbol);
 }
 
-void TradingApi::broadcast_trade_update(const trade::Trade& trade) {
-    // TODO: Implement WebSocket broadcasting for real-time trade notifications
+api::HttpResponse TradingApi::error_response(int status_code, const std::string& message) const {
+    api::HttpResponse response;
+    response.status_code = status_code;
+    // The message may quote request input, so it goes through the escaping writer
+    response.body = utils::JsonBuilder().start_object().add_string("error", message).end_object().build();
+    return response;
 }
 
 // Serialize order book data to JSON format for API response
-std::string TradingApi::serialize_order_book() {
+std::string TradingApi::serialize_order_book(const engine::BookSnapshot& snapshot) {
     utils::JsonBuilder json;
-    json.start_object();
+    // A level is about 35 bytes; sizing up front saves the regrowth copies
+    json.reserve(80 + 40 * (snapshot.bids.size() + snapshot.asks.size()));
+    serialize_order_book(json, snapshot);
+    return json.build();
+}
+
+void TradingApi::serialize_order_book(utils::JsonBuilder& json, const engine::BookSnapshot& snapshot,
+                                      std::string_view key) {
+    json.start_object(key)
+        .add_string("symbol", snapshot.symbol)
+        .add_number("version", static_cast<int64_t>(snapshot.version))
+        .add_number("seq", static_cast<int64_t>(snapshot.sequence));
     
-    // Serialize buy orders (aggregated by price level)
+    // Serialize buy orders (per-level aggregates maintained by the book)
     json.start_array("buy_orders");
-    const auto& buy_orders = order_book_->get_buy_orders();
-    for (const auto& level : buy_orders) {
-        double total_quantity = 0;
-        for (const auto& order : level.second) {
-            total_quantity += order.quantity;
-        }
+    for (const auto& level : snapshot.bids) {
         json.start_object()
-            .add_number("price", level.first)
-            .add_number("quantity", total_quantity)
+            .add_number("price", level.price)
+            .add_number("quantity", level.quantity)
             .end_object();
     }
     json.end_array();
     
-    // Serialize sell orders (aggregated by price level)
+    // Serialize sell orders (per-level aggregates maintained by the book)
     json.start_array("sell_orders");
-    const auto& sell_orders = order_book_->get_sell_orders();
-    for (const auto& level : sell_orders) {
-        double total_quantity = 0;
-        for (const auto& order : level.second) {
-            total_quantity += order.quantity;
-        }
+    for (const auto& level : snapshot.asks) {
         json.start_object()
-            .add_number("price", level.first)
-            .add_number("quantity", total_quantity)
+            .add_number("price", level.price)
+            .add_number("quantity", level.quantity)
             .end_object();
     }
     json.end_array();
     
     json.end_object();
-    return json.build();
 }
 
 // Serialize trade history to JSON format for API response
-std::string TradingApi::serialize_trades() {
+std::string TradingApi::serialize_trades(const order_book::OrderBook& book, int64_t since_trade_id, size_t limit) {
+    const auto& trades = book.get_trades();
     utils::JsonBuilder json;
+    json.reserve(2 + 160 * std::min(limit, trades.size()));
     json.start_array();
     
-    const auto& trades = order_book_->get_trades();
-    for (const auto& trade : trades) {
-        json.start_object()
-            .add_number("trade_id", static_cast<int64_t>(trade.trade_id))
-            .add_number("buy_order_id", static_cast<int64_t>(trade.buy_order_id))
-            .add_number("sell_order_id", static_cast<int64_t>(trade.sell_order_id))
-            .add_number("quantity", static_cast<int64_t>(trade.quantity))
-            .add_number("price", trade.price)
-            .add_number("timestamp", static_cast<int64_t>(trade.timestamp))
-            .end_object();
+    auto write = [&](const trade::Trade& trade) { serialize_trade(json, trade); };
+    if (since_trade_id < 0) {
+        trades.for_each_latest(limit, write);
+    } else {
+        trades.for_each_since(since_trade_id, limit, write);
     }
     
     json.end_array();
     return json.build();
 }
 
-std::string TradingApi::serialize_market_summary() {
-    std::lock_guard<std::mutex> lock(order_book_mutex_);
-    
-    const auto& buy_orders = order_book_->get_buy_orders();
-    const auto& sell_orders = order_book_->get_sell_orders();
-    const auto& trades = order_book_->get_trades();
-    
-    // Calculate statistics
-    int total_trades = trades.size();
-    double total_volume = 0;
-    double total_value = 0;
-    
+std::string TradingApi::serialize_trades(const std::vector<trade::Trade>& trades) {
+    utils::JsonBuilder json;
+    json.reserve(2 + 160 * trades.size());
+    json.start_array();
     for (const auto& trade : trades) {
-        total_volume += trade.quantity;
-        total_value += trade.price * trade.quantity;
+        serialize_trade(json, trade);
     }
-    
-    double avg_trade_size = total_trades > 0 ? total_volume / total_trades : 0;
-    double avg_price = total_volume > 0 ? total_value / total_volume : 0;
-    
-    double buy_depth = 0;
-    double sell_depth = 0;
-    
-    for (const auto& level : buy_orders) {
-        for (const auto& order : level.second) {
-            buy_depth += order.quantity;
-        }
+    json.end_array();
+    return json.build();
+}
+
+// Append the fills of a single submission as a "fills" array
+void TradingApi::serialize_fills(utils::JsonBuilder& json, const std::vector<trade::Trade>& fills) {
+    json.start_array("fills");
+    for (const auto& trade : fills) {
+        serialize_trade(json, trade);
     }
+    json.end_array();
+}
+
+void TradingApi::serialize_trade(utils::JsonBuilder& json, const trade::Trade& trade, std::string_view key) {
+    json.start_object(key)
+        .add_number("trade_id", static_cast<int64_t>(trade.trade_id))
+        .add_number("buy_order_id", static_cast<int64_t>(trade.buy_order_id))
+        .add_number("sell_order_id", static_cast<int64_t>(trade.sell_order_id))
+        .add_number("quantity", static_cast<int64_t>(trade.quantity))
+        .add_number("price", trade.price)
+        .add_number("timestamp", static_cast<int64_t>(trade.timestamp))
+        .add_string("symbol", trade.symbol)
+        .end_object();
+}
+
+std::string TradingApi::serialize_market_summary(const engine::BookSnapshot& snapshot) {
+    // Every figure below is a running total kept by the order book, so this
+    // is O(1) regardless of depth.
+    int64_t total_trades = snapshot.trade_count;
+    double total_volume = static_cast<double>(snapshot.traded_volume);
+    double total_value = snapshot.traded_value;
     
-    for (const auto& level : sell_orders) {
-        for (const auto& order : level.second) {
-            sell_depth += order.quantity;
-        }
-    }
+    double avg_trade_size = total_trades > 0 ? total_volume / static_cast<double>(total_trades) : 0;
+    double avg_price = total_volume > 0 ? total_value / total_volume : 0;
     
     utils::JsonBuilder json;
     json.start_object()
-        .add_number("total_trades", static_cast<int64_t>(total_trades))
+        .add_number("total_trades", total_trades)
         .add_number("total_volume", total_volume)
         .add_number("avg_trade_size", avg_trade_size)
         .add_number("avg_price", avg_price)
-        .add_number("buy_depth", buy_depth)
-        .add_number("sell_depth", sell_depth)
+        .add_number("buy_depth", snapshot.buy_depth)
+        .add_number("sell_depth", snapshot.sell_depth)
         .end_object();
     
     return json.build();
 }
 
-// Parse and validate order from JSON request body
-order::Order TradingApi::parse_order_from_json(const std::string& json_body) {
-    utils::JsonParser parser(json_body);
+void TradingApi::parse_order_request(std::string_view body, OrderRequest& order) {
+    utils::JsonReader reader(body);
+    read_order_request(reader, order);
+    reader.end();
+    if (order.cancel || order.amend) {
+        throw std::invalid_argument(std::string("Invalid order type: ") + (order.cancel ? "CANCEL" : "AMEND"));
+    }
+}
+
+void TradingApi::parse_amend_request(std::string_view body, OrderRequest& order) {
+    utils::JsonReader reader(body);
+    read_order_request(reader, order, "AMEND");
+    reader.end();
+}
+
+void TradingApi::parse_batch_request(std::string_view body, const std::string& default_symbol,
+                                     std::vector<engine::Command>& commands) {
+    commands.clear();
+    utils::JsonReader reader(body);
+    reader.begin_array();
+    OrderRequest item;
+    while (reader.next_element()) {
+        if (commands.size() == MAX_BATCH_SIZE) {
+            throw std::invalid_argument("Batch has more than " + std::to_string(MAX_BATCH_SIZE) + " items");
+        }
+        try {
+            item = OrderRequest();
+            read_order_request(reader, item);
+        } catch (const std::invalid_argument& e) {
+            throw std::invalid_argument("Item " + std::to_string(commands.size()) + ": " + e.what());
+        }
+        
+        commands.emplace_back();
+        engine::Command& command = commands.back();
+        if (item.cancel) {
+            command.type = engine::CommandType::CANCEL_ORDER;
+            command.order_id = item.order_id;
+            continue;
+        }
+        if (item.amend) {
+            command.type = engine::CommandType::AMEND_ORDER;
+            command.order_id = item.order_id;
+            command.quantity = item.quantity;
+            command.price = item.price;
+            continue;
+        }
+        command.type = engine::CommandType::NEW_ORDER;
+        command.order.order_id = 0;
+        command.order.type = item.type;
+        command.order.quantity = item.quantity;
+        command.order.price = item.price;
+        command.order.client_id = std::string(item.client_id);
+        command.order.symbol = item.symbol.empty() ? default_symbol : std::string(item.symbol);
+        command.order.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count());
+    }
+    reader.end();
+    if (commands.empty()) {
+        throw std::invalid_argument("Empty batch");
+    }
+}
+
+void TradingApi::read_order_request(utils::JsonReader& reader, OrderRequest& order, std::string_view implied_type) {
+    // Plain unsigned bits, so the ternary below mixes no enum with 0
+    constexpr unsigned TYPE = 1, PRICE = 2, QUANTITY = 4, SYMBOL = 8, CLIENT_ID = 16, ORDER_ID = 32;
+    unsigned seen = 0;
+    std::string_view type = implied_type;
+    std::string type_storage;
+    double quantity = 0;
     
-    order::Order order;
-    // Generate unique order ID using current timestamp
-    order.order_id = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()
-    ).count());
+    reader.begin_object();
+    std::string_view key;
+    while (reader.next_key(key)) {
+        unsigned field = key == "type" ? TYPE : key == "price" ? PRICE : key == "quantity" ? QUANTITY
+                       : key == "symbol" ? SYMBOL : key == "client_id" ? CLIENT_ID
+                       : key == "order_id" ? ORDER_ID : 0;
+        if (field == 0) {
+            reader.skip_value();
+            continue;
+        }
+        if (field == TYPE && !implied_type.empty()) {
+            reader.fail("unexpected member \"type\"");
+        }
+        if (seen & field) {
+            reader.fail("duplicate member \"" + std::string(key) + "\"");
+        }
+        seen |= field;
+        switch (field) {
+            case TYPE: type = reader.read_string(type_storage); break;
+            case PRICE: order.price = reader.read_number(); break;
+            case QUANTITY: quantity = reader.read_number(); break;
+            case SYMBOL: order.symbol = reader.read_string(order.symbol_storage); break;
+            case CLIENT_ID: order.client_id = reader.read_string(order.client_id_storage); break;
+            case ORDER_ID: order.order_id = reader.read_uint64(); break;
+        }
+    }
+    
+    // The journal and snapshots keep client ids in fixed fields, so a longer
+    // one would come back cut short after a restart
+    if (order.client_id.size() > persistence::JournalRecord::MAX_CLIENT_ID_LENGTH) {
+        throw std::invalid_argument("client_id is longer than " +
+                                    std::to_string(persistence::JournalRecord::MAX_CLIENT_ID_LENGTH) + " bytes");
+    }
     
-    // Parse and validate order type
-    std::string type_str = parser.get_string("type");
-    if (type_str == "BUY") {
+    if (type == "CANCEL") {
+        if (!(seen & ORDER_ID)) {
+            throw std::invalid_argument("Missing order_id");
+        }
+        order.cancel = true;
+        return;
+    }
+    if (type == "AMEND") {
+        // The body of PATCH /api/orders/{order_id} names the order in the path
+        if (implied_type.empty() && !(seen & ORDER_ID)) {
+            throw std::invalid_argument("Missing order_id");
+        }
+        order.amend = true;
+    } else if (type == "BUY") {
         order.type = order::OrderType::BUY;
-    } else if (type_str == "SELL") {
+    } else if (type == "SELL") {
         order.type = order::OrderType::SELL;
     } else {
-        throw std::invalid_argument("Invalid order type: " + type_str);
+        throw std::invalid_argument("Invalid order type: " + std::string(type));
     }
-    
-    // Parse order parameters
-    double quantity = parser.get_number("quantity");
-    order.price = parser.get_number("price");
-    order.client_id = parser.get_string("client_id");
-    order.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()
-    ).count());
-    
-    // Validate order parameters
-    if (quantity <= 0 || order.price <= 0) {
-        throw std::invalid_argument("Invalid quantity or price: quantity=" + std::to_string(quantity) + ", price=" + std::to_string(order.price));
+    if (!(seen & PRICE) || !(seen & QUANTITY)) {
+        throw std::invalid_argument(!(seen & PRICE) ? "Missing price" : "Missing quantity");
     }
     
-    // Convert quantity to uint64_t (round to nearest integer)
-    order.quantity = static_cast<uint64_t>(quantity + 0.5);
+    // Validate order parameters; the quantity must round to at least 1
+    if (!(quantity >= 0.5 && quantity < std::numeric_limits<int>::max()) || !(order.price > 0)) {
+        throw std::invalid_argument("Invalid quantity or price: quantity=" + std::to_string(quantity) +
+                                    ", price=" + std::to_string(order.price));
+    }
     
-    return order;
+    // Round quantity to the nearest whole number
+    order.quantity = static_cast<int>(quantity + 0.5);
 }
 
 } // namespace api
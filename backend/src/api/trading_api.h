@@ -3,46 +3,120 @@
  * 
  * Provides REST API endpoints for the trading engine, handling HTTP requests
  * for order book data, trade history, order submission, and market statistics.
- * Manages thread-safe access to the order book and JSON serialization.
+ * Requests are routed by symbol to the matching engine, which owns one order
+ * book per instrument; handlers never touch a book directly.
  */
 
 #pragma once
 
 #include "http_server.h"
-#include "../order_book/order_book.h"
+#include "../engine/matching_engine.h"
 #include "../utils/json_utils.h"
 #include <memory>
-#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace api {
 
+// Decoded POST /api/orders body (or PATCH /api/orders/{order_id} body,
+// which has only price and quantity). The string views point into the request
+// body, or into the *_storage strings for values that contained escapes.
+struct OrderRequest {
+    order::OrderType type = order::OrderType::BUY;
+    double price = 0;
+    int quantity = 0;
+    std::string_view symbol;        // empty if the body names none
+    std::string_view client_id;
+    std::string symbol_storage;
+    std::string client_id_storage;
+    bool cancel = false;            // {"type": "CANCEL", "order_id": N}, batches only
+    bool amend = false;             // {"type": "AMEND", "order_id": N, ...}, batches only
+    uint64_t order_id = 0;
+};
+
 class TradingApi {
 private:
-    // Core order book instance with thread-safe access
-    std::unique_ptr<order_book::OrderBook> order_book_;
-    std::mutex order_book_mutex_;
+    // Sharded matching engine with one order book per registered symbol
+    std::unique_ptr<engine::MatchingEngine> engine_;
+    std::string default_symbol_;
+    engine::RecoveryStats recovery_;
     
 public:
-    TradingApi();
+    static constexpr const char* DEFAULT_SYMBOL = "DEMO";
+    static constexpr int64_t DEFAULT_TRADE_LIMIT = 100;
+    static constexpr size_t MAX_BATCH_SIZE = 1000;
+    
+    // The first symbol is used when a request does not name one.
+    // num_shards == 0 runs one matching thread per hardware thread.
+    // With a journal directory the books are replayed from it on startup.
+    explicit TradingApi(const std::vector<std::string>& symbols = {DEFAULT_SYMBOL}, size_t num_shards = 0,
+                        const persistence::JournalConfig& journal = persistence::JournalConfig());
+    ~TradingApi();
     
-    // REST API endpoint handlers
+    const engine::RecoveryStats& recovery_stats() const { return recovery_; }
+    // For other order-entry paths (the binary gateway) to share the books
+    engine::MatchingEngine& engine() { return *engine_; }
+    
+    // REST API endpoint handlers; all accept the symbol as a {symbol} path
+    // segment or an optional ?symbol= parameter, and get_trades also
+    // ?since_trade_id= and ?limit= (reading trades older than the book
+    // keeps from the journal). Those that need a matching shard are
+    // asynchronous routes and answer through respond, from the matching
+    // thread once the shard has applied (and journaled) the command.
     api::HttpResponse get_order_book(const api::HttpRequest& request);
-    api::HttpResponse get_trades(const api::HttpRequest& request);
-    api::HttpResponse submit_order(const api::HttpRequest& request);
+    void get_trades(const api::HttpRequest& request, api::HttpResponder respond);
+    void submit_order(const api::HttpRequest& request, api::HttpResponder respond);
+    void submit_batch(const api::HttpRequest& request, api::HttpResponder respond);
+    // DELETE and PATCH /api/orders/{order_id}; no symbol needed, the order
+    // id names its instrument
+    void cancel_order(const api::HttpRequest& request, api::HttpResponder respond);
+    void amend_order(const api::HttpRequest& request, api::HttpResponder respond);
     api::HttpResponse get_market_summary(const api::HttpRequest& request);
     
-    // WebSocket broadcasting methods (for real-time updates)
-    void broadcast_order_book_update();
-    void broadcast_trade_update(const trade::Trade& trade);
+    // JSON serialization; static and public so the bench can time them
+    // without an engine
+    static std::string serialize_order_book(const engine::BookSnapshot& snapshot);
+    // The same object, as a member named key when key is not empty; "seq"
+    // is the last book_delta of the market data feed it includes
+    static void serialize_order_book(utils::JsonBuilder& json, const engine::BookSnapshot& snapshot,
+                                     std::string_view key = {});
+    static std::string serialize_trades(const order_book::OrderBook& book, int64_t since_trade_id, size_t limit);
+    static std::string serialize_trades(const std::vector<trade::Trade>& trades);
+    static std::string serialize_market_summary(const engine::BookSnapshot& snapshot);
+    static void serialize_fills(utils::JsonBuilder& json, const std::vector<trade::Trade>& fills);
+    // A trade object, as a member named key when key is not empty
+    static void serialize_trade(utils::JsonBuilder& json, const trade::Trade& trade, std::string_view key = {});
+    
+    // Decodes and validates an order body in one pass without allocating
+    // (unless a string has escapes). Fields: "type" ("BUY"/"SELL"),
+    // "price" and "quantity" (required, positive; quantity is rounded to a
+    // whole number), "symbol" and "client_id" (optional, at most
+    // JournalRecord::MAX_CLIENT_ID_LENGTH bytes); others are ignored. Throws std::invalid_argument, with the byte offset for
+    // malformed JSON.
+    static void parse_order_request(std::string_view body, OrderRequest& order);
+    // Decodes an amend body: "price" and "quantity", both required and
+    // validated as for an order
+    static void parse_amend_request(std::string_view body, OrderRequest& order);
+    // Decodes a POST /api/orders/batch body: a JSON array of 1 to
+    // MAX_BATCH_SIZE items, each an order as above,
+    // {"type": "CANCEL", "order_id": N} or
+    // {"type": "AMEND", "order_id": N, "price": P, "quantity": Q}, into
+    // engine commands; orders without a symbol go to default_symbol. Throws std::invalid_argument
+    // naming the offending item.
+    static void parse_batch_request(std::string_view body, const std::string& default_symbol,
+                                    std::vector<engine::Command>& commands);
     
 private:
-    // JSON serialization methods
-    std::string serialize_order_book();
-    std::string serialize_trades();
-    std::string serialize_market_summary();
+    // implied_type stands in for a body without a "type" member
+    static void read_order_request(utils::JsonReader& reader, OrderRequest& order,
+                                   std::string_view implied_type = std::string_view());
+    static uint64_t path_order_id(const api::HttpRequest& request);
     
-    // JSON parsing and validation
-    order::Order parse_order_from_json(const std::string& json_body);
+    std::string request_symbol(const api::HttpRequest& request) const;
+    // Integer query parameter; throws std::invalid_argument if it is not a number
+    int64_t query_int(const api::HttpRequest& request, std::string_view name, int64_t fallback) const;
+    api::HttpResponse error_response(int status_code, const std::string& message) const;
 };
 
 } // namespace api
@@ -0,0 +1,77 @@
+/**
+ * Published Order Book Snapshots
+ * 
+ * Immutable, aggregated view of one instrument's book. The matching thread
+ * captures a new snapshot after each batch that touched the book and publishes
+ * it with an atomic shared_ptr swap, so readers never queue behind order flow
+ * or touch the live book.
+ *
+ * While book listeners are registered, the batch's changed levels are also
+ * published as a BookDelta. Deltas are numbered per instrument, and each
+ * snapshot carries the number of the last delta it includes, so a consumer
+ * can start from any snapshot and apply the deltas numbered after it.
+ */
+
+#pragma once
+
+#include "../order_book/order_book.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace engine {
+
+struct LevelSnapshot {
+    double price;
+    int64_t quantity;
+    uint32_t order_count;
+};
+
+// The levels of one book that changed in one matching batch, with their new
+// aggregates (quantity 0: the level is gone)
+struct BookDelta {
+    std::string symbol;
+    uint64_t sequence = 0;                  // 1, 2, ... per instrument
+    std::vector<order_book::LevelUpdate> levels;
+};
+
+struct BookSnapshot {
+    std::string symbol;
+    uint64_t version = 0;                   // bumped on every publish
+    uint64_t sequence = 0;                  // last BookDelta included
+    std::vector<LevelSnapshot> bids;        // best (highest) first
+    std::vector<LevelSnapshot> asks;        // best (lowest) first
+    int64_t buy_depth = 0;
+    int64_t sell_depth = 0;
+    int64_t trade_count = 0;                // all trades, not just the retained history
+    int64_t first_trade_id = 0;             // oldest trade the book still holds (trade_count if none)
+    int64_t traded_volume = 0;
+    double traded_value = 0;
+    
+    static std::shared_ptr<const BookSnapshot> capture(const order_book::OrderBook& book,
+                                                       const std::string& symbol, uint64_t version,
+                                                       uint64_t sequence = 0) {
+        auto snapshot = std::make_shared<BookSnapshot>();
+        snapshot->symbol = symbol;
+        snapshot->version = version;
+        snapshot->sequence = sequence;
+        snapshot->bids.reserve(book.get_buy_orders().size());
+        for (const auto& level : book.get_buy_orders()) {
+            snapshot->bids.push_back({level.price, level.total_quantity, level.order_count});
+        }
+        snapshot->asks.reserve(book.get_sell_orders().size());
+        for (const auto& level : book.get_sell_orders()) {
+            snapshot->asks.push_back({level.price, level.total_quantity, level.order_count});
+        }
+        snapshot->buy_depth = book.get_buy_depth();
+        snapshot->sell_depth = book.get_sell_depth();
+        snapshot->trade_count = book.get_next_trade_id();
+        snapshot->first_trade_id = book.get_trades().empty() ? book.get_next_trade_id() : book.get_trades().first_id();
+        snapshot->traded_volume = book.get_traded_volume();
+        snapshot->traded_value = book.get_traded_value();
+        return snapshot;
+    }
+};
+
+} // namespace engine
@@ -0,0 +1,114 @@
+/**
+ * Matching Engine Commands
+ * 
+ * Defines the commands that gateway threads hand to a shard's matching thread,
+ * the result each command completes with, and the order id layout that lets any
+ * order id be routed back to its instrument without a lookup.
+ */
+
+#pragma once
+
+#include "../order_book/order_book.h"
+#include "book_snapshot.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace engine {
+
+// Order ids carry the instrument index in their low bits and a per-instrument
+// sequence number above it.
+constexpr int SYMBOL_INDEX_BITS = 16;
+constexpr uint32_t MAX_SYMBOLS = 1u << SYMBOL_INDEX_BITS;
+
+inline uint64_t make_order_id(uint64_t sequence, uint32_t symbol_index) {
+    return (sequence << SYMBOL_INDEX_BITS) | symbol_index;
+}
+
+inline uint32_t symbol_index_of(uint64_t order_id) {
+    return static_cast<uint32_t>(order_id & (MAX_SYMBOLS - 1));
+}
+
+// One tradable instrument. The book is only ever touched by the matching
+// thread of the shard it is pinned to; other threads read the snapshot,
+// which is only accessed through std::atomic_load/atomic_store.
+struct Instrument {
+    std::string symbol;
+    uint32_t index = 0;
+    size_t shard = 0;
+    uint64_t next_sequence = 1;
+    std::unique_ptr<order_book::OrderBook> book;
+    std::shared_ptr<const BookSnapshot> snapshot;
+    uint64_t book_sequence = 0;         // last BookDelta published
+    bool dirty = false;
+};
+
+enum class CommandType {
+    NEW_ORDER,
+    CANCEL_ORDER,
+    AMEND_ORDER,
+    QUERY,
+    BATCH
+};
+
+struct CommandResult {
+    bool accepted = true;
+    std::string error;
+    uint64_t order_id = 0;
+    std::vector<trade::Trade> fills;    // NEW_ORDER, and AMEND_ORDER when re-priced
+    std::vector<CommandResult> items;   // BATCH: one result per command, in order
+};
+
+// Invoked on the matching thread once the command has been applied; it must
+// not block (hand the result off to another thread instead).
+using Completion = std::function<void(CommandResult&&)>;
+
+// A batch's results, in the commands' order; invoked like a Completion, on
+// the thread of the last shard to finish
+using BatchCompletion = std::function<void(std::vector<CommandResult>&&)>;
+
+// Invoked on a shard's matching thread with the trades of each batch, once
+// the batch is journaled. Trades and the batch's completions are delivered
+// in execution order: a listener is called with the trades executed before
+// each completion, then that completion runs, so a consumer fed by both
+// sees an order acknowledged before any trade against it and a cancel after
+// every fill that preceded it. Shards call it concurrently; like a
+// Completion it must not block.
+using TradeListener = std::function<void(const trade::Trade* trades, size_t count)>;
+
+// Invoked on a shard's matching thread with the level changes of each book
+// a batch changed, after the batch's completions and trades (and after the
+// snapshot that includes them is published); must not block.
+using BookListener = std::function<void(const std::shared_ptr<const BookDelta>& delta)>;
+
+// Invoked on a shard's matching thread with the order updates of each
+// batch (entries, fills on both sides, amends and cancels, in execution
+// order), after its trades; must not block.
+using OrderListener = std::function<void(const order_book::OrderUpdate* updates, size_t count)>;
+
+// Everything registered through MatchingEngine::add_*_listener, published
+// to the shards as one copy-on-write list
+struct Listeners {
+    std::vector<TradeListener> trades;
+    std::vector<BookListener> books;
+    std::vector<OrderListener> orders;
+};
+
+struct Command {
+    CommandType type = CommandType::NEW_ORDER;
+    Instrument* instrument = nullptr;
+    order::Order order;                                           // NEW_ORDER
+    uint64_t order_id = 0;                                        // CANCEL_ORDER, AMEND_ORDER
+    int quantity = 0;                                             // AMEND_ORDER: new open quantity
+    double price = 0;                                             // AMEND_ORDER: new price
+    std::function<void(const order_book::OrderBook&)> query;      // QUERY
+    // BATCH: NEW_ORDER, CANCEL_ORDER and AMEND_ORDER commands for
+    // instruments on one shard, applied back to back; their own
+    // completions are not called
+    std::vector<Command> batch;
+    Completion on_complete;                                       // optional
+};
+
+} // namespace engine
@@ -0,0 +1,401 @@
+/**
+ * Multi-Symbol Matching Engine Implementation
+ * 
+ * Instruments are assigned to shards round-robin in registration order, which
+ * keeps the symbol -> shard mapping deterministic across restarts.
+ */
+
+#include "matching_engine.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+namespace engine {
+
+MatchingEngine::MatchingEngine(size_t num_shards, bool pin_threads) {
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    if (num_shards == 0) {
+        num_shards = cpus;
+    }
+    
+    for (size_t i = 0; i < num_shards; ++i) {
+        int cpu = pin_threads ? static_cast<int>(i % cpus) : -1;
+        shards_.push_back(std::make_unique<Shard>(i, cpu));
+    }
+}
+
+MatchingEngine::~MatchingEngine() {
+    stop();
+}
+
+void MatchingEngine::add_symbol(const std::string& symbol, double tick_size) {
+    if (started_) {
+        throw std::logic_error("Symbols must be registered before the engine starts");
+    }
+    if (instruments_by_symbol_.count(symbol)) {
+        throw std::invalid_argument("Duplicate symbol: " + symbol);
+    }
+    if (instruments_.size() >= MAX_SYMBOLS) {
+        throw std::invalid_argument("Too many symbols");
+    }
+    
+    auto instrument = std::make_unique<Instrument>();
+    instrument->symbol = symbol;
+    instrument->index = static_cast<uint32_t>(instruments_.size());
+    instrument->shard = instruments_.size() % shards_.size();
+    instrument->book = std::make_unique<order_book::OrderBook>(tick_size);
+    instrument->snapshot = BookSnapshot::capture(*instrument->book, symbol, 0);
+    
+    shards_[instrument->shard]->add_instrument(instrument.get());
+    instruments_by_symbol_[symbol] = instrument.get();
+    symbols_.push_back(symbol);
+    instruments_.push_back(std::move(instrument));
+}
+
+bool MatchingEngine::has_symbol(const std::string& symbol) const {
+    return instruments_by_symbol_.count(symbol) > 0;
+}
+
+RecoveryStats MatchingEngine::open_journal(const persistence::JournalConfig& config) {
+    if (started_) {
+        throw std::logic_error("The journal must be opened before the engine starts");
+    }
+    for (const auto& symbol : symbols_) {
+        if (symbol.size() > persistence::JournalRecord::MAX_SYMBOL_LENGTH) {
+            throw std::invalid_argument("Symbol too long to journal: " + symbol);
+        }
+    }
+    std::filesystem::create_directories(config.directory);
+    
+    RecoveryStats stats;
+    auto start_time = std::chrono::steady_clock::now();
+    auto shard_count = static_cast<uint32_t>(shards_.size());
+    for (uint32_t s = 0; s < shard_count; ++s) {
+        std::string path = persistence::Journal::shard_path(config.directory, s);
+        std::string snapshot_path = persistence::Journal::snapshot_path(config.directory, s);
+        uint64_t valid_length = 0;
+        {
+            // Load the latest snapshot, then replay only the journal written after it
+            persistence::SnapshotReader snapshot(snapshot_path, s, shard_count);
+            if (!snapshot.error().empty()) {
+                std::cerr << "Ignoring snapshot: " << snapshot.error() << std::endl;
+            }
+            auto reader = std::make_unique<persistence::JournalReader>(path, s, shard_count, snapshot.journal_length());
+            if (reader->behind()) {
+                std::cerr << "Ignoring snapshot " << snapshot_path << ": it is ahead of the journal" << std::endl;
+                reader = std::make_unique<persistence::JournalReader>(path, s, shard_count);
+            } else if (snapshot.loaded()) {
+                auto snapshot_start = std::chrono::steady_clock::now();
+                stats.snapshot_orders += snapshot.restore(
+                    [&](const std::string& symbol, double tick_size, uint64_t next_sequence) -> order_book::OrderBook& {
+                        Instrument& instrument = restore_target(symbol, s);
+                        if (tick_size != instrument.book->get_tick_size()) {
+                            throw std::runtime_error("Snapshot tick size for " + symbol + " does not match its registration");
+                        }
+                        instrument.next_sequence = next_sequence;
+                        return *instrument.book;
+                    });
+                stats.snapshot_seconds += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - snapshot_start).count();
+                ++stats.snapshots_loaded;
+            }
+            
+            persistence::JournalRecord record;
+            while (reader->next(record)) {
+                replay(record, s, stats);
+            }
+            valid_length = reader->valid_length();
+            if (reader->truncated()) {
+                ++stats.torn_journals;
+            }
+        }
+        shards_[s]->attach_journal(std::make_unique<persistence::Journal>(
+                                       path, s, shard_count, config.durability, valid_length),
+                                   shard_count, snapshot_path, config.snapshot_interval);
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    journal_directory_ = config.directory;
+    
+    for (auto& instrument : instruments_) {
+        if (instrument->book->order_count() > 0 || instrument->next_sequence > 1) {
+            instrument->snapshot = BookSnapshot::capture(*instrument->book, instrument->symbol, 1);
+        }
+    }
+    return stats;
+}
+
+void MatchingEngine::replay(const persistence::JournalRecord& record, size_t shard, RecoveryStats& stats) {
+    ++stats.records;
+    if (record.type == persistence::RecordType::TRADE) {
+        // Trades are regenerated by re-matching the orders; the records are
+        // kept for audit and history only
+        ++stats.trades;
+        return;
+    }
+    
+    Instrument& instrument = restore_target(record.symbol_name(), shard);
+    
+    if (record.type == persistence::RecordType::NEW_ORDER) {
+        ++stats.orders;
+        instrument.book->submit(record.to_order());
+        instrument.next_sequence = std::max(instrument.next_sequence, (record.order_id >> SYMBOL_INDEX_BITS) + 1);
+    } else if (record.type == persistence::RecordType::AMEND_ORDER) {
+        ++stats.amends;
+        std::vector<trade::Trade> fills;
+        instrument.book->amend_order(record.order_id, record.quantity, record.price, fills);
+    } else {
+        ++stats.cancels;
+        instrument.book->cancel_order(record.order_id);
+    }
+}
+
+Instrument& MatchingEngine::restore_target(const std::string& symbol, size_t shard) const {
+    auto it = instruments_by_symbol_.find(symbol);
+    if (it == instruments_by_symbol_.end()) {
+        throw std::runtime_error("Journal references unregistered symbol: " + symbol);
+    }
+    if (it->second->shard != shard) {
+        throw std::runtime_error("Symbol " + symbol + " moved to another shard; register symbols in the journal's original order");
+    }
+    return *it->second;
+}
+
+void MatchingEngine::start() {
+    if (started_) return;
+    started_ = true;
+    for (auto& shard : shards_) {
+        shard->start();
+    }
+}
+
+void MatchingEngine::stop() {
+    if (!started_) return;
+    // Shards drain whatever is already queued before their threads exit
+    for (auto& shard : shards_) {
+        shard->stop();
+    }
+    started_ = false;
+}
+
+void MatchingEngine::submit(order::Order order, Completion on_complete) {
+    Command command;
+    command.type = CommandType::NEW_ORDER;
+    command.instrument = &find_instrument(order.symbol);
+    command.order = std::move(order);
+    command.on_complete = std::move(on_complete);
+    dispatch(std::move(command));
+}
+
+void MatchingEngine::cancel(uint64_t order_id, Completion on_complete) {
+    Command command;
+    command.type = CommandType::CANCEL_ORDER;
+    command.instrument = &find_instrument(order_id);
+    command.order_id = order_id;
+    command.on_complete = std::move(on_complete);
+    dispatch(std::move(command));
+}
+
+void MatchingEngine::amend(uint64_t order_id, int quantity, double price, Completion on_complete) {
+    Command command;
+    command.type = CommandType::AMEND_ORDER;
+    command.instrument = &find_instrument(order_id);
+    command.order_id = order_id;
+    command.quantity = quantity;
+    command.price = price;
+    command.on_complete = std::move(on_complete);
+    dispatch(std::move(command));
+}
+
+std::future<CommandResult> MatchingEngine::submit(order::Order order) {
+    Command command;
+    command.type = CommandType::NEW_ORDER;
+    command.instrument = &find_instrument(order.symbol);
+    command.order = std::move(order);
+    return dispatch_with_future(std::move(command));
+}
+
+std::future<CommandResult> MatchingEngine::cancel(uint64_t order_id) {
+    Command command;
+    command.type = CommandType::CANCEL_ORDER;
+    command.instrument = &find_instrument(order_id);
+    command.order_id = order_id;
+    return dispatch_with_future(std::move(command));
+}
+
+std::future<CommandResult> MatchingEngine::amend(uint64_t order_id, int quantity, double price) {
+    Command command;
+    command.type = CommandType::AMEND_ORDER;
+    command.instrument = &find_instrument(order_id);
+    command.order_id = order_id;
+    command.quantity = quantity;
+    command.price = price;
+    return dispatch_with_future(std::move(command));
+}
+
+void MatchingEngine::submit_batch(std::vector<Command> commands, BatchCompletion on_complete) {
+    // Shared by the per-shard completions; the last one to finish delivers
+    struct BatchState {
+        std::vector<CommandResult> results;
+        std::atomic<size_t> pending{0};
+        BatchCompletion on_complete;
+    };
+    auto state = std::make_shared<BatchState>();
+    state->results.resize(commands.size());
+    state->on_complete = std::move(on_complete);
+    
+    // One BATCH command per shard, and where each of its items came from
+    std::vector<Command> batches(shards_.size());
+    std::vector<std::vector<size_t>> positions(shards_.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+        Command& command = commands[i];
+        try {
+            if (command.type == CommandType::NEW_ORDER) {
+                command.instrument = &find_instrument(command.order.symbol);
+            } else if (command.type == CommandType::CANCEL_ORDER || command.type == CommandType::AMEND_ORDER) {
+                command.instrument = &find_instrument(command.order_id);
+            } else {
+                throw std::invalid_argument("Only orders, cancels and amends can be batched");
+            }
+        } catch (const std::invalid_argument& e) {
+            state->results[i].accepted = false;
+            state->results[i].error = e.what();
+            continue;
+        }
+        size_t shard = command.instrument->shard;
+        batches[shard].batch.push_back(std::move(command));
+        positions[shard].push_back(i);
+    }
+    
+    size_t involved = 0;
+    for (const auto& batch : batches) {
+        involved += batch.batch.empty() ? 0 : 1;
+    }
+    if (involved == 0) {
+        state->on_complete(std::move(state->results));
+        return;
+    }
+    state->pending.store(involved, std::memory_order_relaxed);
+    for (size_t s = 0; s < batches.size(); ++s) {
+        if (batches[s].batch.empty()) continue;
+        batches[s].type = CommandType::BATCH;
+        batches[s].on_complete = [state, indexes = std::move(positions[s])](CommandResult&& result) {
+            for (size_t k = 0; k < indexes.size(); ++k) {
+                state->results[indexes[k]] = std::move(result.items[k]);
+            }
+            if (state->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                state->on_complete(std::move(state->results));
+            }
+        };
+        shards_[s]->enqueue(std::move(batches[s]));
+    }
+}
+
+std::future<std::vector<CommandResult>> MatchingEngine::submit_batch(std::vector<Command> commands) {
+    auto promise = std::make_shared<std::promise<std::vector<CommandResult>>>();
+    std::future<std::vector<CommandResult>> future = promise->get_future();
+    submit_batch(std::move(commands), [promise](std::vector<CommandResult>&& results) {
+        promise->set_value(std::move(results));
+    });
+    return future;
+}
+
+void MatchingEngine::query(const std::string& symbol, std::function<void(const order_book::OrderBook&)> fn,
+                           Completion on_complete) {
+    Command command;
+    command.type = CommandType::QUERY;
+    command.instrument = &find_instrument(symbol);
+    command.query = std::move(fn);
+    command.on_complete = std::move(on_complete);
+    dispatch(std::move(command));
+}
+
+std::future<CommandResult> MatchingEngine::query(const std::string& symbol,
+                                                 std::function<void(const order_book::OrderBook&)> fn) {
+    Command command;
+    command.type = CommandType::QUERY;
+    command.instrument = &find_instrument(symbol);
+    command.query = std::move(fn);
+    return dispatch_with_future(std::move(command));
+}
+
+// Copy on write: shards keep calling the lists they loaded for their
+// current batch while the new ones are published
+void MatchingEngine::add_trade_listener(TradeListener listener) {
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    auto listeners = listeners_ ? std::make_shared<Listeners>(*listeners_) : std::make_shared<Listeners>();
+    listeners->trades.push_back(std::move(listener));
+    publish_listeners(std::move(listeners));
+}
+
+void MatchingEngine::add_book_listener(BookListener listener) {
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    auto listeners = listeners_ ? std::make_shared<Listeners>(*listeners_) : std::make_shared<Listeners>();
+    listeners->books.push_back(std::move(listener));
+    publish_listeners(std::move(listeners));
+}
+
+void MatchingEngine::add_order_listener(OrderListener listener) {
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    auto listeners = listeners_ ? std::make_shared<Listeners>(*listeners_) : std::make_shared<Listeners>();
+    listeners->orders.push_back(std::move(listener));
+    publish_listeners(std::move(listeners));
+}
+
+void MatchingEngine::publish_listeners(std::shared_ptr<const Listeners> listeners) {
+    listeners_ = listeners;
+    for (auto& shard : shards_) {
+        shard->set_listeners(listeners);
+    }
+}
+
+std::vector<trade::Trade> MatchingEngine::journal_trades(const std::string& symbol, int64_t since_trade_id,
+                                                         size_t limit) const {
+    if (!has_journal()) {
+        throw std::logic_error("The engine has no journal");
+    }
+    const Instrument& instrument = find_instrument(symbol);
+    return persistence::read_journal_trades(persistence::Journal::shard_path(journal_directory_, instrument.shard),
+                                            static_cast<uint32_t>(instrument.shard),
+                                            static_cast<uint32_t>(shards_.size()), symbol, since_trade_id, limit);
+}
+
+std::shared_ptr<const BookSnapshot> MatchingEngine::snapshot(const std::string& symbol) const {
+    return std::atomic_load(&find_instrument(symbol).snapshot);
+}
+
+Instrument& MatchingEngine::find_instrument(const std::string& symbol) const {
+    auto it = instruments_by_symbol_.find(symbol);
+    if (it == instruments_by_symbol_.end()) {
+        throw std::invalid_argument("Unknown symbol: " + symbol);
+    }
+    return *it->second;
+}
+
+Instrument& MatchingEngine::find_instrument(uint64_t order_id) const {
+    uint32_t index = symbol_index_of(order_id);
+    if (index >= instruments_.size()) {
+        throw std::invalid_argument("Unknown order id: " + std::to_string(order_id));
+    }
+    return *instruments_[index];
+}
+
+void MatchingEngine::dispatch(Command&& command) {
+    shards_[command.instrument->shard]->enqueue(std::move(command));
+}
+
+std::future<CommandResult> MatchingEngine::dispatch_with_future(Command&& command) {
+    // std::function needs a copyable target, so the promise is shared
+    auto promise = std::make_shared<std::promise<CommandResult>>();
+    std::future<CommandResult> future = promise->get_future();
+    command.on_complete = [promise](CommandResult&& result) {
+        promise->set_value(std::move(result));
+    };
+    dispatch(std::move(command));
+    return future;
+}
+
+} // namespace engine
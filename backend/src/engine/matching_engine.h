@@ -0,0 +1,127 @@
+/**
+ * Multi-Symbol Matching Engine
+ * 
+ * Owns the instrument registry (one OrderBook per symbol) and a fixed set of
+ * shards, each with a dedicated matching thread. Every instrument is pinned to
+ * one shard, and commands for it are routed to that shard's queue, so flow on
+ * different symbols matches in parallel while each book stays single-writer.
+ */
+
+#pragma once
+
+#include "command.h"
+#include "shard.h"
+#include "../persistence/journal.h"
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace engine {
+
+struct RecoveryStats {
+    uint64_t records = 0;
+    uint64_t orders = 0;
+    uint64_t cancels = 0;
+    uint64_t amends = 0;
+    uint64_t trades = 0;
+    size_t torn_journals = 0;   // journals whose tail was cut off after a crash
+    size_t snapshots_loaded = 0;
+    uint64_t snapshot_orders = 0;
+    double snapshot_seconds = 0;
+    double seconds = 0;         // snapshot load plus journal replay
+};
+
+class MatchingEngine {
+public:
+    // num_shards == 0 picks one shard per hardware thread
+    explicit MatchingEngine(size_t num_shards = 0, bool pin_threads = false);
+    ~MatchingEngine();
+    
+    // Registry setup; symbols must be added before start()
+    void add_symbol(const std::string& symbol, double tick_size = order_book::OrderBook::DEFAULT_TICK_SIZE);
+    bool has_symbol(const std::string& symbol) const;
+    const std::vector<std::string>& symbols() const { return symbols_; }
+    size_t shard_count() const { return shards_.size(); }
+    
+    // Loads each shard's latest snapshot and replays the journal written
+    // after it into the books, then keeps journaling to the same files. Call after all symbols are registered and before
+    // start(); the symbols and shard count must match the ones the journal
+    // was written with, otherwise this throws std::runtime_error.
+    RecoveryStats open_journal(const persistence::JournalConfig& config);
+    bool has_journal() const { return !journal_directory_.empty(); }
+    // Up to limit of the symbol's trades with an id above since_trade_id,
+    // oldest first, read from its shard's journal on the calling thread
+    // (see persistence::read_journal_trades). Only committed trades are
+    // there, which includes every trade a published snapshot counts.
+    std::vector<trade::Trade> journal_trades(const std::string& symbol, int64_t since_trade_id, size_t limit) const;
+    
+    // Engine lifecycle
+    void start();
+    void stop();
+    
+    // Command routing. These throw std::invalid_argument for an unknown symbol
+    // or an order id that no registered instrument could have issued. The
+    // callback forms complete on the matching thread; the future forms wrap
+    // them for callers that want to block.
+    void submit(order::Order order, Completion on_complete);
+    void cancel(uint64_t order_id, Completion on_complete);
+    // Sets a resting order's open quantity and price (see
+    // OrderBook::amend_order: a reduction at the same price keeps its
+    // queue position); the result carries any fills of a re-priced order
+    void amend(uint64_t order_id, int quantity, double price, Completion on_complete);
+    std::future<CommandResult> submit(order::Order order);
+    std::future<CommandResult> cancel(uint64_t order_id);
+    std::future<CommandResult> amend(uint64_t order_id, int quantity, double price);
+    // Applies NEW_ORDER, CANCEL_ORDER and AMEND_ORDER commands with one handoff per shard
+    // involved: each shard applies its share back to back, so commands on
+    // one symbol keep their relative order (there is no order across
+    // shards). Results come back in the commands' order; a command naming
+    // an unknown symbol or order id, or of another type, is rejected there
+    // without reaching a shard. If no command reaches a shard, on_complete
+    // runs on the calling thread.
+    void submit_batch(std::vector<Command> commands, BatchCompletion on_complete);
+    std::future<std::vector<CommandResult>> submit_batch(std::vector<Command> commands);
+    // Runs fn against the symbol's book on its matching thread
+    void query(const std::string& symbol, std::function<void(const order_book::OrderBook&)> fn,
+               Completion on_complete);
+    std::future<CommandResult> query(const std::string& symbol,
+                                     std::function<void(const order_book::OrderBook&)> fn);
+    
+    // Registers a listener for every trade on every symbol, called from the
+    // matching threads in execution order (see TradeListener). Can be added
+    // while running; listeners stay registered for the engine's lifetime.
+    void add_trade_listener(TradeListener listener);
+    // Registers a listener for the level changes of every book a batch
+    // changed, called from the matching threads like a trade listener;
+    // while one is registered the books track their changed levels
+    void add_book_listener(BookListener listener);
+    // Registers a listener for every order update on every symbol; while
+    // one is registered the books record them
+    void add_order_listener(OrderListener listener);
+    
+    // Latest published snapshot of the symbol's book; never blocks on matching
+    std::shared_ptr<const BookSnapshot> snapshot(const std::string& symbol) const;
+
+private:
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<std::unique_ptr<Instrument>> instruments_;
+    std::unordered_map<std::string, Instrument*> instruments_by_symbol_;
+    std::vector<std::string> symbols_;
+    std::string journal_directory_;     // set by open_journal()
+    bool started_ = false;
+    std::mutex listeners_mutex_;    // serializes add_*_listener
+    std::shared_ptr<const Listeners> listeners_;
+    
+    Instrument& find_instrument(const std::string& symbol) const;
+    Instrument& find_instrument(uint64_t order_id) const;
+    Instrument& restore_target(const std::string& symbol, size_t shard) const;
+    void replay(const persistence::JournalRecord& record, size_t shard, RecoveryStats& stats);
+    void publish_listeners(std::shared_ptr<const Listeners> listeners);
+    void dispatch(Command&& command);
+    std::future<CommandResult> dispatch_with_future(Command&& command);
+};
+
+} // namespace engine
@@ -0,0 +1,103 @@
+/**
+ * Bounded Lock-Free MPSC Queue
+ *
+ * Fixed-capacity ring buffer for many producers and a single consumer. Each
+ * cell carries a sequence number (after Dmitry Vyukov's bounded queue), so
+ * producers claim a slot with one CAS on the tail and publish it with a
+ * release store; the consumer never needs an atomic read-modify-write.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace engine {
+
+template <typename T>
+class MpscQueue {
+public:
+    // capacity must be a power of two
+    explicit MpscQueue(size_t capacity)
+        : mask_(capacity - 1), cells_(new Cell[capacity]) {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("MpscQueue capacity must be a power of two");
+        }
+        for (size_t i = 0; i < capacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpscQueue() {
+        T value;
+        while (try_pop(value)) {
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Returns false without consuming value if the ring is full
+    bool try_push(T& value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (&cell.storage) T(std::move(value));
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer side only
+    bool try_pop(T& value) {
+        Cell& cell = cells_[head_ & mask_];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(head_ + 1) < 0) {
+            return false;
+        }
+        T* item = reinterpret_cast<T*>(&cell.storage);
+        value = std::move(*item);
+        item->~T();
+        cell.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+    // Consumer side only; true if a producer has published the next cell
+    bool ready() const {
+        const Cell& cell = cells_[head_ & mask_];
+        return cell.sequence.load(std::memory_order_acquire) == head_ + 1;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    // Producers and the consumer write different ends; keep them on separate cache lines
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) size_t head_ = 0;
+};
+
+} // namespace engine
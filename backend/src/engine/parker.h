@@ -0,0 +1,77 @@
+/**
+ * Idle Parker
+ *
+ * Spin-then-park for the single consumer of lock-free queues such as
+ * MpscQueue. After IDLE_SPINS empty polls in a row the consumer parks on a
+ * condition variable; producers pay one fence and a relaxed load per item
+ * while it is awake, and take the mutex only to wake it. The seq_cst fence
+ * on each side makes a lost wake-up impossible in the model, and the
+ * IDLE_WAIT timeout bounds its cost should one happen anyway.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace engine {
+
+class Parker {
+public:
+    static constexpr int IDLE_SPINS = 64;
+    static constexpr std::chrono::milliseconds IDLE_WAIT{1};
+
+    // Producer side, after publishing work: wakes the consumer if it is
+    // parked. Pairs with the fence in park(): either the consumer sees the
+    // work before parking, or the producer sees it parked and wakes it.
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed)) {
+            wake();
+        }
+    }
+
+    // Wakes the consumer whether or not it is parked (on stop, say)
+    void wake() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cv_.notify_one();
+    }
+
+    // Consumer side, once per poll with whether the poll found work: yields
+    // while the idle streak is short, then parks unless ready() - checked
+    // after the consumer is marked as sleeping - reports work or a reason
+    // to stop
+    template <typename Ready>
+    void idle(bool worked, Ready&& ready) {
+        if (worked) {
+            idle_ = 0;
+        } else if (++idle_ < IDLE_SPINS) {
+            std::this_thread::yield();
+        } else {
+            park(ready);
+            idle_ = 0;
+        }
+    }
+
+private:
+    std::atomic<bool> sleeping_{false};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    int idle_ = 0;      // consumer only
+
+    template <typename Ready>
+    void park(Ready& ready) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleeping_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready()) {
+            cv_.wait_for(lock, IDLE_WAIT);
+        }
+        sleeping_.store(false, std::memory_order_relaxed);
+    }
+};
+
+} // namespace engine
@@ -0,0 +1,396 @@
+/**
+ * Matching Shard Implementation
+ * 
+ * Drains the shard's command ring in batches, applies each command to the
+ * instrument's order book on the shard thread and, after each batch, commits
+ * the batch's journal records, publishes fresh snapshots for the books that
+ * changed and only then completes the batch's commands, handing its trades
+ * to the trade listeners in between and the order updates and the books'
+ * level changes to their listeners after.
+ */
+
+#include "shard.h"
+#include <iostream>
+#include <stdexcept>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace engine {
+
+Shard::Shard(size_t index, int cpu, size_t queue_capacity)
+    : index_(index), cpu_(cpu), queue_(queue_capacity) {}
+
+Shard::~Shard() {
+    stop();
+}
+
+void Shard::add_instrument(Instrument* instrument) {
+    instruments_.push_back(instrument);
+}
+
+void Shard::attach_journal(std::unique_ptr<persistence::Journal> journal, uint32_t shard_count,
+                           std::string snapshot_path, uint64_t snapshot_interval) {
+    journal_ = std::move(journal);
+    shard_count_ = shard_count;
+    snapshot_path_ = std::move(snapshot_path);
+    snapshot_interval_ = snapshot_interval;
+}
+
+void Shard::set_listeners(std::shared_ptr<const Listeners> listeners) {
+    std::atomic_store(&listeners_, std::move(listeners));
+}
+
+void Shard::start() {
+    if (running_.exchange(true)) return;
+    thread_ = std::thread(&Shard::run, this);
+}
+
+void Shard::stop() {
+    if (!running_.exchange(false)) return;
+    parker_.wake();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void Shard::enqueue(Command&& command) {
+    while (!queue_.try_push(command)) {
+        std::this_thread::yield();
+    }
+    parker_.notify();
+}
+
+void Shard::run() {
+    pin_to_cpu();
+    
+    while (running_.load(std::memory_order_acquire)) {
+        parker_.idle(drain() > 0, [this] {
+            return queue_.ready() || !running_.load(std::memory_order_acquire);
+        });
+    }
+    // Complete whatever was queued before stop(), then snapshot so the next
+    // start does not have to replay this session's journal
+    drain();
+    maybe_snapshot(true);
+}
+
+size_t Shard::drain() {
+    Command command;
+    if (!queue_.try_pop(command)) {
+        return 0;
+    }
+    // Loaded once per batch, and not on idle polls
+    auto listeners = std::atomic_load(&listeners_);
+    collect_trades_ = listeners && !listeners->trades.empty();
+    bool track_levels = listeners && !listeners->books.empty();
+    if (track_levels != track_levels_) {
+        track_levels_ = track_levels;
+        for (Instrument* instrument : instruments_) {
+            instrument->book->set_track_level_changes(track_levels);
+        }
+    }
+    bool track_orders = listeners && !listeners->orders.empty();
+    if (track_orders != track_orders_) {
+        track_orders_ = track_orders;
+        for (Instrument* instrument : instruments_) {
+            instrument->book->set_track_order_updates(track_orders);
+        }
+    }
+    
+    // Bound the batch so snapshots keep being published under sustained load
+    size_t executed = 0;
+    do {
+        execute(command);
+        ++executed;
+    } while (executed < queue_.capacity() && queue_.try_pop(command));
+    
+    // Group commit: one write (and at most one sync) covers the batch
+    commit_journal();
+    if (journal_ && journal_->failed()) {
+        // Fail-stop: the books may hold effects the journal lost, so none
+        // of the batch's market data goes out and the last published
+        // snapshot stays the state that recovery will rebuild
+        withhold_batch();
+        complete_batch(nullptr);
+        return executed;
+    }
+    // Publish before completing so a caller that reads after its own
+    // command completes always sees that command's effect
+    publish_snapshots();
+    complete_batch(collect_trades_ ? &listeners->trades : nullptr);
+    if (track_orders_) {
+        deliver_order_updates(listeners->orders);
+    }
+    if (track_levels_) {
+        deliver_deltas(listeners->books);
+    }
+    maybe_snapshot(false);
+    return executed;
+}
+
+void Shard::execute(Command& command) {
+    size_t trades_before = batch_trades_.size();
+    CommandResult result;
+    if (command.type == CommandType::BATCH) {
+        // One handoff for the whole batch, applied with nothing from other
+        // producers in between
+        result.items.reserve(command.batch.size());
+        for (auto& item : command.batch) {
+            result.items.push_back(apply(item));
+        }
+    } else {
+        result = apply(command);
+    }
+    
+    if (command.on_complete) {
+        if (collect_trades_) {
+            completion_trades_.push_back(trades_before);
+        }
+        completions_.emplace_back(std::move(command.on_complete), std::move(result));
+    }
+    if (journal_ && journal_->durability() == persistence::Durability::EVERY_WRITE) {
+        commit_journal();
+    }
+}
+
+CommandResult Shard::apply(Command& command) {
+    CommandResult result;
+    Instrument& instrument = *command.instrument;
+    if (journal_ && journal_->failed()) {
+        // Once a commit has failed the books are no longer what the journal
+        // says they are, so they are not touched, or even read, again
+        result.accepted = false;
+        result.error = "Journal write failed earlier; shard " + std::to_string(index_) +
+                       " no longer applies commands";
+        return result;
+    }
+    
+    try {
+        switch (command.type) {
+            case CommandType::NEW_ORDER:
+                // The sequence is spent only once the book has accepted the
+                // order: replay resumes after the highest journaled id, so an
+                // id handed to a rejected order would be handed out again
+                command.order.order_id = make_order_id(instrument.next_sequence, instrument.index);
+                result.fills = instrument.book->submit(command.order);
+                ++instrument.next_sequence;
+                result.order_id = command.order.order_id;
+                break;
+            case CommandType::CANCEL_ORDER:
+                result.order_id = command.order_id;
+                result.accepted = instrument.book->cancel_order(command.order_id);
+                if (!result.accepted) {
+                    result.error = "Order not found";
+                }
+                break;
+            case CommandType::AMEND_ORDER:
+                result.order_id = command.order_id;
+                result.accepted = instrument.book->amend_order(command.order_id, command.quantity,
+                                                               command.price, result.fills);
+                if (!result.accepted) {
+                    result.error = "Order not found";
+                }
+                break;
+            case CommandType::QUERY:
+                command.query(*instrument.book);
+                break;
+            case CommandType::BATCH:
+                throw std::invalid_argument("Batches cannot be nested");
+        }
+    } catch (const std::exception& e) {
+        result.accepted = false;
+        result.error = e.what();
+    }
+    
+    if (journal_ && result.accepted && command.type != CommandType::QUERY) {
+        journal(command, result);
+    }
+    if (collect_trades_ && !result.fills.empty()) {
+        batch_trades_.insert(batch_trades_.end(), result.fills.begin(), result.fills.end());
+    }
+    if (track_orders_) {
+        instrument.book->take_order_updates(batch_orders_);
+    }
+    
+    if (command.type != CommandType::QUERY && !instrument.dirty) {
+        instrument.dirty = true;
+        dirty_.push_back(&instrument);
+    }
+    return result;
+}
+
+void Shard::journal(const Command& command, const CommandResult& result) {
+    if (command.type == CommandType::NEW_ORDER) {
+        journal_->append(persistence::JournalRecord::new_order(command.order));
+        for (const auto& fill : result.fills) {
+            journal_->append(persistence::JournalRecord::trade(fill));
+        }
+    } else if (command.type == CommandType::AMEND_ORDER) {
+        journal_->append(persistence::JournalRecord::amend_order(command.instrument->symbol, command.order_id,
+                                                                 command.quantity, command.price));
+        for (const auto& fill : result.fills) {
+            journal_->append(persistence::JournalRecord::trade(fill));
+        }
+    } else {
+        journal_->append(persistence::JournalRecord::cancel_order(command.instrument->symbol, command.order_id));
+    }
+}
+
+void Shard::commit_journal() {
+    if (!journal_) return;
+    bool failed_before = journal_->failed();
+    try {
+        journal_->commit();
+    } catch (const std::exception& e) {
+        // These commands are not durable, so they are not acknowledged as
+        // accepted. The journal has dropped them and stays failed: drain()
+        // withholds the batch's market data and apply() rejects every later
+        // command without touching the books, so nothing outside the shard
+        // ever sees what only the lost records described. Commands apply()
+        // already rejected keep their own error.
+        if (!failed_before) {
+            std::cerr << "Shard " << index_ << " journal commit failed, rejecting further commands: "
+                      << e.what() << std::endl;
+        }
+        std::string error = e.what();
+        for (size_t i = committed_completions_; i < completions_.size(); ++i) {
+            CommandResult& result = completions_[i].second;
+            for (auto& item : result.items) {
+                if (item.accepted) {
+                    item.accepted = false;
+                    item.error = error;
+                }
+            }
+            if (result.accepted) {
+                result.accepted = false;
+                result.error = error;
+            }
+        }
+    }
+    committed_completions_ = completions_.size();
+}
+
+void Shard::complete_batch(const std::vector<TradeListener>* listeners) {
+    size_t delivered = 0;
+    auto deliver_trades = [&](size_t end) {
+        if (end > delivered) {
+            for (const auto& listener : *listeners) {
+                listener(batch_trades_.data() + delivered, end - delivered);
+            }
+            delivered = end;
+        }
+    };
+    for (size_t i = 0; i < completions_.size(); ++i) {
+        if (listeners) {
+            deliver_trades(completion_trades_[i]);
+        }
+        completions_[i].first(std::move(completions_[i].second));
+    }
+    if (listeners) {
+        deliver_trades(batch_trades_.size());
+    }
+    completions_.clear();
+    committed_completions_ = 0;
+    batch_trades_.clear();
+    completion_trades_.clear();
+}
+
+void Shard::withhold_batch() {
+    for (Instrument* instrument : dirty_) {
+        if (track_levels_) {
+            std::vector<order_book::LevelUpdate> discarded;
+            instrument->book->take_level_changes(discarded);
+        }
+        instrument->dirty = false;
+    }
+    dirty_.clear();
+    batch_orders_.clear();
+    batch_trades_.clear();
+}
+
+void Shard::deliver_order_updates(const std::vector<OrderListener>& listeners) {
+    if (batch_orders_.empty()) return;
+    for (const auto& listener : listeners) {
+        listener(batch_orders_.data(), batch_orders_.size());
+    }
+    batch_orders_.clear();
+}
+
+void Shard::deliver_deltas(const std::vector<BookListener>& listeners) {
+    for (const auto& delta : deltas_) {
+        for (const auto& listener : listeners) {
+            listener(delta);
+        }
+    }
+    deltas_.clear();
+}
+
+void Shard::maybe_snapshot(bool final_snapshot) {
+    // After a journal failure the books may hold effects the journal lost
+    if (!journal_ || journal_->failed() || journal_->records_written() == snapshot_records_) return;
+    if (!final_snapshot &&
+        (snapshot_interval_ == 0 || journal_->records_written() - snapshot_records_ < snapshot_interval_ ||
+         snapshot_writer_.busy())) {
+        return;
+    }
+    
+    // Runs right after a journal commit, so the image matches the journal
+    // exactly up to its current length
+    uint64_t journal_length = journal_->length();
+    auto encode = [this, journal_length] {
+        persistence::SnapshotImage image(static_cast<uint32_t>(index_), shard_count_, journal_length);
+        for (Instrument* instrument : instruments_) {
+            image.add_instrument(instrument->symbol, instrument->next_sequence, *instrument->book);
+        }
+        return image.finish();
+    };
+    
+    if (final_snapshot) {
+        snapshot_writer_.wait();
+        try {
+            persistence::write_snapshot_file(snapshot_path_, encode());
+        } catch (const std::exception& e) {
+            std::cerr << "Shard " << index_ << " snapshot failed: " << e.what() << std::endl;
+            return;
+        }
+    } else if (!snapshot_writer_.fork_write(snapshot_path_, encode)) {
+        return;
+    }
+    snapshot_records_ = journal_->records_written();
+}
+
+void Shard::publish_snapshots() {
+    for (Instrument* instrument : dirty_) {
+        if (track_levels_) {
+            // One delta per book per batch, however often a level moved
+            auto delta = std::make_shared<BookDelta>();
+            instrument->book->take_level_changes(delta->levels);
+            if (!delta->levels.empty()) {
+                delta->symbol = instrument->symbol;
+                delta->sequence = ++instrument->book_sequence;
+                deltas_.push_back(std::move(delta));
+            }
+        }
+        uint64_t version = instrument->snapshot ? instrument->snapshot->version + 1 : 1;
+        std::atomic_store(&instrument->snapshot, BookSnapshot::capture(*instrument->book, instrument->symbol,
+                                                                       version, instrument->book_sequence));
+        instrument->dirty = false;
+    }
+    dirty_.clear();
+}
+
+void Shard::pin_to_cpu() {
+#ifdef __linux__
+    if (cpu_ < 0) return;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu_, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0) {
+        std::cerr << "Failed to pin shard " << index_ << " to CPU " << cpu_ << std::endl;
+    }
+#endif
+}
+
+} // namespace engine
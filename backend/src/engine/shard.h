@@ -0,0 +1,105 @@
+/**
+ * Matching Shard
+ * 
+ * A shard is one matching thread plus the order books pinned to it. Gateway
+ * threads push commands into a bounded lock-free MPSC ring; only the shard
+ * thread ever reads or mutates its books, so the books need no locking and
+ * matching latency does not depend on lock convoys between gateway threads.
+ */
+
+#pragma once
+
+#include "command.h"
+#include "mpsc_queue.h"
+#include "parker.h"
+#include "../persistence/journal.h"
+#include "../persistence/snapshot.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace engine {
+
+class Shard {
+public:
+    static constexpr size_t DEFAULT_QUEUE_CAPACITY = 1 << 16;
+    
+    // cpu < 0 leaves the thread unpinned
+    Shard(size_t index, int cpu, size_t queue_capacity = DEFAULT_QUEUE_CAPACITY);
+    ~Shard();
+    
+    // Registry setup, before start(): the instruments pinned to this shard
+    void add_instrument(Instrument* instrument);
+    
+    // The journal must be attached before start(); every applied command and
+    // resulting trade is then journaled and committed before it completes.
+    // Every snapshot_interval journal records (and on stop) the shard also
+    // writes a snapshot of its books to snapshot_path.
+    void attach_journal(std::unique_ptr<persistence::Journal> journal, uint32_t shard_count,
+                        std::string snapshot_path, uint64_t snapshot_interval);
+    
+    // May be called while running; the shard picks the lists up at its next batch
+    void set_listeners(std::shared_ptr<const Listeners> listeners);
+    
+    void start();
+    void stop();
+    // Spins (yielding) while the ring is full, so a burst applies backpressure
+    // to gateway threads instead of growing memory without bound
+    void enqueue(Command&& command);
+    
+    size_t index() const { return index_; }
+
+private:
+    size_t index_;
+    int cpu_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+    MpscQueue<Command> queue_;
+    std::vector<Instrument*> dirty_;
+    std::vector<std::pair<Completion, CommandResult>> completions_;
+    std::vector<Instrument*> instruments_;
+    std::unique_ptr<persistence::Journal> journal_;
+    size_t committed_completions_ = 0;  // completions_ already covered by a journal commit
+    
+    // Listeners, only accessed through std::atomic_load/atomic_store;
+    // trades are collected per batch only while there are trade listeners,
+    // along with how many preceded each completion, and the books track
+    // level changes and order updates only while there are listeners for them
+    std::shared_ptr<const Listeners> listeners_;
+    std::vector<trade::Trade> batch_trades_;
+    std::vector<size_t> completion_trades_;
+    bool collect_trades_ = false;
+    bool track_levels_ = false;
+    bool track_orders_ = false;
+    std::vector<order_book::OrderUpdate> batch_orders_;
+    std::vector<std::shared_ptr<const BookDelta>> deltas_;
+    
+    // Book snapshots: written by a forked child, or inline on stop
+    uint32_t shard_count_ = 1;
+    std::string snapshot_path_;
+    uint64_t snapshot_interval_ = 0;
+    uint64_t snapshot_records_ = 0;     // journal records covered by the last snapshot
+    persistence::SnapshotWriter snapshot_writer_;
+    
+    // Idle wake-up: the shard thread parks here after spinning on an empty ring
+    Parker parker_;
+    
+    void run();
+    size_t drain();
+    void execute(Command& command);
+    CommandResult apply(Command& command);
+    void journal(const Command& command, const CommandResult& result);
+    void commit_journal();
+    void maybe_snapshot(bool final_snapshot);
+    void publish_snapshots();
+    void complete_batch(const std::vector<TradeListener>* listeners);
+    // Drops a batch's snapshots, trades, order updates and level changes
+    void withhold_batch();
+    void deliver_order_updates(const std::vector<OrderListener>& listeners);
+    void deliver_deltas(const std::vector<BookListener>& listeners);
+    void pin_to_cpu();
+};
+
+} // namespace engine
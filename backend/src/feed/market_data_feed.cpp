@@ -0,0 +1,780 @@
+/**
+ * Market Data Feed Implementation
+ *
+ * The publisher takes the clients' requests first in each pass, then drains
+ * the ring, forwarding trades, order updates and book deltas in the order
+ * the matching threads queued them to the streams that have subscribers.
+ * The books already coalesce each batch's changes into one delta per
+ * symbol, so the publisher only encodes; it resends a book whole wherever a
+ * delta went missing, and once the ring is drained it brings the
+ * depth-limited books and best bids and offers of the symbols that changed
+ * up to date.
+ */
+
+#include "market_data_feed.h"
+#include "../api/trading_api.h"
+#include "../utils/json_utils.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace feed {
+
+namespace {
+    // levels lists the bids before the asks
+    void write_levels(utils::JsonBuilder& json, const std::vector<order_book::LevelUpdate>& levels) {
+        size_t i = 0;
+        for (auto side : {order::OrderType::BUY, order::OrderType::SELL}) {
+            json.start_array(side == order::OrderType::BUY ? "bids" : "asks");
+            for (; i < levels.size() && levels[i].side == side; ++i) {
+                json.start_object()
+                    .add_number("price", levels[i].price)
+                    .add_number("quantity", levels[i].quantity)
+                    .add_number("orders", static_cast<int64_t>(levels[i].order_count))
+                    .end_object();
+            }
+            json.end_array();
+        }
+    }
+
+    void write_level(utils::JsonBuilder& json, const engine::LevelSnapshot& level, std::string_view key = {}) {
+        json.start_object(key)
+            .add_number("price", level.price)
+            .add_number("quantity", level.quantity)
+            .add_number("orders", static_cast<int64_t>(level.order_count))
+            .end_object();
+    }
+
+    bool same_level(const engine::LevelSnapshot& a, const engine::LevelSnapshot& b) {
+        return a.price == b.price && a.quantity == b.quantity && a.order_count == b.order_count;
+    }
+
+    // Appends the levels that differ between two views of one side, both
+    // best first: new or changed levels with their aggregate, and levels
+    // that are no longer in view with quantity 0
+    void diff_levels(order::OrderType side, const std::vector<engine::LevelSnapshot>& before,
+                     const engine::LevelSnapshot* after, size_t after_count,
+                     std::vector<order_book::LevelUpdate>& changes) {
+        bool is_buy = side == order::OrderType::BUY;
+        auto better = [is_buy](double a, double b) { return is_buy ? a > b : a < b; };
+        size_t i = 0;
+        size_t j = 0;
+        while (i < before.size() || j < after_count) {
+            if (j == after_count || (i < before.size() && better(before[i].price, after[j].price))) {
+                changes.push_back({side, before[i].price, 0, 0});
+                ++i;
+            } else if (i == before.size() || better(after[j].price, before[i].price)) {
+                changes.push_back({side, after[j].price, after[j].quantity, after[j].order_count});
+                ++j;
+            } else {
+                if (!same_level(before[i], after[j])) {
+                    changes.push_back({side, after[j].price, after[j].quantity, after[j].order_count});
+                }
+                ++i;
+                ++j;
+            }
+        }
+    }
+
+    const char* status_name(order_book::OrderStatus status) {
+        switch (status) {
+            case order_book::OrderStatus::NEW: return "NEW";
+            case order_book::OrderStatus::PARTIALLY_FILLED: return "PARTIALLY_FILLED";
+            case order_book::OrderStatus::FILLED: return "FILLED";
+            case order_book::OrderStatus::CANCELED: return "CANCELED";
+            case order_book::OrderStatus::AMENDED: return "AMENDED";
+        }
+        return "UNKNOWN";
+    }
+}
+
+void MarketDataFeed::Handoff::push(Event&& event) {
+    if (!open.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (!queue.try_push(event)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        lost.store(true, std::memory_order_release);
+        return;
+    }
+    parker.notify();
+}
+
+bool MarketDataFeed::Handoff::add_request(Request&& request) {
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex);
+        // Resumes and disconnects are never refused, or the publisher would
+        // lose track of the client
+        if (request.kind == Request::Kind::MESSAGE && requests.size() >= max_requests) {
+            return false;
+        }
+        requests.push_back(std::move(request));
+    }
+    requests_waiting.store(true, std::memory_order_release);
+    parker.wake();
+    return true;
+}
+
+MarketDataFeed::MarketDataFeed(engine::MatchingEngine& engine, websocket::WebSocketServer& server,
+                               MarketDataFeedConfig config)
+    : engine_(engine), server_(server), config_(config),
+      handoff_(std::make_shared<Handoff>(config.queue_capacity, config.max_pending_requests)) {
+    for (const auto& symbol : engine_.symbols()) {
+        SymbolStreams& streams = symbols_[symbol];
+        streams.symbol = symbol;
+        streams.trades_topic = "trades:" + symbol;
+        streams.book_topic = "book:" + symbol;
+        streams.bbo_topic = "bbo:" + symbol;
+    }
+
+    // Set before the server starts, so they never race its event loop. A
+    // client the server had to drop messages for gets its books again once
+    // it catches up, in place of the deltas it missed.
+    std::shared_ptr<Handoff> handoff = handoff_;
+    websocket::WebSocketServer* ws_server = &server_;
+    server_.set_on_connect([handoff](ClientId client_id, std::string_view target) {
+        size_t query = target.find('?');
+        if (query == std::string_view::npos) {
+            return;
+        }
+        api::HttpRequest handshake;
+        handshake.query = target.substr(query + 1);
+        std::string scratch;
+        std::string_view identity = handshake.query_param("client_id", scratch);
+        if (!identity.empty()) {
+            Request request;
+            request.kind = Request::Kind::CONNECT;
+            request.client_id = client_id;
+            request.text = std::string(identity);
+            handoff->add_request(std::move(request));
+        }
+    });
+    server_.set_on_message([handoff, ws_server](ClientId client_id, const std::string& text) {
+        Request request;
+        request.client_id = client_id;
+        request.text = text;
+        if (!handoff->add_request(std::move(request))) {
+            ws_server->send_to_client(client_id, R"({"type":"error","data":{"message":"Too many pending requests"}})");
+        }
+    });
+    server_.set_on_resume([handoff](ClientId client_id) {
+        Request request;
+        request.kind = Request::Kind::RESUME;
+        request.client_id = client_id;
+        handoff->add_request(std::move(request));
+    });
+    server_.set_on_disconnect([handoff](ClientId client_id) {
+        Request request;
+        request.kind = Request::Kind::DISCONNECT;
+        request.client_id = client_id;
+        handoff->add_request(std::move(request));
+    });
+}
+
+MarketDataFeed::~MarketDataFeed() {
+    stop();
+}
+
+uint64_t MarketDataFeed::dropped() const {
+    return handoff_->dropped.load(std::memory_order_relaxed);
+}
+
+void MarketDataFeed::start() {
+    if (running_.exchange(true)) return;
+    handoff_->open.store(true, std::memory_order_release);
+    if (!registered_) {
+        registered_ = true;
+        std::shared_ptr<Handoff> handoff = handoff_;
+        engine_.add_trade_listener([handoff](const trade::Trade* trades, size_t count) {
+            Event event;
+            event.trades.assign(trades, trades + count);
+            handoff->push(std::move(event));
+        });
+        engine_.add_order_listener([handoff](const order_book::OrderUpdate* updates, size_t count) {
+            if (!handoff->orders_wanted.load(std::memory_order_relaxed)) {
+                return;
+            }
+            Event event;
+            event.orders.assign(updates, updates + count);
+            handoff->push(std::move(event));
+        });
+        engine_.add_book_listener([handoff](const std::shared_ptr<const engine::BookDelta>& delta) {
+            Event event;
+            event.book = delta;
+            handoff->push(std::move(event));
+        });
+    }
+    thread_ = std::thread(&MarketDataFeed::run, this);
+}
+
+void MarketDataFeed::stop() {
+    if (!running_.exchange(false)) return;
+    handoff_->open.store(false, std::memory_order_release);
+    handoff_->parker.wake();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void MarketDataFeed::run() {
+    while (running_.load(std::memory_order_acquire)) {
+        handoff_->parker.idle(drain() > 0, [this] {
+            return handoff_->queue.ready() || handoff_->requests_waiting.load(std::memory_order_acquire) ||
+                   !running_.load(std::memory_order_acquire);
+        });
+    }
+}
+
+size_t MarketDataFeed::drain() {
+    handle_requests();
+    Event event;
+    size_t drained = 0;
+    // Bounded so requests are answered under a sustained stream
+    while (drained < handoff_->queue.capacity() && handoff_->queue.try_pop(event)) {
+        ++drained;
+        // A batch's trades are nearly always on one symbol
+        SymbolStreams* streams = nullptr;
+        for (const auto& trade : event.trades) {
+            if (!streams || streams->symbol != trade.symbol) {
+                auto it = symbols_.find(trade.symbol);
+                streams = it == symbols_.end() ? nullptr : &it->second;
+            }
+            if (streams && streams->trades > 0) {
+                publish_trade(*streams, trade);
+            }
+        }
+        if (!owners_.empty()) {
+            for (const auto& update : event.orders) {
+                auto owner = owners_.find(update.client_id);
+                if (owner != owners_.end()) {
+                    publish_order_update(owner->second, update);
+                }
+            }
+        }
+        if (event.book) {
+            publish_book(*event.book);
+            event.book.reset();
+        }
+        event.trades.clear();
+        event.orders.clear();
+    }
+    // A dropped delta may have been a book's last for a while, so a hole
+    // cannot wait for the next delta to show it. Every snapshot the
+    // matching threads publish precedes its delta, so this covers the
+    // dropped one.
+    if (handoff_->lost.exchange(false, std::memory_order_acquire)) {
+        for (auto& entry : symbols_) {
+            SymbolStreams& streams = entry.second;
+            if (streams.book > 0) {
+                streams.book_sequence = publish_snapshot(streams);
+            }
+            mark_changed(streams);
+        }
+    }
+    refresh_views();
+    return drained;
+}
+
+void MarketDataFeed::handle_requests() {
+    if (!handoff_->requests_waiting.exchange(false, std::memory_order_acquire)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(handoff_->requests_mutex);
+        requests_.swap(handoff_->requests);
+    }
+    for (const Request& request : requests_) {
+        auto client = clients_.find(request.client_id);
+        switch (request.kind) {
+            case Request::Kind::CONNECT:
+                identities_[request.client_id] = request.text;
+                break;
+            case Request::Kind::MESSAGE:
+                handle_message(request.client_id, request.text);
+                break;
+            case Request::Kind::RESUME:
+                // Everything it missed is covered by its books' current state
+                if (client != clients_.end()) {
+                    for (const auto& subscription : client->second) {
+                        send_state(request.client_id, subscription);
+                    }
+                }
+                break;
+            case Request::Kind::DISCONNECT:
+                // The server has already dropped its topics
+                identities_.erase(request.client_id);
+                if (client != clients_.end()) {
+                    for (const auto& subscription : client->second) {
+                        release(subscription);
+                    }
+                    clients_.erase(client);
+                }
+                break;
+        }
+    }
+    requests_.clear();
+}
+
+void MarketDataFeed::handle_message(ClientId client_id, const std::string& text) {
+    Subscription subscription;
+    bool subscribing;
+    try {
+        auto identity = identities_.find(client_id);
+        subscription = parse_request(text, identity == identities_.end() ? std::string_view() : identity->second,
+                                     subscribing);
+    } catch (const std::exception& e) {
+        reply_error(client_id, e.what());
+        return;
+    }
+    if (subscribing) {
+        subscribe(client_id, std::move(subscription));
+    } else {
+        unsubscribe(client_id, subscription);
+    }
+}
+
+MarketDataFeed::Subscription MarketDataFeed::parse_request(const std::string& text, std::string_view identity,
+                                                          bool& subscribe) const {
+    // Constants rather than enumerators: the key lookup below ends in a
+    // ternary with 0, and -Wextra flags an enumerator mixed with an int there
+    constexpr unsigned OP = 1, TOPIC = 2, SYMBOL = 4, DEPTH = 8, CLIENT_ID = 16;
+    unsigned seen = 0;
+    std::string op_storage, topic_storage, symbol_storage, client_id_storage;
+    std::string_view op, topic, symbol, client_id;
+    uint64_t depth = 0;
+
+    utils::JsonReader reader(text);
+    reader.begin_object();
+    std::string_view key;
+    while (reader.next_key(key)) {
+        unsigned field = key == "op" ? OP : key == "topic" ? TOPIC : key == "symbol" ? SYMBOL
+                       : key == "depth" ? DEPTH : key == "client_id" ? CLIENT_ID : 0;
+        if (field == 0) {
+            reader.skip_value();
+            continue;
+        }
+        if (seen & field) {
+            reader.fail("duplicate member \"" + std::string(key) + "\"");
+        }
+        seen |= field;
+        switch (field) {
+            case OP: op = reader.read_string(op_storage); break;
+            case TOPIC: topic = reader.read_string(topic_storage); break;
+            case SYMBOL: symbol = reader.read_string(symbol_storage); break;
+            case DEPTH: depth = reader.read_uint64(); break;
+            case CLIENT_ID: client_id = reader.read_string(client_id_storage); break;
+        }
+    }
+    reader.end();
+
+    if (op == "subscribe" || op == "unsubscribe") {
+        subscribe = op == "subscribe";
+    } else {
+        throw std::invalid_argument((seen & OP) ? "Unknown op: " + std::string(op) : "Missing op");
+    }
+
+    Subscription subscription;
+    if (topic == "trades") {
+        subscription.stream = Stream::TRADES;
+    } else if (topic == "book") {
+        subscription.stream = Stream::BOOK;
+    } else if (topic == "bbo") {
+        subscription.stream = Stream::BBO;
+    } else if (topic == "orders") {
+        subscription.stream = Stream::ORDERS;
+    } else {
+        throw std::invalid_argument((seen & TOPIC) ? "Unknown topic: " + std::string(topic) : "Missing topic");
+    }
+
+    if (subscription.stream == Stream::ORDERS) {
+        if (identity.empty()) {
+            throw std::invalid_argument("orders needs a client_id given when connecting: /ws?client_id=...");
+        }
+        if ((seen & CLIENT_ID) && client_id != identity) {
+            throw std::invalid_argument("client_id does not match the one given when connecting");
+        }
+        subscription.key = std::string(identity);
+    } else {
+        if (!(seen & SYMBOL)) {
+            throw std::invalid_argument("Missing symbol");
+        }
+        subscription.key = std::string(symbol);
+        if (!engine_.has_symbol(subscription.key)) {
+            throw std::invalid_argument("Unknown symbol: " + subscription.key);
+        }
+    }
+    if (seen & DEPTH) {
+        if (subscription.stream != Stream::BOOK) {
+            throw std::invalid_argument("depth only applies to the book topic");
+        }
+        if (depth < 1 || depth > config_.max_book_depth) {
+            throw std::invalid_argument("depth must be between 1 and " + std::to_string(config_.max_book_depth));
+        }
+        subscription.depth = static_cast<size_t>(depth);
+    }
+
+    subscription.topic = std::string(topic) + ":" + subscription.key;
+    if (subscription.depth > 0) {
+        subscription.topic += ":" + std::to_string(subscription.depth);
+    }
+    return subscription;
+}
+
+void MarketDataFeed::subscribe(ClientId client_id, Subscription subscription) {
+    std::vector<Subscription>& subscriptions = clients_[client_id];
+    auto it = std::find_if(subscriptions.begin(), subscriptions.end(),
+                           [&](const Subscription& held) { return held.topic == subscription.topic; });
+    if (it == subscriptions.end()) {
+        if (subscriptions.size() >= config_.max_subscriptions) {
+            reply_error(client_id, "Too many subscriptions");
+            return;
+        }
+        acquire(subscription);
+        // Queued behind everything published so far, so the state sent
+        // below is the first thing the client gets on the topic
+        server_.subscribe(client_id, subscription.topic);
+        subscriptions.push_back(std::move(subscription));
+        it = subscriptions.end() - 1;
+    }
+    // Subscribing again just resends the state, which doubles as a resync
+    reply(client_id, "subscribed", *it);
+    send_state(client_id, *it);
+}
+
+void MarketDataFeed::unsubscribe(ClientId client_id, const Subscription& subscription) {
+    auto client = clients_.find(client_id);
+    if (client != clients_.end()) {
+        std::vector<Subscription>& subscriptions = client->second;
+        auto it = std::find_if(subscriptions.begin(), subscriptions.end(),
+                               [&](const Subscription& held) { return held.topic == subscription.topic; });
+        if (it != subscriptions.end()) {
+            release(*it);
+            server_.unsubscribe(client_id, it->topic);
+            reply(client_id, "unsubscribed", *it);
+            subscriptions.erase(it);
+            if (subscriptions.empty()) {
+                clients_.erase(client);
+            }
+            return;
+        }
+    }
+    reply_error(client_id, "Not subscribed");
+}
+
+void MarketDataFeed::acquire(const Subscription& subscription) {
+    if (subscription.stream == Stream::ORDERS) {
+        Owner& owner = owners_[subscription.key];
+        if (owner.subscribers++ == 0) {
+            owner.topic = subscription.topic;
+        }
+        handoff_->orders_wanted.store(true, std::memory_order_relaxed);
+        return;
+    }
+    SymbolStreams& streams = symbols_.at(subscription.key);
+    switch (subscription.stream) {
+        case Stream::TRADES:
+            ++streams.trades;
+            break;
+        case Stream::BOOK:
+            if (subscription.depth == 0) {
+                ++streams.book;
+            } else {
+                // A new view starts its sequence over from the latest book
+                DepthView& view = streams.views[subscription.depth];
+                if (view.subscribers++ == 0) {
+                    view.depth = subscription.depth;
+                    view.topic = subscription.topic;
+                    load_view(view, *engine_.snapshot(streams.symbol));
+                }
+            }
+            break;
+        case Stream::BBO:
+            if (streams.bbo++ == 0) {
+                std::shared_ptr<const engine::BookSnapshot> snapshot = engine_.snapshot(streams.symbol);
+                streams.best_bid = snapshot->bids.empty() ? engine::LevelSnapshot{} : snapshot->bids.front();
+                streams.best_ask = snapshot->asks.empty() ? engine::LevelSnapshot{} : snapshot->asks.front();
+                streams.bbo_sequence = snapshot->sequence;
+            }
+            break;
+        case Stream::ORDERS:
+            break;
+    }
+}
+
+void MarketDataFeed::release(const Subscription& subscription) {
+    if (subscription.stream == Stream::ORDERS) {
+        auto owner = owners_.find(subscription.key);
+        if (--owner->second.subscribers == 0) {
+            owners_.erase(owner);
+            handoff_->orders_wanted.store(!owners_.empty(), std::memory_order_relaxed);
+        }
+        return;
+    }
+    SymbolStreams& streams = symbols_.at(subscription.key);
+    switch (subscription.stream) {
+        case Stream::TRADES:
+            --streams.trades;
+            break;
+        case Stream::BOOK:
+            if (subscription.depth == 0) {
+                --streams.book;
+            } else if (--streams.views.at(subscription.depth).subscribers == 0) {
+                streams.views.erase(subscription.depth);
+            }
+            break;
+        case Stream::BBO:
+            --streams.bbo;
+            break;
+        case Stream::ORDERS:
+            break;
+    }
+}
+
+void MarketDataFeed::send_state(ClientId client_id, const Subscription& subscription) {
+    if (subscription.stream != Stream::BOOK && subscription.stream != Stream::BBO) {
+        return;
+    }
+    SymbolStreams& streams = symbols_.at(subscription.key);
+    if (subscription.stream == Stream::BBO) {
+        publish_bbo(streams, client_id);
+    } else if (subscription.depth == 0) {
+        // Deltas published before this reached the client too; it skips
+        // them until its snapshot, and then those the snapshot includes
+        publish_snapshot(streams, client_id);
+    } else {
+        publish_view_snapshot(streams, streams.views.at(subscription.depth), client_id);
+    }
+}
+
+void MarketDataFeed::reply(ClientId client_id, const char* type, const Subscription& subscription) {
+    static const char* const names[] = {"trades", "book", "bbo", "orders"};
+    buffer_.clear();
+    utils::JsonBuilder json(buffer_);
+    json.start_object().add_string("type", type);
+    if (subscription.stream != Stream::ORDERS) {
+        json.add_string("symbol", subscription.key);
+    }
+    json.start_object("data").add_string("topic", names[static_cast<size_t>(subscription.stream)]);
+    if (subscription.stream == Stream::ORDERS) {
+        json.add_string("client_id", subscription.key);
+    } else {
+        json.add_string("symbol", subscription.key);
+    }
+    if (subscription.depth > 0) {
+        json.add_number("depth", static_cast<int64_t>(subscription.depth));
+    }
+    json.end_object().end_object();
+    server_.send_to_client(client_id, buffer_);
+}
+
+void MarketDataFeed::reply_error(ClientId client_id, const std::string& message) {
+    buffer_.clear();
+    utils::JsonBuilder json(buffer_);
+    json.start_object()
+        .add_string("type", "error")
+        .start_object("data")
+        .add_string("message", message)
+        .end_object()
+        .end_object();
+    server_.send_to_client(client_id, buffer_);
+}
+
+void MarketDataFeed::publish_trade(const SymbolStreams& streams, const trade::Trade& trade) {
+    buffer_.clear();
+    utils::JsonBuilder json(buffer_);
+    json.start_object()
+        .add_string("type", "trade_update")
+        .add_string("symbol", trade.symbol)
+        .add_number("seq", static_cast<int64_t>(trade.trade_id));
+    api::TradingApi::serialize_trade(json, trade, "data");
+    json.end_object();
+    send(streams.trades_topic);
+}
+
+void MarketDataFeed::publish_order_update(const Owner& owner, const order_book::OrderUpdate& update) {
+    buffer_.clear();
+    utils::JsonBuilder json(buffer_);
+    json.start_object()
+        .add_string("type", "order_update")
+        .add_string("symbol", update.symbol)
+        .start_object("data")
+        .add_number("order_id", static_cast<int64_t>(update.order_id))
+        .add_string("client_id", update.client_id)
+        .add_string("type", update.side == order::OrderType::BUY ? "BUY" : "SELL")
+        .add_string("status", status_name(update.status))
+        .add_number("price", update.price)
+        .add_number("open", static_cast<int64_t>(update.open));
+    if (update.trade_id >= 0) {
+        json.add_number("filled", static_cast<int64_t>(update.filled))
+            .add_number("fill_price", update.fill_price)
+            .add_number("trade_id", static_cast<int64_t>(update.trade_id));
+    }
+    json.end_object().end_object();
+    send(owner.topic);
+}
+
+void MarketDataFeed::publish_book(const engine::BookDelta& delta) {
+    auto it = symbols_.find(delta.symbol);
+    if (it == symbols_.end()) {
+        return;
+    }
+    SymbolStreams& streams = it->second;
+    mark_changed(streams);
+
+    // With nobody on the whole book, only track the sequence, so encoding
+    // costs nothing until someone subscribes
+    bool listening = streams.book > 0;
+    uint64_t& last = streams.book_sequence;
+    if (delta.sequence <= last) {
+        return;     // a snapshot sent in its place includes it
+    }
+    if (delta.sequence != last + 1 && listening) {
+        last = publish_snapshot(streams);
+        if (delta.sequence <= last) {
+            return;
+        }
+    }
+    last = delta.sequence;
+    if (!listening) {
+        return;
+    }
+
+    buffer_.clear();
+    utils::JsonBuilder json(buffer_);
+    json.start_object()
+        .add_string("type", "book_delta")
+        .add_string("symbol", delta.symbol)
+        .add_number("seq", static_cast<int64_t>(delta.sequence))
+        .start_object("data");
+    write_levels(json, delta.levels);
+    json.end_object().end_object();
+    send(streams.book_topic);
+}
+
+uint64_t MarketDataFeed::publish_snapshot(SymbolStreams& streams, ClientId client_id) {
+    std::shared_ptr<const engine::BookSnapshot> snapshot = engine_.snapshot(streams.symbol);
+    buffer_.clear();
+    utils::JsonBuilder json(buffer_);
+    json.start_object()
+        .add_string("type", "book_snapshot")
+        .add_string("symbol", streams.symbol)
+        .add_number("seq", static_cast<int64_t>(snapshot->sequence));
+    api::TradingApi::serialize_order_book(json, *snapshot, "data");
+    json.end_object();
+    send(streams.book_topic, client_id);
+    return snapshot->sequence;
+}
+
+void MarketDataFeed::publish_view_snapshot(const SymbolStreams& streams, const DepthView& view, ClientId client_id) {
+    auto write_side = [](utils::JsonBuilder& json, const char* key, const std::vector<engine::LevelSnapshot>& levels) {
+        json.start_array(key);
+        for (const auto& level : levels) {
+            write_level(json, level);
+        }
+        json.end_array();
+    };
+    // data is shaped like GET /api/orderbook, cut to the view's depth
+    buffer_.clear();
+    utils::JsonBuilder json(buffer_);
+    json.start_object()
+        .add_string("type", "depth_snapshot")
+        .add_string("symbol", streams.symbol)
+        .add_number("seq", static_cast<int64_t>(view.sequence))
+        .add_number("depth", static_cast<int64_t>(view.depth))
+        .start_object("data")
+        .add_string("symbol", streams.symbol)
+        .add_number("seq", static_cast<int64_t>(view.sequence))
+        .add_number("depth", static_cast<int64_t>(view.depth));
+    write_side(json, "buy_orders", view.bids);
+    write_side(json, "sell_orders", view.asks);
+    json.end_object().end_object();
+    send(view.topic, client_id);
+}
+
+void MarketDataFeed::publish_bbo(const SymbolStreams& streams, ClientId client_id) {
+    buffer_.clear();
+    utils::JsonBuilder json(buffer_);
+    json.start_object()
+        .add_string("type", "bbo")
+        .add_string("symbol", streams.symbol)
+        .add_number("seq", static_cast<int64_t>(streams.bbo_sequence))
+        .start_object("data");
+    for (auto [key, level] : {std::make_pair("bid", &streams.best_bid), std::make_pair("ask", &streams.best_ask)}) {
+        if (level->quantity == 0) {
+            json.add_null(key);
+        } else {
+            write_level(json, *level, key);
+        }
+    }
+    json.end_object().end_object();
+    send(streams.bbo_topic, client_id);
+}
+
+void MarketDataFeed::mark_changed(SymbolStreams& streams) {
+    if (!streams.changed && (streams.bbo > 0 || !streams.views.empty())) {
+        streams.changed = true;
+        changed_.push_back(&streams);
+    }
+}
+
+void MarketDataFeed::refresh_views() {
+    // One snapshot per symbol per pass however many deltas it had; the
+    // views follow the latest book rather than each delta
+    for (SymbolStreams* streams : changed_) {
+        streams->changed = false;
+        std::shared_ptr<const engine::BookSnapshot> snapshot = engine_.snapshot(streams->symbol);
+        for (auto& entry : streams->views) {
+            DepthView& view = entry.second;
+            changes_.clear();
+            diff_levels(order::OrderType::BUY, view.bids, snapshot->bids.data(),
+                        std::min(view.depth, snapshot->bids.size()), changes_);
+            diff_levels(order::OrderType::SELL, view.asks, snapshot->asks.data(),
+                        std::min(view.depth, snapshot->asks.size()), changes_);
+            if (changes_.empty()) {
+                continue;   // the change was deeper than this view
+            }
+            load_view(view, *snapshot);
+            ++view.sequence;
+
+            buffer_.clear();
+            utils::JsonBuilder json(buffer_);
+            json.start_object()
+                .add_string("type", "depth_delta")
+                .add_string("symbol", streams->symbol)
+                .add_number("seq", static_cast<int64_t>(view.sequence))
+                .add_number("depth", static_cast<int64_t>(view.depth))
+                .start_object("data");
+            write_levels(json, changes_);
+            json.end_object().end_object();
+            send(view.topic);
+        }
+
+        if (streams->bbo > 0) {
+            engine::LevelSnapshot bid = snapshot->bids.empty() ? engine::LevelSnapshot{} : snapshot->bids.front();
+            engine::LevelSnapshot ask = snapshot->asks.empty() ? engine::LevelSnapshot{} : snapshot->asks.front();
+            if (!same_level(bid, streams->best_bid) || !same_level(ask, streams->best_ask)) {
+                streams->best_bid = bid;
+                streams->best_ask = ask;
+                streams->bbo_sequence = snapshot->sequence;
+                publish_bbo(*streams);
+            }
+        }
+    }
+    changed_.clear();
+}
+
+void MarketDataFeed::load_view(DepthView& view, const engine::BookSnapshot& snapshot) {
+    view.bids.assign(snapshot.bids.begin(), snapshot.bids.begin() + std::min(view.depth, snapshot.bids.size()));
+    view.asks.assign(snapshot.asks.begin(), snapshot.asks.begin() + std::min(view.depth, snapshot.asks.size()));
+}
+
+void MarketDataFeed::send(const std::string& topic, ClientId client_id) {
+    // The server encodes the frame straight from the buffer, once
+    if (client_id == 0) {
+        server_.publish(topic, buffer_);
+    } else {
+        server_.send_to_client(client_id, buffer_);
+    }
+}
+
+} // namespace feed
@@ -0,0 +1,271 @@
+/**
+ * Market Data Feed
+ *
+ * Publishes trade prints, order book changes and order updates to WebSocket
+ * clients as they happen, straight from the matching path. The matching
+ * threads only copy a batch's trades or order updates, or take a reference
+ * to a book's level changes, into a lock-free ring; a publisher thread does
+ * the JSON encoding and the socket writes, so matching never waits on a
+ * client.
+ *
+ * A client receives nothing until it subscribes, by sending text messages
+ * {"op": "subscribe" | "unsubscribe", "topic", ...}:
+ *
+ *   trades  "symbol": the symbol's trade_update messages
+ *   book    "symbol": its book, a book_snapshot followed by book_delta
+ *           messages; with "depth": N, only the best N levels per side,
+ *           as depth_snapshot and depth_delta messages
+ *   bbo     "symbol": its best bid and offer, as bbo messages
+ *   orders  order_update messages for the client's orders on every
+ *           symbol. The client id is the one the connection gave in its
+ *           handshake (/ws?client_id=alice); a "client_id" member, if
+ *           present, must match it, so a connection only ever follows one
+ *           client's orders. Client ids are not authenticated, as on the
+ *           REST API.
+ *
+ * Each request is answered with a "subscribed" or "unsubscribed" message
+ * echoing it in data, or an "error" message with data.message. Every stream
+ * is a server topic, published to its subscribers only, and nothing is
+ * encoded for a stream nobody subscribes to.
+ *
+ * Messages are JSON text frames shaped {"type", "symbol", "seq", "data"}:
+ *
+ *   trade_update   data is one trade, as in GET /api/trades; seq is its
+ *                  trade_id
+ *   book_snapshot  data is the book, as in GET /api/orderbook; seq is the
+ *                  last book_delta it includes
+ *   book_delta     data is {"bids", "asks"} listing only the levels that
+ *                  changed, each {"price", "quantity", "orders"}; quantity
+ *                  0 deletes the level. seq counts the stream's deltas,
+ *                  1, 2, ...
+ *   bbo            data is {"bid", "ask"}, each {"price", "quantity",
+ *                  "orders"} or null; seq is the book_delta it reflects,
+ *                  and a later bbo replaces an earlier one
+ *   depth_snapshot, depth_delta
+ *                  the same for a depth-limited book, with "depth" naming
+ *                  it; seq is the depth stream's own
+ *   order_update   data is {"order_id", "client_id", "type", "status",
+ *                  "price", "open"}, status one of NEW, PARTIALLY_FILLED,
+ *                  FILLED, CANCELED and AMENDED, plus "filled",
+ *                  "fill_price" and "trade_id" for a fill; no seq
+ *
+ * A client builds a book by ignoring deltas until it has a snapshot (sent
+ * as it subscribes, and again once it catches up after the server dropped
+ * messages for it), dropping deltas with seq <= the snapshot's, and applying
+ * the rest, which must then arrive as seq + 1. Any other seq is a gap: the
+ * client resyncs from GET /api/orderbook, which carries the same seq, or
+ * waits for the next book_snapshot. If the ring is full, events are dropped
+ * (counted in dropped()); the publisher notices the hole in a symbol's
+ * deltas and publishes a fresh snapshot itself. Dropped trades show as a
+ * trade_id gap and can be fetched from GET /api/trades?since_trade_id=.
+ *
+ * A depth-limited book is its own stream, shared by every client asking for
+ * that depth: after each pass the publisher compares the best levels of the
+ * symbol's latest snapshot with the ones it last sent, and publishes what
+ * changed (levels that moved out of view deleted, ones that moved in added)
+ * as one depth_delta numbered in the stream's own sequence, which its
+ * depth_snapshots carry in seq. Its own message types keep a client that
+ * follows the whole book and a view of it at once from mixing the two
+ * sequences. The dashboard that shows ten levels then only pays for changes
+ * to those ten.
+ */
+
+#pragma once
+
+#include "../engine/matching_engine.h"
+#include "../engine/mpsc_queue.h"
+#include "../engine/parker.h"
+#include "../websocket/websocket_server.h"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace feed {
+
+struct MarketDataFeedConfig {
+    // Events the matching threads may queue ahead of the publisher (a
+    // power of two); beyond it they are dropped rather than waited for
+    size_t queue_capacity = 1 << 16;
+    // Deepest depth-limited book a client may subscribe to
+    size_t max_book_depth = 100;
+    // Subscriptions one client may hold
+    size_t max_subscriptions = 64;
+    // Client requests waiting for the publisher; beyond it they are refused
+    size_t max_pending_requests = 1 << 12;
+};
+
+class MarketDataFeed {
+public:
+    MarketDataFeed(engine::MatchingEngine& engine, websocket::WebSocketServer& server,
+                   MarketDataFeedConfig config = MarketDataFeedConfig());
+    ~MarketDataFeed();
+
+    // Registers with the engine (listeners stay registered for the
+    // engine's lifetime and go quiet after stop()) and starts publishing
+    void start();
+    void stop();
+
+    uint64_t dropped() const;
+
+private:
+    using ClientId = websocket::WebSocketServer::ClientId;
+
+    // One listener call's worth of work for the publisher
+    struct Event {
+        std::vector<trade::Trade> trades;
+        std::vector<order_book::OrderUpdate> orders;
+        std::shared_ptr<const engine::BookDelta> book;
+    };
+
+    // What a client sent or what happened to it, for the publisher
+    struct Request {
+        enum class Kind : uint8_t {
+            CONNECT,        // text is the client id from the handshake
+            MESSAGE,
+            RESUME,         // caught up after messages to it were dropped
+            DISCONNECT
+        };
+        Kind kind = Kind::MESSAGE;
+        ClientId client_id = 0;
+        std::string text;
+    };
+
+    // Shared with the engine's listeners and the server's callbacks so
+    // events that arrive after stop() are dropped instead of touching a
+    // destroyed feed
+    struct Handoff {
+        Handoff(size_t capacity, size_t max_requests) : queue(capacity), max_requests(max_requests) {}
+        void push(Event&& event);
+        // False if a message was refused as too many are pending
+        bool add_request(Request&& request);
+
+        engine::MpscQueue<Event> queue;
+        std::atomic<bool> open{false};
+        std::atomic<uint64_t> dropped{0};
+        // Set when an event is dropped: the books must be resent whole
+        std::atomic<bool> lost{false};
+        // Whether anyone subscribes to order updates; the listener skips
+        // the copy otherwise
+        std::atomic<bool> orders_wanted{false};
+        // Filled on the server's event-loop thread
+        std::mutex requests_mutex;
+        std::vector<Request> requests;
+        size_t max_requests;
+        std::atomic<bool> requests_waiting{false};
+        // Idle wake-up, as in engine::Shard
+        engine::Parker parker;
+    };
+
+    enum class Stream : uint8_t {
+        TRADES,
+        BOOK,
+        BBO,
+        ORDERS
+    };
+
+    // One of a client's subscriptions
+    struct Subscription {
+        Stream stream = Stream::TRADES;
+        std::string key;            // the symbol, or the client id for ORDERS
+        size_t depth = 0;           // BOOK: 0 for the whole book
+        std::string topic;          // the server topic
+    };
+
+    // A depth-limited book stream and the levels it last sent
+    struct DepthView {
+        size_t depth = 0;
+        size_t subscribers = 0;
+        uint64_t sequence = 0;
+        std::vector<engine::LevelSnapshot> bids;
+        std::vector<engine::LevelSnapshot> asks;
+        std::string topic;
+    };
+
+    // One symbol's streams, with their subscriber counts
+    struct SymbolStreams {
+        std::string symbol;
+        // Last delta forwarded (or covered by a snapshot sent in its place),
+        // to spot holes and skip deltas a snapshot already includes
+        uint64_t book_sequence = 0;
+        size_t trades = 0;
+        size_t book = 0;
+        size_t bbo = 0;
+        std::string trades_topic;
+        std::string book_topic;
+        std::string bbo_topic;
+        std::map<size_t, DepthView> views;      // by depth
+        // Best levels last sent on the bbo stream (quantity 0: none)
+        engine::LevelSnapshot best_bid{};
+        engine::LevelSnapshot best_ask{};
+        uint64_t bbo_sequence = 0;
+        bool changed = false;                   // listed in changed_
+    };
+
+    struct Owner {
+        size_t subscribers = 0;
+        std::string topic;
+    };
+
+    engine::MatchingEngine& engine_;
+    websocket::WebSocketServer& server_;
+    MarketDataFeedConfig config_;
+    std::shared_ptr<Handoff> handoff_;
+    std::atomic<bool> running_{false};
+    bool registered_ = false;
+    std::thread thread_;
+
+    // Publisher thread state
+    std::string buffer_;        // reused for every message
+    std::unordered_map<std::string, SymbolStreams> symbols_;
+    std::unordered_map<std::string, Owner> owners_;     // ORDERS subscribers by client id
+    std::unordered_map<ClientId, std::vector<Subscription>> clients_;
+    std::unordered_map<ClientId, std::string> identities_;     // client ids given at connect
+    std::vector<Request> requests_;
+    // Symbols whose views and bbo may be stale after this pass
+    std::vector<SymbolStreams*> changed_;
+    std::vector<order_book::LevelUpdate> changes_;      // scratch for view deltas
+
+    void run();
+    size_t drain();
+
+    // Client requests
+    void handle_requests();
+    void handle_message(ClientId client_id, const std::string& text);
+    // identity is the client id the connection gave, empty if none. Throws
+    // std::invalid_argument for a malformed or invalid request.
+    Subscription parse_request(const std::string& text, std::string_view identity, bool& subscribe) const;
+    void subscribe(ClientId client_id, Subscription subscription);
+    void unsubscribe(ClientId client_id, const Subscription& subscription);
+    // Count a subscription in or out of its stream's subscribers
+    void acquire(const Subscription& subscription);
+    void release(const Subscription& subscription);
+    // Sends the subscription's current state: a book snapshot, or the bbo
+    void send_state(ClientId client_id, const Subscription& subscription);
+    void reply(ClientId client_id, const char* type, const Subscription& subscription);
+    void reply_error(ClientId client_id, const std::string& message);
+
+    // Streams
+    void publish_trade(const SymbolStreams& streams, const trade::Trade& trade);
+    void publish_order_update(const Owner& owner, const order_book::OrderUpdate& update);
+    void publish_book(const engine::BookDelta& delta);
+    // Sends the symbol's current book to one client, or to its book topic
+    // with 0, and returns the delta it is at
+    uint64_t publish_snapshot(SymbolStreams& streams, ClientId client_id = 0);
+    void publish_view_snapshot(const SymbolStreams& streams, const DepthView& view, ClientId client_id);
+    void publish_bbo(const SymbolStreams& streams, ClientId client_id = 0);
+    void mark_changed(SymbolStreams& streams);
+    // Brings the depth views and bbo of the changed symbols up to date
+    void refresh_views();
+    void load_view(DepthView& view, const engine::BookSnapshot& snapshot);
+    // To one client, or to the topic's subscribers with 0
+    void send(const std::string& topic, ClientId client_id = 0);
+};
+
+} // namespace feed
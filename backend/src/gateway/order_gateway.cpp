@@ -0,0 +1,754 @@
+/**
+ * Binary Order Gateway Implementation
+ *
+ * A session's orders are tracked by client token from the moment the request
+ * is decoded, and by engine order id once the engine accepts them, which is
+ * how fills from the engine's trade feed find their way back to the session.
+ * Replace amends the order in place, keeping its order id (and its queue
+ * position for a reduction at the same price); only the token changes. The
+ * open quantity and price of each order are kept from the engine's order
+ * updates rather than counted down from fills, so amends and cancels made
+ * through the REST API are reflected too.
+ */
+
+#include "order_gateway.h"
+#include "../api/event_fd.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace gateway {
+
+namespace {
+    constexpr int MAX_EVENTS = 256;
+    // Free space guaranteed before each recv; every complete message in
+    // what one recv returns is handled before the next
+    constexpr size_t MIN_READ_SPACE = 16384;
+
+    // The symbol's bytes, NUL padded to 8, read as one integer
+    uint64_t symbol_key(std::string_view symbol) {
+        char bytes[protocol::SYMBOL_LENGTH] = {};
+        std::memcpy(bytes, symbol.data(), std::min(symbol.size(), sizeof(bytes)));
+        uint64_t key;
+        std::memcpy(&key, bytes, sizeof(key));
+        return key;
+    }
+
+    uint64_t now_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count());
+    }
+}
+
+OrderGateway::Inbox::Inbox() {
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        throw std::runtime_error("Failed to create gateway wake-up descriptor");
+    }
+}
+
+OrderGateway::Inbox::~Inbox() {
+    close(wake_fd);
+}
+
+void OrderGateway::Inbox::push(Event&& event) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!open) return;
+        wake = events.empty();
+        events.push_back(std::move(event));
+    }
+    // Only the push that makes the inbox non-empty needs to wake the loop
+    if (wake) {
+        api::wake_eventfd(wake_fd);
+    }
+}
+
+OrderGateway::OrderGateway(engine::MatchingEngine& engine, int port, OrderGatewayConfig config)
+    : engine_(engine), port_(port), config_(config), inbox_(std::make_shared<Inbox>()) {
+    for (const auto& symbol : engine_.symbols()) {
+        // Longer symbols cannot be named on the wire
+        if (symbol.size() <= protocol::SYMBOL_LENGTH) {
+            symbol_keys_.emplace(symbol_key(symbol), static_cast<uint32_t>(symbols_.size()));
+            symbols_.push_back(symbol);
+        }
+    }
+
+    // The listener holds the inbox, not the gateway, so it stays safe to
+    // call after the gateway is gone
+    auto inbox = inbox_;
+    engine_.add_trade_listener([inbox](const trade::Trade* trades, size_t count) {
+        if (!inbox->tracking.load(std::memory_order_acquire)) return;
+        Event event;
+        event.kind = EventKind::TRADES;
+        event.trades.assign(trades, trades + count);
+        inbox->push(std::move(event));
+    });
+    engine_.add_order_listener([inbox](const order_book::OrderUpdate* updates, size_t count) {
+        if (!inbox->tracking.load(std::memory_order_acquire)) return;
+        // Entries are known from their completions already
+        Event event;
+        event.kind = EventKind::ORDER_UPDATES;
+        for (size_t i = 0; i < count; ++i) {
+            if (updates[i].status != order_book::OrderStatus::NEW) {
+                event.updates.push_back(updates[i]);
+            }
+        }
+        if (!event.updates.empty()) {
+            inbox->push(std::move(event));
+        }
+    });
+}
+
+OrderGateway::~OrderGateway() {
+    stop();
+}
+
+void OrderGateway::start() {
+    if (running_) return;
+
+    try {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            throw std::runtime_error("Failed to create gateway socket");
+        }
+        int opt = 1;
+        if (setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+            throw std::runtime_error("Failed to set gateway socket options");
+        }
+
+        struct sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;
+        address.sin_port = htons(port_);
+        if (bind(listen_fd_, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            throw std::runtime_error("Failed to bind gateway socket");
+        }
+        if (listen(listen_fd_, config_.backlog) < 0) {
+            throw std::runtime_error("Failed to listen on gateway socket");
+        }
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0) {
+            throw std::runtime_error("Failed to create gateway event loop");
+        }
+        // The listener and the inbox are told apart from sessions by their data pointers
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = &listen_fd_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event) < 0) {
+            throw std::runtime_error("Failed to register gateway socket");
+        }
+        event.events = EPOLLIN;
+        event.data.ptr = inbox_.get();
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, inbox_->wake_fd, &event) < 0) {
+            throw std::runtime_error("Failed to register gateway wake-up descriptor");
+        }
+    } catch (...) {
+        for (int* fd : {&listen_fd_, &epoll_fd_}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(inbox_->mutex);
+        inbox_->open = true;
+    }
+    running_ = true;
+    thread_ = std::thread(&OrderGateway::run, this);
+
+    std::cout << "Order gateway started on port " << port_ << std::endl;
+}
+
+void OrderGateway::stop() {
+    if (!running_) return;
+
+    running_ = false;
+    api::wake_eventfd(inbox_->wake_fd);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    while (!sessions_.empty()) {
+        close_session(*sessions_.begin()->second);
+    }
+    {
+        // Results still on their way concern sessions that no longer exist
+        std::lock_guard<std::mutex> lock(inbox_->mutex);
+        inbox_->open = false;
+        inbox_->events.clear();
+    }
+    inbox_->tracking = false;
+    owners_.clear();
+    in_flight_ = 0;
+    dirty_.clear();
+    for (int* fd : {&listen_fd_, &epoll_fd_}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+
+    std::cout << "Order gateway stopped" << std::endl;
+}
+
+void OrderGateway::run() {
+    epoll_event events[MAX_EVENTS];
+    while (running_) {
+        int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Gateway epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < count && running_; ++i) {
+            void* tag = events[i].data.ptr;
+            if (tag == inbox_.get()) {
+                drain_inbox();
+                continue;
+            }
+            if (tag == &listen_fd_) {
+                accept_sessions();
+                continue;
+            }
+
+            // Read even on EPOLLHUP/EPOLLERR: recv reports the error and the
+            // session is closed; writability just retries the flush below
+            Session& session = *static_cast<Session*>(tag);
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) && !read_input(session)) {
+                continue;
+            }
+            if (!session.flush_pending) {
+                session.flush_pending = true;
+                dirty_.push_back(session.id);
+            }
+        }
+
+        // One send per session per pass, however many responses it collected
+        flush_dirty();
+        inbox_->tracking.store(in_flight_ > 0 || !owners_.empty(), std::memory_order_relaxed);
+    }
+}
+
+void OrderGateway::accept_sessions() {
+    // Edge-triggered: keep accepting until the queue is empty
+    while (true) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Failed to accept gateway session: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        auto session = std::make_unique<Session>();
+        session->id = next_session_id_++;
+        session->fd = fd;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = session.get();
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            continue;
+        }
+        sessions_.emplace(session->id, std::move(session));
+    }
+}
+
+void OrderGateway::close_session(Session& session) {
+    // Orders still awaiting their acknowledgement are canceled when it arrives
+    for (const auto& entry : session.orders) {
+        uint64_t order_id = entry.second.order_id;
+        if (order_id == 0) continue;
+        owners_.erase(order_id);
+        if (config_.cancel_on_disconnect) {
+            engine_.cancel(order_id, engine::Completion());
+        }
+    }
+    // Closing the descriptor also removes it from the epoll set
+    close(session.fd);
+    sessions_.erase(session.id);
+}
+
+bool OrderGateway::read_input(Session& session) {
+    while (true) {
+        size_t available;
+        char* space = session.in.prepare(MIN_READ_SPACE, available);
+        ssize_t n = recv(session.fd, space, available, 0);
+        if (n > 0) {
+            session.in.commit(static_cast<size_t>(n));
+            if (!process_input(session)) {
+                return false;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        // Closed by the peer, or a socket error
+        close_session(session);
+        return false;
+    }
+}
+
+bool OrderGateway::process_input(Session& session) {
+    std::string_view data = session.in.view();
+    size_t consumed = 0;
+    bool valid = true;
+    while (valid && data.size() - consumed >= sizeof(protocol::Header)) {
+        protocol::Header header;
+        std::memcpy(&header, data.data() + consumed, sizeof(header));
+        if (header.length < sizeof(header) || header.length > protocol::MAX_MESSAGE_SIZE) {
+            valid = false;
+            break;
+        }
+        if (data.size() - consumed < header.length) {
+            break;
+        }
+        std::string_view frame = data.substr(consumed, header.length);
+        consumed += header.length;
+
+        valid = false;
+        switch (header.type) {
+            case protocol::NEW_ORDER: {
+                protocol::NewOrder message;
+                if ((valid = protocol::decode(frame, message))) on_new_order(session, message);
+                break;
+            }
+            case protocol::CANCEL: {
+                protocol::Cancel message;
+                if ((valid = protocol::decode(frame, message))) on_cancel(session, message);
+                break;
+            }
+            case protocol::REPLACE: {
+                protocol::Replace message;
+                if ((valid = protocol::decode(frame, message))) on_replace(session, message);
+                break;
+            }
+        }
+    }
+    if (!valid) {
+        // A bad length, an unknown type or the wrong size for its type:
+        // nothing after it can be framed reliably, so drop the session
+        close_session(session);
+        return false;
+    }
+    session.in.consume(consumed);
+    return true;
+}
+
+void OrderGateway::on_new_order(Session& session, const protocol::NewOrder& message) {
+    if (session.orders.count(message.token)) {
+        reject(session, message.token, protocol::DUPLICATE_TOKEN);
+        return;
+    }
+    if (message.side != protocol::BUY && message.side != protocol::SELL) {
+        reject(session, message.token, protocol::MALFORMED);
+        return;
+    }
+    auto symbol = symbol_keys_.find(symbol_key(protocol::symbol_view(message.symbol)));
+    if (symbol == symbol_keys_.end()) {
+        reject(session, message.token, protocol::UNKNOWN_SYMBOL);
+        return;
+    }
+    if (message.quantity == 0 || message.quantity > static_cast<uint32_t>(INT_MAX)) {
+        reject(session, message.token, protocol::INVALID_QUANTITY);
+        return;
+    }
+    if (message.price <= 0) {
+        reject(session, message.token, protocol::INVALID_PRICE);
+        return;
+    }
+
+    LiveOrder order;
+    order.symbol = symbol->second;
+    order.side = message.side;
+    order.price = message.price;
+    order.remaining = static_cast<int>(message.quantity);
+    session.orders.emplace(message.token, order);
+    submit(session, message.token, order);
+}
+
+void OrderGateway::on_cancel(Session& session, const protocol::Cancel& message) {
+    auto it = session.orders.find(message.token);
+    if (it == session.orders.end() || it->second.order_id == 0) {
+        reject(session, message.token, protocol::UNKNOWN_ORDER);
+        return;
+    }
+    if (it->second.canceling) {
+        reject(session, message.token, protocol::CANCEL_PENDING);
+        return;
+    }
+    it->second.canceling = true;
+    cancel(session, message.token, it->second.order_id);
+}
+
+void OrderGateway::on_replace(Session& session, const protocol::Replace& message) {
+    auto it = session.orders.find(message.token);
+    if (it == session.orders.end() || it->second.order_id == 0) {
+        reject(session, message.new_token, protocol::UNKNOWN_ORDER);
+        return;
+    }
+    if (it->second.canceling) {
+        reject(session, message.new_token, protocol::CANCEL_PENDING);
+        return;
+    }
+    if (session.orders.count(message.new_token)) {
+        reject(session, message.new_token, protocol::DUPLICATE_TOKEN);
+        return;
+    }
+    if (message.quantity == 0 || message.quantity > static_cast<uint32_t>(INT_MAX)) {
+        reject(session, message.new_token, protocol::INVALID_QUANTITY);
+        return;
+    }
+    if (message.price <= 0) {
+        reject(session, message.new_token, protocol::INVALID_PRICE);
+        return;
+    }
+
+    // The amended order waits under the new token, without an order id so
+    // fills still go to the old one, until the engine has applied the amend
+    LiveOrder replacement;
+    replacement.symbol = it->second.symbol;
+    replacement.side = it->second.side;
+    replacement.price = message.price;
+    replacement.remaining = static_cast<int>(message.quantity);
+    it->second.canceling = true;
+    uint64_t order_id = it->second.order_id;
+    session.orders.emplace(message.new_token, replacement);
+    amend(session, message.token, message.new_token, order_id, replacement);
+}
+
+void OrderGateway::submit(Session& session, uint64_t token, const LiveOrder& order) {
+    order::Order new_order;
+    new_order.order_id = 0;
+    new_order.type = order.side == protocol::BUY ? order::OrderType::BUY : order::OrderType::SELL;
+    new_order.quantity = order.remaining;
+    new_order.price = static_cast<double>(order.price) / protocol::PRICE_SCALE;
+    new_order.timestamp = now_ns();
+    new_order.symbol = symbols_[order.symbol];
+
+    // Before the command is queued, so the shard sees it before its trades
+    ++in_flight_;
+    inbox_->tracking.store(true, std::memory_order_release);
+    engine_.submit(std::move(new_order), completion(EventKind::NEW_ORDER, session.id, token, 0));
+}
+
+void OrderGateway::cancel(Session& session, uint64_t token, uint64_t order_id) {
+    ++in_flight_;
+    engine_.cancel(order_id, completion(EventKind::CANCEL, session.id, token, 0));
+}
+
+void OrderGateway::amend(Session& session, uint64_t token, uint64_t new_token, uint64_t order_id,
+                         const LiveOrder& order) {
+    ++in_flight_;
+    engine_.amend(order_id, order.remaining, static_cast<double>(order.price) / protocol::PRICE_SCALE,
+                  completion(EventKind::REPLACE, session.id, token, new_token));
+}
+
+engine::Completion OrderGateway::completion(EventKind kind, uint64_t session_id, uint64_t token,
+                                            uint64_t other_token) {
+    auto inbox = inbox_;
+    return [inbox, kind, session_id, token, other_token](engine::CommandResult&& result) {
+        Event event;
+        event.kind = kind;
+        event.session_id = session_id;
+        event.token = token;
+        event.other_token = other_token;
+        event.result = std::move(result);
+        inbox->push(std::move(event));
+    };
+}
+
+void OrderGateway::drain_inbox() {
+    uint64_t value;
+    if (read(inbox_->wake_fd, &value, sizeof(value)) < 0) {
+        // Already reset; whatever was pushed is picked up below either way
+    }
+    {
+        std::lock_guard<std::mutex> lock(inbox_->mutex);
+        events_.swap(inbox_->events);
+    }
+    for (auto& event : events_) {
+        handle(event);
+    }
+    events_.clear();
+}
+
+void OrderGateway::handle(Event& event) {
+    if (event.kind == EventKind::TRADES) {
+        handle_trades(event.trades);
+        return;
+    }
+    if (event.kind == EventKind::ORDER_UPDATES) {
+        handle_order_updates(event.updates);
+        return;
+    }
+
+    --in_flight_;
+    Session* session = find_session(event.session_id);
+    switch (event.kind) {
+        case EventKind::NEW_ORDER:
+            handle_new_order(session, event);
+            break;
+        case EventKind::CANCEL:
+            handle_cancel(session, event);
+            break;
+        case EventKind::REPLACE:
+            handle_replace(session, event);
+            break;
+        case EventKind::TRADES:
+        case EventKind::ORDER_UPDATES:
+            break;
+    }
+}
+
+void OrderGateway::handle_new_order(Session* session, Event& event) {
+    const engine::CommandResult& result = event.result;
+    if (!session) {
+        if (result.accepted && config_.cancel_on_disconnect) {
+            engine_.cancel(result.order_id, engine::Completion());
+        }
+        return;
+    }
+    auto it = session->orders.find(event.token);
+    if (it == session->orders.end()) {
+        return;
+    }
+    if (!result.accepted) {
+        session->orders.erase(it);
+        reject(*session, event.token, protocol::ENGINE_REJECT);
+        return;
+    }
+
+    // Fills, including this order's own, arrive after this through the
+    // trade listener and are matched to the order by its id
+    LiveOrder& order = it->second;
+    order.order_id = result.order_id;
+    owners_[order.order_id] = Owner{session->id, event.token};
+    auto accepted = protocol::make<protocol::Accepted>(protocol::ACCEPTED);
+    accepted.quantity = static_cast<uint32_t>(order.remaining);
+    accepted.token = event.token;
+    accepted.order_id = order.order_id;
+    accepted.price = order.price;
+    accepted.side = order.side;
+    send(*session, accepted);
+}
+
+void OrderGateway::handle_cancel(Session* session, Event& event) {
+    if (!session) {
+        return;
+    }
+    auto it = session->orders.find(event.token);
+    if (!event.result.accepted) {
+        // It filled first; its last Executed has already been sent
+        if (it != session->orders.end()) {
+            it->second.canceling = false;
+        }
+        reject(*session, event.token, protocol::TOO_LATE);
+        return;
+    }
+    auto canceled = protocol::make<protocol::Canceled>(protocol::CANCELED);
+    canceled.token = event.token;
+    canceled.order_id = event.result.order_id;
+    send(*session, canceled);
+    forget(*session, event.token);
+}
+
+void OrderGateway::handle_replace(Session* session, Event& event) {
+    if (!session) {
+        return;
+    }
+    auto replacement = session->orders.find(event.other_token);
+    if (replacement == session->orders.end()) {
+        return;
+    }
+    const engine::CommandResult& result = event.result;
+    if (!result.accepted) {
+        // The order is unchanged: either it is gone (filled or canceled
+        // first) or the engine refused the new price
+        session->orders.erase(replacement);
+        auto it = session->orders.find(event.token);
+        if (it != session->orders.end()) {
+            it->second.canceling = false;
+        }
+        bool gone = result.error == "Order not found";
+        reject(*session, event.other_token, gone ? protocol::TOO_LATE : protocol::ENGINE_REJECT);
+        return;
+    }
+
+    // The same order under the new token; fills from the amend itself
+    // arrive after this through the trade listener
+    LiveOrder& order = replacement->second;
+    order.order_id = result.order_id;
+    session->orders.erase(event.token);
+    owners_[order.order_id] = Owner{session->id, event.other_token};
+    auto replaced = protocol::make<protocol::Replaced>(protocol::REPLACED);
+    replaced.quantity = static_cast<uint32_t>(order.remaining);
+    replaced.token = event.token;
+    replaced.new_token = event.other_token;
+    replaced.order_id = order.order_id;
+    replaced.price = order.price;
+    send(*session, replaced);
+}
+
+void OrderGateway::handle_trades(const std::vector<trade::Trade>& trades) {
+    for (const auto& trade : trades) {
+        for (uint64_t order_id : {trade.buy_order_id, trade.sell_order_id}) {
+            auto owner = owners_.find(order_id);
+            if (owner == owners_.end()) {
+                continue;
+            }
+            // Sessions forget their orders' ids when they close, so both exist
+            Session& session = *find_session(owner->second.session_id);
+            uint64_t token = owner->second.token;
+
+            auto executed = protocol::make<protocol::Executed>(protocol::EXECUTED);
+            executed.quantity = static_cast<uint32_t>(trade.quantity);
+            executed.token = token;
+            executed.order_id = order_id;
+            executed.trade_id = static_cast<uint64_t>(trade.trade_id);
+            executed.price = std::llround(trade.price * protocol::PRICE_SCALE);
+            executed.liquidity = order_id == trade.aggressor_order_id ? protocol::REMOVED : protocol::ADDED;
+            send(session, executed);
+        }
+    }
+}
+
+void OrderGateway::handle_order_updates(const std::vector<order_book::OrderUpdate>& updates) {
+    // After the batch's completions and trades, so a fill's Executed has
+    // been sent by the time its update retires the order
+    for (const auto& update : updates) {
+        auto owner = owners_.find(update.order_id);
+        if (owner == owners_.end()) {
+            continue;
+        }
+        Session& session = *find_session(owner->second.session_id);
+        uint64_t token = owner->second.token;
+        LiveOrder& order = session.orders.at(token);
+
+        switch (update.status) {
+            case order_book::OrderStatus::CANCELED: {
+                // Canceled outside the gateway (its own cancels forget the
+                // order when they complete), so the session has not asked
+                auto canceled = protocol::make<protocol::Canceled>(protocol::CANCELED);
+                canceled.token = token;
+                canceled.order_id = update.order_id;
+                send(session, canceled);
+                forget(session, token);
+                break;
+            }
+            case order_book::OrderStatus::FILLED:
+                forget(session, token);
+                break;
+            case order_book::OrderStatus::AMENDED:
+                order.price = std::llround(update.price * protocol::PRICE_SCALE);
+                order.remaining = update.open;
+                break;
+            default:
+                order.remaining = update.open;
+                break;
+        }
+    }
+}
+
+void OrderGateway::forget(Session& session, uint64_t token) {
+    auto it = session.orders.find(token);
+    if (it == session.orders.end()) {
+        return;
+    }
+    if (it->second.order_id != 0) {
+        owners_.erase(it->second.order_id);
+    }
+    session.orders.erase(it);
+}
+
+OrderGateway::Session* OrderGateway::find_session(uint64_t session_id) {
+    auto it = sessions_.find(session_id);
+    return it == sessions_.end() ? nullptr : it->second.get();
+}
+
+template <typename T>
+void OrderGateway::send(Session& session, const T& message) {
+    session.out.append(reinterpret_cast<const char*>(&message), sizeof(message));
+    if (!session.flush_pending) {
+        session.flush_pending = true;
+        dirty_.push_back(session.id);
+    }
+}
+
+void OrderGateway::reject(Session& session, uint64_t token, protocol::RejectReason reason) {
+    auto rejected = protocol::make<protocol::Rejected>(protocol::REJECTED);
+    rejected.reason = reason;
+    rejected.token = token;
+    send(session, rejected);
+}
+
+void OrderGateway::flush_dirty() {
+    for (uint64_t session_id : dirty_) {
+        // Sessions closed earlier in the pass are skipped
+        Session* session = find_session(session_id);
+        if (session) {
+            session->flush_pending = false;
+            flush(*session);
+        }
+    }
+    dirty_.clear();
+}
+
+bool OrderGateway::flush(Session& session) {
+    while (session.out_offset < session.out.size()) {
+        ssize_t n = ::send(session.fd, session.out.data() + session.out_offset,
+                           session.out.size() - session.out_offset, MSG_NOSIGNAL);
+        if (n > 0) {
+            session.out_offset += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        close_session(session);
+        return false;
+    }
+
+    size_t pending = session.out.size() - session.out_offset;
+    if (pending == 0) {
+        session.out.clear();
+        session.out_offset = 0;
+    } else if (pending > config_.max_output_bytes) {
+        std::cerr << "Closing gateway session " << session.id << ": " << pending
+                  << " bytes of unread responses" << std::endl;
+        close_session(session);
+        return false;
+    } else if (session.out_offset >= pending) {
+        // Keep the buffer from creeping forward forever; EPOLLOUT resumes the rest
+        session.out.erase(0, session.out_offset);
+        session.out_offset = 0;
+    }
+    return true;
+}
+
+} // namespace gateway
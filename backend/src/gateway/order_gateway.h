@@ -0,0 +1,171 @@
+/**
+ * Binary Order Gateway
+ *
+ * TCP order entry using the fixed-layout protocol in protocol.h, next to
+ * the REST API on its own port. Orders go through the same MatchingEngine
+ * as POST /api/orders; the gateway only replaces the JSON/HTTP framing, so
+ * a request costs a bounds check and a few loads instead of an HTTP parse
+ * and a JSON decode, and responses are a few fixed-size copies.
+ *
+ * One event-loop thread owns every session. Its work per message is small
+ * next to matching, and with a single thread the token and order id tables
+ * need no locking. Each readable event decodes every complete message in
+ * the read buffer and hands it to the engine without waiting; results come
+ * back from the matching threads through a mutex-guarded inbox and an
+ * eventfd, and all responses a session accumulates in one pass go out in
+ * a single send.
+ */
+
+#pragma once
+
+#include "protocol.h"
+#include "../api/read_buffer.h"
+#include "../engine/matching_engine.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace gateway {
+
+struct OrderGatewayConfig {
+    // listen() backlog (the kernel caps it at net.core.somaxconn)
+    int backlog = 1024;
+    // Unsent output a session may queue before it is disconnected as a
+    // slow consumer; it would otherwise grow without bound
+    size_t max_output_bytes = 4 << 20;
+    // Cancel a session's live orders when it disconnects
+    bool cancel_on_disconnect = true;
+};
+
+class OrderGateway {
+public:
+    OrderGateway(engine::MatchingEngine& engine, int port, OrderGatewayConfig config = OrderGatewayConfig());
+    ~OrderGateway();
+
+    // Throws std::runtime_error if the port cannot be bound
+    void start();
+    void stop();
+
+private:
+    // An order the session has sent and that is not yet done
+    struct LiveOrder {
+        uint64_t order_id = 0;      // 0 until the engine accepts it
+        uint32_t symbol = 0;        // index into symbols_
+        uint8_t side = protocol::BUY;
+        int64_t price = 0;          // protocol units
+        int remaining = 0;          // open quantity, kept from the order updates
+        bool canceling = false;     // a cancel or replace is in flight
+    };
+
+    struct Session {
+        uint64_t id = 0;
+        int fd = -1;
+        api::ReadBuffer in;
+        std::string out;            // encoded responses not yet sent
+        size_t out_offset = 0;      // bytes of out already sent
+        bool flush_pending = false; // listed in dirty_ for the end of the pass
+        std::unordered_map<uint64_t, LiveOrder> orders;   // by token
+    };
+
+    // Which request a command result answers
+    enum class EventKind : uint8_t {
+        NEW_ORDER,
+        CANCEL,
+        REPLACE,
+        TRADES,
+        ORDER_UPDATES
+    };
+
+    struct Event {
+        EventKind kind = EventKind::TRADES;
+        uint64_t session_id = 0;
+        uint64_t token = 0;                     // of the order the command is for
+        uint64_t other_token = 0;               // replaces: the new token
+        engine::CommandResult result;
+        std::vector<trade::Trade> trades;       // TRADES
+        std::vector<order_book::OrderUpdate> updates;   // ORDER_UPDATES
+    };
+
+    // Hand-off from the matching threads, shared with their callbacks so
+    // results that arrive after stop() are dropped instead of touching a
+    // destroyed gateway
+    struct Inbox {
+        Inbox();
+        ~Inbox();
+        void push(Event&& event);
+
+        int wake_fd = -1;                       // eventfd, also written by stop()
+        std::mutex mutex;
+        std::vector<Event> events;
+        bool open = false;
+        // Set while the gateway has orders in the engine, so trades and
+        // order updates that cannot concern it are not copied to it
+        std::atomic<bool> tracking{false};
+    };
+
+    // Which session and token an engine order id belongs to
+    struct Owner {
+        uint64_t session_id = 0;
+        uint64_t token = 0;
+    };
+
+    engine::MatchingEngine& engine_;
+    int port_;
+    OrderGatewayConfig config_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    std::shared_ptr<Inbox> inbox_;
+    std::vector<Event> events_;                 // swapped with the inbox each pass
+
+    // Symbols are looked up by their 8 wire bytes read as one integer
+    std::vector<std::string> symbols_;
+    std::unordered_map<uint64_t, uint32_t> symbol_keys_;
+
+    uint64_t next_session_id_ = 1;
+    std::unordered_map<uint64_t, std::unique_ptr<Session>> sessions_;
+    std::unordered_map<uint64_t, Owner> owners_;    // acknowledged live orders by order id
+    size_t in_flight_ = 0;                      // commands sent but not completed
+    std::vector<uint64_t> dirty_;               // ids of sessions with output to flush
+
+    void run();
+    void accept_sessions();
+    void close_session(Session& session);
+    // Returns false once the session has been closed
+    bool read_input(Session& session);
+    bool process_input(Session& session);
+    bool flush(Session& session);
+    void flush_dirty();
+    void drain_inbox();
+
+    void on_new_order(Session& session, const protocol::NewOrder& message);
+    void on_cancel(Session& session, const protocol::Cancel& message);
+    void on_replace(Session& session, const protocol::Replace& message);
+
+    void handle(Event& event);
+    void handle_new_order(Session* session, Event& event);
+    void handle_cancel(Session* session, Event& event);
+    void handle_replace(Session* session, Event& event);
+    void handle_trades(const std::vector<trade::Trade>& trades);
+    void handle_order_updates(const std::vector<order_book::OrderUpdate>& updates);
+
+    // Hand a command to the engine; its result comes back as an event
+    void submit(Session& session, uint64_t token, const LiveOrder& order);
+    void cancel(Session& session, uint64_t token, uint64_t order_id);
+    void amend(Session& session, uint64_t token, uint64_t new_token, uint64_t order_id, const LiveOrder& order);
+    engine::Completion completion(EventKind kind, uint64_t session_id, uint64_t token, uint64_t other_token);
+    void forget(Session& session, uint64_t token);
+
+    Session* find_session(uint64_t session_id);
+    template <typename T>
+    void send(Session& session, const T& message);
+    void reject(Session& session, uint64_t token, protocol::RejectReason reason);
+};
+
+} // namespace gateway
@@ -0,0 +1,194 @@
+/**
+ * Binary Order-Entry Protocol
+ *
+ * Fixed-layout messages for the order gateway, in the spirit of OUCH/SBE:
+ * every message starts with a 4-byte header carrying its total length and
+ * type, fields sit at fixed offsets in little-endian byte order, and every
+ * message of a type has the same size, so decoding is a bounds check plus
+ * loads from known offsets - no parsing, no allocation. Fields are laid out
+ * on their natural alignment and messages are padded to a multiple of 8.
+ *
+ * Prices are signed integers in units of 1/10000 (PRICE_SCALE). Orders are
+ * named by a client-chosen token that must be unique among the session's
+ * live orders; the engine's order id comes back on acceptance.
+ *
+ * Client -> gateway: NewOrder, Cancel, Replace.
+ * Gateway -> client: Accepted, Rejected, Canceled, Replaced, Executed.
+ * Each request is answered by exactly one Accepted, Canceled, Replaced or
+ * Rejected; a Rejected carries the request's token (for a Replace, its
+ * new_token). Executed messages follow for every fill, aggressive or
+ * passive, in execution order until the order is done; a Canceled or
+ * Replaced never precedes a fill that happened before it. An order canceled
+ * through the REST API gets an unrequested Canceled.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace gateway {
+namespace protocol {
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the wire format is little-endian");
+
+constexpr int64_t PRICE_SCALE = 10000;
+constexpr size_t SYMBOL_LENGTH = 8;     // space padded or NUL padded
+
+enum MessageType : uint8_t {
+    NEW_ORDER = 'N',
+    CANCEL = 'X',
+    REPLACE = 'U',
+    ACCEPTED = 'A',
+    REJECTED = 'J',
+    CANCELED = 'C',
+    REPLACED = 'R',
+    EXECUTED = 'E'
+};
+
+enum Side : uint8_t {
+    BUY = 'B',
+    SELL = 'S'
+};
+
+enum Liquidity : uint8_t {
+    ADDED = 'A',        // the order was resting
+    REMOVED = 'R'       // the order was the aggressor
+};
+
+enum RejectReason : uint16_t {
+    MALFORMED = 1,          // unknown side or other bad field
+    UNKNOWN_SYMBOL = 2,
+    INVALID_PRICE = 3,
+    INVALID_QUANTITY = 4,
+    UNKNOWN_ORDER = 5,      // no live, acknowledged order with that token
+    DUPLICATE_TOKEN = 6,
+    ENGINE_REJECT = 7,      // the matching engine refused the command
+    TOO_LATE = 8,           // the order filled or was canceled first
+    CANCEL_PENDING = 9      // a cancel or replace for the order is in flight
+};
+
+struct Header {
+    uint16_t length;        // whole message, header included
+    uint8_t type;           // MessageType
+    uint8_t reserved;
+};
+
+struct NewOrder {
+    Header header;
+    uint32_t quantity;
+    uint64_t token;
+    int64_t price;
+    char symbol[SYMBOL_LENGTH];
+    uint8_t side;           // Side
+    uint8_t padding[7];
+};
+
+struct Cancel {
+    Header header;
+    uint32_t padding;
+    uint64_t token;
+};
+
+// Amends a live order to the new price and open quantity and renames it
+// new_token; it keeps its order id, and its time priority too if only the
+// quantity goes down at the same price
+struct Replace {
+    Header header;
+    uint32_t quantity;
+    uint64_t token;
+    uint64_t new_token;
+    int64_t price;
+};
+
+struct Accepted {
+    Header header;
+    uint32_t quantity;
+    uint64_t token;
+    uint64_t order_id;
+    int64_t price;
+    uint8_t side;
+    uint8_t padding[7];
+};
+
+struct Rejected {
+    Header header;
+    uint16_t reason;        // RejectReason
+    uint16_t padding;
+    uint64_t token;
+};
+
+struct Canceled {
+    Header header;
+    uint32_t padding;
+    uint64_t token;
+    uint64_t order_id;
+};
+
+struct Replaced {
+    Header header;
+    uint32_t quantity;
+    uint64_t token;         // the replaced order's token
+    uint64_t new_token;
+    uint64_t order_id;      // unchanged by the replace
+    int64_t price;
+};
+
+struct Executed {
+    Header header;
+    uint32_t quantity;
+    uint64_t token;
+    uint64_t order_id;
+    uint64_t trade_id;
+    int64_t price;
+    uint8_t liquidity;      // Liquidity
+    uint8_t padding[7];
+};
+
+static_assert(sizeof(Header) == 4, "wire layout");
+static_assert(sizeof(NewOrder) == 40, "wire layout");
+static_assert(sizeof(Cancel) == 16, "wire layout");
+static_assert(sizeof(Replace) == 32, "wire layout");
+static_assert(sizeof(Accepted) == 40, "wire layout");
+static_assert(sizeof(Rejected) == 16, "wire layout");
+static_assert(sizeof(Canceled) == 24, "wire layout");
+static_assert(sizeof(Replaced) == 40, "wire layout");
+static_assert(sizeof(Executed) == 48, "wire layout");
+
+constexpr size_t MAX_MESSAGE_SIZE = 64;
+
+// A zeroed message of type T with its header filled in
+template <typename T>
+T make(MessageType type) {
+    T message;
+    std::memset(&message, 0, sizeof(message));
+    message.header.length = static_cast<uint16_t>(sizeof(T));
+    message.header.type = type;
+    return message;
+}
+
+// Reads a message of type T straight out of the read buffer; false if the
+// frame is not exactly that size. memcpy because the frame may sit at any
+// alignment in the buffer (it compiles to plain loads).
+template <typename T>
+bool decode(std::string_view frame, T& message) {
+    if (frame.size() != sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&message, frame.data(), sizeof(T));
+    return true;
+}
+
+// The symbol without its padding
+inline std::string_view symbol_view(const char (&symbol)[SYMBOL_LENGTH]) {
+    size_t length = 0;
+    while (length < SYMBOL_LENGTH && symbol[length] != '\0' && symbol[length] != ' ') {
+        ++length;
+    }
+    return std::string_view(symbol, length);
+}
+
+} // namespace protocol
+} // namespace gateway
@@ -1,22 +1,36 @@
 /**
  * Trading Engine Main Application
  * 
- * Initializes and starts both HTTP API server and WebSocket server for the trading engine.
+ * Initializes and starts the HTTP API server, the binary order gateway and the
+ * WebSocket server for the trading engine, with the market data feed
+ * publishing trades and book changes to the WebSocket clients.
  * Handles graceful shutdown on SIGINT/SIGTERM signals.
+ *
+ * Usage: trading_engine [--journal-dir DIR] [--durability none|batch|every-write]
+ *                       [--snapshot-interval RECORDS] [--no-journal]
+ *                       [--http-workers N] [--http-backlog N]
+ *                       [--http-idle-timeout MS] [--http-max-requests N]
+ *                       [--gateway-port P]
  */
 
 #include "api/http_server.h"
 #include "api/trading_api.h"
+#include "feed/market_data_feed.h"
+#include "gateway/order_gateway.h"
 #include "websocket/websocket_server.h"
 #include <iostream>
 #include <signal.h>
 #include <memory>
 #include <thread>
+#include <vector>
+#include <string>
 
 // Global server instances for signal handling
 std::unique_ptr<api::HttpServer> server;
 std::unique_ptr<api::TradingApi> trading_api;
+std::unique_ptr<gateway::OrderGateway> order_gateway;
 std::unique_ptr<websocket::WebSocketServer> ws_server;
+std::unique_ptr<feed::MarketDataFeed> market_data_feed;
 
 // Signal handler for graceful shutdown
 void signal_handler(int signal) {
@@ -24,47 +38,135 @@ void signal_handler(int signal) {
     if (server) {
         server->stop();
     }
+    if (order_gateway) {
+        order_gateway->stop();
+    }
+    if (market_data_feed) {
+        market_data_feed->stop();
+    }
     if (ws_server) {
         ws_server->stop();
     }
     exit(0);
 }
 
-int main() {
+int main(int argc, char** argv) {
     // Set up signal handlers for graceful shutdown
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     
     try {
-        // Initialize trading API with order book
-        trading_api = std::make_unique<api::TradingApi>();
+        // Orders, cancels and trades are journaled here and replayed on restart
+        persistence::JournalConfig journal;
+        journal.directory = "journal";
+        api::HttpServerConfig http_config;
+        int gateway_port = 9001;    // 0 disables the binary gateway
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--journal-dir" && i + 1 < argc) {
+                journal.directory = argv[++i];
+            } else if (arg == "--durability" && i + 1 < argc) {
+                journal.durability = persistence::parse_durability(argv[++i]);
+            } else if (arg == "--snapshot-interval" && i + 1 < argc) {
+                journal.snapshot_interval = std::stoull(argv[++i]);
+            } else if (arg == "--no-journal") {
+                journal.directory.clear();
+            } else if (arg == "--http-workers" && i + 1 < argc) {
+                http_config.workers = std::stoul(argv[++i]);
+            } else if (arg == "--http-backlog" && i + 1 < argc) {
+                http_config.backlog = std::stoi(argv[++i]);
+            } else if (arg == "--http-idle-timeout" && i + 1 < argc) {
+                http_config.idle_timeout_ms = static_cast<uint32_t>(std::stoul(argv[++i]));
+            } else if (arg == "--http-max-requests" && i + 1 < argc) {
+                http_config.max_requests_per_connection = static_cast<uint32_t>(std::stoul(argv[++i]));
+            } else if (arg == "--gateway-port" && i + 1 < argc) {
+                gateway_port = std::stoi(argv[++i]);
+            } else {
+                std::cerr << "Usage: " << argv[0]
+                          << " [--journal-dir DIR] [--durability none|batch|every-write]"
+                          << " [--snapshot-interval RECORDS] [--no-journal]"
+                          << " [--http-workers N] [--http-backlog N]"
+                          << " [--http-idle-timeout MS] [--http-max-requests N]"
+                          << " [--gateway-port P]" << std::endl;
+                return 1;
+            }
+        }
+        
+        // Initialize trading API with one order book per instrument; the first
+        // symbol is used when a request does not pass ?symbol=
+        const std::vector<std::string> symbols = {api::TradingApi::DEFAULT_SYMBOL, "AAPL", "MSFT", "TSLA"};
+        trading_api = std::make_unique<api::TradingApi>(symbols, 0, journal);
+        
+        if (!journal.directory.empty()) {
+            const auto& recovery = trading_api->recovery_stats();
+            if (recovery.snapshots_loaded > 0) {
+                std::cout << "Loaded " << recovery.snapshot_orders << " resting orders from "
+                          << recovery.snapshots_loaded << " snapshot(s) in " << recovery.snapshot_seconds * 1000
+                          << " ms" << std::endl;
+            }
+            std::cout << "Replayed " << recovery.records << " journal records (" << recovery.orders << " orders, "
+                      << recovery.cancels << " cancels, " << recovery.amends
+                      << " amends, " << recovery.trades << " trades) from " << journal.directory
+                      << "; recovery took " << recovery.seconds * 1000 << " ms" << std::endl;
+            if (recovery.torn_journals > 0) {
+                std::cout << "Discarded a torn tail in " << recovery.torn_journals << " journal(s)" << std::endl;
+            }
+        }
         
         // Create HTTP server for REST API
-        server = std::make_unique<api::HttpServer>(8080);
+        server = std::make_unique<api::HttpServer>(8080, http_config);
+        
+        // Binary order entry on its own port, into the same matching engine
+        if (gateway_port > 0) {
+            order_gateway = std::make_unique<gateway::OrderGateway>(trading_api->engine(), gateway_port);
+        }
         
         // Create WebSocket server for real-time updates
         ws_server = std::make_unique<websocket::WebSocketServer>(8081);
+        market_data_feed = std::make_unique<feed::MarketDataFeed>(trading_api->engine(), *ws_server);
         
         // Register REST API routes
-        server->add_route("GET", "/api/orderbook", 
-                         [&](const api::HttpRequest& req) { 
-                             return trading_api->get_order_book(req); 
-                         });
+        // Symbol-scoped reads also take the symbol as a path segment
+        for (const char* path : {"/api/orderbook", "/api/orderbook/{symbol}"}) {
+            server->add_route("GET", path,
+                             [&](const api::HttpRequest& req) {
+                                 return trading_api->get_order_book(req);
+                             });
+        }
         
-        server->add_route("GET", "/api/trades", 
-                         [&](const api::HttpRequest& req) { 
-                             return trading_api->get_trades(req); 
-                         });
+        for (const char* path : {"/api/trades", "/api/trades/{symbol}"}) {
+            server->add_async_route("GET", path,
+                                   [&](const api::HttpRequest& req, api::HttpResponder respond) {
+                                       trading_api->get_trades(req, std::move(respond));
+                                   });
+        }
         
-        server->add_route("POST", "/api/orders", 
-                         [&](const api::HttpRequest& req) { 
-                             return trading_api->submit_order(req); 
-                         });
+        server->add_async_route("POST", "/api/orders",
+                               [&](const api::HttpRequest& req, api::HttpResponder respond) {
+                                   trading_api->submit_order(req, std::move(respond));
+                               });
         
-        server->add_route("GET", "/api/market-summary", 
-                         [&](const api::HttpRequest& req) { 
-                             return trading_api->get_market_summary(req); 
-                         });
+        server->add_async_route("POST", "/api/orders/batch",
+                               [&](const api::HttpRequest& req, api::HttpResponder respond) {
+                                   trading_api->submit_batch(req, std::move(respond));
+                               });
+        
+        server->add_async_route("DELETE", "/api/orders/{order_id}",
+                               [&](const api::HttpRequest& req, api::HttpResponder respond) {
+                                   trading_api->cancel_order(req, std::move(respond));
+                               });
+        
+        server->add_async_route("PATCH", "/api/orders/{order_id}",
+                               [&](const api::HttpRequest& req, api::HttpResponder respond) {
+                                   trading_api->amend_order(req, std::move(respond));
+                               });
+        
+        for (const char* path : {"/api/market-summary", "/api/market-summary/{symbol}"}) {
+            server->add_route("GET", path,
+                             [&](const api::HttpRequest& req) {
+                                 return trading_api->get_market_summary(req);
+                             });
+        }
         
         // Health check endpoint for monitoring
         server->add_route("GET", "/health", 
@@ -76,15 +178,25 @@ int main() {
         
         // Start both servers
         server->start();
+        if (order_gateway) {
+            order_gateway->start();
+        }
         ws_server->start();
+        market_data_feed->start();
         
         // Display server information
         std::cout << "Trading Engine API Server is running on port 8080" << std::endl;
+        if (order_gateway) {
+            std::cout << "Binary order gateway is running on port " << gateway_port << std::endl;
+        }
         std::cout << "WebSocket Server is running on port 8081" << std::endl;
-        std::cout << "Available endpoints:" << std::endl;
+        std::cout << "Available endpoints (pass ?symbol=<name>, default " << symbols.front() << "):" << std::endl;
         std::cout << "  GET  /api/orderbook     - Get current order book" << std::endl;
         std::cout << "  GET  /api/trades        - Get trade history" << std::endl;
         std::cout << "  POST /api/orders        - Submit new order" << std::endl;
+        std::cout << "  POST /api/orders/batch  - Submit orders and cancels in one request" << std::endl;
+        std::cout << "  DELETE /api/orders/{id} - Cancel an order" << std::endl;
+        std::cout << "  PATCH  /api/orders/{id} - Amend an order's price and quantity" << std::endl;
         std::cout << "  GET  /api/market-summary - Get market statistics" << std::endl;
         std::cout << "  GET  /health            - Health check" << std::endl;
         std::cout << "  WS   ws://localhost:8081/ws - WebSocket connection" << std::endl;
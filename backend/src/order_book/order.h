@@ -11,12 +11,13 @@ namespace order {
     };
 
     struct Order {
-        int order_id;
+        uint64_t order_id;
         OrderType type;
         int quantity;
         double price;
         std::string client_id;
         uint64_t timestamp;
+        std::string symbol;
     };
 }
 #endif
\ No newline at end of file
@@ -1,97 +1,311 @@
 #include "order_book.h"
 #include <iostream>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <iterator>
 
 using namespace std;
 using namespace order;
 using namespace trade;
 using namespace order_book;
 
-OrderBook::OrderBook() noexcept {}
+OrderBook::OrderBook(double tick_size, size_t reserve_orders) noexcept
+    : tick_size(tick_size), ticks_per_unit(1.0 / tick_size), buy_orders(true), sell_orders(false),
+      pool(reserve_orders), orders(reserve_orders) {}
+
+int64_t OrderBook::to_tick(double price) const {
+    double scaled = price * ticks_per_unit;
+    int64_t tick = llround(scaled);
+    if (tick <= 0 || fabs(scaled - static_cast<double>(tick)) > 1e-6) {
+        throw invalid_argument("Price " + to_string(price) + " is not a positive multiple of tick size " + to_string(tick_size));
+    }
+    return tick;
+}
+
+vector<Trade> OrderBook::submit(const Order& order) {
+    return execute(order, OrderStatus::NEW);
+}
+
+vector<Trade> OrderBook::execute(const Order& order, OrderStatus entry) {
+    int64_t tick = to_tick(order.price);
+    bool is_buy = order.type == OrderType::BUY;
+    PriceLadder& own = is_buy ? buy_orders : sell_orders;
+    PriceLadder& opposite = is_buy ? sell_orders : buy_orders;
+    // Reject before matching so a remainder can always be rested
+    if (!own.accepts(tick)) {
+        throw invalid_argument("Price " + to_string(order.price) + " is outside the order book's ladder range");
+    }
+    int remaining = order.quantity;
+    vector<Trade> fills;
+    note_order(order, entry, remaining);
+
+    while (remaining > 0 && !opposite.empty()) {
+        PriceLevel& level = opposite.best();
+        if (is_buy ? level.tick > tick : level.tick < tick) {
+            break;
+        }
+
+        OrderHandle resting_handle = level.head;
+        Order& resting = pool[resting_handle].order;
+        int quantity = min(remaining, resting.quantity);
+        uint64_t resting_id = resting.order_id;
+
+        remaining -= quantity;
+        resting.quantity -= quantity;
+        level.total_quantity -= quantity;
+        (is_buy ? sell_depth : buy_depth) -= quantity;
+        traded_volume += quantity;
+        traded_value += level.price * quantity;
+        note_level(is_buy ? OrderType::SELL : OrderType::BUY, level.tick);
+
+        fills.push_back({trade_id++, is_buy ? order.order_id : resting_id, is_buy ? resting_id : order.order_id,
+                         quantity, level.price, order.timestamp, order.symbol, order.order_id});
+        note_fill(order, remaining, fills.back());
+        note_fill(resting, resting.quantity, fills.back());
+
+        if (resting.quantity == 0) {
+            remove_order(opposite, level, resting_handle);
+        }
+    }
+
+    if (remaining > 0) {
+        rest_order(order, tick, remaining);
+    }
+
+    for (const auto& fill : fills) {
+        trades.push(fill);
+    }
+    return fills;
+}
+
+void OrderBook::restore_level(OrderType side, const PriceLevel& level) {
+    PriceLevel& restored = (side == OrderType::BUY ? buy_orders : sell_orders).activate(level.tick, to_price(level.tick));
+    restored.head = level.head;
+    restored.tail = level.tail;
+    restored.total_quantity = level.total_quantity;
+    restored.order_count = level.order_count;
+    (side == OrderType::BUY ? buy_depth : sell_depth) += level.total_quantity;
+}
+
+void OrderBook::finish_restore(int next_trade_id, int64_t volume, double value) {
+    pool.finish_restore();
+    trade_id = next_trade_id;
+    traded_volume = volume;
+    traded_value = value;
+}
 
 void OrderBook::add_order(const Order& order) {
-    if (order.type == OrderType::BUY) {
-        buy_orders[order.price].push_back(order);
-        orders[order.order_id] = {order.price, prev(buy_orders[order.price].end())};
+    note_order(order, OrderStatus::NEW, order.quantity);
+    rest_order(order, to_tick(order.price), order.quantity);
+}
+
+void OrderBook::rest_order(const Order& order, int64_t tick, int quantity) {
+    PriceLadder& ladder = order.type == OrderType::BUY ? buy_orders : sell_orders;
+    PriceLevel& level = ladder.activate(tick, to_price(tick));
+
+    OrderHandle handle = pool.allocate(order);
+    OrderNode& node = pool[handle];
+    node.order.quantity = quantity;
+    node.tick = tick;
+    node.prev = level.tail;
+    node.next = NULL_HANDLE;
+    if (level.tail != NULL_HANDLE) {
+        pool[level.tail].next = handle;
     } else {
-        sell_orders[order.price].push_back(order);
-        orders[order.order_id] = {order.price, prev(sell_orders[order.price].end())};
+        level.head = handle;
+    }
+    level.tail = handle;
+    level.total_quantity += quantity;
+    ++level.order_count;
+    (order.type == OrderType::BUY ? buy_depth : sell_depth) += quantity;
+    note_level(order.type, tick);
+
+    orders.insert(order.order_id, handle);
+}
+
+bool OrderBook::cancel_order(uint64_t order_id) {
+    OrderHandle handle = orders.find(order_id);
+    if (handle == NULL_HANDLE) { 
+        return false;
     }
+
+    OrderNode& node = pool[handle];
+    PriceLadder& ladder = node.order.type == OrderType::BUY ? buy_orders : sell_orders;
+    PriceLevel& level = *ladder.find(node.tick);
+    level.total_quantity -= node.order.quantity;
+    (node.order.type == OrderType::BUY ? buy_depth : sell_depth) -= node.order.quantity;
+    note_level(node.order.type, node.tick);
+    note_order(node.order, OrderStatus::CANCELED, 0);
+    remove_order(ladder, level, handle);
+    return true;
 }
 
-void OrderBook::cancel_order(int order_id) {
-    auto it = orders.find(order_id);
-    if (it == orders.end()) { 
-        return;
+bool OrderBook::amend_order(uint64_t order_id, int quantity, double price, vector<Trade>& fills) {
+    if (quantity <= 0) {
+        throw invalid_argument("Quantity must be positive");
     }
+    OrderHandle handle = orders.find(order_id);
+    if (handle == NULL_HANDLE) {
+        return false;
+    }
+    int64_t tick = to_tick(price);
 
-    double price = it->second.first;
-    auto iter = it->second.second;
+    OrderNode& node = pool[handle];
+    bool is_buy = node.order.type == OrderType::BUY;
+    PriceLadder& ladder = is_buy ? buy_orders : sell_orders;
+    PriceLevel& level = *ladder.find(node.tick);
+    if (tick == node.tick && quantity <= node.order.quantity) {
+        int reduction = node.order.quantity - quantity;
+        node.order.quantity = quantity;
+        level.total_quantity -= reduction;
+        (is_buy ? buy_depth : sell_depth) -= reduction;
+        note_level(node.order.type, node.tick);
+        note_order(node.order, OrderStatus::AMENDED, quantity);
+        return true;
+    }
+    // Checked while the order still rests so a refused amend leaves it as
+    // it was (conservative if the order alone holds an extreme level)
+    if (tick != node.tick && !ladder.accepts(tick)) {
+        throw invalid_argument("Price " + to_string(price) + " is outside the order book's ladder range");
+    }
 
-    if (buy_orders.count(price)) {
-        buy_orders[price].erase(iter);
-        if (buy_orders[price].empty()) {
-            buy_orders.erase(price);
-        }
+    Order amended = node.order;
+    amended.quantity = quantity;
+    amended.price = to_price(tick);
+    level.total_quantity -= node.order.quantity;
+    (is_buy ? buy_depth : sell_depth) -= node.order.quantity;
+    note_level(node.order.type, node.tick);
+    remove_order(ladder, level, handle);
+
+    vector<Trade> amend_fills = execute(amended, OrderStatus::AMENDED);
+    fills.insert(fills.end(), amend_fills.begin(), amend_fills.end());
+    return true;
+}
+
+// Unlinks an order from its level in O(1), returns the node to the pool and
+// retires the level if it is now empty. Callers have already taken the
+// order's remaining quantity out of the level and depth totals.
+void OrderBook::remove_order(PriceLadder& ladder, PriceLevel& level, OrderHandle handle) {
+    OrderNode& node = pool[handle];
+    if (node.prev != NULL_HANDLE) {
+        pool[node.prev].next = node.next;
     } else {
-        sell_orders[price].erase(iter);
-        if (sell_orders[price].empty()) {
-            sell_orders.erase(price);
-        }
+        level.head = node.next;
+    }
+    if (node.next != NULL_HANDLE) {
+        pool[node.next].prev = node.prev;
+    } else {
+        level.tail = node.prev;
     }
 
-    orders.erase(it);
+    --level.order_count;
+    orders.erase(node.order.order_id);
+    pool.release(handle);
+    if (level.head == NULL_HANDLE) {
+        ladder.deactivate(level.tick);
+    }
+}
+
+void OrderBook::set_track_level_changes(bool enabled) {
+    track_level_changes = enabled;
+    changed_bids.clear();
+    changed_asks.clear();
+}
+
+void OrderBook::take_level_changes(vector<LevelUpdate>& changes) {
+    auto report = [&](OrderType side, vector<int64_t>& ticks) {
+        bool is_buy = side == OrderType::BUY;
+        PriceLadder& ladder = is_buy ? buy_orders : sell_orders;
+        if (is_buy) {
+            sort(ticks.begin(), ticks.end(), greater<int64_t>());
+        } else {
+            sort(ticks.begin(), ticks.end());
+        }
+        ticks.erase(unique(ticks.begin(), ticks.end()), ticks.end());
+        for (int64_t tick : ticks) {
+            const PriceLevel* level = ladder.find(tick);
+            changes.push_back({side, to_price(tick), level ? level->total_quantity : 0,
+                               level ? level->order_count : 0});
+        }
+        ticks.clear();
+    };
+    report(OrderType::BUY, changed_bids);
+    report(OrderType::SELL, changed_asks);
+}
+
+void OrderBook::set_track_order_updates(bool enabled) {
+    track_order_updates = enabled;
+    order_updates.clear();
+}
+
+void OrderBook::take_order_updates(vector<OrderUpdate>& updates) {
+    if (order_updates.empty()) return;
+    updates.insert(updates.end(), make_move_iterator(order_updates.begin()), make_move_iterator(order_updates.end()));
+    order_updates.clear();
 }
 
 void OrderBook::match_orders() {
     while (!buy_orders.empty() && !sell_orders.empty()) {
-        auto buy_it = buy_orders.begin();
-        auto sell_it = sell_orders.begin();
+        PriceLevel& buy_level = buy_orders.best();
+        PriceLevel& sell_level = sell_orders.best();
         
-        if (buy_it->first < sell_it->first) {
+        if (buy_level.tick < sell_level.tick) {
             break;
         }
 
-        int quantity = min(buy_it->second.front().quantity, sell_it->second.front().quantity);
+        OrderHandle buy_handle = buy_level.head;
+        OrderHandle sell_handle = sell_level.head;
+        Order& buy_order = pool[buy_handle].order;
+        Order& sell_order = pool[sell_handle].order;
+        int quantity = min(buy_order.quantity, sell_order.quantity);
         
-        int buy_order_id = buy_it->second.front().order_id;
-        int sell_order_id = sell_it->second.front().order_id;
-        double trade_price = sell_it->first; 
-        uint64_t trade_timestamp = buy_it->second.front().timestamp;
+        uint64_t buy_order_id = buy_order.order_id;
+        uint64_t sell_order_id = sell_order.order_id;
+        double trade_price = sell_level.price; 
+        uint64_t trade_timestamp = buy_order.timestamp;
         
-        buy_it->second.front().quantity -= quantity;
-        sell_it->second.front().quantity -= quantity;
-
-        if (buy_it->second.front().quantity == 0) {
-            buy_orders[buy_it->first].pop_front();
-            if (buy_orders[buy_it->first].empty()) {
-                buy_orders.erase(buy_it->first);
-            }
+        buy_order.quantity -= quantity;
+        sell_order.quantity -= quantity;
+        buy_level.total_quantity -= quantity;
+        sell_level.total_quantity -= quantity;
+        buy_depth -= quantity;
+        sell_depth -= quantity;
+        traded_volume += quantity;
+        traded_value += trade_price * quantity;
+        note_level(OrderType::BUY, buy_level.tick);
+        note_level(OrderType::SELL, sell_level.tick);
+        // Only add_order() leaves the book crossed, so the newer order is the one that arrived
+        Trade fill{trade_id++, buy_order_id, sell_order_id, quantity, trade_price, trade_timestamp, buy_order.symbol,
+                   max(buy_order_id, sell_order_id)};
+        trades.push(fill);
+        note_fill(buy_order, buy_order.quantity, fill);
+        note_fill(sell_order, sell_order.quantity, fill);
+
+        if (buy_order.quantity == 0) {
+            remove_order(buy_orders, buy_level, buy_handle);
         }   
 
-        if (sell_it->second.front().quantity == 0) {
-            sell_orders[sell_it->first].pop_front();
-            if (sell_orders[sell_it->first].empty()) {
-                sell_orders.erase(sell_it->first);
-            }
+        if (sell_order.quantity == 0) {
+            remove_order(sell_orders, sell_level, sell_handle);
         }
-
-        trades.push_back({trade_id++, buy_order_id, sell_order_id, quantity, trade_price, trade_timestamp});
     }
 }
 
 void OrderBook::print_order_book() const {
     cout << "Buy Orders:" << endl;
-    for (const auto& [price, orders] : buy_orders) {
-        cout << "Price: " << price << ", Quantity: " << orders.front().quantity << endl;
+    for (const auto& level : buy_orders) {
+        cout << "Price: " << level.price << ", Quantity: " << level.total_quantity << ", Orders: " << level.order_count << endl;
     }
 
     cout << "Sell Orders:" << endl;
-    for (const auto& [price, orders] : sell_orders) {
-        cout << "Price: " << price << ", Quantity: " << orders.front().quantity << endl;
+    for (const auto& level : sell_orders) {
+        cout << "Price: " << level.price << ", Quantity: " << level.total_quantity << ", Orders: " << level.order_count << endl;
     }
 
     cout << "Trades:" << endl;
-    for (const auto& trade : trades) {
+    trades.for_each_since(-1, trades.size(), [](const Trade& trade) {
         cout << "Trade ID: " << trade.trade_id << ", Buy Order ID: " << trade.buy_order_id << ", Sell Order ID: " << trade.sell_order_id << ", Quantity: " << trade.quantity << ", Price: " << trade.price << ", Timestamp: " << trade.timestamp << endl;
-    }
-}
\ No newline at end of file
+    });
+}
@@ -1,40 +1,173 @@
 #ifndef ORDER_BOOK_H
 #define ORDER_BOOK_H
 
-#include <unordered_map>
-#include <map>
 #include <vector>
-#include <deque>
 #include <cstdint>
 #include "order.h"
 #include "trade.h"
+#include "price_ladder.h"
+#include "order_pool.h"
+#include "order_index.h"
+#include "trade_ring.h"
 
 using namespace std;
 using namespace order;
 using namespace trade;
 
 namespace order_book {
+    // A price level's aggregate after a change; quantity 0 means the level
+    // is gone
+    struct LevelUpdate {
+        OrderType side;
+        double price;
+        int64_t quantity;
+        uint32_t order_count;
+    };
+
+    enum class OrderStatus {
+        NEW,                // entered the book (fills, if any, follow)
+        PARTIALLY_FILLED,
+        FILLED,
+        CANCELED,
+        AMENDED             // quantity or price changed (fills, if any, follow)
+    };
+
+    // A change to one order. open is what is left of it afterwards (0 once
+    // it is done); a fill also carries its quantity, price and trade.
+    struct OrderUpdate {
+        uint64_t order_id;
+        OrderType side;
+        OrderStatus status;
+        double price;
+        int open;
+        int filled;
+        double fill_price;
+        int trade_id;       // -1 unless a fill
+        string client_id;
+        string symbol;
+    };
+
     class OrderBook {
         public:
-        OrderBook() noexcept;
+        static constexpr double DEFAULT_TICK_SIZE = 0.01;
+
+        explicit OrderBook(double tick_size = DEFAULT_TICK_SIZE, size_t reserve_orders = OrderPool::CHUNK_SIZE) noexcept;
+
+        // Matches an incoming order against the opposite side, best price
+        // first, and rests any remainder. Fills execute at the resting
+        // order's price and are returned as well as recorded in the history.
+        vector<Trade> submit(const Order& order);
+        // Returns false if the order is not resting (unknown, filled or cancelled)
+        bool cancel_order(uint64_t order_id);
+        // Changes a resting order's open quantity and price, found by id in
+        // O(1). Reducing the quantity at the same price edits the order in
+        // place and keeps its time priority; any other change re-enters it
+        // under the same id behind the orders at the new price, matching
+        // first if it now crosses, with any fills added to fills. Returns
+        // false if the order is not resting; throws invalid_argument for a
+        // non-positive quantity or an invalid price, leaving the order as it was.
+        bool amend_order(uint64_t order_id, int quantity, double price, vector<Trade>& fills);
+        void print_order_book() const;
+
+        // Compatibility path: rest without matching, then sweep the crossed
+        // book. submit() is preferred as the book is never left crossed.
         void add_order(const Order& order);
-        void cancel_order(int order_id);
         void match_orders();
-        void print_order_book() const;
-        
-        // Public accessors for API
-        const map<double, deque<Order>, greater<double>>& get_buy_orders() const { return buy_orders; }
-        const map<double, deque<Order>>& get_sell_orders() const { return sell_orders; }
-        const vector<Trade>& get_trades() const { return trades; }
+
+        // Price <-> integer tick conversion. add_order rejects prices that are
+        // not a positive multiple of the tick size.
+        double get_tick_size() const { return tick_size; }
+        int64_t to_tick(double price) const;
+        double to_price(int64_t tick) const { return static_cast<double>(tick) / ticks_per_unit; }
         
+        // Public accessors for API; ladders iterate from best to worst price
+        const PriceLadder& get_buy_orders() const { return buy_orders; }
+        const PriceLadder& get_sell_orders() const { return sell_orders; }
+        OrderRange get_level_orders(const PriceLevel& level) const { return OrderRange(pool, level.head); }
+        // The most recent trades; older ones are only kept in the journal
+        const TradeRing& get_trades() const { return trades; }
+        size_t order_count() const { return pool.size(); }
+
+        // Running totals, maintained incrementally so summaries are O(1)
+        int64_t get_buy_depth() const { return buy_depth; }
+        int64_t get_sell_depth() const { return sell_depth; }
+        int64_t get_traded_volume() const { return traded_volume; }
+        double get_traded_value() const { return traded_value; }
+        int get_next_trade_id() const { return trade_id; }
+
+        // Snapshot support. A snapshot copies the pool nodes, the non-empty
+        // levels and the id index as they are, so restoring into an empty
+        // book needs no matching or re-insertion: restore the nodes in
+        // ascending handle order, then the levels and the index, then call
+        // finish_restore().
+        const OrderPool& get_pool() const { return pool; }
+        const OrderIndex& get_index() const { return orders; }
+
+        // Level change tracking for incremental market data. While enabled,
+        // every level whose aggregate changes is noted, and take_level_changes
+        // reports each of them once with its current aggregate (best first
+        // per side, bids before asks) and starts over. Off by default, so
+        // matching pays nothing for it unless someone listens.
+        void set_track_level_changes(bool enabled);
+        void take_level_changes(vector<LevelUpdate>& changes);
+        // Order update tracking, likewise off by default. While enabled,
+        // every change to an order is recorded in the order it happens, for
+        // the aggressor and the resting side of each fill alike, and
+        // take_order_updates appends them to updates and starts over.
+        void set_track_order_updates(bool enabled);
+        void take_order_updates(vector<OrderUpdate>& updates);
+        void restore_node(OrderHandle handle, const OrderNode& node) { pool.restore(handle, node); }
+        void restore_level(OrderType side, const PriceLevel& level);
+        void restore_index(vector<OrderIndex::Slot> slots, size_t size) { orders.restore(std::move(slots), size); }
+        void finish_restore(int next_trade_id, int64_t volume, double value);
 
         private:
+        double tick_size;
+        double ticks_per_unit;
         int trade_id = 0;
-        map<double, deque<Order>, greater<double>> buy_orders;
-        map<double, deque<Order>> sell_orders;
-        unordered_map<int, pair<double, deque<Order>::iterator>> orders;
-        vector<Trade> trades;
+        int64_t buy_depth = 0;
+        int64_t sell_depth = 0;
+        int64_t traded_volume = 0;
+        double traded_value = 0;
+        PriceLadder buy_orders;
+        PriceLadder sell_orders;
+        OrderPool pool;
+        OrderIndex orders;
+        TradeRing trades;
+        bool track_level_changes = false;
+        vector<int64_t> changed_bids;   // ticks, possibly repeated
+        vector<int64_t> changed_asks;
+        bool track_order_updates = false;
+        vector<OrderUpdate> order_updates;
+
+        void note_level(OrderType side, int64_t tick) {
+            if (track_level_changes) {
+                vector<int64_t>& changed = side == OrderType::BUY ? changed_bids : changed_asks;
+                if (changed.empty() || changed.back() != tick) {
+                    changed.push_back(tick);
+                }
+            }
+        }
+
+        void note_order(const Order& order, OrderStatus status, int open) {
+            if (track_order_updates) {
+                order_updates.push_back({order.order_id, order.type, status, order.price, open, 0, 0, -1,
+                                         order.client_id, order.symbol});
+            }
+        }
+
+        void note_fill(const Order& order, int open, const Trade& fill) {
+            if (track_order_updates) {
+                order_updates.push_back({order.order_id, order.type,
+                                         open == 0 ? OrderStatus::FILLED : OrderStatus::PARTIALLY_FILLED,
+                                         order.price, open, fill.quantity, fill.price, fill.trade_id,
+                                         order.client_id, order.symbol});
+            }
+        }
 
+        vector<Trade> execute(const Order& order, OrderStatus entry);
+        void rest_order(const Order& order, int64_t tick, int quantity);
+        void remove_order(PriceLadder& ladder, PriceLevel& level, OrderHandle handle);
     };
 }
-#endif
\ No newline at end of file
+#endif
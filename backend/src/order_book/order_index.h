@@ -0,0 +1,115 @@
+#ifndef ORDER_INDEX_H
+#define ORDER_INDEX_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "order_pool.h"
+
+using namespace std;
+
+namespace order_book {
+    // Open-addressing hash map from order id to pool handle. Linear probing
+    // with backward-shift deletion keeps lookups short without tombstones,
+    // and the table only allocates when it doubles.
+    class OrderIndex {
+        public:
+        explicit OrderIndex(size_t reserve = 1024) {
+            size_t capacity = 16;
+            while (capacity < reserve * 2) {
+                capacity *= 2;
+            }
+            slots_.assign(capacity, Slot{0, NULL_HANDLE});
+            mask_ = capacity - 1;
+        }
+
+        OrderHandle find(uint64_t order_id) const {
+            for (size_t i = hash(order_id); ; i = (i + 1) & mask_) {
+                const Slot& slot = slots_[i];
+                if (slot.handle == NULL_HANDLE) {
+                    return NULL_HANDLE;
+                }
+                if (slot.order_id == order_id) {
+                    return slot.handle;
+                }
+            }
+        }
+
+        // Inserts or overwrites the handle stored for order_id.
+        void insert(uint64_t order_id, OrderHandle handle) {
+            if ((size_ + 1) * 2 > slots_.size()) {
+                rehash(slots_.size() * 2);
+            }
+            for (size_t i = hash(order_id); ; i = (i + 1) & mask_) {
+                Slot& slot = slots_[i];
+                if (slot.handle == NULL_HANDLE) {
+                    slot = {order_id, handle};
+                    ++size_;
+                    return;
+                }
+                if (slot.order_id == order_id) {
+                    slot.handle = handle;
+                    return;
+                }
+            }
+        }
+
+        void erase(uint64_t order_id) {
+            size_t i = hash(order_id);
+            while (slots_[i].handle != NULL_HANDLE && slots_[i].order_id != order_id) {
+                i = (i + 1) & mask_;
+            }
+            if (slots_[i].handle == NULL_HANDLE) {
+                return;
+            }
+            // Shift later entries of the probe run back into the hole
+            for (size_t j = (i + 1) & mask_; slots_[j].handle != NULL_HANDLE; j = (j + 1) & mask_) {
+                size_t home = hash(slots_[j].order_id);
+                if (((j - home) & mask_) >= ((j - i) & mask_)) {
+                    slots_[i] = slots_[j];
+                    i = j;
+                }
+            }
+            slots_[i].handle = NULL_HANDLE;
+            --size_;
+        }
+
+        size_t size() const { return size_; }
+
+        struct Slot {
+            uint64_t order_id;
+            OrderHandle handle;
+        };
+
+        // Raw table access for snapshots: the table is copied and restored
+        // as-is, so a restored index needs no rehashing.
+        const vector<Slot>& slots() const { return slots_; }
+        void restore(vector<Slot> slots, size_t size) {
+            slots_ = std::move(slots);
+            mask_ = slots_.size() - 1;
+            size_ = size;
+        }
+
+        private:
+        vector<Slot> slots_;
+        size_t mask_ = 0;
+        size_t size_ = 0;
+
+        size_t hash(uint64_t order_id) const {
+            return static_cast<size_t>((order_id * 0x9E3779B97F4A7C15ull) >> 32) & mask_;
+        }
+
+        void rehash(size_t capacity) {
+            vector<Slot> old = std::move(slots_);
+            slots_.assign(capacity, Slot{0, NULL_HANDLE});
+            mask_ = capacity - 1;
+            size_ = 0;
+            for (const Slot& slot : old) {
+                if (slot.handle != NULL_HANDLE) {
+                    insert(slot.order_id, slot.handle);
+                }
+            }
+        }
+    };
+}
+#endif
@@ -0,0 +1,142 @@
+#ifndef ORDER_POOL_H
+#define ORDER_POOL_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "order.h"
+
+using namespace std;
+using namespace order;
+
+namespace order_book {
+    // Stable reference to a pooled order node. Handles are indices, so they
+    // stay valid when the pool grows.
+    using OrderHandle = uint32_t;
+    constexpr OrderHandle NULL_HANDLE = UINT32_MAX;
+
+    // A resting order linked into its price level's FIFO queue.
+    struct OrderNode {
+        Order order;
+        int64_t tick;
+        OrderHandle prev;
+        OrderHandle next;
+    };
+
+    // Slab allocator for order nodes. Nodes live in fixed-size chunks that are
+    // never moved or freed; released nodes go on an intrusive free list and
+    // are reused before a new chunk is allocated.
+    class OrderPool {
+        public:
+        static constexpr size_t CHUNK_BITS = 12;
+        static constexpr size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+
+        explicit OrderPool(size_t reserve_count = CHUNK_SIZE) {
+            reserve(reserve_count);
+        }
+
+        OrderHandle allocate(const Order& order) {
+            if (free_head_ == NULL_HANDLE) {
+                add_chunk();
+            }
+            OrderHandle handle = free_head_;
+            OrderNode& node = (*this)[handle];
+            free_head_ = node.next;
+            node.order = order;
+            ++size_;
+            return handle;
+        }
+
+        void release(OrderHandle handle) {
+            (*this)[handle].next = free_head_;
+            free_head_ = handle;
+            --size_;
+        }
+
+        OrderNode& operator[](OrderHandle handle) { return chunks_[handle >> CHUNK_BITS][handle & (CHUNK_SIZE - 1)]; }
+        const OrderNode& operator[](OrderHandle handle) const { return chunks_[handle >> CHUNK_BITS][handle & (CHUNK_SIZE - 1)]; }
+
+        size_t size() const { return size_; }
+        size_t capacity() const { return chunks_.size() * CHUNK_SIZE; }
+        void reserve(size_t count) {
+            while (capacity() < count) {
+                add_chunk();
+            }
+        }
+
+        // Snapshot restore into an empty pool: place nodes at their original
+        // handles in ascending order, then finish_restore() puts every handle
+        // that was skipped back on the free list.
+        void restore(OrderHandle handle, const OrderNode& node) {
+            reserve(static_cast<size_t>(handle) + 1);
+            for (; restore_cursor_ < handle; ++restore_cursor_) {
+                skipped_.push_back(restore_cursor_);
+            }
+            (*this)[handle] = node;
+            restore_cursor_ = handle + 1;
+            ++size_;
+        }
+
+        void finish_restore() {
+            // Restored nodes overwrote links of the original free list, so rebuild it
+            free_head_ = NULL_HANDLE;
+            for (OrderHandle handle = static_cast<OrderHandle>(capacity()); handle-- > restore_cursor_; ) {
+                (*this)[handle].next = free_head_;
+                free_head_ = handle;
+            }
+            for (auto it = skipped_.rbegin(); it != skipped_.rend(); ++it) {
+                (*this)[*it].next = free_head_;
+                free_head_ = *it;
+            }
+            skipped_.clear();
+            skipped_.shrink_to_fit();
+            restore_cursor_ = 0;
+        }
+
+        private:
+        vector<unique_ptr<OrderNode[]>> chunks_;
+        OrderHandle free_head_ = NULL_HANDLE;
+        size_t size_ = 0;
+        OrderHandle restore_cursor_ = 0;
+        vector<OrderHandle> skipped_;
+
+        void add_chunk() {
+            OrderHandle first = static_cast<OrderHandle>(capacity());
+            chunks_.emplace_back(new OrderNode[CHUNK_SIZE]);
+            OrderNode* chunk = chunks_.back().get();
+            // Thread the new nodes onto the free list in ascending order
+            for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+                chunk[i].next = i + 1 < CHUNK_SIZE ? first + static_cast<OrderHandle>(i + 1) : free_head_;
+            }
+            free_head_ = first;
+        }
+    };
+
+    // Iterates the orders of one price level, oldest first.
+    class OrderRange {
+        public:
+        class const_iterator {
+            public:
+            const_iterator(const OrderPool* pool, OrderHandle handle) : pool_(pool), handle_(handle) {}
+            const Order& operator*() const { return (*pool_)[handle_].order; }
+            const Order* operator->() const { return &(*pool_)[handle_].order; }
+            const_iterator& operator++() { handle_ = (*pool_)[handle_].next; return *this; }
+            bool operator==(const const_iterator& other) const { return handle_ == other.handle_; }
+            bool operator!=(const const_iterator& other) const { return handle_ != other.handle_; }
+
+            private:
+            const OrderPool* pool_;
+            OrderHandle handle_;
+        };
+
+        OrderRange(const OrderPool& pool, OrderHandle head) : pool_(&pool), head_(head) {}
+        const_iterator begin() const { return const_iterator(pool_, head_); }
+        const_iterator end() const { return const_iterator(pool_, NULL_HANDLE); }
+
+        private:
+        const OrderPool* pool_;
+        OrderHandle head_;
+    };
+}
+#endif
@@ -0,0 +1,155 @@
+#include "price_ladder.h"
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+using namespace order_book;
+
+namespace {
+    constexpr size_t INITIAL_LEVELS = 1024;
+    constexpr size_t WORD_BITS = 64;
+
+    size_t round_up_to_word(size_t n) {
+        return (n + WORD_BITS - 1) / WORD_BITS * WORD_BITS;
+    }
+}
+
+PriceLadder::PriceLadder(bool descending, size_t max_levels) noexcept
+    : descending_(descending), max_levels_(round_up_to_word(max(max_levels, INITIAL_LEVELS))) {}
+
+PriceLevel& PriceLadder::activate(int64_t tick, double price) {
+    if (levels_.empty() || tick < base_ || tick >= base_ + static_cast<int64_t>(levels_.size())) {
+        grow(tick);
+    }
+
+    ptrdiff_t index = tick - base_;
+    PriceLevel& level = levels_[index];
+    uint64_t& word = bitmap_[index / WORD_BITS];
+    uint64_t bit = uint64_t(1) << (index % WORD_BITS);
+    if (!(word & bit)) {
+        word |= bit;
+        level.tick = tick;
+        level.price = price;
+        ++active_;
+        if (best_ < 0 || (descending_ ? index > best_ : index < best_)) {
+            best_ = index;
+        }
+    }
+    return level;
+}
+
+void PriceLadder::deactivate(int64_t tick) {
+    ptrdiff_t index = tick - base_;
+    bitmap_[index / WORD_BITS] &= ~(uint64_t(1) << (index % WORD_BITS));
+    --active_;
+    if (index == best_) {
+        best_ = next_active(index);
+    }
+}
+
+bool PriceLadder::accepts(int64_t tick) const {
+    if (active_ == 0 || (tick >= base_ && tick < base_ + static_cast<int64_t>(levels_.size()))) {
+        return true;
+    }
+    int64_t low = min(base_ + lowest_active(), tick);
+    int64_t high = max(base_ + highest_active(), tick);
+    return static_cast<size_t>(high - low + 1) <= max_levels_;
+}
+
+PriceLevel* PriceLadder::find(int64_t tick) {
+    if (tick < base_ || tick >= base_ + static_cast<int64_t>(levels_.size())) {
+        return nullptr;
+    }
+    ptrdiff_t index = tick - base_;
+    if (!(bitmap_[index / WORD_BITS] & (uint64_t(1) << (index % WORD_BITS)))) {
+        return nullptr;
+    }
+    return &levels_[index];
+}
+
+void PriceLadder::grow(int64_t tick) {
+    if (active_ == 0) {
+        // Nothing is resting, so the window can simply be re-centred on tick.
+        if (levels_.empty()) {
+            levels_.resize(INITIAL_LEVELS);
+            bitmap_.assign(INITIAL_LEVELS / WORD_BITS, 0);
+        }
+        base_ = tick - static_cast<int64_t>(levels_.size() / 2);
+        return;
+    }
+
+    ptrdiff_t low_index = lowest_active();
+    int64_t low = min(base_ + low_index, tick);
+    int64_t high = max(base_ + highest_active(), tick);
+    size_t span = static_cast<size_t>(high - low + 1);
+    if (span > max_levels_) {
+        throw invalid_argument("Price is outside the order book's ladder range");
+    }
+
+    size_t new_size = levels_.size();
+    while (new_size < 2 * span && new_size < max_levels_) {
+        new_size *= 2;
+    }
+    new_size = min(new_size, max_levels_);
+    int64_t new_base = low - static_cast<int64_t>((new_size - span) / 2);
+
+    vector<PriceLevel> levels(new_size);
+    vector<uint64_t> bitmap(new_size / WORD_BITS, 0);
+    for (ptrdiff_t index = low_index; index >= 0; index = lowest_above(index)) {
+        ptrdiff_t moved = base_ + index - new_base;
+        levels[moved] = levels_[index];
+        bitmap[moved / WORD_BITS] |= uint64_t(1) << (moved % WORD_BITS);
+    }
+    best_ += base_ - new_base;
+    base_ = new_base;
+    levels_ = std::move(levels);
+    bitmap_ = std::move(bitmap);
+}
+
+ptrdiff_t PriceLadder::lowest_active() const {
+    return descending_ ? lowest_above(-1) : best_;
+}
+
+ptrdiff_t PriceLadder::highest_active() const {
+    return descending_ ? best_ : highest_below(static_cast<ptrdiff_t>(levels_.size()));
+}
+
+ptrdiff_t PriceLadder::next_active(ptrdiff_t index) const {
+    return descending_ ? highest_below(index) : lowest_above(index);
+}
+
+ptrdiff_t PriceLadder::highest_below(ptrdiff_t index) const {
+    if (index <= 0) {
+        return -1;
+    }
+    size_t i = static_cast<size_t>(index - 1);
+    size_t w = i / WORD_BITS;
+    uint64_t word = bitmap_[w] & (~uint64_t(0) >> (WORD_BITS - 1 - i % WORD_BITS));
+    while (true) {
+        if (word) {
+            return static_cast<ptrdiff_t>(w * WORD_BITS + WORD_BITS - 1 - __builtin_clzll(word));
+        }
+        if (w == 0) {
+            return -1;
+        }
+        word = bitmap_[--w];
+    }
+}
+
+ptrdiff_t PriceLadder::lowest_above(ptrdiff_t index) const {
+    size_t i = static_cast<size_t>(index + 1);
+    if (i >= levels_.size()) {
+        return -1;
+    }
+    size_t w = i / WORD_BITS;
+    uint64_t word = bitmap_[w] & (~uint64_t(0) << (i % WORD_BITS));
+    while (true) {
+        if (word) {
+            return static_cast<ptrdiff_t>(w * WORD_BITS + __builtin_ctzll(word));
+        }
+        if (++w >= bitmap_.size()) {
+            return -1;
+        }
+        word = bitmap_[w];
+    }
+}
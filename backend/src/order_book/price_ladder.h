@@ -0,0 +1,83 @@
+#ifndef PRICE_LADDER_H
+#define PRICE_LADDER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "order_pool.h"
+
+using namespace std;
+
+namespace order_book {
+    // Resting orders at one tick, kept as an intrusive FIFO of pool nodes
+    // (head is the oldest order). The book keeps the aggregate remaining
+    // quantity and order count up to date as orders rest, fill and cancel.
+    struct PriceLevel {
+        int64_t tick = 0;
+        double price = 0;
+        OrderHandle head = NULL_HANDLE;
+        OrderHandle tail = NULL_HANDLE;
+        int64_t total_quantity = 0;
+        uint32_t order_count = 0;
+    };
+
+    // Contiguous array of price levels indexed by integer tick, with a bitmap
+    // of non-empty levels and a cursor on the best one. Bids keep the highest
+    // tick as best (descending), asks the lowest.
+    class PriceLadder {
+        public:
+        static constexpr size_t DEFAULT_MAX_LEVELS = size_t(1) << 20;
+
+        explicit PriceLadder(bool descending, size_t max_levels = DEFAULT_MAX_LEVELS) noexcept;
+
+        // Returns the level for tick, growing the ladder if needed and marking
+        // it non-empty. Throws std::invalid_argument if the ladder would have
+        // to span more than max_levels ticks.
+        PriceLevel& activate(int64_t tick, double price);
+        // True if activate(tick) would succeed without exceeding max_levels.
+        bool accepts(int64_t tick) const;
+        // Marks a level empty once its last order has gone.
+        void deactivate(int64_t tick);
+
+        bool empty() const { return best_ < 0; }
+        size_t size() const { return active_; }
+        PriceLevel& best() { return levels_[best_]; }
+        const PriceLevel& best() const { return levels_[best_]; }
+        PriceLevel* find(int64_t tick);
+
+        class const_iterator {
+            public:
+            const_iterator(const PriceLadder* ladder, ptrdiff_t index) : ladder_(ladder), index_(index) {}
+            const PriceLevel& operator*() const { return ladder_->levels_[index_]; }
+            const PriceLevel* operator->() const { return &ladder_->levels_[index_]; }
+            const_iterator& operator++() { index_ = ladder_->next_active(index_); return *this; }
+            bool operator==(const const_iterator& other) const { return index_ == other.index_; }
+            bool operator!=(const const_iterator& other) const { return index_ != other.index_; }
+
+            private:
+            const PriceLadder* ladder_;
+            ptrdiff_t index_;
+        };
+
+        // Iterates non-empty levels from best to worst.
+        const_iterator begin() const { return const_iterator(this, best_); }
+        const_iterator end() const { return const_iterator(this, -1); }
+
+        private:
+        bool descending_;
+        size_t max_levels_;
+        int64_t base_ = 0;
+        ptrdiff_t best_ = -1;
+        size_t active_ = 0;
+        vector<PriceLevel> levels_;
+        vector<uint64_t> bitmap_;
+
+        void grow(int64_t tick);
+        ptrdiff_t lowest_active() const;
+        ptrdiff_t highest_active() const;
+        ptrdiff_t next_active(ptrdiff_t index) const;
+        ptrdiff_t highest_below(ptrdiff_t index) const;
+        ptrdiff_t lowest_above(ptrdiff_t index) const;
+    };
+}
+#endif
@@ -7,11 +7,15 @@
 namespace trade {
     struct Trade {
         int trade_id;
-        int buy_order_id;
-        int sell_order_id;
+        uint64_t buy_order_id;
+        uint64_t sell_order_id;
         int quantity;
         double price;
         uint64_t timestamp;
+        std::string symbol;
+        // The incoming order, which took liquidity; not always the newer
+        // id, as a re-priced amend keeps its id
+        uint64_t aggressor_order_id;
     };
 }
 #endif
\ No newline at end of file
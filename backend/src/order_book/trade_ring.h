@@ -0,0 +1,75 @@
+#ifndef TRADE_RING_H
+#define TRADE_RING_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "trade.h"
+
+using namespace std;
+using namespace trade;
+
+namespace order_book {
+    // Fixed-capacity history of the most recent trades. Trade ids are issued
+    // consecutively by the book, so a trade's slot is its id modulo the
+    // capacity and reads by id need no search. The oldest trade is
+    // overwritten once the ring is full; every trade is also journaled, so
+    // the journal is the record of anything older.
+    class TradeRing {
+        public:
+        static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+        // capacity is rounded up to a power of two
+        explicit TradeRing(size_t capacity = DEFAULT_CAPACITY) {
+            size_t rounded = 1;
+            while (rounded < capacity) {
+                rounded *= 2;
+            }
+            trades_.resize(rounded);
+            mask_ = rounded - 1;
+        }
+
+        void push(const Trade& trade) {
+            if (size_ == 0) {
+                first_id_ = trade.trade_id;
+            } else if (size_ == trades_.size()) {
+                ++first_id_;
+            }
+            trades_[static_cast<size_t>(trade.trade_id) & mask_] = trade;
+            size_ = min(size_ + 1, trades_.size());
+        }
+
+        size_t size() const { return size_; }
+        size_t capacity() const { return trades_.size(); }
+        bool empty() const { return size_ == 0; }
+        // Id of the oldest retained trade; only meaningful when not empty
+        int64_t first_id() const { return first_id_; }
+        int64_t last_id() const { return first_id_ + static_cast<int64_t>(size_) - 1; }
+
+        // Calls fn for up to limit trades with an id above since_id, oldest
+        // first. A negative since_id starts from the oldest retained trade.
+        template <typename Fn>
+        void for_each_since(int64_t since_id, size_t limit, Fn fn) const {
+            if (size_ == 0) {
+                return;
+            }
+            int64_t id = max(since_id + 1, first_id_);
+            for (; id <= last_id() && limit > 0; ++id, --limit) {
+                fn(trades_[static_cast<size_t>(id) & mask_]);
+            }
+        }
+
+        // Calls fn for the most recent count trades, oldest first.
+        template <typename Fn>
+        void for_each_latest(size_t count, Fn fn) const {
+            for_each_since(last_id() - static_cast<int64_t>(min(count, size_)), count, fn);
+        }
+
+        private:
+        vector<Trade> trades_;
+        size_t mask_ = 0;
+        size_t size_ = 0;
+        int64_t first_id_ = 0;
+    };
+}
+#endif
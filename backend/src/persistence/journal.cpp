@@ -0,0 +1,476 @@
+/**
+ * Write-Ahead Journal Implementation
+ *
+ * File layout: a 64-byte header (magic, format version, record size and the
+ * shard layout the file was written under) followed by JournalRecords. Each
+ * record carries a checksum, so a torn write at the tail is detected on
+ * replay and cut off before new records are appended.
+ */
+
+#include "journal.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace persistence {
+
+namespace {
+    constexpr char MAGIC[8] = {'T', 'R', 'D', 'J', 'R', 'N', 'L', '1'};
+    constexpr uint32_t FORMAT_VERSION = 1;
+    constexpr size_t WRITE_BUFFER_RECORDS = 4096;
+    constexpr size_t READ_BUFFER_RECORDS = 16384;
+    // Smaller than for replay: history reads mostly probe a few records
+    constexpr size_t HISTORY_READ_RECORDS = 256;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+        uint32_t shard_index;
+        uint32_t shard_count;
+        uint8_t reserved[40];
+    };
+    static_assert(sizeof(FileHeader) == 64, "FileHeader layout changed");
+
+    // Word-at-a-time mix over everything but the checksum field itself
+    uint32_t compute_checksum(const JournalRecord& record) {
+        const char* bytes = reinterpret_cast<const char*>(&record);
+        uint64_t hash = 0x84222325cbf29ce4ULL;
+        for (size_t offset = 0; offset + sizeof(uint64_t) <= offsetof(JournalRecord, checksum); offset += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, bytes + offset, sizeof(word));
+            hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+            hash ^= hash >> 32;
+        }
+        uint32_t tail;
+        std::memcpy(&tail, bytes + offsetof(JournalRecord, trade_id), sizeof(tail));
+        hash = (hash ^ tail) * 0x9e3779b97f4a7c15ULL;
+        return static_cast<uint32_t>(hash ^ (hash >> 29));
+    }
+
+    void copy_padded(char* destination, size_t size, const std::string& value) {
+        std::memset(destination, 0, size);
+        std::memcpy(destination, value.data(), std::min(value.size(), size - 1));
+    }
+
+    std::string read_padded(const char* source, size_t size) {
+        return std::string(source, strnlen(source, size));
+    }
+
+    JournalRecord blank_record(RecordType type) {
+        JournalRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.type = type;
+        return record;
+    }
+
+    [[noreturn]] void throw_errno(const std::string& what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    // Reads until size bytes or end of file; returns the bytes read
+    size_t read_fully(int fd, char* data, size_t size) {
+        size_t total = 0;
+        while (total < size) {
+            ssize_t n = ::read(fd, data + total, size - total);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw_errno("Journal read failed");
+            }
+            if (n == 0) break;
+            total += static_cast<size_t>(n);
+        }
+        return total;
+    }
+
+    void check_header(const FileHeader& header, const std::string& path,
+                      uint32_t shard_index, uint32_t shard_count) {
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION ||
+            header.record_size != sizeof(JournalRecord)) {
+            throw std::runtime_error("Not a journal file (or unsupported version): " + path);
+        }
+        if (header.shard_index != shard_index || header.shard_count != shard_count) {
+            throw std::runtime_error("Journal " + path + " was written for shard " +
+                                     std::to_string(header.shard_index) + " of " + std::to_string(header.shard_count) +
+                                     "; restart with the same shard count to replay it");
+        }
+    }
+}
+
+Durability parse_durability(const std::string& name) {
+    if (name == "none") return Durability::NONE;
+    if (name == "batch") return Durability::BATCH;
+    if (name == "every-write") return Durability::EVERY_WRITE;
+    throw std::invalid_argument("Unknown durability mode: " + name + " (expected none, batch or every-write)");
+}
+
+// ----------------------------------------------------------------------------
+// JournalRecord
+// ----------------------------------------------------------------------------
+
+JournalRecord JournalRecord::new_order(const order::Order& order) {
+    JournalRecord record = blank_record(RecordType::NEW_ORDER);
+    record.side = static_cast<uint8_t>(order.type);
+    record.quantity = order.quantity;
+    record.order_id = order.order_id;
+    record.price = order.price;
+    record.timestamp = order.timestamp;
+    copy_padded(record.symbol, sizeof(record.symbol), order.symbol);
+    copy_padded(record.client_id, sizeof(record.client_id), order.client_id);
+    return record;
+}
+
+JournalRecord JournalRecord::cancel_order(const std::string& symbol, uint64_t order_id) {
+    JournalRecord record = blank_record(RecordType::CANCEL_ORDER);
+    record.order_id = order_id;
+    copy_padded(record.symbol, sizeof(record.symbol), symbol);
+    return record;
+}
+
+JournalRecord JournalRecord::amend_order(const std::string& symbol, uint64_t order_id, int quantity, double price) {
+    JournalRecord record = blank_record(RecordType::AMEND_ORDER);
+    record.quantity = quantity;
+    record.order_id = order_id;
+    record.price = price;
+    copy_padded(record.symbol, sizeof(record.symbol), symbol);
+    return record;
+}
+
+JournalRecord JournalRecord::trade(const trade::Trade& trade) {
+    JournalRecord record = blank_record(RecordType::TRADE);
+    record.quantity = trade.quantity;
+    record.order_id = trade.buy_order_id;
+    record.sell_order_id = trade.sell_order_id;
+    record.price = trade.price;
+    record.timestamp = trade.timestamp;
+    record.trade_id = trade.trade_id;
+    copy_padded(record.symbol, sizeof(record.symbol), trade.symbol);
+    return record;
+}
+
+trade::Trade JournalRecord::to_trade() const {
+    trade::Trade trade;
+    trade.trade_id = trade_id;
+    trade.buy_order_id = order_id;
+    trade.sell_order_id = sell_order_id;
+    trade.quantity = quantity;
+    trade.price = price;
+    trade.timestamp = timestamp;
+    trade.symbol = symbol_name();
+    trade.aggressor_order_id = 0;
+    return trade;
+}
+
+order::Order JournalRecord::to_order() const {
+    order::Order order;
+    order.order_id = order_id;
+    order.type = static_cast<order::OrderType>(side);
+    order.quantity = quantity;
+    order.price = price;
+    order.client_id = read_padded(client_id, sizeof(client_id));
+    order.timestamp = timestamp;
+    order.symbol = symbol_name();
+    return order;
+}
+
+std::string JournalRecord::symbol_name() const {
+    return read_padded(symbol, sizeof(symbol));
+}
+
+// ----------------------------------------------------------------------------
+// Journal
+// ----------------------------------------------------------------------------
+
+Journal::Journal(const std::string& path, uint32_t shard_index, uint32_t shard_count,
+                 Durability durability, uint64_t valid_length)
+    : durability_(durability) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw_errno("Cannot open journal " + path);
+    }
+
+    if (valid_length < sizeof(FileHeader)) {
+        // New (or header-less) file: start it over with a fresh header
+        FileHeader header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = FORMAT_VERSION;
+        header.record_size = sizeof(JournalRecord);
+        header.shard_index = shard_index;
+        header.shard_count = shard_count;
+        if (::ftruncate(fd_, 0) != 0 || ::pwrite(fd_, &header, sizeof(header), 0) != sizeof(header)) {
+            int error = errno;
+            ::close(fd_);
+            throw std::system_error(error, std::generic_category(), "Cannot initialise journal " + path);
+        }
+        valid_length = sizeof(FileHeader);
+    } else if (::ftruncate(fd_, static_cast<off_t>(valid_length)) != 0) {
+        int error = errno;
+        ::close(fd_);
+        throw std::system_error(error, std::generic_category(), "Cannot truncate journal " + path);
+    }
+
+    if (::lseek(fd_, static_cast<off_t>(valid_length), SEEK_SET) < 0 || ::fsync(fd_) != 0) {
+        int error = errno;
+        ::close(fd_);
+        throw std::system_error(error, std::generic_category(), "Cannot open journal " + path);
+    }
+    length_ = valid_length;
+    committed_length_ = valid_length;
+    buffer_.reserve(WRITE_BUFFER_RECORDS);
+}
+
+Journal::~Journal() {
+    if (fd_ < 0) return;
+    try {
+        commit();
+    } catch (const std::exception&) {
+        // Nothing left to report to; the records were never acknowledged
+    }
+    ::close(fd_);
+}
+
+void Journal::append(JournalRecord record) {
+    if (failed_) return;
+    record.checksum = compute_checksum(record);
+    buffer_.push_back(record);
+    if (buffer_.size() == WRITE_BUFFER_RECORDS) {
+        // A very large batch: write early, the sync still happens at commit(),
+        // which also reports a failure here
+        try {
+            write_buffer();
+        } catch (const std::system_error& e) {
+            fail(e);
+        }
+    }
+}
+
+void Journal::commit() {
+    if (failed_) {
+        throw std::runtime_error("Journal failed earlier: " + failure_);
+    }
+    try {
+        write_buffer();
+        if (durability_ != Durability::NONE && ::fdatasync(fd_) != 0) {
+            throw_errno("Journal sync failed");
+        }
+    } catch (const std::system_error& e) {
+        fail(e);
+        throw;
+    }
+    committed_length_ = length_;
+}
+
+void Journal::fail(const std::system_error& error) {
+    // Nothing since the last commit was acknowledged, and none of it may
+    // come back on replay: a partial write would otherwise leave whole or
+    // torn records in the file for the next commit to write after
+    failed_ = true;
+    failure_ = error.what();
+    buffer_.clear();
+    if (::ftruncate(fd_, static_cast<off_t>(committed_length_)) != 0 ||
+        ::lseek(fd_, static_cast<off_t>(committed_length_), SEEK_SET) < 0) {
+        failure_ += "; rolling back failed too: ";
+        failure_ += std::strerror(errno);
+    }
+    length_ = committed_length_;
+}
+
+void Journal::write_buffer() {
+    const char* data = reinterpret_cast<const char*>(buffer_.data());
+    size_t remaining = buffer_.size() * sizeof(JournalRecord);
+    while (remaining > 0) {
+        ssize_t n = ::write(fd_, data, remaining);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_errno("Journal write failed");
+        }
+        data += n;
+        remaining -= static_cast<size_t>(n);
+    }
+    records_written_ += buffer_.size();
+    length_ += buffer_.size() * sizeof(JournalRecord);
+    buffer_.clear();
+}
+
+std::string Journal::shard_path(const std::string& directory, size_t shard_index) {
+    return directory + "/shard-" + std::to_string(shard_index) + ".journal";
+}
+
+std::string Journal::snapshot_path(const std::string& directory, size_t shard_index) {
+    return directory + "/shard-" + std::to_string(shard_index) + ".snapshot";
+}
+
+// ----------------------------------------------------------------------------
+// JournalReader
+// ----------------------------------------------------------------------------
+
+JournalReader::JournalReader(const std::string& path, uint32_t shard_index, uint32_t shard_count,
+                             uint64_t start_offset) {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        if (errno == ENOENT) {
+            done_ = true;
+            return;
+        }
+        throw_errno("Cannot open journal " + path);
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    FileHeader header;
+    size_t n = read_fully(fd_, reinterpret_cast<char*>(&header), sizeof(header));
+    if (n < sizeof(header)) {
+        // Crashed while creating the file; the writer will start it over
+        truncated_ = n > 0;
+        done_ = true;
+        return;
+    }
+    check_header(header, path, shard_index, shard_count);
+    valid_length_ = sizeof(FileHeader);
+
+    if (start_offset > valid_length_) {
+        struct stat info;
+        if (::fstat(fd_, &info) != 0) {
+            throw_errno("Cannot stat journal " + path);
+        }
+        if ((start_offset - sizeof(FileHeader)) % sizeof(JournalRecord) != 0 ||
+            start_offset > static_cast<uint64_t>(info.st_size)) {
+            behind_ = true;
+            done_ = true;
+            return;
+        }
+        if (::lseek(fd_, static_cast<off_t>(start_offset), SEEK_SET) < 0) {
+            throw_errno("Cannot seek journal " + path);
+        }
+        valid_length_ = start_offset;
+    }
+    buffer_.resize(READ_BUFFER_RECORDS);
+}
+
+JournalReader::~JournalReader() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool JournalReader::next(JournalRecord& record) {
+    if (position_ == count_ && !fill()) {
+        return false;
+    }
+    const JournalRecord& candidate = buffer_[position_];
+    bool known_type = candidate.type == RecordType::NEW_ORDER || candidate.type == RecordType::CANCEL_ORDER ||
+                      candidate.type == RecordType::TRADE || candidate.type == RecordType::AMEND_ORDER;
+    if (!known_type || candidate.checksum != compute_checksum(candidate)) {
+        truncated_ = true;
+        done_ = true;
+        return false;
+    }
+    record = candidate;
+    ++position_;
+    valid_length_ += sizeof(JournalRecord);
+    return true;
+}
+
+bool JournalReader::fill() {
+    if (done_) {
+        return false;
+    }
+    size_t bytes = read_fully(fd_, reinterpret_cast<char*>(buffer_.data()), buffer_.size() * sizeof(JournalRecord));
+    count_ = bytes / sizeof(JournalRecord);
+    position_ = 0;
+    if (bytes < buffer_.size() * sizeof(JournalRecord)) {
+        // End of file; a partial trailing record is a torn write
+        done_ = true;
+        truncated_ = bytes % sizeof(JournalRecord) != 0;
+    }
+    return count_ > 0;
+}
+
+// ----------------------------------------------------------------------------
+
+std::vector<trade::Trade> read_journal_trades(const std::string& path, uint32_t shard_index, uint32_t shard_count,
+                                              const std::string& symbol, int64_t since_trade_id, size_t limit) {
+    std::vector<trade::Trade> trades;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return trades;
+        }
+        throw_errno("Cannot open journal " + path);
+    }
+    struct Closer {
+        int fd;
+        ~Closer() { ::close(fd); }
+    } closer{fd};
+
+    FileHeader header;
+    if (read_fully(fd, reinterpret_cast<char*>(&header), sizeof(header)) < sizeof(header)) {
+        return trades;
+    }
+    check_header(header, path, shard_index, shard_count);
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        throw_errno("Cannot stat journal " + path);
+    }
+    // Records the shard appends after this are not looked at
+    uint64_t count = (static_cast<uint64_t>(info.st_size) - sizeof(FileHeader)) / sizeof(JournalRecord);
+
+    // Calls fn(index, record) for each of the symbol's trades from record
+    // first on, until fn returns false or the records run out
+    std::vector<JournalRecord> buffer(HISTORY_READ_RECORDS);
+    auto scan = [&](uint64_t first, auto&& fn) {
+        for (uint64_t index = first; index < count;) {
+            size_t wanted = static_cast<size_t>(std::min<uint64_t>(buffer.size(), count - index));
+            if (::lseek(fd, static_cast<off_t>(sizeof(FileHeader) + index * sizeof(JournalRecord)), SEEK_SET) < 0) {
+                throw_errno("Cannot seek journal " + path);
+            }
+            size_t records = read_fully(fd, reinterpret_cast<char*>(buffer.data()),
+                                        wanted * sizeof(JournalRecord)) / sizeof(JournalRecord);
+            for (size_t i = 0; i < records; ++i, ++index) {
+                const JournalRecord& record = buffer[i];
+                if (record.checksum != compute_checksum(record)) {
+                    return;
+                }
+                if (record.type == RecordType::TRADE && record.symbol_name() == symbol && !fn(index, record)) {
+                    return;
+                }
+            }
+            if (records < wanted) {
+                return;
+            }
+        }
+    };
+
+    // The first record from which every trade of the symbol is newer than
+    // since_trade_id; a probe that finds an older one skips past it
+    uint64_t low = 0;
+    uint64_t high = count;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        bool older = false;
+        scan(middle, [&](uint64_t index, const JournalRecord& record) {
+            if (record.trade_id <= since_trade_id) {
+                older = true;
+                low = index + 1;
+            }
+            return false;
+        });
+        if (!older) {
+            high = middle;
+        }
+    }
+
+    scan(low, [&](uint64_t, const JournalRecord& record) {
+        trades.push_back(record.to_trade());
+        return trades.size() < limit;
+    });
+    return trades;
+}
+
+} // namespace persistence
@@ -0,0 +1,171 @@
+/**
+ * Write-Ahead Journal
+ *
+ * Append-only binary log of every command a shard applied and every trade it
+ * produced. Each shard writes its own file of fixed-size records, so appends
+ * never contend across shards and replay can read a file straight through
+ * without parsing. Records are buffered on the matching thread and written out
+ * (and, depending on the durability mode, fsync'd) once per batch before the
+ * batch's commands are acknowledged, which gives group commit for free.
+ */
+
+#pragma once
+
+#include "../order_book/order.h"
+#include "../order_book/trade.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace persistence {
+
+enum class Durability {
+    NONE,           // write at batch end, leave flushing to the OS
+    BATCH,          // one fdatasync per drained batch (group commit)
+    EVERY_WRITE     // fdatasync after every command
+};
+
+// Accepts "none", "batch" and "every-write"; throws std::invalid_argument otherwise
+Durability parse_durability(const std::string& name);
+
+struct JournalConfig {
+    std::string directory;                  // empty disables journaling
+    Durability durability = Durability::BATCH;
+    // Journal records between book snapshots per shard; 0 disables periodic
+    // snapshots (one is still written on shutdown)
+    uint64_t snapshot_interval = 1000000;
+};
+
+enum class RecordType : uint8_t {
+    NEW_ORDER = 1,
+    CANCEL_ORDER = 2,
+    TRADE = 3,
+    AMEND_ORDER = 4
+};
+
+// Fixed 80-byte record. Symbols and client ids are stored NUL-padded, so
+// journaled symbols are limited to MAX_SYMBOL_LENGTH characters and client
+// ids to MAX_CLIENT_ID_LENGTH; the REST API refuses longer client ids, and
+// anything longer that reaches a record is truncated.
+struct JournalRecord {
+    static constexpr size_t MAX_SYMBOL_LENGTH = 15;
+    static constexpr size_t MAX_CLIENT_ID_LENGTH = 15;
+
+    RecordType type;
+    uint8_t side;               // order::OrderType for NEW_ORDER
+    uint16_t reserved;
+    int32_t quantity;           // AMEND_ORDER: the new open quantity
+    uint64_t order_id;          // TRADE: buy order id
+    uint64_t sell_order_id;     // TRADE only
+    double price;
+    uint64_t timestamp;
+    char symbol[16];
+    char client_id[16];
+    int32_t trade_id;           // TRADE only
+    uint32_t checksum;
+
+    static JournalRecord new_order(const order::Order& order);
+    static JournalRecord cancel_order(const std::string& symbol, uint64_t order_id);
+    static JournalRecord amend_order(const std::string& symbol, uint64_t order_id, int quantity, double price);
+    static JournalRecord trade(const trade::Trade& trade);
+
+    order::Order to_order() const;
+    // The aggressor is not journaled and comes back as 0
+    trade::Trade to_trade() const;
+    std::string symbol_name() const;
+};
+
+static_assert(sizeof(JournalRecord) == 80, "JournalRecord layout changed");
+
+// Appends records for one shard. Not thread-safe: only the owning shard
+// thread may call append() and commit().
+class Journal {
+public:
+    // Opens (creating if needed) the shard's file and truncates it to
+    // valid_length, dropping a torn tail left by a crash. Throws
+    // std::runtime_error if the file belongs to a different shard layout.
+    Journal(const std::string& path, uint32_t shard_index, uint32_t shard_count,
+            Durability durability, uint64_t valid_length);
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    void append(JournalRecord record);
+    // Writes buffered records and syncs unless durability is NONE. Throws
+    // std::system_error if the write or sync fails. A failure truncates the
+    // file back to the last successful commit, drops what was appended since,
+    // and leaves the journal failed: every later commit throws, as the
+    // shard's books no longer match what is durable.
+    void commit();
+
+    bool failed() const { return failed_; }
+    Durability durability() const { return durability_; }
+    uint64_t records_written() const { return records_written_; }
+    // File length once everything appended so far has been written
+    uint64_t length() const { return length_ + buffer_.size() * sizeof(JournalRecord); }
+
+    static std::string shard_path(const std::string& directory, size_t shard_index);
+    static std::string snapshot_path(const std::string& directory, size_t shard_index);
+
+private:
+    int fd_ = -1;
+    Durability durability_;
+    std::vector<JournalRecord> buffer_;
+    uint64_t records_written_ = 0;
+    uint64_t length_ = 0;
+    uint64_t committed_length_ = 0;     // file length at the last successful commit
+    bool failed_ = false;
+    std::string failure_;
+
+    void write_buffer();
+    // Rolls the file back to committed_length_ and marks the journal failed
+    void fail(const std::system_error& error);
+};
+
+// Sequential reader used for replay. Stops at the end of the file or at the
+// first torn or corrupt record; valid_length() then tells the writer where
+// to truncate.
+class JournalReader {
+public:
+    // Throws std::runtime_error if the file exists but was written by a
+    // different shard layout or is not a journal. A missing file reads as
+    // empty. A non-zero start_offset (a Journal::length() taken earlier)
+    // skips the records before it; if the file is shorter than that,
+    // behind() is set and nothing is read.
+    JournalReader(const std::string& path, uint32_t shard_index, uint32_t shard_count, uint64_t start_offset = 0);
+    ~JournalReader();
+
+    JournalReader(const JournalReader&) = delete;
+    JournalReader& operator=(const JournalReader&) = delete;
+
+    bool next(JournalRecord& record);
+    uint64_t valid_length() const { return valid_length_; }
+    bool truncated() const { return truncated_; }
+    bool behind() const { return behind_; }
+
+private:
+    int fd_ = -1;
+    std::vector<JournalRecord> buffer_;
+    size_t position_ = 0;
+    size_t count_ = 0;
+    uint64_t valid_length_ = 0;
+    bool truncated_ = false;
+    bool behind_ = false;
+    bool done_ = false;
+
+    bool fill();
+};
+
+// Up to limit of the symbol's trades with an id above since_trade_id, oldest
+// first, from a shard's journal; this is the trade history beyond what the
+// books keep in memory. A symbol's trade ids rise through the file, so the
+// first one is found by bisecting on record offsets instead of reading the
+// whole journal. Safe while the shard appends: reading stops at the first
+// incomplete or invalid record. A missing file has no trades.
+std::vector<trade::Trade> read_journal_trades(const std::string& path, uint32_t shard_index, uint32_t shard_count,
+                                              const std::string& symbol, int64_t since_trade_id, size_t limit);
+
+} // namespace persistence
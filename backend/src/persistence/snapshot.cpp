@@ -0,0 +1,443 @@
+/**
+ * Order Book Snapshot Implementation
+ *
+ * File layout: a 64-byte header (magic, shard layout, journal length and a
+ * checksum of the payload), then per instrument an InstrumentHeader, its
+ * non-empty levels, its live pool nodes in handle order and its id index
+ * table verbatim. Handles are preserved, so the level queues and the index
+ * come back exactly as they were. Files are written to a temporary name,
+ * synced and renamed, so a crash mid-write leaves the previous snapshot.
+ */
+
+#include "snapshot.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace persistence {
+
+namespace {
+    constexpr char MAGIC[8] = {'T', 'R', 'D', 'S', 'N', 'A', 'P', '1'};
+    constexpr uint32_t FORMAT_VERSION = 1;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t shard_index;
+        uint32_t shard_count;
+        uint32_t instrument_count;
+        uint64_t journal_length;
+        uint64_t payload_size;
+        uint64_t checksum;
+        uint8_t reserved[16];
+    };
+    static_assert(sizeof(FileHeader) == 64, "FileHeader layout changed");
+
+    struct InstrumentHeader {
+        char symbol[16];
+        uint64_t next_sequence;
+        double tick_size;
+        int64_t traded_volume;
+        double traded_value;
+        int32_t next_trade_id;
+        uint32_t level_count;
+        uint64_t node_count;
+        uint64_t index_capacity;
+        uint64_t index_size;
+        uint8_t reserved[16];
+    };
+    static_assert(sizeof(InstrumentHeader) == 96, "InstrumentHeader layout changed");
+
+    struct LevelEntry {
+        int64_t tick;
+        int64_t total_quantity;
+        uint32_t head;
+        uint32_t tail;
+        uint32_t order_count;
+        uint8_t side;
+        uint8_t reserved[3];
+    };
+    static_assert(sizeof(LevelEntry) == 32, "LevelEntry layout changed");
+
+    struct NodeEntry {
+        uint32_t handle;
+        uint32_t prev;
+        uint32_t next;
+        int32_t quantity;
+        uint64_t order_id;
+        uint64_t timestamp;
+        int64_t tick;
+        char client_id[16];
+        uint8_t side;
+        uint8_t reserved[7];
+    };
+    static_assert(sizeof(NodeEntry) == 64, "NodeEntry layout changed");
+
+    struct IndexEntry {
+        uint64_t order_id;
+        uint32_t handle;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(IndexEntry) == 16, "IndexEntry layout changed");
+
+    uint64_t compute_checksum(const char* data, size_t size) {
+        uint64_t hash = 0x84222325cbf29ce4ULL ^ size;
+        size_t offset = 0;
+        for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, data + offset, sizeof(word));
+            hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+            hash ^= hash >> 32;
+        }
+        for (; offset < size; ++offset) {
+            hash = (hash ^ static_cast<uint8_t>(data[offset])) * 0x9e3779b97f4a7c15ULL;
+        }
+        return hash;
+    }
+
+    void copy_padded(char* destination, size_t size, const std::string& value) {
+        std::memset(destination, 0, size);
+        std::memcpy(destination, value.data(), std::min(value.size(), size - 1));
+    }
+
+    [[noreturn]] void throw_errno(const std::string& what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    // Bounds-checked sequential reads over the mapped payload
+    class Cursor {
+    public:
+        Cursor(const char* data, size_t size) : position_(data), end_(data + size) {}
+
+        template <typename T>
+        const T& next() {
+            if (static_cast<size_t>(end_ - position_) < sizeof(T)) {
+                throw std::runtime_error("Snapshot is truncated");
+            }
+            const T* value = reinterpret_cast<const T*>(position_);
+            position_ += sizeof(T);
+            return *value;
+        }
+
+    private:
+        const char* position_;
+        const char* end_;
+    };
+}
+
+// ----------------------------------------------------------------------------
+// SnapshotImage
+// ----------------------------------------------------------------------------
+
+SnapshotImage::SnapshotImage(uint32_t shard_index, uint32_t shard_count, uint64_t journal_length) {
+    FileHeader* header = append<FileHeader>();
+    std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+    header->version = FORMAT_VERSION;
+    header->shard_index = shard_index;
+    header->shard_count = shard_count;
+    header->journal_length = journal_length;
+}
+
+template <typename T>
+T* SnapshotImage::append() {
+    size_t offset = data_.size();
+    data_.resize(offset + sizeof(T));
+    T* value = reinterpret_cast<T*>(data_.data() + offset);
+    std::memset(value, 0, sizeof(T));
+    return value;
+}
+
+void SnapshotImage::add_instrument(const std::string& symbol, uint64_t next_sequence,
+                                   const order_book::OrderBook& book) {
+    const order_book::PriceLadder& bids = book.get_buy_orders();
+    const order_book::PriceLadder& asks = book.get_sell_orders();
+    const order_book::OrderPool& pool = book.get_pool();
+    const auto& slots = book.get_index().slots();
+    data_.reserve(data_.size() + sizeof(InstrumentHeader) + (bids.size() + asks.size()) * sizeof(LevelEntry) +
+                  pool.size() * sizeof(NodeEntry) + slots.size() * sizeof(IndexEntry));
+
+    InstrumentHeader* instrument = append<InstrumentHeader>();
+    copy_padded(instrument->symbol, sizeof(instrument->symbol), symbol);
+    instrument->next_sequence = next_sequence;
+    instrument->tick_size = book.get_tick_size();
+    instrument->traded_volume = book.get_traded_volume();
+    instrument->traded_value = book.get_traded_value();
+    instrument->next_trade_id = book.get_next_trade_id();
+    instrument->level_count = static_cast<uint32_t>(bids.size() + asks.size());
+    instrument->node_count = pool.size();
+    instrument->index_capacity = slots.size();
+    instrument->index_size = book.get_index().size();
+
+    for (const order_book::PriceLadder* ladder : {&bids, &asks}) {
+        uint8_t side = static_cast<uint8_t>(ladder == &bids ? order::OrderType::BUY : order::OrderType::SELL);
+        for (const auto& level : *ladder) {
+            LevelEntry* entry = append<LevelEntry>();
+            entry->tick = level.tick;
+            entry->total_quantity = level.total_quantity;
+            entry->head = level.head;
+            entry->tail = level.tail;
+            entry->order_count = level.order_count;
+            entry->side = side;
+        }
+    }
+
+    // Live nodes in handle order: a sequential sweep of the pool rather than
+    // a pointer chase through every level's queue
+    std::vector<uint64_t> live((pool.capacity() + 63) / 64, 0);
+    for (const auto& slot : slots) {
+        if (slot.handle != order_book::NULL_HANDLE) {
+            live[slot.handle / 64] |= uint64_t(1) << (slot.handle % 64);
+        }
+    }
+    for (size_t word = 0; word < live.size(); ++word) {
+        for (uint64_t bits = live[word]; bits; bits &= bits - 1) {
+            auto handle = static_cast<order_book::OrderHandle>(word * 64 + __builtin_ctzll(bits));
+            const order_book::OrderNode& node = pool[handle];
+            NodeEntry* entry = append<NodeEntry>();
+            entry->handle = handle;
+            entry->prev = node.prev;
+            entry->next = node.next;
+            entry->quantity = node.order.quantity;
+            entry->order_id = node.order.order_id;
+            entry->timestamp = node.order.timestamp;
+            entry->tick = node.tick;
+            copy_padded(entry->client_id, sizeof(entry->client_id), node.order.client_id);
+            entry->side = static_cast<uint8_t>(node.order.type);
+        }
+    }
+
+    size_t offset = data_.size();
+    data_.resize(offset + slots.size() * sizeof(IndexEntry));
+    auto* index = reinterpret_cast<IndexEntry*>(data_.data() + offset);
+    for (size_t i = 0; i < slots.size(); ++i) {
+        index[i] = {slots[i].order_id, slots[i].handle, 0};
+    }
+    ++instrument_count_;
+}
+
+std::vector<char> SnapshotImage::finish() {
+    FileHeader* header = reinterpret_cast<FileHeader*>(data_.data());
+    header->instrument_count = instrument_count_;
+    header->payload_size = data_.size() - sizeof(FileHeader);
+    header->checksum = compute_checksum(data_.data() + sizeof(FileHeader), header->payload_size);
+    return std::move(data_);
+}
+
+// ----------------------------------------------------------------------------
+// Writing
+// ----------------------------------------------------------------------------
+
+void write_snapshot_file(const std::string& path, const std::vector<char>& image) {
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw_errno("Cannot create snapshot " + temp_path);
+    }
+
+    const char* data = image.data();
+    size_t remaining = image.size();
+    while (remaining > 0) {
+        ssize_t n = ::write(fd, data, remaining);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "Snapshot write failed");
+        }
+        data += n;
+        remaining -= static_cast<size_t>(n);
+    }
+    if (::fsync(fd) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), "Snapshot sync failed");
+    }
+    ::close(fd);
+
+    if (::rename(temp_path.c_str(), path.c_str()) != 0) {
+        throw_errno("Cannot rename snapshot to " + path);
+    }
+    // Make the rename itself durable
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int dir_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    wait();
+}
+
+bool SnapshotWriter::busy() {
+    return child_ > 0 && !reap(WNOHANG);
+}
+
+bool SnapshotWriter::fork_write(const std::string& path, const std::function<std::vector<char>()>& encode) {
+    if (busy()) {
+        return false;
+    }
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        std::cerr << "Snapshot " << path << " failed: fork: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (pid == 0) {
+        // Child: only this thread exists here, so stay away from iostreams
+        // and anything else another parent thread may have held locked
+        int status = 0;
+        try {
+            write_snapshot_file(path, encode());
+        } catch (...) {
+            status = 1;
+        }
+        ::_exit(status);
+    }
+    child_ = pid;
+    path_ = path;
+    return true;
+}
+
+void SnapshotWriter::wait() {
+    if (child_ > 0) {
+        reap(0);
+    }
+}
+
+bool SnapshotWriter::reap(int options) {
+    int status = 0;
+    pid_t pid = ::waitpid(child_, &status, options);
+    if (pid == 0) {
+        return false;
+    }
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "Snapshot " << path_ << " failed in the writer process" << std::endl;
+    }
+    child_ = 0;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// SnapshotReader
+// ----------------------------------------------------------------------------
+
+SnapshotReader::SnapshotReader(const std::string& path, uint32_t shard_index, uint32_t shard_count) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            error_ = "cannot open " + path + ": " + std::strerror(errno);
+        }
+        return;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(FileHeader)) {
+        ::close(fd);
+        error_ = path + " is truncated";
+        return;
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        error_ = "cannot map " + path + ": " + std::strerror(errno);
+        return;
+    }
+    ::madvise(mapping, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(mapping);
+
+    const FileHeader& header = *reinterpret_cast<const FileHeader*>(data_);
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION) {
+        error_ = path + " is not a snapshot (or has an unsupported version)";
+    } else if (header.shard_index != shard_index || header.shard_count != shard_count) {
+        error_ = path + " was written for a different shard layout";
+    } else if (header.payload_size != size_ - sizeof(FileHeader) ||
+               header.checksum != compute_checksum(data_ + sizeof(FileHeader), header.payload_size)) {
+        error_ = path + " is corrupt";
+    }
+    if (!error_.empty()) {
+        unmap();
+    }
+}
+
+SnapshotReader::~SnapshotReader() {
+    unmap();
+}
+
+void SnapshotReader::unmap() {
+    if (data_) {
+        ::munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+    }
+}
+
+uint64_t SnapshotReader::journal_length() const {
+    return data_ ? reinterpret_cast<const FileHeader*>(data_)->journal_length : 0;
+}
+
+uint64_t SnapshotReader::restore(const BookResolver& resolve) const {
+    if (!data_) {
+        return 0;
+    }
+    const FileHeader& header = *reinterpret_cast<const FileHeader*>(data_);
+    Cursor cursor(data_ + sizeof(FileHeader), header.payload_size);
+    uint64_t restored = 0;
+
+    for (uint32_t i = 0; i < header.instrument_count; ++i) {
+        const InstrumentHeader& instrument = cursor.next<InstrumentHeader>();
+        std::string symbol(instrument.symbol, strnlen(instrument.symbol, sizeof(instrument.symbol)));
+        order_book::OrderBook& book = resolve(symbol, instrument.tick_size, instrument.next_sequence);
+
+        std::vector<const LevelEntry*> levels(instrument.level_count);
+        for (auto& level : levels) {
+            level = &cursor.next<LevelEntry>();
+        }
+
+        order_book::OrderNode node;
+        node.order.symbol = symbol;
+        for (uint64_t n = 0; n < instrument.node_count; ++n) {
+            const NodeEntry& entry = cursor.next<NodeEntry>();
+            node.order.order_id = entry.order_id;
+            node.order.type = static_cast<order::OrderType>(entry.side);
+            node.order.quantity = entry.quantity;
+            node.order.price = book.to_price(entry.tick);
+            node.order.client_id.assign(entry.client_id, strnlen(entry.client_id, sizeof(entry.client_id)));
+            node.order.timestamp = entry.timestamp;
+            node.tick = entry.tick;
+            node.prev = entry.prev;
+            node.next = entry.next;
+            book.restore_node(entry.handle, node);
+        }
+
+        for (const LevelEntry* entry : levels) {
+            order_book::PriceLevel level;
+            level.tick = entry->tick;
+            level.head = entry->head;
+            level.tail = entry->tail;
+            level.total_quantity = entry->total_quantity;
+            level.order_count = entry->order_count;
+            book.restore_level(static_cast<order::OrderType>(entry->side), level);
+        }
+
+        std::vector<order_book::OrderIndex::Slot> slots(instrument.index_capacity);
+        for (auto& slot : slots) {
+            const IndexEntry& entry = cursor.next<IndexEntry>();
+            slot = {entry.order_id, entry.handle};
+        }
+        book.restore_index(std::move(slots), instrument.index_size);
+        book.finish_restore(instrument.next_trade_id, instrument.traded_volume, instrument.traded_value);
+        restored += instrument.node_count;
+    }
+    return restored;
+}
+
+} // namespace persistence
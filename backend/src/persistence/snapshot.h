@@ -0,0 +1,94 @@
+/**
+ * Order Book Snapshots
+ *
+ * Point-in-time image of every book on one shard in a flat binary layout:
+ * per instrument its counters, its non-empty levels, its resting order nodes
+ * and its id index. The image is encoded and written by a forked child from
+ * its copy-on-write view of the books and mapped back with mmap on recovery.
+ * The image records how far the shard's journal had been committed when it
+ * was taken, so recovery is a snapshot load plus a replay of the journal tail
+ * after that point.
+ */
+
+#pragma once
+
+#include "../order_book/order_book.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace persistence {
+
+// Encodes one shard's books; not thread-safe
+class SnapshotImage {
+public:
+    SnapshotImage(uint32_t shard_index, uint32_t shard_count, uint64_t journal_length);
+
+    void add_instrument(const std::string& symbol, uint64_t next_sequence, const order_book::OrderBook& book);
+    // Seals the header (counts and checksum) and hands over the bytes
+    std::vector<char> finish();
+
+private:
+    std::vector<char> data_;
+    uint32_t instrument_count_ = 0;
+
+    template <typename T>
+    T* append();
+};
+
+void write_snapshot_file(const std::string& path, const std::vector<char>& image);
+
+// Writes snapshots from a forked child: the child encodes its copy-on-write
+// view of the books and writes the file while the parent keeps matching, so
+// the matching thread only pays for the fork. One write is in flight at a time.
+class SnapshotWriter {
+public:
+    ~SnapshotWriter();
+
+    // Reaps the child once it has exited
+    bool busy();
+    // Returns false (writing nothing) if a write is still in flight or fork fails
+    bool fork_write(const std::string& path, const std::function<std::vector<char>()>& encode);
+    void wait();
+
+private:
+    pid_t child_ = 0;
+    std::string path_;
+
+    bool reap(int options);
+};
+
+// Maps a snapshot file read-only and restores books from it
+class SnapshotReader {
+public:
+    using BookResolver = std::function<order_book::OrderBook&(const std::string& symbol, double tick_size,
+                                                              uint64_t next_sequence)>;
+
+    // A missing file leaves the reader empty. A file that fails validation is
+    // also left unloaded, with error() describing why, so the caller can fall
+    // back to a full journal replay.
+    SnapshotReader(const std::string& path, uint32_t shard_index, uint32_t shard_count);
+    ~SnapshotReader();
+
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+    bool loaded() const { return data_ != nullptr; }
+    const std::string& error() const { return error_; }
+    uint64_t journal_length() const;
+
+    // Restores every instrument into the book resolve() returns for it and
+    // returns the number of orders restored
+    uint64_t restore(const BookResolver& resolve) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::string error_;
+
+    void unmap();
+};
+
+} // namespace persistence
@@ -1,217 +1,421 @@
 #include "json_utils.h"
-#include <iostream>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
 
 namespace utils {
 
-JsonBuilder& JsonBuilder::start_object() {
-    if (!first_) oss_ << ",";
-    oss_ << "{";
+void JsonBuilder::separator() {
+    if (!first_) out_->push_back(',');
+}
+
+void JsonBuilder::key(std::string_view key) {
+    separator();
+    string(key);
+    out_->push_back(':');
+}
+
+void JsonBuilder::string(std::string_view value) {
+    static const char HEX[] = "0123456789abcdef";
+    std::string& out = *out_;
+    out.push_back('"');
+    size_t run = 0;     // start of the pending run of characters needing no escape
+    for (size_t i = 0; i < value.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(value.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\b': out.append("\\b"); break;
+            case '\f': out.append("\\f"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            case '\t': out.append("\\t"); break;
+            default: {
+                char escape[] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xf]};
+                out.append(escape, sizeof(escape));
+            }
+        }
+    }
+    out.append(value.data() + run, value.size() - run);
+    out.push_back('"');
+}
+
+JsonBuilder& JsonBuilder::start_object(std::string_view key) {
+    if (key.empty()) {
+        separator();
+    } else {
+        this->key(key);
+    }
+    out_->push_back('{');
     first_ = true;
     return *this;
 }
 
 JsonBuilder& JsonBuilder::end_object() {
-    oss_ << "}";
+    out_->push_back('}');
     first_ = false;
     return *this;
 }
 
-JsonBuilder& JsonBuilder::start_array(const std::string& key) {
-    if (!first_) oss_ << ",";
-    if (!key.empty()) {
-        oss_ << "\"" << key << "\":";
+JsonBuilder& JsonBuilder::start_array(std::string_view key) {
+    if (key.empty()) {
+        separator();
+    } else {
+        this->key(key);
     }
-    oss_ << "[";
+    out_->push_back('[');
     first_ = true;
     return *this;
 }
 
 JsonBuilder& JsonBuilder::end_array() {
-    oss_ << "]";
+    out_->push_back(']');
     first_ = false;
     return *this;
 }
 
-JsonBuilder& JsonBuilder::add_string(const std::string& key, const std::string& value) {
-    if (!first_) oss_ << ",";
-    oss_ << "\"" << key << "\":\"" << value << "\"";
+JsonBuilder& JsonBuilder::add_string(std::string_view key, std::string_view value) {
+    this->key(key);
+    string(value);
     first_ = false;
     return *this;
 }
 
-JsonBuilder& JsonBuilder::add_number(const std::string& key, double value) {
-    if (!first_) oss_ << ",";
-    oss_ << "\"" << key << "\":" << value;
+JsonBuilder& JsonBuilder::add_number(std::string_view key, double value) {
+    this->key(key);
+    if (std::isfinite(value)) {
+        char buffer[32];
+        char* end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+        out_->append(buffer, end);
+    } else {
+        out_->append("null");
+    }
     first_ = false;
     return *this;
 }
 
-JsonBuilder& JsonBuilder::add_number(const std::string& key, int64_t value) {
-    if (!first_) oss_ << ",";
-    oss_ << "\"" << key << "\":" << value;
+JsonBuilder& JsonBuilder::add_number(std::string_view key, int64_t value) {
+    this->key(key);
+    char buffer[24];
+    char* end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+    out_->append(buffer, end);
     first_ = false;
     return *this;
 }
 
-JsonBuilder& JsonBuilder::add_bool(const std::string& key, bool value) {
-    if (!first_) oss_ << ",";
-    oss_ << "\"" << key << "\":" << (value ? "true" : "false");
+JsonBuilder& JsonBuilder::add_bool(std::string_view key, bool value) {
+    this->key(key);
+    out_->append(value ? "true" : "false");
     first_ = false;
     return *this;
 }
 
-JsonBuilder& JsonBuilder::add_null(const std::string& key) {
-    if (!first_) oss_ << ",";
-    oss_ << "\"" << key << "\":null";
+JsonBuilder& JsonBuilder::add_null(std::string_view key) {
+    this->key(key);
+    out_->append("null");
     first_ = false;
     return *this;
 }
 
 std::string JsonBuilder::build() {
-    return oss_.str();
+    return out_ == &owned_ ? std::move(owned_) : *out_;
+}
+
+void JsonReader::fail(const std::string& message) const {
+    throw std::invalid_argument("Invalid JSON at offset " + std::to_string(pos_) + ": " + message);
 }
 
-void JsonParser::skip_whitespace() {
-    while (pos_ < json_.length() && std::isspace(json_[pos_])) {
-        pos_++;
+void JsonReader::skip_whitespace() {
+    while (pos_ < json_.size() &&
+           (json_[pos_] == ' ' || json_[pos_] == '\t' || json_[pos_] == '\n' || json_[pos_] == '\r')) {
+        ++pos_;
     }
 }
 
-std::string JsonParser::parse_string() {
+char JsonReader::peek() {
     skip_whitespace();
-    if (pos_ >= json_.length() || json_[pos_] != '"') {
-        return "";
-    }
-    pos_++; // skip opening quote
-    
-    std::string result;
-    while (pos_ < json_.length() && json_[pos_] != '"') {
-        if (json_[pos_] == '\\' && pos_ + 1 < json_.length()) {
-            pos_++; // skip backslash
-            switch (json_[pos_]) {
-                case '"': result += '"'; break;
-                case '\\': result += '\\'; break;
-                case '/': result += '/'; break;
-                case 'b': result += '\b'; break;
-                case 'f': result += '\f'; break;
-                case 'n': result += '\n'; break;
-                case 'r': result += '\r'; break;
-                case 't': result += '\t'; break;
-                default: result += json_[pos_]; break;
-            }
+    if (pos_ == json_.size()) {
+        fail("unexpected end of input");
+    }
+    return json_[pos_];
+}
+
+void JsonReader::expect(char c) {
+    if (peek() != c) {
+        fail(std::string("expected '") + c + "'");
+    }
+    ++pos_;
+    last_ = c;
+}
+
+void JsonReader::after_value() {
+    last_ = 'v';
+}
+
+void JsonReader::begin_object() {
+    expect('{');
+}
+
+bool JsonReader::next_key(std::string_view& key) {
+    if (peek() == '}') {
+        if (last_ == ',') fail("expected member name");
+        ++pos_;
+        after_value();
+        return false;
+    }
+    if (last_ != '{') {
+        expect(',');
+    }
+    if (peek() != '"') {
+        fail("expected member name");
+    }
+    size_t start = ++pos_;
+    while (pos_ < json_.size() && json_[pos_] != '"') {
+        if (json_[pos_] == '\\') ++pos_;
+        ++pos_;
+    }
+    if (pos_ >= json_.size()) {
+        fail("unterminated member name");
+    }
+    key = json_.substr(start, pos_ - start);
+    ++pos_;
+    expect(':');
+    return true;
+}
+
+void JsonReader::begin_array() {
+    expect('[');
+}
+
+bool JsonReader::next_element() {
+    if (peek() == ']') {
+        if (last_ == ',') fail("expected value");
+        ++pos_;
+        after_value();
+        return false;
+    }
+    if (last_ != '[') {
+        expect(',');
+    }
+    return true;
+}
+
+namespace {
+    int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    void append_utf8(std::string& out, uint32_t code_point) {
+        if (code_point < 0x80) {
+            out.push_back(static_cast<char>(code_point));
+        } else if (code_point < 0x800) {
+            out.push_back(static_cast<char>(0xc0 | (code_point >> 6)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+        } else if (code_point < 0x10000) {
+            out.push_back(static_cast<char>(0xe0 | (code_point >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
         } else {
-            result += json_[pos_];
+            out.push_back(static_cast<char>(0xf0 | (code_point >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
         }
-        pos_++;
     }
-    
-    if (pos_ < json_.length()) pos_++; // skip closing quote
-    return result;
 }
 
-double JsonParser::parse_number() {
-    skip_whitespace();
-    size_t start = pos_;
-    
-    if (pos_ < json_.length() && json_[pos_] == '-') pos_++;
-    while (pos_ < json_.length() && std::isdigit(json_[pos_])) pos_++;
-    if (pos_ < json_.length() && json_[pos_] == '.') {
-        pos_++;
-        while (pos_ < json_.length() && std::isdigit(json_[pos_])) pos_++;
+std::string_view JsonReader::read_string(std::string& storage) {
+    if (peek() != '"') {
+        fail("expected string");
+    }
+    size_t start = ++pos_;
+    // Common case: no escapes, so the value is a slice of the document
+    while (pos_ < json_.size() && json_[pos_] != '"' && json_[pos_] != '\\') {
+        if (static_cast<unsigned char>(json_[pos_]) < 0x20) fail("control character in string");
+        ++pos_;
     }
-    if (pos_ < json_.length() && (json_[pos_] == 'e' || json_[pos_] == 'E')) {
-        pos_++;
-        if (pos_ < json_.length() && (json_[pos_] == '+' || json_[pos_] == '-')) pos_++;
-        while (pos_ < json_.length() && std::isdigit(json_[pos_])) pos_++;
+    if (pos_ < json_.size() && json_[pos_] == '"') {
+        ++pos_;
+        after_value();
+        return json_.substr(start, pos_ - start - 1);
     }
-    
-    return std::stod(json_.substr(start, pos_ - start));
+
+    storage.assign(json_.data() + start, pos_ - start);
+    while (pos_ < json_.size() && json_[pos_] != '"') {
+        char c = json_[pos_];
+        if (static_cast<unsigned char>(c) < 0x20) fail("control character in string");
+        if (c != '\\') {
+            storage.push_back(c);
+            ++pos_;
+            continue;
+        }
+        if (pos_ + 1 >= json_.size()) break;
+        char escape = json_[pos_ + 1];
+        pos_ += 2;
+        switch (escape) {
+            case '"': storage.push_back('"'); break;
+            case '\\': storage.push_back('\\'); break;
+            case '/': storage.push_back('/'); break;
+            case 'b': storage.push_back('\b'); break;
+            case 'f': storage.push_back('\f'); break;
+            case 'n': storage.push_back('\n'); break;
+            case 'r': storage.push_back('\r'); break;
+            case 't': storage.push_back('\t'); break;
+            case 'u': {
+                auto read_hex4 = [&]() -> uint32_t {
+                    if (pos_ + 4 > json_.size()) fail("truncated \\u escape");
+                    uint32_t value = 0;
+                    for (int i = 0; i < 4; ++i) {
+                        int digit = hex_value(json_[pos_ + i]);
+                        if (digit < 0) fail("invalid \\u escape");
+                        value = value * 16 + static_cast<uint32_t>(digit);
+                    }
+                    pos_ += 4;
+                    return value;
+                };
+                uint32_t code_point = read_hex4();
+                if (code_point >= 0xd800 && code_point < 0xdc00) {
+                    // High surrogate: must be followed by \u and a low surrogate
+                    if (json_.substr(pos_, 2) != "\\u") fail("unpaired surrogate");
+                    pos_ += 2;
+                    uint32_t low = read_hex4();
+                    if (low < 0xdc00 || low >= 0xe000) fail("unpaired surrogate");
+                    code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                } else if (code_point >= 0xdc00 && code_point < 0xe000) {
+                    fail("unpaired surrogate");
+                }
+                append_utf8(storage, code_point);
+                break;
+            }
+            default:
+                pos_ -= 1;
+                fail("invalid escape");
+        }
+    }
+    if (pos_ >= json_.size()) {
+        fail("unterminated string");
+    }
+    ++pos_;
+    after_value();
+    return storage;
 }
 
-bool JsonParser::parse_bool() {
-    skip_whitespace();
+double JsonReader::read_number() {
+    char c = peek();
+    if (c != '-' && (c < '0' || c > '9')) {
+        fail("expected number");
+    }
+    double value = 0;
+    auto [end, error] = std::from_chars(json_.data() + pos_, json_.data() + json_.size(), value);
+    if (error == std::errc::result_out_of_range) {
+        fail("number out of range");
+    }
+    if (error != std::errc()) {
+        fail("expected number");
+    }
+    pos_ = static_cast<size_t>(end - json_.data());
+    after_value();
+    return value;
+}
+
+uint64_t JsonReader::read_uint64() {
+    char c = peek();
+    if (c < '0' || c > '9') {
+        fail("expected non-negative integer");
+    }
+    uint64_t value = 0;
+    auto [end, error] = std::from_chars(json_.data() + pos_, json_.data() + json_.size(), value);
+    if (error == std::errc::result_out_of_range) {
+        fail("number out of range");
+    }
+    pos_ = static_cast<size_t>(end - json_.data());
+    if (pos_ < json_.size() && (json_[pos_] == '.' || json_[pos_] == 'e' || json_[pos_] == 'E')) {
+        fail("expected non-negative integer");
+    }
+    after_value();
+    return value;
+}
+
+bool JsonReader::read_bool() {
+    peek();
     if (json_.substr(pos_, 4) == "true") {
         pos_ += 4;
+        after_value();
         return true;
-    } else if (json_.substr(pos_, 5) == "false") {
+    }
+    if (json_.substr(pos_, 5) == "false") {
         pos_ += 5;
+        after_value();
         return false;
     }
-    return false;
+    fail("expected true or false");
 }
 
-void JsonParser::parse_null() {
-    skip_whitespace();
-    if (json_.substr(pos_, 4) == "null") {
-        pos_ += 4;
+bool JsonReader::read_null() {
+    peek();
+    if (json_.substr(pos_, 4) != "null") {
+        return false;
     }
+    pos_ += 4;
+    after_value();
+    return true;
 }
 
-std::map<std::string, std::string> JsonParser::parse_object() {
-    std::map<std::string, std::string> result;
-    skip_whitespace();
-    
-    if (pos_ >= json_.length() || json_[pos_] != '{') {
-        return result;
-    }
-    pos_++; // skip opening brace
-    
-    while (pos_ < json_.length()) {
-        skip_whitespace();
-        if (json_[pos_] == '}') {
-            pos_++;
+void JsonReader::skip_value() {
+    skip_value(0);
+}
+
+void JsonReader::skip_value(int depth) {
+    if (depth >= MAX_DEPTH) {
+        fail("nesting too deep");
+    }
+    std::string_view key;
+    switch (peek()) {
+        case '{':
+            begin_object();
+            while (next_key(key)) skip_value(depth + 1);
+            break;
+        case '[':
+            begin_array();
+            while (next_element()) skip_value(depth + 1);
+            break;
+        case '"': {
+            // Scan without decoding
+            ++pos_;
+            while (pos_ < json_.size() && json_[pos_] != '"') {
+                if (json_[pos_] == '\\') ++pos_;
+                ++pos_;
+            }
+            if (pos_ >= json_.size()) fail("unterminated string");
+            ++pos_;
+            after_value();
             break;
         }
-        
-        std::string key = parse_string();
-        skip_whitespace();
-        if (pos_ < json_.length() && json_[pos_] == ':') {
-            pos_++; // skip colon
-        }
-        
-        skip_whitespace();
-        if (pos_ < json_.length() && json_[pos_] == '"') {
-            result[key] = parse_string();
-        } else if (pos_ < json_.length() && (std::isdigit(json_[pos_]) || json_[pos_] == '-')) {
-            result[key] = std::to_string(parse_number());
-        } else if (pos_ < json_.length() && (json_[pos_] == 't' || json_[pos_] == 'f')) {
-            result[key] = parse_bool() ? "true" : "false";
-        } else if (pos_ < json_.length() && json_[pos_] == 'n') {
-            parse_null();
-            result[key] = "null";
-        }
-        
-        skip_whitespace();
-        if (pos_ < json_.length() && json_[pos_] == ',') {
-            pos_++; // skip comma
-        }
+        case 't':
+        case 'f':
+            read_bool();
+            break;
+        case 'n':
+            if (!read_null()) fail("expected value");
+            break;
+        default:
+            read_number();
     }
-    
-    return result;
-}
-
-std::string JsonParser::get_string(const std::string& key) {
-    // Reset position to start
-    pos_ = 0;
-    auto obj = parse_object();
-    auto it = obj.find(key);
-    return (it != obj.end()) ? it->second : "";
-}
-
-double JsonParser::get_number(const std::string& key) {
-    // Reset position to start
-    pos_ = 0;
-    auto obj = parse_object();
-    auto it = obj.find(key);
-    return (it != obj.end()) ? std::stod(it->second) : 0.0;
 }
 
-bool JsonParser::get_bool(const std::string& key) {
-    // Reset position to start
-    pos_ = 0;
-    auto obj = parse_object();
-    auto it = obj.find(key);
-    return (it != obj.end()) ? (it->second == "true") : false;
+void JsonReader::end() {
+    skip_whitespace();
+    if (pos_ != json_.size()) {
+        fail("unexpected data after value");
+    }
 }
 
 } // namespace utils
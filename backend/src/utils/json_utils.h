@@ -1,50 +1,106 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
-#include <map>
-#include <vector>
-#include <sstream>
+#include <string_view>
 
 namespace utils {
 
+// Appends JSON text to a string buffer. Numbers go through std::to_chars:
+// integers exactly and doubles as the shortest text that reads back as the
+// same value (so 100.123456 stays 100.123456); NaN and infinities, which
+// JSON cannot represent, are written as null. Keys and string values are
+// escaped. The builder writes into its own buffer, or appends to one the
+// caller provides (and can keep reusing across documents).
 class JsonBuilder {
 private:
-    std::ostringstream oss_;
+    std::string owned_;
+    std::string* out_;
     bool first_ = true;
     
+    void separator();
+    void key(std::string_view key);
+    void string(std::string_view value);
+    
 public:
-    JsonBuilder& start_object();
+    JsonBuilder() : out_(&owned_) {}
+    explicit JsonBuilder(std::string& out) : out_(&out) {}
+    JsonBuilder(const JsonBuilder&) = delete;
+    JsonBuilder& operator=(const JsonBuilder&) = delete;
+    
+    JsonBuilder& reserve(size_t bytes) { out_->reserve(out_->size() + bytes); return *this; }
+    
+    JsonBuilder& start_object(std::string_view key = {});
     JsonBuilder& end_object();
-    JsonBuilder& start_array(const std::string& key = "");
+    JsonBuilder& start_array(std::string_view key = {});
     JsonBuilder& end_array();
-    JsonBuilder& add_string(const std::string& key, const std::string& value);
-    JsonBuilder& add_number(const std::string& key, double value);
-    JsonBuilder& add_number(const std::string& key, int64_t value);
-    JsonBuilder& add_bool(const std::string& key, bool value);
-    JsonBuilder& add_null(const std::string& key);
+    JsonBuilder& add_string(std::string_view key, std::string_view value);
+    JsonBuilder& add_number(std::string_view key, double value);
+    JsonBuilder& add_number(std::string_view key, int64_t value);
+    JsonBuilder& add_bool(std::string_view key, bool value);
+    JsonBuilder& add_null(std::string_view key);
     
+    // Text written so far
+    std::string_view view() const { return *out_; }
+    // Moves the JSON out of the builder's own buffer; with a caller's
+    // buffer it returns a copy of it
     std::string build();
 };
 
-class JsonParser {
+// Forward-only reader over a JSON document held by the caller, for decoding
+// straight into typed structs in one pass. Nothing is copied or allocated
+// except to unescape a string that contains escapes. Malformed input
+// throws std::invalid_argument naming the byte offset of the problem.
+//
+//     reader.begin_object();
+//     std::string_view key;
+//     while (reader.next_key(key)) {
+//         if (key == "price") price = reader.read_number();
+//         else reader.skip_value();
+//     }
+//     reader.end();
+class JsonReader {
 private:
-    std::string json_;
+    std::string_view json_;
     size_t pos_ = 0;
+    char last_ = '\0';     // last structural character consumed, to place commas
     
     void skip_whitespace();
-    std::string parse_string();
-    double parse_number();
-    bool parse_bool();
-    void parse_null();
+    char peek();
+    void expect(char c);
+    void after_value();
+    void skip_value(int depth);
     
 public:
-    JsonParser(const std::string& json) : json_(json) {}
+    static constexpr int MAX_DEPTH = 64;
+    
+    explicit JsonReader(std::string_view json) : json_(json) {}
+    
+    void begin_object();
+    // Reads the next member name of the current object (as written, escapes
+    // and all); false once the closing brace has been consumed
+    bool next_key(std::string_view& key);
+    void begin_array();
+    // Positions at the next element of the current array; false once the
+    // closing bracket has been consumed
+    bool next_element();
+    
+    // A string without escapes is returned as a view of the document;
+    // otherwise it is decoded into storage and the view points there
+    std::string_view read_string(std::string& storage);
+    double read_number();
+    // A non-negative integer, exactly (ids above 2^53 do not survive a
+    // double); fractions and exponents are rejected
+    uint64_t read_uint64();
+    bool read_bool();
+    // Consumes null and returns true, or leaves any other value in place
+    bool read_null();
+    void skip_value();
+    // Requires that only whitespace follows the value just read
+    void end();
     
-    std::map<std::string, std::string> parse_object();
-    std::vector<std::string> parse_array();
-    std::string get_string(const std::string& key);
-    double get_number(const std::string& key);
-    bool get_bool(const std::string& key);
+    size_t offset() const { return pos_; }
+    [[noreturn]] void fail(const std::string& message) const;
 };
 
 } // namespace utils
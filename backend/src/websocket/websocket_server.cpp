@@ -3,15 +3,27 @@
  * 
  * Implements a lightweight WebSocket server for real-time trading data updates.
  * Supports WebSocket handshake, frame encoding/decoding, and client management.
+ *
+ * Each pass of the event loop reads whatever the ready clients sent, moves
+ * the outbox into the clients' output queues (applying subscription changes
+ * as it meets them), and then writes each client with pending output once.
  */
 
 #include "websocket_server.h"
+#include "../api/event_fd.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
 #include <cstring>
 #include <unistd.h>
-#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <openssl/sha.h>
 #include <openssl/bio.h>
 #include <openssl/evp.h>
@@ -19,8 +31,52 @@
 
 namespace websocket {
 
-WebSocketServer::WebSocketServer(int port) 
-    : port_(port), server_fd_(-1), running_(false) {
+namespace {
+    constexpr int MAX_EVENTS = 256;
+    // Free space guaranteed before each recv; clients send little
+    constexpr size_t MIN_READ_SPACE = 4096;
+    // A handshake request that has not ended by then is refused
+    constexpr size_t MAX_HANDSHAKE_BYTES = 8192;
+    // iovecs per sendmsg; well under IOV_MAX
+    constexpr size_t MAX_IOVECS = 64;
+
+    // epoll tags besides client ids
+    constexpr uint64_t WAKE_TAG = 0;
+    constexpr uint64_t LISTENER_TAG = UINT64_MAX;
+
+    enum Opcode : uint8_t {
+        CONTINUATION = 0x0,
+        TEXT = 0x1,
+        BINARY = 0x2,
+        CLOSE = 0x8,
+        PING = 0x9,
+        PONG = 0xA
+    };
+
+    // Close status codes (RFC 6455 section 7.4.1)
+    constexpr uint16_t GOING_AWAY = 1001;
+    constexpr uint16_t PROTOCOL_ERROR = 1002;
+    constexpr uint16_t MESSAGE_TOO_BIG = 1009;
+
+    bool iequals(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    std::string_view trim(std::string_view text) {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+        return text;
+    }
+
+    std::string status_payload(uint16_t status) {
+        return {static_cast<char>(status >> 8), static_cast<char>(status & 0xFF)};
+    }
+}
+
+WebSocketServer::WebSocketServer(int port, WebSocketServerConfig config)
+    : port_(port), config_(config) {
 }
 
 WebSocketServer::~WebSocketServer() {
@@ -32,38 +88,62 @@ bool WebSocketServer::start() {
         return true;
     }
     
+    auto fail_start = [this](const char* error) {
+        std::cerr << error << std::endl;
+        for (int* fd : {&server_fd_, &epoll_fd_, &wake_fd_}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        return false;
+    };
+    
     // Create socket
-    server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    server_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (server_fd_ < 0) {
-        std::cerr << "Failed to create socket" << std::endl;
-        return false;
+        return fail_start("Failed to create socket");
     }
     
     // Set socket options
     int opt = 1;
     if (setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        std::cerr << "Failed to set socket options" << std::endl;
-        close(server_fd_);
-        return false;
+        return fail_start("Failed to set socket options");
     }
     
     // Bind socket
     struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port_);
     
     if (bind(server_fd_, (struct sockaddr*)&address, sizeof(address)) < 0) {
         std::cerr << "Failed to bind socket to port " << port_ << std::endl;
-        close(server_fd_);
-        return false;
+        return fail_start("WebSocket server not started");
     }
     
     // Listen for connections
-    if (listen(server_fd_, 10) < 0) {
-        std::cerr << "Failed to listen on socket" << std::endl;
-        close(server_fd_);
-        return false;
+    if (listen(server_fd_, config_.backlog) < 0) {
+        return fail_start("Failed to listen on socket");
+    }
+    
+    // The event loop, and the eventfd that wakes it for new output
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+        return fail_start("Failed to create WebSocket event loop");
+    }
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = LISTENER_TAG;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_fd_, &event) < 0) {
+        return fail_start("Failed to register WebSocket socket");
+    }
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_TAG;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) < 0) {
+        return fail_start("Failed to register WebSocket wake-up descriptor");
     }
     
     running_ = true;
@@ -74,104 +154,333 @@ bool WebSocketServer::start() {
 }
 
 void WebSocketServer::stop() {
-    if (!running_) {
+    if (!running_.exchange(false)) {
         return;
     }
     
-    running_ = false;
+    // Wake the loop and wait for it to finish
+    api::wake_eventfd(wake_fd_);
+    if (server_thread_.joinable()) {
+        server_thread_.join();
+    }
     
-    // Close all client connections
-    {
-        std::lock_guard<std::mutex> lock(clients_mutex_);
-        for (int client_fd : clients_) {
-            close(client_fd);
+    // Tell the clients, best effort, and close them
+    Frame going_away = encode_frame(CLOSE, status_payload(GOING_AWAY));
+    while (!clients_.empty()) {
+        Client& client = *clients_.begin()->second;
+        if (client.state == State::OPEN && client.out_bytes == 0) {
+            ::send(client.fd, going_away->data(), going_away->size(), MSG_NOSIGNAL);
         }
-        clients_.clear();
+        close_client(client);
     }
-    
-    // Close server socket
-    if (server_fd_ >= 0) {
-        close(server_fd_);
-        server_fd_ = -1;
+    {
+        std::lock_guard<std::mutex> lock(outbox_mutex_);
+        outbox_.clear();
+        outbox_overflowed_ = false;
     }
-    
-    // Wait for server thread to finish
-    if (server_thread_.joinable()) {
-        server_thread_.join();
+    dirty_.clear();
+    expired_.clear();
+    for (int* fd : {&server_fd_, &epoll_fd_, &wake_fd_}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
     }
     
     std::cout << "WebSocket server stopped" << std::endl;
 }
 
 void WebSocketServer::server_loop() {
+    epoll_event events[MAX_EVENTS];
     while (running_) {
-        struct sockaddr_in client_address;
-        socklen_t client_len = sizeof(client_address);
+        int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "WebSocket epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
         
-        int client_fd = accept(server_fd_, (struct sockaddr*)&client_address, &client_len);
-        if (client_fd < 0) {
-            if (running_) {
-                std::cerr << "Failed to accept client connection" << std::endl;
+        for (int i = 0; i < count && running_; ++i) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == WAKE_TAG) {
+                uint64_t value;
+                if (read(wake_fd_, &value, sizeof(value)) < 0) {
+                    // Already reset by an earlier read; nothing else can fail
+                }
+                drain_outbox();
+                continue;
+            }
+            if (tag == LISTENER_TAG) {
+                accept_clients();
+                continue;
+            }
+            
+            // Clients are looked up by id, as one closed earlier in the
+            // pass may still have an event here
+            Client* client = find_client(tag);
+            if (!client) continue;
+            // Read even on EPOLLHUP/EPOLLERR: recv reports the error and the
+            // client is closed; writability just retries the flush below
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) && !read_input(*client)) {
+                continue;
+            }
+            mark_dirty(*client);
+        }
+        
+        // One send per client per pass, however many frames it collected
+        flush_dirty();
+    }
+}
+
+void WebSocketServer::accept_clients() {
+    // Edge-triggered: keep accepting until the queue is empty
+    while (true) {
+        int fd = accept4(server_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Failed to accept client connection: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        
+        auto client = std::make_unique<Client>();
+        client->id = next_client_id_++;
+        client->fd = fd;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = client->id;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            continue;
+        }
+        clients_.emplace(client->id, std::move(client));
+    }
+}
+
+void WebSocketServer::close_client(Client& client) {
+    ClientId id = client.id;
+    bool connected = client.state != State::HANDSHAKE;
+    queued_.fetch_sub(client.out.size(), std::memory_order_relaxed);
+    while (!client.topics.empty()) {
+        remove_subscription(client, client.topics.back());
+    }
+    // Closing the descriptor also removes it from the epoll set
+    close(client.fd);
+    clients_.erase(id);
+    if (connected) {
+        client_count_.fetch_sub(1, std::memory_order_relaxed);
+        if (on_disconnect_) {
+            on_disconnect_(id);
+        }
+    }
+}
+
+WebSocketServer::Client* WebSocketServer::find_client(ClientId client_id) {
+    auto it = clients_.find(client_id);
+    return it == clients_.end() ? nullptr : it->second.get();
+}
+
+bool WebSocketServer::read_input(Client& client) {
+    while (true) {
+        size_t available;
+        char* space = client.in.prepare(MIN_READ_SPACE, available);
+        ssize_t n = recv(client.fd, space, available, 0);
+        if (n > 0) {
+            client.in.commit(static_cast<size_t>(n));
+            if (!process_input(client)) {
+                return false;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        // Closed by the peer, or a socket error
+        close_client(client);
+        return false;
+    }
+}
+
+bool WebSocketServer::process_input(Client& client) {
+    while (true) {
+        if (client.state == State::HANDSHAKE) {
+            if (!handle_handshake(client)) {
+                return false;
+            }
+            if (client.state == State::HANDSHAKE) {
+                return true;    // the request is not complete yet
             }
             continue;
         }
+        if (client.state == State::CLOSING) {
+            // Nothing more is read once a close frame is queued
+            client.in.consume(client.in.size());
+            return true;
+        }
         
-        // Set client socket to non-blocking
-        int flags = fcntl(client_fd, F_GETFL, 0);
-        fcntl(client_fd, F_SETFL, flags | O_NONBLOCK);
+        std::string_view data = client.in.view();
+        if (data.size() < 2) {
+            return true;
+        }
+        uint8_t first = static_cast<uint8_t>(data[0]);
+        uint8_t second = static_cast<uint8_t>(data[1]);
+        // No extensions are negotiated, so the reserved bits must be clear,
+        // and every client frame must be masked
+        if ((first & 0x70) != 0 || (second & 0x80) == 0) {
+            fail(client, PROTOCOL_ERROR);
+            continue;
+        }
         
-        // Handle WebSocket handshake
-        char buffer[4096];
-        int bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0';
-            std::string request(buffer);
-            
-            if (handle_handshake(client_fd, request)) {
-                add_client(client_fd);
-                if (on_connect_) {
-                    on_connect_(client_fd);
-                }
-            } else {
-                close(client_fd);
+        uint64_t payload_len = second & 0x7F;
+        size_t header_len = 2;
+        if (payload_len == 126) {
+            if (data.size() < 4) return true;
+            payload_len = (static_cast<uint64_t>(static_cast<uint8_t>(data[2])) << 8) |
+                          static_cast<uint8_t>(data[3]);
+            header_len = 4;
+        } else if (payload_len == 127) {
+            if (data.size() < 10) return true;
+            payload_len = 0;
+            for (int i = 2; i < 10; ++i) {
+                payload_len = (payload_len << 8) | static_cast<uint8_t>(data[i]);
             }
-        } else {
-            close(client_fd);
+            header_len = 10;
+        }
+        if (payload_len > config_.max_message_bytes) {
+            fail(client, MESSAGE_TOO_BIG);
+            continue;
+        }
+        size_t frame_len = header_len + 4 + static_cast<size_t>(payload_len);
+        if (data.size() < frame_len) {
+            return true;
         }
+        
+        handle_frame(client, first & 0x0F, (first & 0x80) != 0,
+                     data.substr(header_len + 4, static_cast<size_t>(payload_len)), data.data() + header_len);
+        client.in.consume(frame_len);
     }
 }
 
-bool WebSocketServer::handle_handshake(int client_fd, const std::string& request) {
+bool WebSocketServer::handle_handshake(Client& client) {
+    std::string_view data = client.in.view();
+    size_t end = data.find("\r\n\r\n");
+    if (end == std::string_view::npos) {
+        if (data.size() > MAX_HANDSHAKE_BYTES) {
+            close_client(client);
+            return false;
+        }
+        return true;
+    }
+    
     // Extract WebSocket key from request
-    std::istringstream stream(request);
-    std::string line;
+    std::string_view request = data.substr(0, end + 2);
     std::string websocket_key;
-    
-    while (std::getline(stream, line)) {
-        if (line.find("Sec-WebSocket-Key:") != std::string::npos) {
-            websocket_key = line.substr(line.find(":") + 1);
-            // Remove leading/trailing whitespace
-            websocket_key.erase(0, websocket_key.find_first_not_of(" \t\r\n"));
-            websocket_key.erase(websocket_key.find_last_not_of(" \t\r\n") + 1);
-            break;
+    size_t pos = request.find("\r\n") + 2;
+    while (pos < request.size()) {
+        size_t line_end = request.find("\r\n", pos);
+        std::string_view line = request.substr(pos, line_end - pos);
+        pos = line_end + 2;
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos && iequals(trim(line.substr(0, colon)), "Sec-WebSocket-Key")) {
+            websocket_key = std::string(trim(line.substr(colon + 1)));
         }
     }
     
-    if (websocket_key.empty()) {
+    if (request.substr(0, 4) != "GET " || websocket_key.empty()) {
+        static const char bad_request[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        ::send(client.fd, bad_request, sizeof(bad_request) - 1, MSG_NOSIGNAL);
+        close_client(client);
         return false;
     }
     
-    // Create handshake response
-    std::string response = create_handshake_response(websocket_key);
-    
-    // Send response
-    if (send(client_fd, response.c_str(), response.length(), 0) < 0) {
-        return false;
+    // Copied before the request is consumed from the buffer
+    std::string_view request_line = request.substr(4, request.find("\r\n") - 4);
+    std::string target(request_line.substr(0, request_line.find(' ')));
+    client.in.consume(end + 4);
+    push_frame(client, std::make_shared<const std::string>(create_handshake_response(websocket_key)));
+    client.state = State::OPEN;
+    client_count_.fetch_add(1, std::memory_order_relaxed);
+    if (on_connect_) {
+        on_connect_(client.id, target);
     }
-    
     return true;
 }
 
+void WebSocketServer::handle_frame(Client& client, uint8_t opcode, bool fin, std::string_view payload,
+                                   const char* mask) {
+    auto unmask = [&](std::string& out) {
+        size_t base = out.size();
+        out.resize(base + payload.size());
+        for (size_t i = 0; i < payload.size(); ++i) {
+            out[base + i] = static_cast<char>(payload[i] ^ mask[i & 3]);
+        }
+    };
+    
+    switch (opcode) {
+        case CLOSE:
+        case PING:
+        case PONG:
+            // Control frames may not be fragmented and carry at most 125 bytes
+            if (!fin || payload.size() > 125) {
+                fail(client, PROTOCOL_ERROR);
+                return;
+            }
+            control_.clear();
+            unmask(control_);
+            if (opcode == PING) {
+                enqueue_control(client, PONG, control_);
+            } else if (opcode == CLOSE) {
+                // Echo the status code; the connection closes once it is sent
+                if (control_.size() == 1) {
+                    fail(client, PROTOCOL_ERROR);
+                    return;
+                }
+                enqueue_control(client, CLOSE, std::string_view(control_).substr(0, 2));
+                client.state = State::CLOSING;
+            }
+            return;
+        case CONTINUATION:
+            if (!client.fragmented) {
+                fail(client, PROTOCOL_ERROR);
+                return;
+            }
+            break;
+        case TEXT:
+        case BINARY:
+            if (client.fragmented) {
+                fail(client, PROTOCOL_ERROR);
+                return;
+            }
+            break;
+        default:
+            fail(client, PROTOCOL_ERROR);
+            return;
+    }
+    
+    if (client.message.size() + payload.size() > config_.max_message_bytes) {
+        fail(client, MESSAGE_TOO_BIG);
+        return;
+    }
+    unmask(client.message);
+    client.fragmented = !fin;
+    if (fin) {
+        if (on_message_) {
+            on_message_(client.id, client.message);
+        }
+        client.message.clear();
+    }
+}
+
+void WebSocketServer::fail(Client& client, uint16_t status) {
+    enqueue_control(client, CLOSE, status_payload(status));
+    client.state = State::CLOSING;
+}
+
 std::string WebSocketServer::create_handshake_response(const std::string& key) {
     const std::string magic_string = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
     std::string accept_key = sha1_hash(key + magic_string);
@@ -186,108 +495,294 @@ std::string WebSocketServer::create_handshake_response(const std::string& key) {
     return response.str();
 }
 
-void WebSocketServer::add_client(int client_fd) {
-    std::lock_guard<std::mutex> lock(clients_mutex_);
-    clients_.push_back(client_fd);
+// Frames are encoded here, on the caller's thread, once whatever the
+// number of clients
+void WebSocketServer::broadcast(std::string_view data) {
+    Outgoing outgoing;
+    outgoing.frame = encode_frame(TEXT, data);
+    post(std::move(outgoing));
 }
 
-void WebSocketServer::remove_client(int client_fd) {
-    std::lock_guard<std::mutex> lock(clients_mutex_);
-    clients_.erase(std::remove(clients_.begin(), clients_.end(), client_fd), clients_.end());
-    close(client_fd);
-    
-    if (on_disconnect_) {
-        on_disconnect_(client_fd);
+void WebSocketServer::send_to_client(ClientId client_id, std::string_view data) {
+    if (client_id != 0) {
+        Outgoing outgoing;
+        outgoing.client_id = client_id;
+        outgoing.frame = encode_frame(TEXT, data);
+        post(std::move(outgoing));
     }
 }
 
-void WebSocketServer::broadcast(const WebSocketMessage& message) {
-    std::string frame = encode_frame(message.data);
+void WebSocketServer::publish(std::string_view topic, std::string_view data) {
+    Outgoing outgoing;
+    outgoing.action = Outgoing::Action::PUBLISH;
+    outgoing.topic = std::string(topic);
+    outgoing.frame = encode_frame(TEXT, data);
+    post(std::move(outgoing));
+}
+
+void WebSocketServer::subscribe(ClientId client_id, std::string_view topic) {
+    Outgoing outgoing;
+    outgoing.action = Outgoing::Action::SUBSCRIBE;
+    outgoing.client_id = client_id;
+    outgoing.topic = std::string(topic);
+    post(std::move(outgoing));
+}
+
+void WebSocketServer::unsubscribe(ClientId client_id, std::string_view topic) {
+    Outgoing outgoing;
+    outgoing.action = Outgoing::Action::UNSUBSCRIBE;
+    outgoing.client_id = client_id;
+    outgoing.topic = std::string(topic);
+    post(std::move(outgoing));
+}
+
+void WebSocketServer::post(Outgoing&& outgoing) {
+    if (!running_) {
+        return;
+    }
+    bool was_empty;
+    {
+        std::lock_guard<std::mutex> lock(outbox_mutex_);
+        if (outgoing.frame && outbox_.size() >= config_.max_outbox_messages) {
+            outbox_overflowed_ = true;
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        was_empty = outbox_.empty();
+        outbox_.push_back(std::move(outgoing));
+    }
+    // Only the post that makes the outbox non-empty needs to wake the loop
+    if (was_empty) {
+        api::wake_eventfd(wake_fd_);
+    }
+}
+
+void WebSocketServer::drain_outbox() {
+    bool overflowed;
+    {
+        std::lock_guard<std::mutex> lock(outbox_mutex_);
+        outgoing_.swap(outbox_);
+        overflowed = outbox_overflowed_;
+        outbox_overflowed_ = false;
+    }
     
-    std::lock_guard<std::mutex> lock(clients_mutex_);
-    auto it = clients_.begin();
-    while (it != clients_.end()) {
-        int client_fd = *it;
-        if (send(client_fd, frame.c_str(), frame.length(), 0) < 0) {
-            // Client disconnected, remove from list
-            close(client_fd);
-            it = clients_.erase(it);
-        } else {
-            ++it;
+    for (const Outgoing& outgoing : outgoing_) {
+        if (outgoing.action == Outgoing::Action::PUBLISH) {
+            auto topic = topics_.find(outgoing.topic);
+            if (topic != topics_.end()) {
+                for (Client* client : topic->second) {
+                    enqueue(*client, outgoing.frame);
+                }
+            }
+            continue;
+        }
+        if (outgoing.client_id == 0) {
+            for (auto& entry : clients_) {
+                enqueue(*entry.second, outgoing.frame);
+            }
+            continue;
+        }
+        Client* client = find_client(outgoing.client_id);
+        if (!client || client->state == State::HANDSHAKE) {
+            continue;
+        }
+        switch (outgoing.action) {
+            case Outgoing::Action::SEND: enqueue(*client, outgoing.frame); break;
+            case Outgoing::Action::SUBSCRIBE: add_subscription(*client, outgoing.topic); break;
+            case Outgoing::Action::UNSUBSCRIBE: remove_subscription(*client, outgoing.topic); break;
+            case Outgoing::Action::PUBLISH: break;
+        }
+    }
+    outgoing_.clear();
+    for (ClientId client_id : expired_) {
+        Client* client = find_client(client_id);
+        if (client) {
+            close_client(*client);
+        }
+    }
+    expired_.clear();
+    
+    // Every client missed what the outbox dropped; treat them all as
+    // lagging, so each is resumed once its queue has drained
+    if (overflowed) {
+        auto now = std::chrono::steady_clock::now();
+        for (auto& entry : clients_) {
+            Client& client = *entry.second;
+            if (client.state == State::OPEN && !client.lagging) {
+                client.lagging = true;
+                client.lagging_since = now;
+                mark_dirty(client);
+            }
+        }
+    }
+}
+
+void WebSocketServer::enqueue(Client& client, const Frame& frame) {
+    if (client.state != State::OPEN) {
+        return;
+    }
+    if (client.lagging || client.out_bytes + frame->size() > config_.max_queued_bytes) {
+        // A slow consumer: drop rather than queue without bound, and give
+        // up on it if it stays behind
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        auto now = std::chrono::steady_clock::now();
+        if (!client.lagging) {
+            client.lagging = true;
+            client.lagging_since = now;
+        } else if (now - client.lagging_since > config_.max_lag) {
+            std::cerr << "Closing WebSocket client " << client.id << ": " << client.out_bytes
+                      << " bytes unread for over " << config_.max_lag.count() << " ms" << std::endl;
+            // Not closed here, as the caller may be walking a list it is in
+            client.state = State::CLOSING;
+            expired_.push_back(client.id);
         }
+        return;
+    }
+    push_frame(client, frame);
+}
+
+void WebSocketServer::add_subscription(Client& client, const std::string& topic) {
+    if (std::find(client.topics.begin(), client.topics.end(), topic) != client.topics.end()) {
+        return;
+    }
+    client.topics.push_back(topic);
+    topics_[topic].push_back(&client);
+}
+
+void WebSocketServer::remove_subscription(Client& client, const std::string& topic) {
+    auto it = std::find(client.topics.begin(), client.topics.end(), topic);
+    if (it == client.topics.end()) {
+        return;
+    }
+    auto entry = topics_.find(topic);
+    std::vector<Client*>& subscribers = entry->second;
+    *std::find(subscribers.begin(), subscribers.end(), &client) = subscribers.back();
+    subscribers.pop_back();
+    if (subscribers.empty()) {
+        topics_.erase(entry);
+    }
+    // Last, as topic may be the client's own copy
+    std::swap(*it, client.topics.back());
+    client.topics.pop_back();
+}
+
+void WebSocketServer::enqueue_control(Client& client, uint8_t opcode, std::string_view payload) {
+    // Control frames are tiny and never dropped
+    push_frame(client, encode_frame(opcode, payload));
+}
+
+void WebSocketServer::push_frame(Client& client, Frame frame) {
+    client.out_bytes += frame->size();
+    client.out.push_back(std::move(frame));
+    queued_.fetch_add(1, std::memory_order_relaxed);
+    mark_dirty(client);
+}
+
+void WebSocketServer::mark_dirty(Client& client) {
+    if (!client.flush_pending) {
+        client.flush_pending = true;
+        dirty_.push_back(client.id);
     }
 }
 
-void WebSocketServer::send_to_client(int client_fd, const WebSocketMessage& message) {
-    std::string frame = encode_frame(message.data);
+void WebSocketServer::flush_dirty() {
+    for (ClientId client_id : dirty_) {
+        // Clients closed earlier in the pass are skipped
+        Client* client = find_client(client_id);
+        if (client) {
+            client->flush_pending = false;
+            flush(*client);
+        }
+    }
+    dirty_.clear();
+}
+
+bool WebSocketServer::flush(Client& client) {
+    // sendmsg rather than writev so MSG_NOSIGNAL still applies. Not
+    // MSG_ZEROCOPY: it pins pages and reports completion on the socket's
+    // error queue, which only pays off from about 10 KiB per send, while
+    // these frames are mostly a few hundred bytes (and loopback copies
+    // anyway); each frame would also stay referenced until its completion.
+    iovec iov[MAX_IOVECS];
+    while (client.out_bytes > 0) {
+        size_t count = 0;
+        for (auto it = client.out.begin(); it != client.out.end() && count < MAX_IOVECS; ++it, ++count) {
+            size_t skip = count == 0 ? client.out_offset : 0;
+            iov[count].iov_base = const_cast<char*>((*it)->data() + skip);
+            iov[count].iov_len = (*it)->size() - skip;
+        }
+        msghdr message{};
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t n = sendmsg(client.fd, &message, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // EPOLLOUT resumes the rest
+            return true;
+        }
+        if (n <= 0) {
+            close_client(client);
+            return false;
+        }
+        
+        // Release what was sent; a short write leaves out_offset inside a frame
+        size_t sent = static_cast<size_t>(n);
+        client.out_bytes -= sent;
+        while (sent > 0) {
+            size_t remaining = client.out.front()->size() - client.out_offset;
+            if (sent < remaining) {
+                client.out_offset += sent;
+                break;
+            }
+            sent -= remaining;
+            client.out.pop_front();
+            client.out_offset = 0;
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
     
-    if (send(client_fd, frame.c_str(), frame.length(), 0) < 0) {
-        remove_client(client_fd);
+    if (client.state == State::CLOSING) {
+        close_client(client);
+        return false;
     }
+    // Caught up: whoever publishes resends what the client missed
+    if (client.lagging) {
+        client.lagging = false;
+        if (on_resume_) {
+            on_resume_(client.id);
+        }
+    }
+    return true;
 }
 
-std::string WebSocketServer::encode_frame(const std::string& data) {
-    std::string frame;
+Frame WebSocketServer::encode_frame(uint8_t opcode, std::string_view data) {
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(data.length() + 10);
     
-    // First byte: FIN=1, opcode=1 (text frame)
-    frame.push_back(0x81);
+    // First byte: FIN=1 and the opcode
+    frame->push_back(static_cast<char>(0x80 | opcode));
     
-    // Payload length
+    // Payload length (server frames are not masked)
     size_t payload_len = data.length();
     if (payload_len < 126) {
-        frame.push_back(static_cast<char>(payload_len));
+        frame->push_back(static_cast<char>(payload_len));
     } else if (payload_len < 65536) {
-        frame.push_back(126);
-        frame.push_back(static_cast<char>((payload_len >> 8) & 0xFF));
-        frame.push_back(static_cast<char>(payload_len & 0xFF));
+        char length[3] = {126, static_cast<char>((payload_len >> 8) & 0xFF), static_cast<char>(payload_len & 0xFF)};
+        frame->append(length, sizeof(length));
     } else {
-        frame.push_back(127);
-        for (int i = 7; i >= 0; --i) {
-            frame.push_back(static_cast<char>((payload_len >> (i * 8)) & 0xFF));
+        char length[9] = {127};
+        for (int i = 0; i < 8; ++i) {
+            length[1 + i] = static_cast<char>((payload_len >> ((7 - i) * 8)) & 0xFF);
         }
+        frame->append(length, sizeof(length));
     }
     
     // Payload data
-    frame += data;
+    frame->append(data.data(), data.size());
     
     return frame;
 }
 
-std::string WebSocketServer::decode_frame(const std::string& frame) {
-    if (frame.length() < 2) {
-        return "";
-    }
-    
-    // Check if this is a text frame
-    if ((frame[0] & 0x0F) != 1) {
-        return "";
-    }
-    
-    // Get payload length
-    size_t payload_len = frame[1] & 0x7F;
-    size_t header_len = 2;
-    
-    if (payload_len == 126) {
-        if (frame.length() < 4) return "";
-        payload_len = (static_cast<unsigned char>(frame[2]) << 8) | static_cast<unsigned char>(frame[3]);
-        header_len = 4;
-    } else if (payload_len == 127) {
-        if (frame.length() < 10) return "";
-        payload_len = 0;
-        for (int i = 2; i < 10; ++i) {
-            payload_len = (payload_len << 8) | static_cast<unsigned char>(frame[i]);
-        }
-        header_len = 10;
-    }
-    
-    // Extract payload
-    if (frame.length() < header_len + payload_len) {
-        return "";
-    }
-    
-    return frame.substr(header_len, payload_len);
-}
-
 std::string WebSocketServer::base64_encode(const std::string& input) {
     BIO* bio = BIO_new(BIO_s_mem());
     BIO* b64 = BIO_new(BIO_f_base64());
@@ -1,21 +1,51 @@
 /**
  * WebSocket Server Implementation
- * 
+ *
  * Provides real-time communication capabilities for the trading engine,
  * allowing clients to receive live updates for order book changes and trade executions.
+ *
+ * One epoll event-loop thread owns every connection: it accepts, completes
+ * the handshake, reads and unmasks client frames (answering pings and close
+ * frames itself) and writes queued output. broadcast() and send_to_client()
+ * encode the frame on the caller's thread and hand it to the loop through a
+ * mutex-guarded outbox and an eventfd, so publishing costs the same however
+ * many clients there are and however slow any of them is.
+ *
+ * A frame is encoded once into an immutable, reference-counted buffer that
+ * holds its header and payload; every client queue it goes to holds a
+ * pointer to it, and a client's queued frames go out in one gathered
+ * sendmsg. Fan-out to N clients costs N pointer copies rather than N copies
+ * of the frame, and the frame is freed when the last client has sent it.
+ *
+ * Clients can also subscribe to named topics: publish() goes only to a
+ * topic's subscribers, through a per-topic subscriber list kept on the loop
+ * thread, so a stream costs in proportion to the clients that asked for it.
+ * Subscribing goes through the outbox too, so it takes effect in order with
+ * the caller's sends and publishes.
+ *
+ * Each client has a bounded output queue and partial writes resume on
+ * EPOLLOUT. A client whose queue is full is a slow consumer: messages for
+ * it are dropped until its queue has drained, and it is then reported to
+ * the on_resume callback so the publisher can resend state in place of what
+ * was dropped (the market data feed sends book snapshots). One that stays
+ * behind for max_lag is disconnected.
  */
 
 #pragma once
 
-#include <string>
-#include <vector>
+#include "../api/read_buffer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <functional>
-#include <thread>
+#include <memory>
 #include <mutex>
-#include <map>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace websocket {
 
@@ -24,48 +54,159 @@ struct WebSocketMessage {
     std::string data;
 };
 
+// An encoded frame, header and payload in one buffer, shared by every
+// client queue it is in
+using Frame = std::shared_ptr<const std::string>;
+
+struct WebSocketServerConfig {
+    // listen() backlog (the kernel caps it at net.core.somaxconn)
+    int backlog = 1024;
+    // Unsent output a client may have queued; beyond it the client's
+    // messages are dropped until it catches up
+    size_t max_queued_bytes = 1 << 20;
+    // How long a client may stay behind before it is disconnected
+    std::chrono::milliseconds max_lag = std::chrono::seconds(10);
+    // Largest message a client may send, fragments included
+    size_t max_message_bytes = 64 << 10;
+    // Messages handed to the loop but not yet queued to clients; beyond it
+    // new ones are dropped and every client is resumed afterwards
+    size_t max_outbox_messages = 1 << 16;
+};
+
 class WebSocketServer {
 public:
-    WebSocketServer(int port);
+    // Clients are named by ids that are never reused; 0 names none
+    using ClientId = uint64_t;
+
+    WebSocketServer(int port, WebSocketServerConfig config = WebSocketServerConfig());
     ~WebSocketServer();
-    
+
     // Server lifecycle
     bool start();
     void stop();
     bool is_running() const { return running_; }
-    
-    // Message handling
-    void broadcast(const WebSocketMessage& message);
-    void send_to_client(int client_fd, const WebSocketMessage& message);
-    
-    // Client management
-    void add_client(int client_fd);
-    void remove_client(int client_fd);
-    
-    // Event callbacks
-    void set_on_connect(std::function<void(int)> callback) { on_connect_ = callback; }
-    void set_on_disconnect(std::function<void(int)> callback) { on_disconnect_ = callback; }
-    void set_on_message(std::function<void(int, const std::string&)> callback) { on_message_ = callback; }
+
+    // Message handling; thread-safe, never block on a client. data goes out
+    // as one text frame, encoded once whatever the number of clients.
+    void broadcast(std::string_view data);
+    void send_to_client(ClientId client_id, std::string_view data);
+    void broadcast(const WebSocketMessage& message) { broadcast(message.data); }
+    void send_to_client(ClientId client_id, const WebSocketMessage& message) { send_to_client(client_id, message.data); }
+    // Topics; thread-safe. Subscribing twice is the same as once, and a
+    // client's subscriptions end with it.
+    void subscribe(ClientId client_id, std::string_view topic);
+    void unsubscribe(ClientId client_id, std::string_view topic);
+    void publish(std::string_view topic, std::string_view data);
+
+    // Clients that have completed the handshake
+    size_t client_count() const { return client_count_.load(std::memory_order_relaxed); }
+    // Frames waiting in client queues, counted once per client
+    size_t queued() const { return queued_.load(std::memory_order_relaxed); }
+    // Messages dropped for slow consumers or a full outbox
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // Event callbacks, run on the event-loop thread; set them before start().
+    // on_connect gets the handshake's request target, path and query
+    // (/ws?client_id=alice), so a client can name itself as it connects.
+    void set_on_connect(std::function<void(ClientId, std::string_view)> callback) { on_connect_ = callback; }
+    void set_on_disconnect(std::function<void(ClientId)> callback) { on_disconnect_ = callback; }
+    void set_on_message(std::function<void(ClientId, const std::string&)> callback) { on_message_ = callback; }
+    // A client that had messages dropped has caught up
+    void set_on_resume(std::function<void(ClientId)> callback) { on_resume_ = callback; }
 
 private:
+    enum class State : uint8_t {
+        HANDSHAKE,
+        OPEN,
+        CLOSING     // a close frame is queued, closed once it is written; or lagged too long
+    };
+
+    struct Client {
+        ClientId id = 0;
+        int fd = -1;
+        State state = State::HANDSHAKE;
+        api::ReadBuffer in;
+        std::string message;            // text or binary message being reassembled
+        bool fragmented = false;        // message awaits continuation frames
+        std::deque<Frame> out;          // frames not yet sent
+        size_t out_offset = 0;          // bytes of out.front() already sent
+        size_t out_bytes = 0;           // unsent bytes across out
+        bool flush_pending = false;     // listed in dirty_ for the end of the pass
+        bool lagging = false;           // messages are being dropped
+        std::chrono::steady_clock::time_point lagging_since;
+        std::vector<std::string> topics;
+    };
+
+    // What the loop is asked to do; only frames count against the outbox
+    // limit, as a lost subscription would go unnoticed
+    struct Outgoing {
+        enum class Action : uint8_t {
+            SEND,           // frame to client_id, or to every open client when it is 0
+            PUBLISH,        // frame to the topic's subscribers
+            SUBSCRIBE,
+            UNSUBSCRIBE
+        };
+        Action action = Action::SEND;
+        ClientId client_id = 0;
+        std::string topic;
+        Frame frame;
+    };
+
     int port_;
-    int server_fd_;
-    bool running_;
+    WebSocketServerConfig config_;
+    std::atomic<bool> running_{false};
     std::thread server_thread_;
-    std::vector<int> clients_;
-    std::mutex clients_mutex_;
-    
+    int server_fd_ = -1;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;                  // eventfd, written when the outbox turns non-empty
+
+    std::mutex outbox_mutex_;
+    std::vector<Outgoing> outbox_;
+    bool outbox_overflowed_ = false;
+    std::vector<Outgoing> outgoing_;    // swapped with the outbox each pass
+
+    ClientId next_client_id_ = 1;
+    std::unordered_map<ClientId, std::unique_ptr<Client>> clients_;
+    std::vector<ClientId> dirty_;       // ids of clients with output to flush
+    std::vector<ClientId> expired_;     // lagged too long; closed once the outbox is delivered
+    // Subscribers per topic; a client is closed only between deliveries,
+    // so the pointers never dangle while a list is walked
+    std::unordered_map<std::string, std::vector<Client*>> topics_;
+    std::atomic<size_t> client_count_{0};
+    std::atomic<size_t> queued_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::string control_;               // scratch for unmasked control payloads
+
     // Event callbacks
-    std::function<void(int)> on_connect_;
-    std::function<void(int)> on_disconnect_;
-    std::function<void(int, const std::string&)> on_message_;
-    
+    std::function<void(ClientId, std::string_view)> on_connect_;
+    std::function<void(ClientId)> on_disconnect_;
+    std::function<void(ClientId, const std::string&)> on_message_;
+    std::function<void(ClientId)> on_resume_;
+
     // Internal methods
     void server_loop();
-    bool handle_handshake(int client_fd, const std::string& request);
+    void post(Outgoing&& outgoing);
+    void accept_clients();
+    void close_client(Client& client);
+    // Return false once the client has been closed
+    bool read_input(Client& client);
+    bool process_input(Client& client);
+    bool handle_handshake(Client& client);
+    void handle_frame(Client& client, uint8_t opcode, bool fin, std::string_view payload, const char* mask);
+    void fail(Client& client, uint16_t status);
+    void drain_outbox();
+    void add_subscription(Client& client, const std::string& topic);
+    void remove_subscription(Client& client, const std::string& topic);
+    void enqueue(Client& client, const Frame& frame);
+    void push_frame(Client& client, Frame frame);
+    void enqueue_control(Client& client, uint8_t opcode, std::string_view payload);
+    void mark_dirty(Client& client);
+    bool flush(Client& client);
+    void flush_dirty();
+    Client* find_client(ClientId client_id);
+
     std::string create_handshake_response(const std::string& key);
-    std::string encode_frame(const std::string& data);
-    std::string decode_frame(const std::string& frame);
+    static Frame encode_frame(uint8_t opcode, std::string_view data);
     std::string base64_encode(const std::string& input);
     std::string sha1_hash(const std::string& input);
 };
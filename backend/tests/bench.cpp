@@ -0,0 +1,992 @@
+/**
+ * Order Book Microbenchmarks
+ *
+ * Runs a set of order book scenarios and times every operation on its own,
+ * so each scenario reports a latency distribution rather than one average.
+ * Scenarios cover deep queues, wide price distributions, cancel- and amend-heavy flow,
+ * aggressive sweeps through many levels and replay of a recorded journal,
+ * plus the HTTP request parser and router on typical requests and the JSON
+ * serialization of order books and trade history (reported as headers,
+ * levels or trades per second as well). Each one builds its book and its
+ * operation stream up front; only the operations themselves are timed.
+ *
+ * Per scenario: latency percentiles (p50/p90/p99/p99.9/max) and a log2
+ * latency histogram, heap allocations and bytes per operation (counted by
+ * replacing the global operator new), and cache misses per operation from
+ * perf_event_open when the kernel allows it. --json writes the results in
+ * the Google Benchmark JSON layout ("context" plus a "benchmarks" array),
+ * so runs from two builds can be diffed with the usual tooling.
+ *
+ * Usage: bench [--filter SUBSTRING] [--ops N] [--json PATH|-] [--list]
+ *              [--replay JOURNAL [--shard I] [--shards N]]
+ */
+
+#include "api/http_parser.h"
+#include "api/router.h"
+#include "api/trading_api.h"
+#include "engine/book_snapshot.h"
+#include "order_book/order_book.h"
+#include "persistence/journal.h"
+#include "utils/json_utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+using order::Order;
+using order::OrderType;
+using order_book::OrderBook;
+
+// ----------------------------------------------------------------------------
+// Allocation counting. The benchmark is single-threaded, so plain counters
+// are enough and keep the hook cheap inside the timed loop.
+// ----------------------------------------------------------------------------
+
+namespace {
+    uint64_t allocation_count = 0;
+    uint64_t allocation_bytes = 0;
+
+    void* counted_allocate(std::size_t size) {
+        ++allocation_count;
+        allocation_bytes += size;
+        if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+            return pointer;
+        }
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new(std::size_t size) { return counted_allocate(size); }
+void* operator new[](std::size_t size) { return counted_allocate(size); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+
+namespace {
+
+struct Options {
+    std::string filter;
+    size_t ops = 1000000;
+    std::string json_path;
+    std::string replay_path;
+    uint32_t shard = 0;
+    uint32_t shards = 1;
+    bool list = false;
+};
+
+// Results of ops that have no side effect of their own end up here, so the
+// compiler cannot drop them
+volatile uint64_t benchmark_sink = 0;
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+// ----------------------------------------------------------------------------
+// Hardware counters
+// ----------------------------------------------------------------------------
+
+// One user-space perf counter for the calling thread. Opening fails quietly
+// (in containers, or with perf_event_paranoid too high) and the counter then
+// reports itself unavailable instead of a value.
+class PerfCounter {
+public:
+    PerfCounter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~PerfCounter() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    bool available() const { return fd_ >= 0; }
+
+    void start() {
+        if (fd_ < 0) return;
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t stop() {
+        if (fd_ < 0) return 0;
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t value = 0;
+        if (read(fd_, &value, sizeof(value)) != sizeof(value)) return 0;
+        return value;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+// ----------------------------------------------------------------------------
+// Scenarios
+// ----------------------------------------------------------------------------
+
+struct Op {
+    enum class Kind : uint8_t { SUBMIT, CANCEL, AMEND, PARSE_HTTP, ROUTE, SERIALIZE_BOOK, SERIALIZE_TRADES, DECODE_ORDER };
+    Kind kind;
+    // PARSE_HTTP, DECODE_ORDER: index into Scenario::requests, ROUTE: into
+    // Scenario::routed
+    uint32_t book;
+    Order order;    // CANCEL only uses order_id, AMEND also quantity and price
+};
+
+// Books plus the operations that build their starting state (untimed) and
+// the operations under measurement
+struct Scenario {
+    std::string name;
+    std::string description;
+    std::vector<std::unique_ptr<OrderBook>> books;
+    std::vector<Op> setup;
+    std::vector<Op> ops;
+
+    // PARSE_HTTP: raw requests, and how many bytes of each arrive in the
+    // first read (0: all at once)
+    std::vector<std::string> requests;
+    size_t first_read = 0;
+    api::HttpParser parser;
+    api::HttpRequest request;
+    // ROUTE: parsed requests to match against router
+    api::Router router;
+    std::vector<api::HttpRequest> routed;
+    // SERIALIZE_BOOK writes snapshot, SERIALIZE_TRADES the trade history
+    // of books[0]
+    std::shared_ptr<const engine::BookSnapshot> snapshot;
+    size_t trade_limit = 0;
+    // DECODE_ORDER: requests holds order bodies
+    api::OrderRequest order_request;
+    // AMEND: fills of a re-priced order, reused across ops
+    std::vector<Trade> fills;
+
+    const char* item_name = "";     // what apply() counts, for the report
+    uint64_t output_bytes = 0;      // JSON produced by SERIALIZE_* ops
+};
+
+constexpr double TICK_SIZE = 0.01;
+
+Op submit_op(uint64_t order_id, OrderType type, int64_t tick, int quantity, uint32_t book = 0) {
+    Op op{Op::Kind::SUBMIT, book, Order{}};
+    op.order.order_id = order_id;
+    op.order.type = type;
+    op.order.quantity = quantity;
+    op.order.price = static_cast<double>(tick) * TICK_SIZE;
+    op.order.timestamp = order_id;
+    return op;
+}
+
+Op cancel_op(uint64_t order_id, uint32_t book = 0) {
+    Op op{Op::Kind::CANCEL, book, Order{}};
+    op.order.order_id = order_id;
+    return op;
+}
+
+Op amend_op(uint64_t order_id, int64_t tick, int quantity, uint32_t book = 0) {
+    Op op{Op::Kind::AMEND, book, Order{}};
+    op.order.order_id = order_id;
+    op.order.quantity = quantity;
+    op.order.price = static_cast<double>(tick) * TICK_SIZE;
+    return op;
+}
+
+Scenario make_scenario(const std::string& name, const std::string& description) {
+    Scenario scenario;
+    scenario.name = name;
+    scenario.description = description;
+    scenario.books.push_back(std::make_unique<OrderBook>(TICK_SIZE));
+    return scenario;
+}
+
+// Passive orders queued on ten levels a side: appends to long FIFOs
+Scenario deep_book_rest(size_t ops) {
+    Scenario scenario = make_scenario("deep_book/rest", "passive orders onto 10 deep levels a side");
+    const int64_t mid = 10000;
+    std::mt19937 rng(1);
+    for (size_t i = 0; i < ops; ++i) {
+        bool buy = i % 2 == 0;
+        int64_t offset = static_cast<int64_t>(rng() % 10) + 1;
+        scenario.ops.push_back(submit_op(i + 1, buy ? OrderType::BUY : OrderType::SELL,
+                                         buy ? mid - offset : mid + offset, static_cast<int>(rng() % 100) + 1));
+    }
+    return scenario;
+}
+
+// Small aggressive orders against deep queues, each filling a few resting orders
+Scenario deep_book_match(size_t ops) {
+    Scenario scenario = make_scenario("deep_book/match", "small aggressors filling 1-3 orders off deep queues");
+    const int64_t mid = 10000;
+    uint64_t id = 0;
+    // Resting volume per side (10 per order) comfortably exceeds the aggressors' total
+    for (size_t i = 0; i < ops; ++i) {
+        bool buy = i % 2 == 0;
+        int64_t offset = static_cast<int64_t>((i / 2) % 10) + 1;
+        scenario.setup.push_back(submit_op(++id, buy ? OrderType::BUY : OrderType::SELL,
+                                           buy ? mid - offset : mid + offset, 10));
+    }
+    std::mt19937 rng(2);
+    for (size_t i = 0; i < ops / 2; ++i) {
+        bool buy = i % 2 == 0;
+        scenario.ops.push_back(submit_op(++id, buy ? OrderType::BUY : OrderType::SELL,
+                                         buy ? mid + 10 : mid - 10, static_cast<int>(rng() % 20) + 1));
+    }
+    return scenario;
+}
+
+int64_t normal_offset(std::mt19937& rng, std::normal_distribution<double>& distribution, int64_t limit) {
+    return std::min(limit, static_cast<int64_t>(std::fabs(distribution(rng))) + 1);
+}
+
+// Passive orders spread over thousands of sparse levels
+Scenario wide_prices_rest(size_t ops) {
+    Scenario scenario = make_scenario("wide_prices/rest", "passive orders over ~8k sparse levels a side");
+    const int64_t mid = 100000;
+    std::mt19937 rng(3);
+    std::normal_distribution<double> distribution(0.0, 2000.0);
+    for (size_t i = 0; i < ops; ++i) {
+        bool buy = rng() % 2 == 0;
+        int64_t offset = normal_offset(rng, distribution, 50000);
+        scenario.ops.push_back(submit_op(i + 1, buy ? OrderType::BUY : OrderType::SELL,
+                                         buy ? mid - offset : mid + offset, static_cast<int>(rng() % 100) + 1));
+    }
+    return scenario;
+}
+
+// Crossing flow over a wide price range with 25% cancels of earlier orders
+Scenario wide_prices_mixed(size_t ops) {
+    Scenario scenario = make_scenario("wide_prices/mixed", "crossing flow, sigma 500 ticks, 25% cancels");
+    const int64_t mid = 100000;
+    std::mt19937 rng(4);
+    std::normal_distribution<double> distribution(0.0, 500.0);
+    uint64_t id = 0;
+    for (size_t i = 0; i < ops; ++i) {
+        if (rng() % 4 == 0 && id > 0) {
+            scenario.ops.push_back(cancel_op(rng() % id + 1));
+            continue;
+        }
+        int64_t tick = mid + static_cast<int64_t>(std::llround(distribution(rng)));
+        scenario.ops.push_back(submit_op(++id, rng() % 2 == 0 ? OrderType::BUY : OrderType::SELL,
+                                         tick, static_cast<int>(rng() % 100) + 1));
+    }
+    return scenario;
+}
+
+// Market-maker flow: every quote rests, 90% of steps also pull a random live
+// quote. Quotes never cross, so the live set is known when generating.
+Scenario cancel_heavy(size_t ops) {
+    Scenario scenario = make_scenario("cancel_heavy", "non-crossing quotes on 50 levels, 90% pulled");
+    const int64_t mid = 10000;
+    std::mt19937 rng(42);
+    std::vector<uint64_t> live;
+    uint64_t id = 0;
+    while (scenario.ops.size() < ops) {
+        bool buy = rng() % 2 == 0;
+        int64_t offset = static_cast<int64_t>(rng() % 50) + 1;
+        scenario.ops.push_back(submit_op(++id, buy ? OrderType::BUY : OrderType::SELL,
+                                         buy ? mid - offset : mid + offset, static_cast<int>(rng() % 100) + 1));
+        live.push_back(id);
+        if (rng() % 100 < 90 && scenario.ops.size() < ops) {
+            size_t victim = rng() % live.size();
+            scenario.ops.push_back(cancel_op(live[victim]));
+            live[victim] = live.back();
+            live.pop_back();
+        }
+    }
+    return scenario;
+}
+
+// Market-maker requoting through amends on a book of 5000 quotes over 50
+// levels: 70% shrink a quote in place, 30% move it one to three ticks
+// further out (wrapping back to the touch), to the back of another level. Quotes stay on their side
+// of the mid, so amends never cross; a quote shrunk to 1 is topped up again
+// by a reprice.
+Scenario amend_heavy(size_t ops) {
+    Scenario scenario = make_scenario("amend_heavy", "5000 quotes on 50 levels, 70% shrink in place, 30% reprice");
+    const int64_t mid = 10000;
+    const int64_t levels = 50;
+    std::mt19937 rng(7);
+    struct Quote { uint64_t id; bool buy; int64_t offset; int quantity; };
+    std::vector<Quote> quotes;
+    for (uint64_t id = 1; id <= 5000; ++id) {
+        bool buy = id % 2 == 0;
+        int64_t offset = static_cast<int64_t>(rng() % levels) + 1;
+        quotes.push_back({id, buy, offset, 100});
+        scenario.setup.push_back(submit_op(id, buy ? OrderType::BUY : OrderType::SELL,
+                                           buy ? mid - offset : mid + offset, 100));
+    }
+    for (size_t i = 0; i < ops; ++i) {
+        Quote& quote = quotes[rng() % quotes.size()];
+        if (rng() % 100 < 70 && quote.quantity > 1) {
+            quote.quantity -= static_cast<int>(rng() % (quote.quantity - 1)) + 1;
+        } else {
+            quote.offset = (quote.offset + static_cast<int64_t>(rng() % 3)) % levels + 1;
+            quote.quantity = 100;
+        }
+        scenario.ops.push_back(amend_op(quote.id, quote.buy ? mid - quote.offset : mid + quote.offset, quote.quantity));
+    }
+    return scenario;
+}
+
+// Each op sweeps exactly 20 full levels (80 orders) off one side. The book is
+// built deep enough that no sweep ever runs into an empty side.
+Scenario sweep(size_t ops) {
+    const int64_t levels_per_sweep = 20;
+    const int orders_per_level = 4;
+    const int quantity = 25;
+    const int64_t mid = 200000;
+    size_t sweeps_per_side = std::max<size_t>(50, ops / 200);
+
+    Scenario scenario = make_scenario("sweep/20_levels", "aggressors clearing 20 levels x 4 orders each");
+    uint64_t id = 0;
+    int64_t levels = static_cast<int64_t>(sweeps_per_side) * levels_per_sweep;
+    for (int64_t level = 1; level <= levels; ++level) {
+        for (int i = 0; i < orders_per_level; ++i) {
+            scenario.setup.push_back(submit_op(++id, OrderType::SELL, mid + level, quantity));
+            scenario.setup.push_back(submit_op(++id, OrderType::BUY, mid - level, quantity));
+        }
+    }
+    int sweep_quantity = static_cast<int>(levels_per_sweep) * orders_per_level * quantity;
+    for (size_t i = 0; i < sweeps_per_side; ++i) {
+        int64_t depth = static_cast<int64_t>(i + 1) * levels_per_sweep;
+        scenario.ops.push_back(submit_op(++id, OrderType::BUY, mid + depth, sweep_quantity));
+        scenario.ops.push_back(submit_op(++id, OrderType::SELL, mid - depth, sweep_quantity));
+    }
+    return scenario;
+}
+
+// Replays a shard journal's order, cancel and amend records, one book per symbol,
+// the way recovery applies them (trade records are skipped)
+Scenario replay_journal(const std::string& path, uint32_t shard, uint32_t shards, const std::string& name) {
+    Scenario scenario;
+    scenario.name = name;
+    scenario.description = "journal replay of " + std::filesystem::path(path).filename().string();
+    std::unordered_map<std::string, uint32_t> books;
+    auto book_for = [&](const std::string& symbol) {
+        auto found = books.find(symbol);
+        if (found != books.end()) return found->second;
+        scenario.books.push_back(std::make_unique<OrderBook>(TICK_SIZE));
+        uint32_t index = static_cast<uint32_t>(scenario.books.size() - 1);
+        books.emplace(symbol, index);
+        return index;
+    };
+
+    if (!std::filesystem::exists(path)) {
+        throw std::runtime_error("No such journal: " + path);
+    }
+    persistence::JournalReader reader(path, shard, shards);
+    persistence::JournalRecord record;
+    while (reader.next(record)) {
+        if (record.type == persistence::RecordType::NEW_ORDER) {
+            Order order = record.to_order();
+            uint32_t book = book_for(order.symbol);
+            scenario.ops.push_back({Op::Kind::SUBMIT, book, std::move(order)});
+        } else if (record.type == persistence::RecordType::CANCEL_ORDER) {
+            scenario.ops.push_back(cancel_op(record.order_id, book_for(record.symbol_name())));
+        } else if (record.type == persistence::RecordType::AMEND_ORDER) {
+            Op op{Op::Kind::AMEND, book_for(record.symbol_name()), Order{}};
+            op.order.order_id = record.order_id;
+            op.order.quantity = record.quantity;
+            op.order.price = record.price;
+            scenario.ops.push_back(std::move(op));
+        }
+    }
+    if (reader.truncated()) {
+        std::cerr << "Warning: " << path << " has a torn tail; replaying the records before it\n";
+    }
+    return scenario;
+}
+
+// Without --replay: records a session (near-the-touch flow, 30% cancels of
+// recent orders) to a scratch journal exactly as the engine would journal
+// it, then replays that file
+Scenario replay_recorded(size_t ops) {
+    auto directory = std::filesystem::temp_directory_path() / ("bench_replay_" + std::to_string(now_ns()));
+    std::filesystem::create_directories(directory);
+    std::string path = persistence::Journal::shard_path(directory.string(), 0);
+    {
+        persistence::Journal journal(path, 0, 1, persistence::Durability::NONE, 0);
+        OrderBook book(TICK_SIZE);
+        const int64_t mid = 10000;
+        std::mt19937 rng(9);
+        std::normal_distribution<double> distribution(0.0, 10.0);
+        uint64_t id = 0;
+        for (size_t i = 0; i < ops; ++i) {
+            if (rng() % 10 < 3 && id > 0) {
+                uint64_t victim = id - std::min<uint64_t>(id - 1, rng() % 1000);
+                if (book.cancel_order(victim)) {
+                    journal.append(persistence::JournalRecord::cancel_order("RPLY", victim));
+                }
+                continue;
+            }
+            Op op = submit_op(++id, rng() % 2 == 0 ? OrderType::BUY : OrderType::SELL,
+                              mid + static_cast<int64_t>(std::llround(distribution(rng))),
+                              static_cast<int>(rng() % 100) + 1);
+            op.order.symbol = "RPLY";
+            op.order.client_id = "bench";
+            journal.append(persistence::JournalRecord::new_order(op.order));
+            for (const auto& fill : book.submit(op.order)) {
+                journal.append(persistence::JournalRecord::trade(fill));
+            }
+        }
+        journal.commit();
+    }
+    Scenario scenario = replay_journal(path, 0, 1, "replay/recorded");
+    std::filesystem::remove_all(directory);
+    return scenario;
+}
+
+// Every op parses one request from the same buffer, as a worker does for
+// each request in a connection's read buffer
+Scenario http_scenario(const std::string& name, const std::string& description, std::string request,
+                       size_t ops, size_t first_read = 0) {
+    Scenario scenario;
+    scenario.name = name;
+    scenario.description = description;
+    scenario.requests.push_back(std::move(request));
+    scenario.first_read = first_read;
+    scenario.item_name = "headers";
+    scenario.ops.assign(ops, Op{Op::Kind::PARSE_HTTP, 0, Order{}});
+    return scenario;
+}
+
+const char* const BROWSER_GET =
+    "GET /api/orderbook?symbol=AAPL&depth=20 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+    "Accept: application/json, text/plain, */*\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Origin: http://localhost:5173\r\n"
+    "Sec-Fetch-Site: same-site\r\n"
+    "Sec-Fetch-Mode: cors\r\n"
+    "Sec-Fetch-Dest: empty\r\n"
+    "Referer: http://localhost:5173/\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "\r\n";
+
+// What curl or the load generator sends: request line plus three headers
+Scenario http_curl_get(size_t ops) {
+    return http_scenario("http/curl_get", "GET with 3 headers",
+                         "GET /api/orderbook?symbol=AAPL HTTP/1.1\r\n"
+                         "Host: localhost:8080\r\n"
+                         "User-Agent: curl/8.4.0\r\n"
+                         "Accept: */*\r\n"
+                         "\r\n",
+                         ops);
+}
+
+// Fetch from the frontend: 14 headers, ~700 bytes
+Scenario http_browser_get(size_t ops) {
+    return http_scenario("http/browser_get", "browser GET with 14 headers", BROWSER_GET, ops);
+}
+
+// Order entry with a JSON body delimited by Content-Length
+Scenario http_order_post(size_t ops) {
+    std::string body = "{\"symbol\":\"AAPL\",\"type\":\"BUY\",\"price\":150.25,\"quantity\":100,\"user_id\":\"trader1\"}";
+    return http_scenario("http/order_post", "POST /api/orders with a JSON body",
+                         "POST /api/orders HTTP/1.1\r\n"
+                         "Host: localhost:8080\r\n"
+                         "Content-Type: application/json\r\n"
+                         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                         "\r\n" + body,
+                         ops);
+}
+
+// The browser request split mid-header across two reads: the second parse
+// call resumes the header scan rather than starting over
+Scenario http_split_read(size_t ops) {
+    std::string request = BROWSER_GET;
+    return http_scenario("http/split_read", "browser GET arriving in two reads", request, ops, request.size() / 2);
+}
+
+// Route lookup for a mix of the server's endpoints, literal and {symbol}
+// paths, with and without query strings (plus one miss)
+Scenario http_route(size_t ops) {
+    Scenario scenario;
+    scenario.name = "http/route";
+    scenario.description = "route table lookup with path parameters";
+    const char* const routes[][2] = {
+        {"GET", "/api/orderbook"}, {"GET", "/api/orderbook/{symbol}"},
+        {"GET", "/api/trades"}, {"GET", "/api/trades/{symbol}"},
+        {"POST", "/api/orders"}, {"GET", "/api/market-summary"},
+        {"GET", "/api/market-summary/{symbol}"}, {"GET", "/health"},
+    };
+    uint32_t route_id = 0;
+    for (const auto& route : routes) {
+        scenario.router.add(route[0], route[1], route_id++);
+    }
+    const char* const requests[] = {
+        "GET /api/orderbook?symbol=AAPL HTTP/1.1\r\n\r\n",
+        "GET /api/orderbook/MSFT HTTP/1.1\r\n\r\n",
+        "GET /api/trades/AAPL?since_trade_id=1200&limit=50 HTTP/1.1\r\n\r\n",
+        "POST /api/orders HTTP/1.1\r\n\r\n",
+        "GET /api/market-summary/GOOG HTTP/1.1\r\n\r\n",
+        "GET /health HTTP/1.1\r\n\r\n",
+        "GET /api/unknown HTTP/1.1\r\n\r\n",
+    };
+    for (const char* request : requests) {
+        scenario.requests.push_back(request);
+    }
+    // The requests are parsed once, untimed; their views point into
+    // scenario.requests, which is not modified afterwards
+    for (const auto& request : scenario.requests) {
+        scenario.routed.emplace_back();
+        scenario.parser.parse(request, scenario.routed.back());
+    }
+    for (size_t i = 0; i < ops; ++i) {
+        scenario.ops.push_back(Op{Op::Kind::ROUTE, static_cast<uint32_t>(i % scenario.routed.size()), Order{}});
+    }
+    return scenario;
+}
+
+// Serializations are far slower than book operations, so these run one
+// op per JSON_OPS_DIVISOR of --ops
+constexpr size_t JSON_OPS_DIVISOR = 100;
+
+// GET /api/orderbook body for 500 levels a side, prices with cents
+Scenario json_order_book(size_t ops) {
+    Scenario scenario = make_scenario("json/order_book", "serialize a 1000-level order book snapshot");
+    const int64_t mid = 10000;
+    std::mt19937 rng(7);
+    uint64_t order_id = 1;
+    OrderBook& book = *scenario.books[0];
+    for (int64_t level = 1; level <= 500; ++level) {
+        book.submit(submit_op(order_id++, OrderType::BUY, mid - level, static_cast<int>(rng() % 1000) + 1).order);
+        book.submit(submit_op(order_id++, OrderType::SELL, mid + level, static_cast<int>(rng() % 1000) + 1).order);
+    }
+    scenario.snapshot = engine::BookSnapshot::capture(book, "AAPL", 1);
+    scenario.ops.assign(std::max<size_t>(1, ops / JSON_OPS_DIVISOR), Op{Op::Kind::SERIALIZE_BOOK, 0, Order{}});
+    scenario.item_name = "levels";
+    return scenario;
+}
+
+// GET /api/trades body for a page of 1000 trades
+Scenario json_trades(size_t ops) {
+    Scenario scenario = make_scenario("json/trades", "serialize a page of 1000 trades");
+    const int64_t mid = 10000;
+    uint64_t order_id = 1;
+    for (int i = 0; i < 1000; ++i) {
+        int64_t tick = mid + i % 50;
+        scenario.setup.push_back(submit_op(order_id++, OrderType::SELL, tick, 10 + i % 90));
+        scenario.setup.push_back(submit_op(order_id++, OrderType::BUY, tick, 10 + i % 90));
+    }
+    for (auto& op : scenario.setup) {
+        op.order.symbol = "AAPL";
+    }
+    scenario.trade_limit = 1000;
+    scenario.ops.assign(std::max<size_t>(1, ops / JSON_OPS_DIVISOR), Op{Op::Kind::SERIALIZE_TRADES, 0, Order{}});
+    scenario.item_name = "trades";
+    return scenario;
+}
+
+// POST /api/orders bodies as the frontend sends them, decoded into an
+// OrderRequest
+Scenario json_order_decode(size_t ops) {
+    Scenario scenario;
+    scenario.name = "json/order_decode";
+    scenario.description = "decode an order submission body";
+    std::mt19937 rng(11);
+    for (int i = 0; i < 64; ++i) {
+        scenario.requests.push_back(
+            "{\"type\":\"" + std::string(i % 2 ? "BUY" : "SELL") + "\",\"quantity\":" + std::to_string(rng() % 1000 + 1) +
+            ",\"price\":" + std::to_string(90 + rng() % 20) + "." + std::to_string(10 + rng() % 90) +
+            ",\"client_id\":\"sim_1700000000" + std::to_string(100 + i) + "_k3x9q\"}");
+    }
+    for (size_t i = 0; i < ops; ++i) {
+        scenario.ops.push_back(Op{Op::Kind::DECODE_ORDER, static_cast<uint32_t>(i % scenario.requests.size()), Order{}});
+    }
+    return scenario;
+}
+
+// ----------------------------------------------------------------------------
+// Measurement
+// ----------------------------------------------------------------------------
+
+struct Result {
+    std::string name;
+    std::string description;
+    size_t ops = 0;
+    double seconds = 0;
+    std::vector<uint32_t> latencies;    // sorted, ns
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    bool have_cache_misses = false;
+    uint64_t cache_misses = 0;
+    bool have_l1d_misses = false;
+    uint64_t l1d_misses = 0;
+    uint64_t items = 0;                 // headers, levels or trades, per item_name
+    std::string item_name;
+    uint64_t output_bytes = 0;
+
+    double per_op(uint64_t total) const { return ops > 0 ? static_cast<double>(total) / ops : 0; }
+    double ns_per_op() const { return ops > 0 ? seconds * 1e9 / ops : 0; }
+    double items_per_second() const { return seconds > 0 ? items / seconds : 0; }
+    double bytes_per_second() const { return seconds > 0 ? output_bytes / seconds : 0; }
+    // Nearest-rank percentile
+    uint32_t percentile(double p) const {
+        if (latencies.empty()) return 0;
+        size_t rank = static_cast<size_t>(std::ceil(p * latencies.size()));
+        return latencies[std::min(latencies.size(), std::max<size_t>(rank, 1)) - 1];
+    }
+};
+
+// Returns the number of items processed beyond the op itself (headers,
+// levels, trades)
+inline size_t apply(Scenario& scenario, const Op& op) {
+    if (op.kind == Op::Kind::PARSE_HTTP) {
+        std::string_view data = scenario.requests[op.book];
+        if (scenario.first_read > 0 &&
+            scenario.parser.parse(data.substr(0, scenario.first_read), scenario.request) !=
+                api::HttpParser::Result::INCOMPLETE) {
+            throw std::runtime_error("partial request did not parse as incomplete");
+        }
+        if (scenario.parser.parse(data, scenario.request) != api::HttpParser::Result::COMPLETE) {
+            throw std::runtime_error(std::string("request did not parse: ") + scenario.parser.error());
+        }
+        return scenario.request.header_count;
+    }
+    if (op.kind == Op::Kind::ROUTE) {
+        api::HttpRequest& request = scenario.routed[op.book];
+        benchmark_sink += scenario.router.match(request) + request.path_param_count;
+        return 0;
+    }
+    if (op.kind == Op::Kind::DECODE_ORDER) {
+        api::TradingApi::parse_order_request(scenario.requests[op.book], scenario.order_request);
+        benchmark_sink += static_cast<uint64_t>(scenario.order_request.quantity);
+        return 0;
+    }
+    if (op.kind == Op::Kind::SERIALIZE_BOOK) {
+        scenario.output_bytes += api::TradingApi::serialize_order_book(*scenario.snapshot).size();
+        return scenario.snapshot->bids.size() + scenario.snapshot->asks.size();
+    }
+    if (op.kind == Op::Kind::SERIALIZE_TRADES) {
+        const OrderBook& book = *scenario.books[op.book];
+        scenario.output_bytes += api::TradingApi::serialize_trades(book, -1, scenario.trade_limit).size();
+        return std::min(scenario.trade_limit, book.get_trades().size());
+    }
+    OrderBook& book = *scenario.books[op.book];
+    if (op.kind == Op::Kind::SUBMIT) {
+        book.submit(op.order);
+    } else if (op.kind == Op::Kind::AMEND) {
+        scenario.fills.clear();
+        book.amend_order(op.order.order_id, op.order.quantity, op.order.price, scenario.fills);
+    } else {
+        book.cancel_order(op.order.order_id);
+    }
+    return 0;
+}
+
+Result run(Scenario& scenario, PerfCounter& cache_misses, PerfCounter& l1d_misses) {
+    for (const auto& op : scenario.setup) {
+        apply(scenario, op);
+    }
+    scenario.setup = std::vector<Op>();
+
+    Result result;
+    result.name = scenario.name;
+    result.description = scenario.description;
+    result.ops = scenario.ops.size();
+    result.latencies.resize(result.ops);
+
+    uint64_t allocations_before = allocation_count;
+    uint64_t bytes_before = allocation_bytes;
+    cache_misses.start();
+    l1d_misses.start();
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < result.ops; ++i) {
+        uint64_t op_start = now_ns();
+        result.items += apply(scenario, scenario.ops[i]);
+        uint64_t elapsed = now_ns() - op_start;
+        result.latencies[i] = static_cast<uint32_t>(std::min<uint64_t>(elapsed, UINT32_MAX));
+    }
+    uint64_t end = now_ns();
+    result.l1d_misses = l1d_misses.stop();
+    result.cache_misses = cache_misses.stop();
+    result.have_cache_misses = cache_misses.available();
+    result.have_l1d_misses = l1d_misses.available();
+    result.allocations = allocation_count - allocations_before;
+    result.allocated_bytes = allocation_bytes - bytes_before;
+    result.item_name = scenario.item_name;
+    result.output_bytes = scenario.output_bytes;
+
+    result.seconds = (end - start) / 1e9;
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+// Cost of one back-to-back clock read, which every latency sample includes
+uint64_t timer_overhead_ns() {
+    std::vector<uint64_t> samples(10001);
+    for (auto& sample : samples) {
+        uint64_t start = now_ns();
+        sample = now_ns() - start;
+    }
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+}
+
+// ----------------------------------------------------------------------------
+// Reporting
+// ----------------------------------------------------------------------------
+
+void print_header(uint64_t timer_overhead, bool have_counters) {
+    std::cout << "Timer overhead: " << timer_overhead << " ns per sample (included in latencies)\n";
+    if (!have_counters) {
+        std::cout << "Cache counters: unavailable (perf_event_open denied)\n";
+    }
+    std::cout << "\n" << std::left << std::setw(20) << "Benchmark" << std::right << std::setw(10) << "Ops"
+              << std::setw(10) << "ns/op" << std::setw(8) << "p50" << std::setw(8) << "p99" << std::setw(9) << "p99.9"
+              << std::setw(10) << "max" << std::setw(11) << "allocs/op" << std::setw(13) << "LLC miss/op"
+              << std::setw(13) << "L1D miss/op" << "\n";
+    std::cout << std::string(112, '-') << "\n";
+}
+
+void print_result(const Result& result) {
+    auto counter = [&](bool available, uint64_t value) {
+        std::ostringstream out;
+        if (available) {
+            out << std::fixed << std::setprecision(2) << result.per_op(value);
+        } else {
+            out << "n/a";
+        }
+        return out.str();
+    };
+    std::cout << std::left << std::setw(20) << result.name << std::right << std::setw(10) << result.ops
+              << std::setw(10) << std::fixed << std::setprecision(1) << result.ns_per_op() << std::setw(8)
+              << result.percentile(0.50) << std::setw(8) << result.percentile(0.99) << std::setw(9)
+              << result.percentile(0.999) << std::setw(10) << result.percentile(1.0) << std::setw(11)
+              << std::setprecision(3) << result.per_op(result.allocations) << std::setw(13)
+              << counter(result.have_cache_misses, result.cache_misses) << std::setw(13)
+              << counter(result.have_l1d_misses, result.l1d_misses) << "\n";
+    if (result.items > 0) {
+        std::cout << std::left << std::setw(20) << "" << std::right << std::setprecision(2)
+                  << result.items_per_second() / 1e6 << "M " << result.item_name << "/s";
+        if (result.output_bytes > 0) {
+            std::cout << ", " << result.bytes_per_second() / 1e6 << " MB/s";
+        }
+        std::cout << "\n";
+    }
+}
+
+std::string json_report(const std::vector<Result>& results, uint64_t timer_overhead) {
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+
+    utils::JsonBuilder json;
+    json.start_object();
+    json.start_object("context")
+        .add_string("date", date)
+        .add_string("host_name", host)
+        .add_string("executable", "bench")
+        .add_number("num_cpus", static_cast<int64_t>(std::thread::hardware_concurrency()))
+        .add_string("compiler", __VERSION__)
+#ifdef NDEBUG
+        .add_string("library_build_type", "release")
+#else
+        .add_string("library_build_type", "debug")
+#endif
+        .add_number("timer_overhead_ns", static_cast<int64_t>(timer_overhead))
+        .end_object();
+
+    json.start_array("benchmarks");
+    for (const auto& result : results) {
+        double ns_per_op = result.ns_per_op();
+        json.start_object()
+            .add_string("name", result.name)
+            .add_string("description", result.description)
+            .add_string("run_type", "iteration")
+            .add_number("iterations", static_cast<int64_t>(result.ops))
+            .add_number("real_time", ns_per_op)
+            .add_number("cpu_time", ns_per_op)
+            .add_string("time_unit", "ns")
+            .add_number("ops_per_sec", result.seconds > 0 ? result.ops / result.seconds : 0.0)
+            .add_number("p50_ns", static_cast<int64_t>(result.percentile(0.50)))
+            .add_number("p90_ns", static_cast<int64_t>(result.percentile(0.90)))
+            .add_number("p99_ns", static_cast<int64_t>(result.percentile(0.99)))
+            .add_number("p999_ns", static_cast<int64_t>(result.percentile(0.999)))
+            .add_number("max_ns", static_cast<int64_t>(result.percentile(1.0)))
+            .add_number("allocs_per_op", result.per_op(result.allocations))
+            .add_number("alloc_bytes_per_op", result.per_op(result.allocated_bytes));
+        if (result.items > 0) {
+            json.add_number("items_per_second", result.items_per_second());
+        }
+        if (result.output_bytes > 0) {
+            json.add_number("bytes_per_second", result.bytes_per_second());
+        }
+        if (result.have_cache_misses) {
+            json.add_number("cache_misses_per_op", result.per_op(result.cache_misses));
+        } else {
+            json.add_null("cache_misses_per_op");
+        }
+        if (result.have_l1d_misses) {
+            json.add_number("l1d_misses_per_op", result.per_op(result.l1d_misses));
+        } else {
+            json.add_null("l1d_misses_per_op");
+        }
+
+        // Log2 buckets: a sample of n ns lands in the bucket with the
+        // smallest power-of-two upper bound le_ns >= n
+        json.start_array("histogram");
+        size_t i = 0;
+        for (uint64_t bound = 1; i < result.latencies.size(); bound *= 2) {
+            size_t end = std::upper_bound(result.latencies.begin() + i, result.latencies.end(), bound) -
+                         result.latencies.begin();
+            if (end > i) {
+                json.start_object()
+                    .add_number("le_ns", static_cast<int64_t>(bound))
+                    .add_number("count", static_cast<int64_t>(end - i))
+                    .end_object();
+            }
+            i = end;
+        }
+        json.end_array();
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+    return json.build();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+            if (arg == "--filter") options.filter = next();
+            else if (arg == "--ops") options.ops = std::stoull(next());
+            else if (arg == "--json") options.json_path = next();
+            else if (arg == "--replay") options.replay_path = next();
+            else if (arg == "--shard") options.shard = static_cast<uint32_t>(std::stoul(next()));
+            else if (arg == "--shards") options.shards = static_cast<uint32_t>(std::stoul(next()));
+            else if (arg == "--list") options.list = true;
+            else {
+                std::cerr << "Usage: bench [--filter SUBSTRING] [--ops N] [--json PATH|-] [--list]\n"
+                             "             [--replay JOURNAL [--shard I] [--shards N]]\n";
+                return 1;
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Invalid numeric argument\n";
+        return 1;
+    }
+    if (options.ops == 0) {
+        std::cerr << "--ops must be at least 1\n";
+        return 1;
+    }
+
+    using Factory = Scenario (*)(size_t);
+    std::vector<std::pair<std::string, Factory>> factories = {
+        {"deep_book/rest", deep_book_rest},
+        {"deep_book/match", deep_book_match},
+        {"wide_prices/rest", wide_prices_rest},
+        {"wide_prices/mixed", wide_prices_mixed},
+        {"cancel_heavy", cancel_heavy},
+        {"amend_heavy", amend_heavy},
+        {"sweep/20_levels", sweep},
+        {"http/curl_get", http_curl_get},
+        {"http/browser_get", http_browser_get},
+        {"http/order_post", http_order_post},
+        {"http/split_read", http_split_read},
+        {"http/route", http_route},
+        {"json/order_book", json_order_book},
+        {"json/trades", json_trades},
+        {"json/order_decode", json_order_decode},
+        {"replay/recorded", replay_recorded},
+    };
+    if (!options.replay_path.empty()) {
+        factories.back().first = "replay/journal";
+    }
+
+    if (options.list) {
+        for (const auto& factory : factories) {
+            std::cout << factory.first << "\n";
+        }
+        return 0;
+    }
+
+    // With --json - the JSON goes to stdout, so the table goes to stderr
+    std::streambuf* stdout_buffer = std::cout.rdbuf();
+    if (options.json_path == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    PerfCounter cache_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    PerfCounter l1d_misses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    uint64_t timer_overhead = timer_overhead_ns();
+    print_header(timer_overhead, cache_misses.available() || l1d_misses.available());
+
+    std::vector<Result> results;
+    for (const auto& factory : factories) {
+        if (factory.first.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        try {
+            Scenario scenario = factory.first == "replay/journal"
+                                    ? replay_journal(options.replay_path, options.shard, options.shards, factory.first)
+                                    : factory.second(options.ops);
+            results.push_back(run(scenario, cache_misses, l1d_misses));
+        } catch (const std::exception& e) {
+            std::cerr << factory.first << " failed: " << e.what() << "\n";
+            return 1;
+        }
+        print_result(results.back());
+    }
+
+    std::cout.rdbuf(stdout_buffer);
+    if (!options.json_path.empty()) {
+        std::string report = json_report(results, timer_overhead);
+        if (options.json_path == "-") {
+            std::cout << report << "\n";
+        } else {
+            std::ofstream out(options.json_path);
+            out << report << "\n";
+            if (!out) {
+                std::cerr << "Cannot write " << options.json_path << "\n";
+                return 1;
+            }
+            std::cout << "\nWrote " << options.json_path << "\n";
+        }
+    }
+    return 0;
+}
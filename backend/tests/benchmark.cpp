@@ -1,8 +1,13 @@
 #include "order_book/order_book.h"
+#include "engine/matching_engine.h"
+#include "persistence/snapshot.h"
 #include <chrono>
+#include <filesystem>
 #include <iostream>
 #include <vector>
 #include <random>
+#include <string>
+#include <thread>
 
 using namespace std;
 using namespace order;
@@ -33,6 +38,265 @@ void print_benchmark_config(
     std::cout << "============================\n\n";
 }
 
+// Market-maker style flow: every step rests a new quote away from the mid and
+// 90% of steps also pull a random live quote. Quotes never cross, so the set
+// of live orders (and therefore the op sequence) can be generated up front.
+void run_cancel_heavy_benchmark() {
+    const int num_orders = 1000000;
+    const double mid_price = 100.0;
+    const double tick_size = 0.01;
+    const int price_levels = 50;
+    const int cancel_percent = 90;
+
+    struct Op {
+        bool is_cancel;
+        Order order;
+    };
+
+    mt19937 rng(42);
+    vector<Op> ops;
+    ops.reserve(num_orders * 2);
+    vector<int> live;
+
+    for (int i = 0; i < num_orders; ++i) {
+        Order order;
+        order.order_id = i;
+        order.type = rng() % 2 == 0 ? OrderType::BUY : OrderType::SELL;
+        int offset = static_cast<int>(rng() % price_levels) + 1;
+        order.price = mid_price + tick_size * (order.type == OrderType::BUY ? -offset : offset);
+        order.quantity = static_cast<int>(rng() % 100) + 1;
+        order.timestamp = i;
+        ops.push_back({false, order});
+        live.push_back(i);
+
+        if (static_cast<int>(rng() % 100) < cancel_percent) {
+            size_t victim = rng() % live.size();
+            Order cancel{};
+            cancel.order_id = live[victim];
+            ops.push_back({true, cancel});
+            live[victim] = live.back();
+            live.pop_back();
+        }
+    }
+
+    OrderBook order_book(tick_size);
+    auto start_time = NowNs();
+    for (const auto& op : ops) {
+        if (op.is_cancel) {
+            order_book.cancel_order(op.order.order_id);
+        } else {
+            order_book.add_order(op.order);
+        }
+    }
+    auto end_time = NowNs();
+
+    double duration = (end_time - start_time) / 1e9;
+    double throughput = ops.size() / (duration > 0 ? duration : 1e-9);
+
+    std::cout << "\n===== Cancel-Heavy Benchmark =====\n";
+    std::cout << "Orders Added  : " << num_orders << "\n";
+    std::cout << "Cancels       : " << ops.size() - num_orders << " (" << cancel_percent << "%)\n";
+    std::cout << "Price Levels  : " << price_levels << " per side\n";
+    std::cout << "Resting Orders: " << order_book.order_count() << "\n";
+    std::cout << "Avg Latency   : " << (end_time - start_time) / static_cast<double>(ops.size()) << " ns/op\n";
+    std::cout << "Throughput    : " << throughput << " ops/sec\n";
+    std::cout << "==================================\n\n";
+}
+
+// Flow spread evenly over many symbols, submitted through the sharded engine
+// by one producer thread per shard. Reports end-to-end orders/sec (queue
+// hand-off plus matching) for increasing shard counts.
+void run_sharded_engine_benchmark() {
+    const int num_orders = 1000000;
+    const int num_symbols = 64;
+    const double mid_price = 100.0;
+    const double tick_size = 0.01;
+
+    std::cout << "\n===== Sharded Engine Benchmark =====\n";
+    std::cout << "Total Orders  : " << num_orders << "\n";
+    std::cout << "Symbols       : " << num_symbols << "\n";
+    std::cout << "HW Threads    : " << std::thread::hardware_concurrency() << "\n";
+
+    for (size_t num_shards : {1, 2, 4}) {
+        engine::MatchingEngine matching_engine(num_shards);
+        vector<string> symbols;
+        for (int i = 0; i < num_symbols; ++i) {
+            symbols.push_back("SYM" + to_string(i));
+            matching_engine.add_symbol(symbols.back(), tick_size);
+        }
+        matching_engine.start();
+
+        // Pre-build each producer's orders so only submission is timed
+        vector<vector<Order>> flows(num_shards);
+        mt19937 rng(7);
+        for (int i = 0; i < num_orders; ++i) {
+            Order order;
+            order.order_id = 0;
+            order.type = rng() % 2 == 0 ? OrderType::BUY : OrderType::SELL;
+            order.price = mid_price + tick_size * (static_cast<int>(rng() % 21) - 10);
+            order.quantity = static_cast<int>(rng() % 100) + 1;
+            order.timestamp = i;
+            order.symbol = symbols[i % num_symbols];
+            flows[i % num_shards].push_back(order);
+        }
+
+        auto start_time = NowNs();
+        vector<thread> producers;
+        for (size_t p = 0; p < num_shards; ++p) {
+            producers.emplace_back([&matching_engine, &flows, p] {
+                for (auto& order : flows[p]) {
+                    matching_engine.submit(std::move(order), engine::Completion());
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        // Shards execute in FIFO order, so a trailing query per symbol marks completion
+        for (const auto& symbol : symbols) {
+            matching_engine.query(symbol, [](const OrderBook&) {}).wait();
+        }
+        auto end_time = NowNs();
+
+        double duration = (end_time - start_time) / 1e9;
+        std::cout << "Shards " << num_shards << "      : " << num_orders / (duration > 0 ? duration : 1e-9) << " orders/sec\n";
+    }
+    std::cout << "====================================\n\n";
+}
+
+// ----------------------------------------------------------------------------
+// Journal benchmark: order entry with journaling on, then a cold-start replay
+// of the same journal into a fresh engine.
+// ----------------------------------------------------------------------------
+void run_journal_benchmark() {
+    const int num_commands = 1000000;
+    const double mid_price = 100.0;
+    const double tick_size = 0.01;
+    const string symbol = "JRNL";
+
+    std::cout << "\n===== Journal Benchmark =====\n";
+    std::cout << "Commands      : " << num_commands << " (1 in 4 a cancel)\n";
+
+    for (auto durability : {persistence::Durability::NONE, persistence::Durability::BATCH}) {
+        auto directory = std::filesystem::temp_directory_path() / ("journal_bench_" + to_string(NowNs()));
+        persistence::JournalConfig config;
+        config.directory = directory.string();
+        config.durability = durability;
+
+        double write_seconds;
+        {
+            engine::MatchingEngine matching_engine(1);
+            matching_engine.add_symbol(symbol, tick_size);
+            matching_engine.open_journal(config);
+            matching_engine.start();
+
+            mt19937 rng(11);
+            uint64_t issued = 0;
+            auto start_time = NowNs();
+            for (int i = 0; i < num_commands; ++i) {
+                if (i % 4 == 3 && issued > 0) {
+                    matching_engine.cancel(engine::make_order_id(rng() % issued + 1, 0), engine::Completion());
+                    continue;
+                }
+                Order order;
+                order.order_id = 0;
+                order.type = rng() % 2 == 0 ? OrderType::BUY : OrderType::SELL;
+                order.price = mid_price + tick_size * (static_cast<int>(rng() % 41) - 20);
+                order.quantity = static_cast<int>(rng() % 100) + 1;
+                order.timestamp = i;
+                order.symbol = symbol;
+                matching_engine.submit(std::move(order), engine::Completion());
+                ++issued;
+            }
+            matching_engine.query(symbol, [](const OrderBook&) {}).wait();
+            write_seconds = (NowNs() - start_time) / 1e9;
+        }
+
+        // Drop the shutdown snapshot so recovery replays the whole journal
+        std::filesystem::remove(persistence::Journal::snapshot_path(config.directory, 0));
+        engine::MatchingEngine recovered(1);
+        recovered.add_symbol(symbol, tick_size);
+        engine::RecoveryStats stats = recovered.open_journal(config);
+        std::filesystem::remove_all(directory);
+
+        const char* mode = durability == persistence::Durability::NONE ? "none " : "batch";
+        std::cout << "Write (" << mode << ") : " << num_commands / (write_seconds > 0 ? write_seconds : 1e-9)
+                  << " commands/sec\n";
+        std::cout << "Replay        : " << stats.records << " records in " << stats.seconds * 1000 << " ms ("
+                  << stats.records / (stats.seconds > 0 ? stats.seconds : 1e-9) << " records/sec)\n";
+    }
+    std::cout << "=============================\n\n";
+}
+
+// ----------------------------------------------------------------------------
+// Snapshot benchmark: encode (the pause on the matching thread), write and
+// mmap-load a 1M-order book
+// ----------------------------------------------------------------------------
+void run_snapshot_benchmark() {
+    const int num_orders = 1000000;
+    const double mid_price = 100.0;
+    const double tick_size = 0.01;
+    const string symbol = "SNAP";
+
+    // Non-crossing book: bids below the mid, asks above, 500 levels a side
+    OrderBook book(tick_size, num_orders);
+    mt19937 rng(5);
+    for (int i = 0; i < num_orders; ++i) {
+        Order order;
+        order.order_id = engine::make_order_id(i + 1, 0);
+        order.type = i % 2 == 0 ? OrderType::BUY : OrderType::SELL;
+        int offset = static_cast<int>(rng() % 500) + 1;
+        order.price = mid_price + tick_size * (order.type == OrderType::BUY ? -offset : offset);
+        order.quantity = static_cast<int>(rng() % 100) + 1;
+        order.client_id = "client" + to_string(i % 1000);
+        order.timestamp = i;
+        order.symbol = symbol;
+        book.add_order(order);
+    }
+
+    auto path = (std::filesystem::temp_directory_path() / ("snapshot_bench_" + to_string(NowNs()))).string();
+    auto encode = [&] {
+        persistence::SnapshotImage image(0, 1, 0);
+        image.add_instrument(symbol, num_orders + 1, book);
+        return image.finish();
+    };
+
+    // In-process encode, for reference: this is what the fork keeps off the matching thread
+    auto start_time = NowNs();
+    size_t image_bytes = encode().size();
+    auto encoded_time = NowNs();
+
+    persistence::SnapshotWriter writer;
+    auto fork_start = NowNs();
+    writer.fork_write(path, encode);
+    auto fork_end = NowNs();
+    writer.wait();
+    auto written_time = NowNs();
+
+    OrderBook restored(tick_size);
+    auto load_start = NowNs();
+    uint64_t loaded;
+    {
+        persistence::SnapshotReader reader(path, 0, 1);
+        loaded = reader.restore([&](const string&, double, uint64_t) -> OrderBook& { return restored; });
+    }
+    auto load_end = NowNs();
+    std::filesystem::remove(path);
+
+    bool same = restored.get_buy_depth() == book.get_buy_depth() && restored.get_sell_depth() == book.get_sell_depth() &&
+                restored.get_buy_orders().best().head == book.get_buy_orders().best().head &&
+                restored.get_sell_orders().size() == book.get_sell_orders().size();
+
+    std::cout << "\n===== Snapshot Benchmark =====\n";
+    std::cout << "Resting Orders: " << book.order_count() << " (" << image_bytes / (1024 * 1024) << " MiB image)\n";
+    std::cout << "Encode inline : " << (encoded_time - start_time) / 1e6 << " ms\n";
+    std::cout << "Fork pause    : " << (fork_end - fork_start) / 1e6 << " ms (matching thread)\n";
+    std::cout << "Child write   : " << (written_time - fork_end) / 1e6 << " ms (encode + write + fsync)\n";
+    std::cout << "Load (mmap)   : " << (load_end - load_start) / 1e6 << " ms, " << loaded << " orders\n";
+    std::cout << "Book matches  : " << (same ? "yes" : "no") << "\n";
+    std::cout << "==============================\n\n";
+}
+
 int main() {
     OrderBook order_book;
     const int num_orders = 1000000;
@@ -73,5 +337,10 @@ int main() {
         logging_enabled,
         throughput
     );
+
+    run_cancel_heavy_benchmark();
+    run_sharded_engine_benchmark();
+    run_journal_benchmark();
+    run_snapshot_benchmark();
     return 0;
 }
\ No newline at end of file
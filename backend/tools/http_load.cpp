@@ -0,0 +1,403 @@
+/**
+ * HTTP Load Generator
+ *
+ * Drives POST /api/orders (or any route) from many concurrent connections
+ * and reports throughput and per-request latency percentiles. Connections
+ * are non-blocking and multiplexed over one epoll loop per thread, so tens
+ * of thousands can be held open at once. Each client sends its requests
+ * back to back and times each one from when it is queued (including the
+ * connect, for the first request on a connection) to the last byte of its
+ * response. By default every request opens a new connection; --keep-alive
+ * reuses it and --pipeline N keeps N requests in flight on it. --batch N
+ * posts N orders per request to /api/orders/batch and also reports orders
+ * per second.
+ *
+ * Usage: http_load [--connections N] [--threads N] [--requests N] [--port P]
+ *                  [--path /api/orders] [--get] [--symbol S]
+ *                  [--keep-alive] [--pipeline N] [--batch N]
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Options {
+    int connections = 64;
+    int threads = 0;            // 0: one per hardware thread, at most one per connection
+    int requests = 200;         // per connection
+    bool keep_alive = false;    // reuse each connection for all its requests
+    int pipeline = 1;           // requests in flight per connection with keep-alive
+    int batch = 0;              // orders per request to /api/orders/batch; 0 posts single orders
+    int port = 8080;
+    std::string path = "/api/orders";
+    std::string symbol;
+    bool get = false;
+};
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+std::string build_request(const Options& options, std::mt19937& rng) {
+    const char* connection = options.keep_alive ? "" : "Connection: close\r\n";
+    if (options.get) {
+        return "GET " + options.path + " HTTP/1.1\r\nHost: localhost\r\n" + connection + "\r\n";
+    }
+
+    // Quotes around 100.00 so the flow both rests and trades
+    auto order = [&] {
+        bool buy = rng() % 2 == 0;
+        int ticks = static_cast<int>(rng() % 41) - 20;
+        char price[32];
+        snprintf(price, sizeof(price), "%.2f", 100.0 + ticks * 0.01);
+        std::string body = std::string("{\"type\":\"") + (buy ? "BUY" : "SELL") + "\",\"quantity\":" +
+                           std::to_string(rng() % 100 + 1) + ",\"price\":" + price + ",\"client_id\":\"load\"";
+        if (!options.symbol.empty()) {
+            body += ",\"symbol\":\"" + options.symbol + "\"";
+        }
+        return body + "}";
+    };
+    std::string body;
+    if (options.batch > 0) {
+        body = "[";
+        for (int i = 0; i < options.batch; ++i) {
+            body += (i > 0 ? "," : "") + order();
+        }
+        body += "]";
+    } else {
+        body = order();
+    }
+
+    return "POST " + options.path + " HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\n" + connection +
+           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// One simulated client working through its requests. Without keep-alive
+// each request gets its own connection; with it the connection is reused
+// and up to `pipeline` requests are written before reading the responses.
+struct Client {
+    int fd = -1;
+    int remaining = 0;                  // requests not yet answered or failed
+    std::string out;
+    size_t sent = 0;
+    std::string in;
+    std::deque<uint64_t> outstanding;   // send times of unanswered requests
+    bool server_closing = false;        // a response carried Connection: close
+};
+
+// Runs a share of the clients on one epoll loop
+class LoadThread {
+public:
+    LoadThread(const Options& options, int first_client, int client_count)
+        : options_(options), rng_(first_client), clients_(client_count) {
+        for (auto& client : clients_) {
+            client.remaining = options.requests;
+        }
+    }
+
+    void run() {
+        epoll_fd_ = epoll_create1(0);
+        if (epoll_fd_ < 0) {
+            errors_ += static_cast<int>(clients_.size()) * options_.requests;
+            return;
+        }
+        latencies_.reserve(clients_.size() * options_.requests);
+        for (auto& client : clients_) {
+            connect_client(client);
+        }
+
+        epoll_event events[256];
+        while (active_ > 0) {
+            int count = epoll_wait(epoll_fd_, events, 256, -1);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                Client& client = *static_cast<Client*>(events[i].data.ptr);
+                if (events[i].events & EPOLLERR) {
+                    fail(client);
+                    continue;
+                }
+                if (send_pending(client)) {
+                    read_responses(client);
+                }
+            }
+        }
+        close(epoll_fd_);
+    }
+
+    const std::vector<uint64_t>& latencies() const { return latencies_; }
+    int errors() const { return errors_; }
+
+private:
+    const Options& options_;
+    std::mt19937 rng_;
+    std::vector<Client> clients_;
+    std::vector<uint64_t> latencies_;
+    int errors_ = 0;
+    int active_ = 0;
+    int epoll_fd_ = -1;
+
+    // Opens a connection and queues the first batch of requests on it
+    void connect_client(Client& client) {
+        while (client.remaining > 0) {
+            client.in.clear();
+            client.server_closing = false;
+            queue_requests(client);
+
+            client.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            if (client.fd >= 0) {
+                int one = 1;
+                setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                sockaddr_in address{};
+                address.sin_family = AF_INET;
+                address.sin_port = htons(options_.port);
+                address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                int rc = connect(client.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+                epoll_event event{};
+                event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                event.data.ptr = &client;
+                if ((rc == 0 || errno == EINPROGRESS) && epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client.fd, &event) == 0) {
+                    ++active_;
+                    return;
+                }
+                close(client.fd);
+                client.fd = -1;
+            }
+            drop_outstanding(client);
+        }
+    }
+
+    void queue_requests(Client& client) {
+        int depth = options_.keep_alive ? options_.pipeline : 1;
+        int count = std::min(depth, client.remaining - static_cast<int>(client.outstanding.size()));
+        uint64_t now = now_ns();
+        client.out.clear();
+        client.sent = 0;
+        for (int i = 0; i < count; ++i) {
+            client.out += build_request(options_, rng_);
+            client.outstanding.push_back(now);
+        }
+    }
+
+    // Counts every unanswered request on the connection as failed
+    void drop_outstanding(Client& client) {
+        errors_ += static_cast<int>(client.outstanding.size());
+        client.remaining -= static_cast<int>(client.outstanding.size());
+        client.outstanding.clear();
+    }
+
+    void disconnect(Client& client) {
+        close(client.fd);
+        client.fd = -1;
+        --active_;
+    }
+
+    void fail(Client& client) {
+        disconnect(client);
+        drop_outstanding(client);
+        connect_client(client);
+    }
+
+    // Returns false if the connection failed
+    bool send_pending(Client& client) {
+        while (client.sent < client.out.size()) {
+            ssize_t n = send(client.fd, client.out.data() + client.sent, client.out.size() - client.sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                client.sent += static_cast<size_t>(n);
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN)) {
+                return true;    // still connecting, or the send buffer is full
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                fail(client);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void read_responses(Client& client) {
+        char buffer[16384];
+        while (true) {
+            ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) fail(client);
+                return;
+            }
+            if (n == 0) {
+                // Requests the server never answered after announcing the
+                // close (request cap reached) are resent on a new connection
+                disconnect(client);
+                if (client.server_closing) {
+                    client.outstanding.clear();
+                } else {
+                    drop_outstanding(client);
+                }
+                connect_client(client);
+                return;
+            }
+            client.in.append(buffer, n);
+            if (!consume_responses(client)) {
+                return;
+            }
+        }
+    }
+
+    // Takes complete responses off the read buffer; returns false once the
+    // client has moved to a new connection (or finished)
+    bool consume_responses(Client& client) {
+        size_t offset = 0;
+        while (!client.outstanding.empty()) {
+            size_t header_end = client.in.find("\r\n\r\n", offset);
+            if (header_end == std::string::npos) break;
+            std::string headers = client.in.substr(offset, header_end - offset);
+            std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+            size_t content_length = 0;
+            size_t cl = headers.find("content-length:");
+            if (cl != std::string::npos) {
+                content_length = std::stoul(headers.substr(cl + 15));
+            }
+            if (client.in.size() < header_end + 4 + content_length) break;
+
+            offset = header_end + 4 + content_length;
+            latencies_.push_back(now_ns() - client.outstanding.front());
+            client.outstanding.pop_front();
+            --client.remaining;
+            if (headers.find("connection: close") != std::string::npos) {
+                client.server_closing = true;
+            }
+        }
+        client.in.erase(0, offset);
+
+        if (!client.outstanding.empty()) {
+            return true;
+        }
+        if (client.remaining > 0 && options_.keep_alive && !client.server_closing) {
+            queue_requests(client);
+            return send_pending(client);
+        }
+        disconnect(client);
+        connect_client(client);
+        return false;
+    }
+};
+
+double percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+// Each connection needs a descriptor; lift the soft limit as far as allowed
+void raise_fd_limit(int connections) {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+    rlim_t wanted = static_cast<rlim_t>(connections) + 64;
+    if (limit.rlim_cur < wanted) {
+        limit.rlim_cur = std::min(wanted, limit.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (limit.rlim_cur < wanted) {
+        std::cerr << "Warning: descriptor limit " << limit.rlim_cur << " is below " << wanted
+                  << "; some connections will fail" << std::endl;
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--connections" || arg == "--clients") options.connections = std::stoi(next());
+        else if (arg == "--threads") options.threads = std::stoi(next());
+        else if (arg == "--requests") options.requests = std::stoi(next());
+        else if (arg == "--port") options.port = std::stoi(next());
+        else if (arg == "--path") options.path = next();
+        else if (arg == "--symbol") options.symbol = next();
+        else if (arg == "--get") options.get = true;
+        else if (arg == "--keep-alive") options.keep_alive = true;
+        else if (arg == "--pipeline") options.pipeline = std::stoi(next());
+        else if (arg == "--batch") options.batch = std::stoi(next());
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (options.batch > 0 && options.path == "/api/orders") {
+        options.path = "/api/orders/batch";
+    }
+    if (options.connections < 1 || options.requests < 1 || options.pipeline < 1) {
+        std::cerr << "--connections, --requests and --pipeline must be at least 1" << std::endl;
+        return 1;
+    }
+    int threads = options.threads > 0 ? options.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::min(threads, options.connections);
+    raise_fd_limit(options.connections);
+
+    std::vector<std::unique_ptr<LoadThread>> loads;
+    for (int t = 0; t < threads; ++t) {
+        int first = options.connections * t / threads;
+        int last = options.connections * (t + 1) / threads;
+        loads.push_back(std::make_unique<LoadThread>(options, first, last - first));
+    }
+
+    std::vector<std::thread> workers;
+    uint64_t start = now_ns();
+    for (auto& load : loads) {
+        workers.emplace_back(&LoadThread::run, load.get());
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    std::vector<uint64_t> all;
+    int total_errors = 0;
+    for (const auto& load : loads) {
+        all.insert(all.end(), load->latencies().begin(), load->latencies().end());
+        total_errors += load->errors();
+    }
+    std::sort(all.begin(), all.end());
+
+    std::cout << "\n===== HTTP Load =====\n";
+    std::cout << "Route         : " << (options.get ? "GET " : "POST ") << options.path << "\n";
+    std::cout << "Connections   : " << options.connections << " over " << threads << " thread(s), "
+              << (options.keep_alive ? "keep-alive, pipeline " + std::to_string(options.pipeline) : "one per request")
+              << "\n";
+    std::cout << "Requests      : " << all.size() << " ok, " << total_errors << " errors\n";
+    std::cout << "Throughput    : " << all.size() / (elapsed > 0 ? elapsed : 1e-9) << " req/sec\n";
+    if (options.batch > 0) {
+        std::cout << "Orders        : " << all.size() * options.batch / (elapsed > 0 ? elapsed : 1e-9)
+                  << " orders/sec (" << options.batch << " per request)\n";
+    }
+    std::cout << "Latency p50   : " << percentile(all, 0.50) << " us\n";
+    std::cout << "Latency p99   : " << percentile(all, 0.99) << " us\n";
+    std::cout << "Latency p99.9 : " << percentile(all, 0.999) << " us\n";
+    std::cout << "Latency max   : " << (all.empty() ? 0 : all.back() / 1000.0) << " us\n";
+    std::cout << "=====================\n\n";
+    return total_errors > 0 ? 2 : 0;
+}
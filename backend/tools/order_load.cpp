@@ -0,0 +1,410 @@
+/**
+ * Binary Order Gateway Load Generator
+ *
+ * Drives the binary order-entry protocol (src/gateway/protocol.h) from many
+ * persistent connections and reports throughput and round-trip latency
+ * percentiles, separately for new orders and cancels. A round trip runs
+ * from queuing the request to reading its Accepted, Canceled or Rejected.
+ * Each connection keeps --window requests in flight; orders are quoted
+ * around 100.00 so the flow both rests and trades, and --cancel-percent of
+ * the requests cancel one of the connection's resting orders instead.
+ *
+ * Usage: order_load [--connections N] [--threads N] [--requests N] [--port P]
+ *                   [--symbol S] [--window N] [--cancel-percent N]
+ */
+
+#include "gateway/protocol.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+namespace protocol = gateway::protocol;
+
+struct Options {
+    int connections = 8;
+    int threads = 0;            // 0: one per hardware thread, at most one per connection
+    int requests = 10000;       // per connection
+    int window = 1;             // requests in flight per connection
+    int cancel_percent = 30;
+    int port = 9001;
+    std::string symbol = "DEMO";
+};
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+struct Client {
+    int fd = -1;
+    int unsent = 0;                 // requests not yet queued
+    int unanswered = 0;             // queued but not answered
+    std::string out;
+    size_t sent = 0;
+    std::string in;
+    uint64_t next_token = 1;
+    // Send time and kind of each unanswered request, by token
+    std::unordered_map<uint64_t, std::pair<uint64_t, bool>> pending;   // token -> (time, is_cancel)
+    std::unordered_map<uint64_t, int> resting;                         // token -> open quantity
+};
+
+struct Counts {
+    uint64_t accepted = 0;
+    uint64_t canceled = 0;
+    uint64_t rejected = 0;
+    uint64_t executions = 0;
+};
+
+// Runs a share of the connections on one epoll loop
+class LoadThread {
+public:
+    LoadThread(const Options& options, int first_client, int client_count)
+        : options_(options), rng_(first_client), clients_(client_count) {
+        std::memset(symbol_, ' ', sizeof(symbol_));
+        std::memcpy(symbol_, options.symbol.data(), std::min(options.symbol.size(), sizeof(symbol_)));
+    }
+
+    void run() {
+        epoll_fd_ = epoll_create1(0);
+        if (epoll_fd_ < 0) {
+            errors_ += clients_.size();
+            return;
+        }
+        new_latencies_.reserve(clients_.size() * options_.requests);
+        for (auto& client : clients_) {
+            connect_client(client);
+        }
+
+        epoll_event events[256];
+        while (active_ > 0) {
+            int count = epoll_wait(epoll_fd_, events, 256, -1);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                Client& client = *static_cast<Client*>(events[i].data.ptr);
+                if (client.fd < 0) continue;
+                if (events[i].events & EPOLLERR) {
+                    fail(client);
+                    continue;
+                }
+                if (send_pending(client)) {
+                    read_responses(client);
+                }
+            }
+        }
+        close(epoll_fd_);
+    }
+
+    const std::vector<uint64_t>& new_latencies() const { return new_latencies_; }
+    const std::vector<uint64_t>& cancel_latencies() const { return cancel_latencies_; }
+    const Counts& counts() const { return counts_; }
+    uint64_t errors() const { return errors_; }
+
+private:
+    const Options& options_;
+    std::mt19937 rng_;
+    std::vector<Client> clients_;
+    char symbol_[protocol::SYMBOL_LENGTH];
+    std::vector<uint64_t> new_latencies_;
+    std::vector<uint64_t> cancel_latencies_;
+    Counts counts_;
+    uint64_t errors_ = 0;
+    int active_ = 0;
+    int epoll_fd_ = -1;
+
+    void connect_client(Client& client) {
+        client.unsent = options_.requests;
+        client.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (client.fd < 0) {
+            errors_ += client.unsent;
+            return;
+        }
+        int one = 1;
+        setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(options_.port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int rc = connect(client.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = &client;
+        if ((rc != 0 && errno != EINPROGRESS) || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client.fd, &event) != 0) {
+            close(client.fd);
+            client.fd = -1;
+            errors_ += client.unsent;
+            return;
+        }
+        ++active_;
+        queue_requests(client);
+    }
+
+    void queue_requests(Client& client) {
+        while (client.unanswered < options_.window && client.unsent > 0) {
+            uint64_t now = now_ns();
+            bool cancel = !client.resting.empty() && static_cast<int>(rng_() % 100) < options_.cancel_percent;
+            if (cancel) {
+                // Any resting order without a request in flight for it
+                uint64_t token = 0;
+                for (const auto& entry : client.resting) {
+                    if (!client.pending.count(entry.first)) {
+                        token = entry.first;
+                        break;
+                    }
+                }
+                cancel = token != 0;
+                if (cancel) {
+                    auto message = protocol::make<protocol::Cancel>(protocol::CANCEL);
+                    message.token = token;
+                    client.out.append(reinterpret_cast<const char*>(&message), sizeof(message));
+                    client.pending[token] = {now, true};
+                }
+            }
+            if (!cancel) {
+                auto message = protocol::make<protocol::NewOrder>(protocol::NEW_ORDER);
+                message.token = client.next_token++;
+                message.side = rng_() % 2 == 0 ? protocol::BUY : protocol::SELL;
+                message.quantity = rng_() % 100 + 1;
+                message.price = 100 * protocol::PRICE_SCALE + (static_cast<int64_t>(rng_() % 41) - 20) * 100;
+                std::memcpy(message.symbol, symbol_, sizeof(symbol_));
+                client.out.append(reinterpret_cast<const char*>(&message), sizeof(message));
+                client.pending[message.token] = {now, false};
+            }
+            --client.unsent;
+            ++client.unanswered;
+        }
+    }
+
+    void disconnect(Client& client) {
+        close(client.fd);
+        client.fd = -1;
+        --active_;
+    }
+
+    void fail(Client& client) {
+        disconnect(client);
+        errors_ += client.unsent + client.unanswered;
+        client.unsent = 0;
+        client.unanswered = 0;
+    }
+
+    // Returns false if the connection failed
+    bool send_pending(Client& client) {
+        while (client.sent < client.out.size()) {
+            ssize_t n = send(client.fd, client.out.data() + client.sent, client.out.size() - client.sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                client.sent += static_cast<size_t>(n);
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN)) {
+                return true;    // still connecting, or the send buffer is full
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                fail(client);
+                return false;
+            }
+        }
+        client.out.clear();
+        client.sent = 0;
+        return true;
+    }
+
+    void read_responses(Client& client) {
+        char buffer[16384];
+        while (client.fd >= 0) {
+            ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) fail(client);
+                return;
+            }
+            if (n == 0) {
+                fail(client);
+                return;
+            }
+            client.in.append(buffer, n);
+            consume_responses(client);
+        }
+    }
+
+    void answered(Client& client, uint64_t token, uint64_t now) {
+        auto it = client.pending.find(token);
+        if (it == client.pending.end()) return;
+        (it->second.second ? cancel_latencies_ : new_latencies_).push_back(now - it->second.first);
+        client.pending.erase(it);
+        --client.unanswered;
+    }
+
+    void consume_responses(Client& client) {
+        uint64_t now = now_ns();
+        size_t offset = 0;
+        while (client.in.size() - offset >= sizeof(protocol::Header)) {
+            protocol::Header header;
+            std::memcpy(&header, client.in.data() + offset, sizeof(header));
+            if (header.length < sizeof(header)) {
+                fail(client);
+                return;
+            }
+            if (client.in.size() - offset < header.length) break;
+            std::string_view frame(client.in.data() + offset, header.length);
+            offset += header.length;
+
+            switch (header.type) {
+                case protocol::ACCEPTED: {
+                    protocol::Accepted message;
+                    if (!protocol::decode(frame, message)) break;
+                    ++counts_.accepted;
+                    client.resting[message.token] += static_cast<int>(message.quantity);
+                    answered(client, message.token, now);
+                    break;
+                }
+                case protocol::CANCELED: {
+                    protocol::Canceled message;
+                    if (!protocol::decode(frame, message)) break;
+                    ++counts_.canceled;
+                    client.resting.erase(message.token);
+                    answered(client, message.token, now);
+                    break;
+                }
+                case protocol::REJECTED: {
+                    protocol::Rejected message;
+                    if (!protocol::decode(frame, message)) break;
+                    ++counts_.rejected;
+                    answered(client, message.token, now);
+                    break;
+                }
+                case protocol::EXECUTED: {
+                    protocol::Executed message;
+                    if (!protocol::decode(frame, message)) break;
+                    ++counts_.executions;
+                    auto it = client.resting.find(message.token);
+                    if (it != client.resting.end() && (it->second -= static_cast<int>(message.quantity)) <= 0) {
+                        client.resting.erase(it);
+                    }
+                    break;
+                }
+            }
+        }
+        client.in.erase(0, offset);
+
+        if (client.unsent == 0 && client.unanswered == 0) {
+            disconnect(client);     // the gateway cancels whatever still rests
+            return;
+        }
+        queue_requests(client);
+        send_pending(client);
+    }
+};
+
+double percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+void print_latencies(const char* name, const std::vector<uint64_t>& sorted) {
+    std::cout << name << " (" << sorted.size() << ")\n";
+    std::cout << "  p50         : " << percentile(sorted, 0.50) << " us\n";
+    std::cout << "  p90         : " << percentile(sorted, 0.90) << " us\n";
+    std::cout << "  p99         : " << percentile(sorted, 0.99) << " us\n";
+    std::cout << "  p99.9       : " << percentile(sorted, 0.999) << " us\n";
+    std::cout << "  max         : " << (sorted.empty() ? 0 : sorted.back() / 1000.0) << " us\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--connections" || arg == "--clients") options.connections = std::stoi(next());
+        else if (arg == "--threads") options.threads = std::stoi(next());
+        else if (arg == "--requests") options.requests = std::stoi(next());
+        else if (arg == "--port") options.port = std::stoi(next());
+        else if (arg == "--symbol") options.symbol = next();
+        else if (arg == "--window") options.window = std::stoi(next());
+        else if (arg == "--cancel-percent") options.cancel_percent = std::stoi(next());
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (options.connections < 1 || options.requests < 1 || options.window < 1) {
+        std::cerr << "--connections, --requests and --window must be at least 1" << std::endl;
+        return 1;
+    }
+    if (options.symbol.empty() || options.symbol.size() > protocol::SYMBOL_LENGTH) {
+        std::cerr << "--symbol must be 1 to " << protocol::SYMBOL_LENGTH << " characters" << std::endl;
+        return 1;
+    }
+    int threads = options.threads > 0 ? options.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::min(threads, options.connections);
+
+    std::vector<std::unique_ptr<LoadThread>> loads;
+    for (int t = 0; t < threads; ++t) {
+        int first = options.connections * t / threads;
+        int last = options.connections * (t + 1) / threads;
+        loads.push_back(std::make_unique<LoadThread>(options, first, last - first));
+    }
+
+    std::vector<std::thread> workers;
+    uint64_t start = now_ns();
+    for (auto& load : loads) {
+        workers.emplace_back(&LoadThread::run, load.get());
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    std::vector<uint64_t> new_orders;
+    std::vector<uint64_t> cancels;
+    Counts counts;
+    uint64_t errors = 0;
+    for (const auto& load : loads) {
+        new_orders.insert(new_orders.end(), load->new_latencies().begin(), load->new_latencies().end());
+        cancels.insert(cancels.end(), load->cancel_latencies().begin(), load->cancel_latencies().end());
+        counts.accepted += load->counts().accepted;
+        counts.canceled += load->counts().canceled;
+        counts.rejected += load->counts().rejected;
+        counts.executions += load->counts().executions;
+        errors += load->errors();
+    }
+    std::vector<uint64_t> all(new_orders);
+    all.insert(all.end(), cancels.begin(), cancels.end());
+    std::sort(new_orders.begin(), new_orders.end());
+    std::sort(cancels.begin(), cancels.end());
+    std::sort(all.begin(), all.end());
+
+    std::cout << "\n===== Order Gateway Load =====\n";
+    std::cout << "Connections   : " << options.connections << " over " << threads << " thread(s), window "
+              << options.window << ", symbol " << options.symbol << "\n";
+    std::cout << "Requests      : " << all.size() << " answered, " << errors << " errors\n";
+    std::cout << "Responses     : " << counts.accepted << " accepted, " << counts.canceled << " canceled, "
+              << counts.rejected << " rejected, " << counts.executions << " executions\n";
+    std::cout << "Throughput    : " << all.size() / (elapsed > 0 ? elapsed : 1e-9) << " req/sec\n";
+    print_latencies("Round trip, all requests", all);
+    print_latencies("Round trip, new orders", new_orders);
+    print_latencies("Round trip, cancels", cancels);
+    std::cout << "==============================\n\n";
+    return errors > 0 ? 2 : 0;
+}
@@ -0,0 +1,337 @@
+/**
+ * WebSocket Fan-out Benchmark
+ *
+ * Runs a WebSocketServer in process with --subscribers local clients and
+ * one publisher thread broadcasting --messages text messages of --size
+ * bytes. Reports how fast the publisher hands messages off and how fast
+ * they reach every subscriber (messages/sec counts one per subscriber).
+ * With --topics T, subscriber i subscribes to topic i % T and message m is
+ * published to topic m % T, so each message reaches a T-th of them.
+ *
+ * It then stops reading, publishes --backlog more messages so they pile up
+ * in the server's per-client queues, and reports the heap growth per queued
+ * message (heap delta over frames queued), next to the size of a frame,
+ * which is what a private copy per client would cost.
+ *
+ * Usage: ws_fanout [--subscribers N] [--messages N] [--size BYTES]
+ *                  [--backlog N] [--topics T] [--port P]
+ */
+
+#include "websocket/websocket_server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <malloc.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Options {
+    int subscribers = 1000;
+    int messages = 10000;
+    int size = 200;
+    int backlog = 1000;
+    int topics = 0;         // 0: broadcast
+    int port = 8091;
+};
+
+double now_s() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Heap bytes in use; unlike the resident size it shrinks on free and does
+// not hide allocations that reuse freed pages
+size_t heap_bytes() {
+    return mallinfo2().uordblks;
+}
+
+// Connects and completes the handshake on a blocking socket, then switches
+// it to non-blocking; -1 on failure
+int subscribe(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    static const char request[] =
+        "GET /ws HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    if (send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) < 0) {
+        close(fd);
+        return -1;
+    }
+    // The response has no body, so read it byte by byte up to its end
+    std::string response;
+    char c;
+    while (response.size() < 4 || response.compare(response.size() - 4, 4, "\r\n\r\n") != 0) {
+        if (recv(fd, &c, 1, 0) != 1) {
+            close(fd);
+            return -1;
+        }
+        response.push_back(c);
+    }
+    if (response.compare(0, 12, "HTTP/1.1 101") != 0) {
+        close(fd);
+        return -1;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    return fd;
+}
+
+// Reads every subscriber on one thread, counting bytes per subscriber
+class Reader {
+public:
+    explicit Reader(const std::vector<int>& fds) : fds_(fds), received_(fds.size(), 0) {
+        epoll_fd_ = epoll_create1(0);
+        for (size_t i = 0; i < fds_.size(); ++i) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fds_[i], &event);
+        }
+        thread_ = std::thread(&Reader::run, this);
+    }
+
+    ~Reader() {
+        running_ = false;
+        thread_.join();
+        close(epoll_fd_);
+    }
+
+    void set_paused(bool paused) { paused_ = paused; }
+
+    // Waits until every subscriber has read at least bytes; false on timeout
+    bool wait_for(uint64_t bytes, double timeout_s) {
+        target_ = bytes;
+        double deadline = now_s() + timeout_s;
+        while (done_.load() < fds_.size()) {
+            if (now_s() > deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+private:
+    std::vector<int> fds_;
+    std::vector<uint64_t> received_;
+    int epoll_fd_ = -1;
+    std::atomic<bool> running_{true};
+    std::atomic<bool> paused_{false};
+    std::atomic<uint64_t> target_{UINT64_MAX};
+    std::atomic<size_t> done_{0};
+    std::thread thread_;
+
+    void run() {
+        std::vector<char> buffer(1 << 16);
+        epoll_event events[256];
+        uint64_t counted_target = UINT64_MAX;
+        while (running_) {
+            if (paused_) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            uint64_t target = target_.load();
+            if (target != counted_target) {
+                counted_target = target;
+                done_ = std::count_if(received_.begin(), received_.end(), [&](uint64_t n) { return n >= target; });
+            }
+            int count = epoll_wait(epoll_fd_, events, 256, 10);
+            for (int i = 0; i < count; ++i) {
+                size_t index = events[i].data.u64;
+                while (true) {
+                    ssize_t n = recv(fds_[index], buffer.data(), buffer.size(), 0);
+                    if (n <= 0) break;
+                    bool was_done = received_[index] >= counted_target;
+                    received_[index] += static_cast<uint64_t>(n);
+                    if (!was_done && received_[index] >= counted_target) {
+                        ++done_;
+                    }
+                }
+            }
+        }
+    }
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--subscribers") options.subscribers = std::stoi(next());
+        else if (arg == "--messages") options.messages = std::stoi(next());
+        else if (arg == "--size") options.size = std::stoi(next());
+        else if (arg == "--backlog") options.backlog = std::stoi(next());
+        else if (arg == "--topics") options.topics = std::stoi(next());
+        else if (arg == "--port") options.port = std::stoi(next());
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (options.subscribers < 1 || options.messages < 1 || options.size < 1 || options.backlog < 0 ||
+        options.topics < 0 || options.topics > options.messages) {
+        std::cerr << "--subscribers, --messages and --size must be at least 1, and --topics at most --messages"
+                  << std::endl;
+        return 1;
+    }
+
+    // Two descriptors per subscriber live in this process
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    // Queues large enough that the throughput run drops nothing
+    websocket::WebSocketServerConfig config;
+    config.max_queued_bytes = size_t(1) << 30;
+    config.max_outbox_messages = size_t(1) << 20;
+    config.max_lag = std::chrono::hours(1);
+    websocket::WebSocketServer server(options.port, config);
+    // Subscribers connect one at a time, so ids arrive in their order
+    std::mutex ids_mutex;
+    std::vector<websocket::WebSocketServer::ClientId> ids;
+    server.set_on_connect([&](websocket::WebSocketServer::ClientId client_id, std::string_view) {
+        std::lock_guard<std::mutex> lock(ids_mutex);
+        ids.push_back(client_id);
+    });
+    if (!server.start()) {
+        return 1;
+    }
+
+    std::vector<int> fds;
+    for (int i = 0; i < options.subscribers; ++i) {
+        int fd = subscribe(options.port);
+        if (fd < 0) {
+            std::cerr << "Subscriber " << i << " failed to connect: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        fds.push_back(fd);
+    }
+    while (server.client_count() < fds.size()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::vector<std::string> topic_names;
+    for (int t = 0; t < options.topics; ++t) {
+        topic_names.push_back("topic:" + std::to_string(t));
+    }
+    {
+        std::lock_guard<std::mutex> lock(ids_mutex);
+        for (size_t i = 0; i < ids.size() && options.topics > 0; ++i) {
+            server.subscribe(ids[i], topic_names[i % options.topics]);
+        }
+    }
+
+    // A JSON text message of exactly --size bytes
+    std::string payload = "{\"type\":\"x\",\"data\":\"";
+    payload.resize(std::max<size_t>(payload.size(), options.size - 2), 'x');
+    payload += "\"}";
+    size_t header = payload.size() < 126 ? 2 : payload.size() < 65536 ? 4 : 10;
+    uint64_t frame_bytes = header + payload.size();
+
+    auto publish = [&](int m) {
+        if (options.topics > 0) {
+            server.publish(topic_names[m % options.topics], payload);
+        } else {
+            server.broadcast(payload);
+        }
+    };
+    // Every subscriber gets at least this many; some topics get one more
+    int per_subscriber = options.topics > 0 ? options.messages / options.topics : options.messages;
+    double deliveries = 0;
+    for (int i = 0; i < options.subscribers; ++i) {
+        int topic = options.topics > 0 ? i % options.topics : 0;
+        deliveries += options.topics > 0 ? (options.messages - topic + options.topics - 1) / options.topics
+                                         : options.messages;
+    }
+
+    Reader reader(fds);
+    double start = now_s();
+    for (int m = 0; m < options.messages; ++m) {
+        publish(m);
+    }
+    double published = now_s();
+    bool complete = reader.wait_for(frame_bytes * per_subscriber, 300);
+    double elapsed = now_s() - start;
+
+    std::cout << "===== WebSocket Fan-out =====\n";
+    std::cout << "Subscribers   : " << options.subscribers;
+    if (options.topics > 0) {
+        std::cout << " over " << options.topics << " topics";
+    }
+    std::cout << "\n";
+    std::cout << "Messages      : " << options.messages << " x " << payload.size() << " bytes ("
+              << frame_bytes << " per frame)\n";
+    std::cout << "Publish       : " << static_cast<uint64_t>(options.messages / (published - start))
+              << (options.topics > 0 ? " publishes/sec\n" : " broadcasts/sec\n");
+    std::cout << "Delivered     : " << static_cast<uint64_t>(deliveries / elapsed) << " msgs/sec, "
+              << static_cast<uint64_t>(deliveries * frame_bytes / elapsed / (1 << 20)) << " MiB/sec"
+              << (complete ? "" : " (timed out)") << "\n";
+
+    if (options.backlog > 0) {
+        // Stop reading until the kernel buffers are full, then measure what
+        // the server's own queues cost for what is published after that
+        reader.set_paused(true);
+        // The loop queues a broadcast to every subscriber asynchronously
+        auto settle = [&]() {
+            size_t queued = server.queued();
+            while (true) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                size_t now = server.queued();
+                if (now == queued) return now;
+                queued = now;
+            }
+        };
+        // Until the socket buffers are full, frames leave the queues at once
+        for (int round = 0; round < 256 && settle() < fds.size() * 16; ++round) {
+            for (int m = 0; m < 1000; ++m) {
+                publish(m);
+            }
+        }
+        size_t queued_before = settle();
+        size_t heap_before = heap_bytes();
+        for (int m = 0; m < options.backlog; ++m) {
+            publish(m);
+        }
+        size_t queued_after = settle();
+        size_t heap_after = heap_bytes();
+        size_t added = queued_after - queued_before;
+        double grown = static_cast<double>(heap_after) - static_cast<double>(heap_before);
+        std::cout << "Backlog       : " << added << " frames queued across subscribers, "
+                  << static_cast<int64_t>(grown / 1024) << " KiB of heap\n";
+        if (added > 0) {
+            std::cout << "Per message   : " << grown / added << " bytes queued (a private copy: "
+                      << frame_bytes << ")\n";
+        }
+        reader.set_paused(false);
+    }
+    std::cout << "Dropped       : " << server.dropped() << "\n";
+    std::cout << "=============================" << std::endl;
+
+    for (int fd : fds) {
+        close(fd);
+    }
+    server.stop();
+    return complete ? 0 : 2;
+}
@@ -6,25 +6,58 @@
  * It fetches data from the backend API and handles real-time WebSocket connections.
  */
 
-import { useState, useEffect } from 'react';
+import { useState, useEffect, useRef } from 'react';
 import { Layout, Typography, Space, message, Spin, Alert, Button, Slider, Modal, Row, Col } from 'antd';
 import './App.css';
 import { OrderBookTable } from './components/OrderBook/OrderBookTable';
 import { OrderBookTradeSummary } from './components/OrderBook/OrderBookTradeSummary';
 import { OrderForm } from './components/OrderForm/OrderForm';
 import { TradeHistory } from './components/TradeHistory/TradeHistory';
-import { useWebSocket } from './hooks/useWebSocket';
-import { OrderBook as OrderBookType } from './types/order';
+import { useWebSocket, WebSocketMessage } from './hooks/useWebSocket';
+import { OrderBook as OrderBookType, OrderBookLevel } from './types/order';
 import { Trade } from './types/trade';
 import { apiService } from './services/api';
 
 const { Header, Content } = Layout;
 const { Title } = Typography;
 
+const MAX_TRADES = 100;
+const WEBSOCKET_URL = 'ws://localhost:8081/ws';
+// Feed topics the UI shows, per symbol; the summary needs the whole book
+const FEED_TOPICS = ['book', 'trades'];
+
+interface LevelChange {
+  price: number;
+  quantity: number;
+}
+
+// Applies a book_delta side: each change sets a level's quantity, 0 removes it
+const applyLevelChanges = (levels: OrderBookLevel[], changes: LevelChange[], descending: boolean) => {
+  if (changes.length === 0) return levels;
+  const byPrice = new Map(levels.map(level => [level.price, level]));
+  for (const change of changes) {
+    if (change.quantity === 0) {
+      byPrice.delete(change.price);
+    } else {
+      byPrice.set(change.price, { ...byPrice.get(change.price), price: change.price, quantity: change.quantity, orders: [] });
+    }
+  }
+  return Array.from(byPrice.values()).sort((a, b) => descending ? b.price - a.price : a.price - b.price);
+};
+
 function App() {
   // Core data state
   const [orderBook, setOrderBook] = useState<OrderBookType>({ buy_orders: [], sell_orders: [] });
   const [trades, setTrades] = useState<Trade[]>([]);
+  // Highest trade id seen so far, so refreshes only fetch newer trades
+  const lastTradeIdRef = useRef(-1);
+  // The displayed symbol (the backend's default until the first REST book
+  // names it) and the seq of the last book_delta applied to the book; null
+  // until a snapshot arrives, and while resyncing after a gap
+  const symbolRef = useRef('DEMO');
+  const bookSeqRef = useRef<number | null>(null);
+  const pendingDeltasRef = useRef<WebSocketMessage[]>([]);
+  const resyncingRef = useRef(false);
   
   // UI state management
   const [isSubmitting, setIsSubmitting] = useState(false);
@@ -49,8 +82,99 @@ function App() {
     priceVariation: 5
   });
 
-  // WebSocket connection for real-time updates
-  const { isConnected, lastMessage, sendMessage } = useWebSocket('ws://localhost:8080/ws');
+  // Takes a whole book (a feed snapshot or GET /api/orderbook) unless the
+  // book already holds newer deltas
+  const applyBook = (book: OrderBookType) => {
+    const seq = book.seq ?? 0;
+    if (bookSeqRef.current !== null && seq < bookSeqRef.current) return;
+    bookSeqRef.current = seq;
+    setOrderBook(book);
+  };
+
+  const applyDelta = (delta: WebSocketMessage) => {
+    bookSeqRef.current = delta.seq!;
+    setOrderBook(prev => ({
+      ...prev,
+      seq: delta.seq,
+      buy_orders: applyLevelChanges(prev.buy_orders, delta.data.bids, true),
+      sell_orders: applyLevelChanges(prev.sell_orders, delta.data.asks, false)
+    }));
+  };
+
+  // A delta went missing: refetch the book and replay the deltas that
+  // arrive meanwhile on top of it
+  const resyncBook = async (gapDelta: WebSocketMessage) => {
+    resyncingRef.current = true;
+    pendingDeltasRef.current = [gapDelta];
+    try {
+      bookSeqRef.current = null;
+      applyBook(await apiService.getOrderBook());
+      for (const delta of pendingDeltasRef.current) {
+        if (delta.seq! === bookSeqRef.current! + 1) {
+          applyDelta(delta);
+        } else if (delta.seq! > bookSeqRef.current! + 1) {
+          break;  // the next delta resyncs again
+        }
+      }
+    } catch (error) {
+      console.error('Failed to resync order book:', error);
+    } finally {
+      resyncingRef.current = false;
+      pendingDeltasRef.current = [];
+    }
+  };
+
+  // Real-time trades and book changes from the market data feed; while it
+  // is connected, the REST refreshes after each submission are skipped.
+  // Deltas count from 1 per symbol: those up to the book's seq are already
+  // in it, and anything but seq + 1 after that is a gap. Each connection
+  // subscribes to the displayed symbol and starts over from its snapshot.
+  const { isConnected, sendMessage } = useWebSocket(WEBSOCKET_URL, (feedMessage) => {
+    if (feedMessage.type === 'error') {
+      console.error('Market data feed error:', feedMessage.data.message);
+      return;
+    }
+    if (feedMessage.symbol !== symbolRef.current) return;
+    switch (feedMessage.type) {
+      case 'subscribed':
+      case 'unsubscribed':
+        break;
+      case 'book_snapshot':
+        applyBook(feedMessage.data);
+        break;
+      case 'book_delta':
+        if (resyncingRef.current) {
+          pendingDeltasRef.current.push(feedMessage);
+        } else if (bookSeqRef.current === null || feedMessage.seq! <= bookSeqRef.current) {
+          // Waiting for a snapshot, or already in the book
+        } else if (feedMessage.seq! === bookSeqRef.current + 1) {
+          applyDelta(feedMessage);
+        } else {
+          resyncBook(feedMessage);
+        }
+        break;
+      case 'trade_update':
+        if (feedMessage.data.trade_id > lastTradeIdRef.current) {
+          lastTradeIdRef.current = feedMessage.data.trade_id;
+          setTrades(prev => [...prev, feedMessage.data].slice(-MAX_TRADES));
+        }
+        break;
+      default:
+        console.log('Unknown message type:', feedMessage.type);
+    }
+  }, (send) => {
+    bookSeqRef.current = null;
+    FEED_TOPICS.forEach(topic => send({ op: 'subscribe', topic, symbol: symbolRef.current }));
+  });
+  const isConnectedRef = useRef(isConnected);
+  isConnectedRef.current = isConnected;
+
+  // A new connection starts over from its snapshot
+  useEffect(() => {
+    if (!isConnected) {
+      bookSeqRef.current = null;
+    }
+  }, [isConnected]);
 
   // Fetch initial data from backend API on component mount
   useEffect(() => {
@@ -65,8 +189,21 @@ function App() {
           apiService.getTrades()
         ]);
         
-        setOrderBook(orderBookData);
+        if (orderBookData.symbol && orderBookData.symbol !== symbolRef.current) {
+          // Move the feed over if it connected before the symbol was known
+          const previous = symbolRef.current;
+          symbolRef.current = orderBookData.symbol;
+          bookSeqRef.current = null;
+          FEED_TOPICS.forEach(topic => {
+            sendMessage({ op: 'unsubscribe', topic, symbol: previous });
+            sendMessage({ op: 'subscribe', topic, symbol: orderBookData.symbol });
+          });
+        }
+        applyBook(orderBookData);
         setTrades(tradesData);
+        if (tradesData.length > 0) {
+          lastTradeIdRef.current = tradesData[tradesData.length - 1].trade_id;
+        }
         setApiError(null);
       } catch (error) {
         console.error('Failed to fetch initial data:', error);
@@ -81,53 +218,29 @@ function App() {
     fetchInitialData();
   }, []);
 
-  // Handle real-time WebSocket messages
-  useEffect(() => {
-    if (lastMessage) {
-      switch (lastMessage.type) {
-        case 'order_book_update':
-          setOrderBook(lastMessage.data);
-          break;
-        case 'trade_update':
-          setTrades(prev => [lastMessage.data, ...prev].slice(0, 100));
-          break;
-        case 'order_submitted':
-          setIsSubmitting(false);
-          message.success('Order submitted successfully!');
-          break;
-        case 'order_error':
-          setIsSubmitting(false);
-          message.error('Failed to submit order');
-          break;
-        default:
-          console.log('Unknown message type:', lastMessage.type);
-      }
-    }
-  }, [lastMessage]);
+  // Fetch trades executed since the last refresh and append them
+  const refreshTrades = async () => {
+    const newTrades = await apiService.getTrades(lastTradeIdRef.current, MAX_TRADES);
+    if (newTrades.length === 0) return;
+    lastTradeIdRef.current = newTrades[newTrades.length - 1].trade_id;
+    setTrades(prev => [...prev, ...newTrades].slice(-MAX_TRADES));
+  };
 
-  // Handle order submission with fallback to HTTP API if WebSocket is disconnected
+  // Submit over HTTP; the feed delivers the resulting trades and book
+  // changes, so data is only re-fetched while it is disconnected
   const handleOrderSubmit = async (order: any) => {
     setIsSubmitting(true);
     try {
-      if (isConnected) {
-        // Use WebSocket for real-time order submission
-        sendMessage({
-          type: 'submit_order',
-          data: order
-        });
-      } else {
-        // Fallback to HTTP API when WebSocket is disconnected
-        const response = await apiService.submitOrder(order);
-        message.success(`Order submitted successfully! Order ID: ${response.order_id}`);
-        
-        // Refresh data after successful submission
-        const [updatedOrderBook, updatedTrades] = await Promise.all([
+      const response = await apiService.submitOrder(order);
+      message.success(`Order submitted successfully! Order ID: ${response.order_id}`);
+      
+      if (!isConnectedRef.current) {
+        const [updatedOrderBook] = await Promise.all([
           apiService.getOrderBook(),
-          apiService.getTrades()
+          refreshTrades()
         ]);
         
         setOrderBook(updatedOrderBook);
-        setTrades(updatedTrades);
       }
     } catch (error) {
       console.error('Failed to submit order:', error);
@@ -156,7 +269,7 @@ function App() {
       type,
       quantity,
       price: Math.round(price * 100) / 100, // Round to 2 decimal places
-      client_id: `sim_${Date.now()}_${Math.random().toString(36).substr(2, 5)}`
+      client_id: `sim_${Math.random().toString(36).substr(2, 9)}`
     };
   };
 
@@ -166,14 +279,15 @@ function App() {
       const order = generateRandomOrder();
       await apiService.submitOrder(order);
       
-      // Refresh data after submission
-      const [updatedOrderBook, updatedTrades] = await Promise.all([
-        apiService.getOrderBook(),
-        apiService.getTrades()
-      ]);
-      
-      setOrderBook(updatedOrderBook);
-      setTrades(updatedTrades);
+      // Without the feed, refresh data after submission
+      if (!isConnectedRef.current) {
+        const [updatedOrderBook] = await Promise.all([
+          apiService.getOrderBook(),
+          refreshTrades()
+        ]);
+        
+        setOrderBook(updatedOrderBook);
+      }
     } catch (error) {
       console.error('Failed to submit simulated order:', error);
     }
@@ -26,7 +26,7 @@ export const OrderForm: React.FC<OrderFormProps> = ({ onSubmit, loading = false,
       ...values,
       type: orderType,
       timestamp: Date.now(),
-      client_id: `client_${Math.random().toString(36).substr(2, 9)}`,
+      client_id: `c_${Math.random().toString(36).substr(2, 9)}`,
     };
     
     onSubmit(order);
@@ -9,14 +9,28 @@ import { useEffect, useRef, useState } from 'react';
 
 export interface WebSocketMessage {
   type: string;
+  symbol?: string;
+  seq?: number;
   data: any;
 }
 
-export const useWebSocket = (url: string) => {
+// onMessage is called for every message, in order; lastMessage only holds
+// the latest one, so it can skip messages that arrive within one render.
+// onOpen runs on every (re)connect with a send function, to subscribe: the
+// server sends nothing a connection has not subscribed to.
+export const useWebSocket = (
+  url: string,
+  onMessage?: (message: WebSocketMessage) => void,
+  onOpen?: (send: (message: any) => void) => void
+) => {
   const [socket, setSocket] = useState<WebSocket | null>(null);
   const [isConnected, setIsConnected] = useState(false);
   const [lastMessage, setLastMessage] = useState<WebSocketMessage | null>(null);
   const reconnectTimeoutRef = useRef<NodeJS.Timeout>();
+  const onMessageRef = useRef(onMessage);
+  onMessageRef.current = onMessage;
+  const onOpenRef = useRef(onOpen);
+  onOpenRef.current = onOpen;
 
   useEffect(() => {
     const connect = () => {
@@ -24,6 +38,7 @@ export const useWebSocket = (url: string) => {
       
       ws.onopen = () => {
         console.log('WebSocket connected');
+        onOpenRef.current?.(message => ws.send(JSON.stringify(message)));
         setIsConnected(true);
         setSocket(ws);
       };
@@ -31,6 +46,7 @@ export const useWebSocket = (url: string) => {
       ws.onmessage = (event) => {
         try {
           const message: WebSocketMessage = JSON.parse(event.data);
+          onMessageRef.current?.(message);
           setLastMessage(message);
         } catch (error) {
           console.error('Failed to parse WebSocket message:', error);
@@ -35,8 +35,14 @@ class ApiService {
     return this.request<OrderBook>('/orderbook');
   }
 
-  async getTrades(): Promise<Trade[]> {
-    return this.request<Trade[]>('/trades');
+  // Without sinceTradeId the backend returns its most recent trades; with it,
+  // only trades newer than that id (oldest first), so polling stays incremental
+  async getTrades(sinceTradeId?: number, limit?: number): Promise<Trade[]> {
+    const params = new URLSearchParams();
+    if (sinceTradeId !== undefined) params.set('since_trade_id', String(sinceTradeId));
+    if (limit !== undefined) params.set('limit', String(limit));
+    const query = params.toString();
+    return this.request<Trade[]>(query ? `/trades?${query}` : '/trades');
   }
 
   async getMarketSummary(): Promise<{
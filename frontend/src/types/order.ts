@@ -26,6 +26,9 @@ export interface OrderBookLevel {
 }
 
 export interface OrderBook {
+  symbol?: string;
+  // Last market data feed book_delta the book includes
+  seq?: number;
   buy_orders: OrderBookLevel[];
   sell_orders: OrderBookLevel[];
 }